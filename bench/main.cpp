@@ -0,0 +1,2493 @@
+/*
+Copyright (C) 2013 James S Urquhart
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+// DTSBench: command line benchmarks for libDTShape.
+//
+// Usage: DTSBench [data dir] [iterations] [--json file] [--trace file]
+//
+// The data dir should contain the sample assets from the example
+// directory (soldier_rigged.cached.dts and the player_*.dts sequences).
+//
+// --json writes the min, mean, max and p50/p90/p99 of every timed series
+// in microseconds. --trace writes a Chrome trace of the run, and needs a
+// build with LIBDTSHAPE_ENABLE_PROFILER.
+//
+// Benches also check their results against a reference (e.g. the fast path
+// against the loop it replaces), and the exit code is non-zero if any check
+// fails.
+
+#include "platform/platform.h"
+#include "libdtshape.h"
+#include "core/log.h"
+#include "ts/tsShape.h"
+#include "ts/tsShapeInstance.h"
+#include "ts/tsMesh.h"
+#include "ts/tsRenderState.h"
+#include "ts/tsAnimationBatch.h"
+#include "ts/tsShapeLoadService.h"
+#include "ts/tsSequenceCache.h"
+#include "ts/tsLastDetail.h"
+#include "ts/tsBroadphase.h"
+#include "ts/tsIntegerSet.h"
+#include "platform/threads/thread.h"
+#include "platform/threads/threadPool.h"
+#include "platform/profiler.h"
+#include "core/stream/memStream.h"
+#include "core/stream/fileStream.h"
+#include "math/mRandom.h"
+#include "math/util/frustum.h"
+#include "math/util/triRayCheck.h"
+#include "collision/concretePolyList.h"
+#include "collision/collision.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace DTShape;
+
+//-----------------------------------------------------------------------------
+
+// Platform::getRealMilliseconds is too coarse for timing individual runs
+static F64 getTimeUS()
+{
+#ifdef WIN32
+   static LARGE_INTEGER sFreq = { 0 };
+   LARGE_INTEGER count;
+   if (sFreq.QuadPart == 0)
+      QueryPerformanceFrequency(&sFreq);
+   QueryPerformanceCounter(&count);
+   return (F64)count.QuadPart * 1000000.0 / (F64)sFreq.QuadPart;
+#else
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (F64)ts.tv_sec * 1000000.0 + (F64)ts.tv_nsec / 1000.0;
+#endif
+}
+
+/// Set while normal log output (e.g. the profiler summary) should be shown.
+static bool sShowLog = false;
+
+static void OnBenchLog(U32 level, LogEntry *logEntry)
+{
+   switch (logEntry->mLevel)
+   {
+      case LogEntry::Normal:
+         if (sShowLog)
+            fprintf(stdout, "%s\n", logEntry->mData);
+         break;
+      case LogEntry::Warning:
+         fprintf(stdout, "%s\n", logEntry->mData);
+         break;
+      case LogEntry::Error:
+         fprintf(stderr, "%s\n", logEntry->mData);
+         break;
+      default:
+         break;
+   }
+}
+
+static S32 QSORT_CALLBACK compareS32(const void *a, const void *b)
+{
+   return *(const S32*)a - *(const S32*)b;
+}
+
+static S32 QSORT_CALLBACK compareF64(const void *a, const void *b)
+{
+   F64 da = *(const F64*)a;
+   F64 db = *(const F64*)b;
+   return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/// Median of samples; sorts samples in place
+static F64 getMedian(Vector<F64> &samples)
+{
+   if (samples.empty())
+      return 0.0;
+
+   dQsort(samples.address(), samples.size(), sizeof(F64), compareF64);
+   return samples[samples.size() / 2];
+}
+
+static F64 getMean(const Vector<F64> &samples)
+{
+   F64 total = 0.0;
+   for (U32 i=0; i<samples.size(); i++)
+      total += samples[i];
+   return samples.empty() ? 0.0 : total / samples.size();
+}
+
+/// Summary of one timed series, kept for the JSON report
+struct BenchResult
+{
+   String bench;
+   String mode;
+   U32 count;
+   F64 min;
+   F64 mean;
+   F64 p50;
+   F64 p90;
+   F64 p99;
+   F64 max;
+};
+
+static Vector<BenchResult> sBenchResults;
+
+/// Nearest rank percentile of sorted samples
+static F64 getPercentile(const Vector<F64> &sorted, F64 percentile)
+{
+   if (sorted.empty())
+      return 0.0;
+
+   S32 rank = (S32)mCeil(percentile * sorted.size());
+   return sorted[mClamp(rank, 1, (S32)sorted.size()) - 1];
+}
+
+/// Records a series of times in microseconds; sorts samples in place
+static void addBenchResult(const char *bench, const char *mode, Vector<F64> &samples)
+{
+   if (samples.empty())
+      return;
+
+   dQsort(samples.address(), samples.size(), sizeof(F64), compareF64);
+
+   sBenchResults.increment();
+   BenchResult &result = sBenchResults.last();
+   result.bench = bench;
+   result.mode = mode;
+   result.count = samples.size();
+   result.min = samples.first();
+   result.mean = getMean(samples);
+   result.p50 = getPercentile(samples, 0.5);
+   result.p90 = getPercentile(samples, 0.9);
+   result.p99 = getPercentile(samples, 0.99);
+   result.max = samples.last();
+}
+
+/// Writes every recorded series as JSON, so runs can be compared by tools
+static bool writeBenchResults(const char *fileName, U32 iterations)
+{
+   FILE *fp = fopen(fileName, "w");
+   if (!fp)
+   {
+      Log::errorf("Couldn't write %s", fileName);
+      return false;
+   }
+
+   fprintf(fp, "{\n  \"iterations\": %u,\n  \"unit\": \"us\",\n  \"results\": [\n", iterations);
+   for (U32 i=0; i<sBenchResults.size(); i++)
+   {
+      const BenchResult &result = sBenchResults[i];
+      fprintf(fp, "    { \"bench\": \"%s\", \"mode\": \"%s\", \"count\": %u, "
+                  "\"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+              result.bench.c_str(), result.mode.c_str(), result.count,
+              result.min, result.mean, result.p50, result.p90, result.p99, result.max,
+              i + 1 < sBenchResults.size() ? "," : "");
+   }
+   fprintf(fp, "  ]\n}\n");
+   fclose(fp);
+   return true;
+}
+
+/// Number of failed result checks, main() returns an error if there are any
+static U32 sNumFailedChecks = 0;
+
+/// Reports a bench result which doesn't match its reference; returns ok
+static bool checkBenchResult(bool ok, const char *bench, const char *what)
+{
+   if (!ok)
+   {
+      Log::errorf("FAILED %s: %s", bench, what);
+      sNumFailedChecks++;
+   }
+   return ok;
+}
+
+static const char *sDataDir = ".";
+
+static const char* GetBenchAssetPath(const char *file)
+{
+   static char sBuffer[1024];
+   dSprintf(sBuffer, sizeof(sBuffer), "%s/%s", sDataDir, file);
+   return sBuffer;
+}
+
+//-----------------------------------------------------------------------------
+// Skinning
+
+struct SkinBenchMode
+{
+   const char *name;
+   bool allowHardwareSkinning;
+   bool useSoASkinning;
+};
+
+static const SkinBenchMode sSkinBenchModes[] = {
+   { "transform", false, false }, // batch-by-transform
+   { "vertex",    true,  false }, // batch-by-vertex
+   { "soa",       false, true  }, // structure-of-arrays
+};
+
+static const U32 sNumSkinBenchModes = sizeof(sSkinBenchModes) / sizeof(sSkinBenchModes[0]);
+
+/// Skinned output of a single mesh
+struct SkinBenchMesh
+{
+   TSSkinMesh *mesh;
+   Vector<MatrixF> bones;
+   TSMesh::TSMeshVertexArray output;
+};
+
+/// Shape loaded with the batch data for one skinning mode
+struct SkinBenchShape
+{
+   TSShape *shape;
+   TSShapeInstance *inst;
+   Vector<SkinBenchMesh*> meshes;
+   Vector<F64> frameTimes;
+
+   SkinBenchShape() : shape(NULL), inst(NULL) {}
+
+   ~SkinBenchShape()
+   {
+      for (U32 i=0; i<meshes.size(); i++)
+         delete meshes[i];
+      delete inst;
+      delete shape;
+   }
+
+   void skin()
+   {
+      for (U32 i=0; i<meshes.size(); i++)
+         meshes[i]->mesh->skinVerts(meshes[i]->bones.address(), (U8*)meshes[i]->output.address(), meshes[i]->output.vertSize());
+   }
+};
+
+static TSShape *loadBenchShape()
+{
+   TSShape *shape = TSShape::createFromPath(GetBenchAssetPath("soldier_rigged.cached.dts"));
+   if (!shape)
+      return NULL;
+
+   if (shape->addSequence(GetBenchAssetPath("player_Run.dts"), "", "Run", 150, 169, true, false))
+      shape->sequences[shape->findSequence("Run")].flags |= TSShape::Cyclic;
+
+   return shape;
+}
+
+static bool initSkinBenchShape(SkinBenchShape &bench, TSRenderState &renderState)
+{
+   bench.shape = loadBenchShape();
+   if (!bench.shape)
+   {
+      Log::errorf("Couldn't load soldier_rigged.cached.dts from %s", sDataDir);
+      return false;
+   }
+
+   bench.inst = new TSShapeInstance(bench.shape, &renderState, false);
+
+   // Pose the shape somewhere other than the bind pose
+   S32 seq = bench.shape->findSequence("Run");
+   if (seq != -1)
+   {
+      TSThread *thread = bench.inst->addThread();
+      bench.inst->setSequence(thread, seq, 0.37f);
+   }
+   bench.inst->setCurrentDetail(0);
+   bench.inst->animate();
+
+   // Batch data is built here, so the skinning flags only need to be set
+   // until this returns
+   for (U32 i=0; i<bench.inst->mMeshObjects.size(); i++)
+   {
+      TSShapeInstance::MeshObjectInstance &meshObj = bench.inst->mMeshObjects[i];
+      TSMesh *mesh = meshObj.getMesh(0);
+      if (!mesh || mesh->getMeshType() != TSMesh::SkinMeshType || mesh->mNumVerts == 0)
+         continue;
+
+      SkinBenchMesh *benchMesh = new SkinBenchMesh;
+      benchMesh->mesh = static_cast<TSSkinMesh*>(mesh);
+      benchMesh->mesh->convertToAlignedMeshData();
+      benchMesh->mesh->createBatchData();
+      benchMesh->mesh->updateSkinBones(bench.inst->mNodeTransforms, benchMesh->bones);
+      benchMesh->mesh->initSkinnedVerts(benchMesh->output);
+      bench.meshes.push_back(benchMesh);
+   }
+
+   return true;
+}
+
+static void benchSkinning(U32 iterations)
+{
+   printf("skinning (%u iterations)\n", iterations);
+
+   TSRenderState renderState;
+   SkinBenchShape benches[sNumSkinBenchModes];
+
+   bool ok = true;
+   for (U32 m=0; m<sNumSkinBenchModes && ok; m++)
+   {
+      TSShape::smUseHardwareSkinning = false;
+      TSShape::smAllowHardwareSkinning = sSkinBenchModes[m].allowHardwareSkinning;
+      TSShape::smUseSoASkinning = sSkinBenchModes[m].useSoASkinning;
+      ok = initSkinBenchShape(benches[m], renderState);
+   }
+
+   TSShape::smUseSoASkinning = false;
+   TSShape::smAllowHardwareSkinning = true;
+   TSShape::smUseHardwareSkinning = true;
+
+   if (!ok)
+      return;
+
+   // Warm up, then time the modes in turn so they see the same conditions
+   for (U32 m=0; m<sNumSkinBenchModes; m++)
+   {
+      benches[m].skin();
+      benches[m].frameTimes.reserve(iterations);
+   }
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      for (U32 m=0; m<sNumSkinBenchModes; m++)
+      {
+         F64 start = getTimeUS();
+         benches[m].skin();
+         benches[m].frameTimes.push_back(getTimeUS() - start);
+      }
+   }
+
+   // Compare output against the first mode
+   const SkinBenchShape &reference = benches[0];
+   U32 numVerts = 0;
+   for (U32 i=0; i<reference.meshes.size(); i++)
+      numVerts += reference.meshes[i]->output.size();
+
+   for (U32 m=0; m<sNumSkinBenchModes; m++)
+   {
+      const SkinBenchShape &bench = benches[m];
+      F32 maxError = 0.0f;
+
+      for (U32 i=0; i<bench.meshes.size(); i++)
+      {
+         const TSMesh::TSMeshVertexArray &out = bench.meshes[i]->output;
+         const TSMesh::TSMeshVertexArray &ref = reference.meshes[i]->output;
+         for (U32 v=0; v<out.size(); v++)
+         {
+            maxError = getMax(maxError, (out.getBase(v).vert() - ref.getBase(v).vert()).len());
+            maxError = getMax(maxError, (out.getBase(v).normal() - ref.getBase(v).normal()).len());
+         }
+      }
+
+      addBenchResult("skinning", sSkinBenchModes[m].name, benches[m].frameTimes);
+      printf("  %-10s median %8.2f us  mean %8.2f us  (%u meshes, %u verts)  max error %g\n",
+             sSkinBenchModes[m].name, getMedian(benches[m].frameTimes), getMean(benches[m].frameTimes),
+             bench.meshes.size(), numVerts, maxError);
+   }
+}
+
+//-----------------------------------------------------------------------------
+// Animation sampling
+
+struct AnimBenchMode
+{
+   const char *name;
+   bool useSoASampling;
+};
+
+static const AnimBenchMode sAnimBenchModes[] = {
+   { "scalar", false }, // per-node sampling loop
+   { "soa",    true  }, // dense track lists, bulk nlerp + matrix build
+};
+
+static const U32 sNumAnimBenchModes = sizeof(sAnimBenchModes) / sizeof(sAnimBenchModes[0]);
+
+static void benchAnimation(U32 iterations)
+{
+   printf("animation (%u iterations)\n", iterations);
+
+   TSShape *shape = loadBenchShape();
+   if (!shape)
+   {
+      Log::errorf("Couldn't load soldier_rigged.cached.dts from %s", sDataDir);
+      return;
+   }
+
+   S32 seq = shape->findSequence("Run");
+   if (seq == -1)
+   {
+      Log::errorf("Couldn't add player_Run.dts from %s", sDataDir);
+      delete shape;
+      return;
+   }
+
+   // Both modes animate instances of the same shape in lockstep, so their
+   // transforms can be compared after every step
+   TSRenderState renderState;
+   TSShapeInstance *insts[sNumAnimBenchModes];
+   TSThread *threads[sNumAnimBenchModes];
+   Vector<F64> frameTimes[sNumAnimBenchModes];
+
+   for (U32 m=0; m<sNumAnimBenchModes; m++)
+   {
+      insts[m] = new TSShapeInstance(shape, &renderState, false);
+      threads[m] = insts[m]->addThread();
+      insts[m]->setSequence(threads[m], seq, 0.0f);
+      frameTimes[m].reserve(iterations);
+   }
+
+   F32 maxError[sNumAnimBenchModes];
+   dMemset(maxError, 0, sizeof(maxError));
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      for (U32 m=0; m<sNumAnimBenchModes; m++)
+      {
+         insts[m]->advanceTime(0.013f, threads[m]);
+         TSShape::smUseSoASampling = sAnimBenchModes[m].useSoASampling;
+
+         F64 start = getTimeUS();
+         insts[m]->animate();
+         frameTimes[m].push_back(getTimeUS() - start);
+      }
+
+      const Vector<MatrixF> &ref = insts[0]->mNodeTransforms;
+      for (U32 m=1; m<sNumAnimBenchModes; m++)
+      {
+         const Vector<MatrixF> &out = insts[m]->mNodeTransforms;
+         for (U32 i=0; i<out.size(); i++)
+         {
+            const F32 *a = out[i];
+            const F32 *b = ref[i];
+            for (U32 j=0; j<16; j++)
+               maxError[m] = getMax(maxError[m], mFabs(a[j] - b[j]));
+         }
+      }
+   }
+
+   TSShape::smUseSoASampling = true;
+
+   for (U32 m=0; m<sNumAnimBenchModes; m++)
+   {
+      addBenchResult("animation", sAnimBenchModes[m].name, frameTimes[m]);
+      printf("  %-10s median %8.2f us  mean %8.2f us  (%u nodes)  max error %g\n",
+             sAnimBenchModes[m].name, getMedian(frameTimes[m]), getMean(frameTimes[m]),
+             shape->nodes.size(), maxError[m]);
+      delete insts[m];
+   }
+
+   delete shape;
+}
+
+//-----------------------------------------------------------------------------
+// Blended animation
+
+/// Frames of one sequence in a bundled animation file
+struct AnimSequenceRange
+{
+   const char *file;
+   const char *name;
+   S32 start;
+   S32 end;
+};
+
+/// Blend sequences layered over Run, relative to the first frame of Root
+static const AnimSequenceRange sBlendSequences[] = {
+   { "player_Side.dts",            "Side",            200, 219 },
+   { "player_Crouch_Backward.dts", "Crouch_Backward", 0,   -1  },
+   { "player_Jump.dts",            "Jump",            1000, 1010 },
+};
+
+static const U32 sNumBlendSequences = sizeof(sBlendSequences) / sizeof(sBlendSequences[0]);
+
+static void benchBlendAnimation(U32 iterations)
+{
+   printf("blended animation (%u iterations)\n", iterations);
+
+   TSShape *shape = loadBenchShape();
+   if (!shape || shape->findSequence("Run") == -1)
+   {
+      Log::errorf("Couldn't load soldier_rigged.cached.dts and player_Run.dts from %s", sDataDir);
+      delete shape;
+      return;
+   }
+
+   bool ok = shape->addSequence(GetBenchAssetPath("player_Root.dts"), "", "Root", 50, 109, true, false);
+   for (U32 i=0; i<sNumBlendSequences && ok; i++)
+   {
+      const AnimSequenceRange &range = sBlendSequences[i];
+      ok = shape->addSequence(GetBenchAssetPath(range.file), "", range.name, range.start, range.end, true, false) &&
+           shape->setSequenceBlend(range.name, true, "Root", 0);
+   }
+
+   if (!ok)
+   {
+      Log::errorf("Couldn't set up blend sequences from %s", sDataDir);
+      delete shape;
+      return;
+   }
+
+   // One instance each with Run alone, Run and one blend, and Run with all
+   // three blends, advanced in step
+   static const U32 sThreadCounts[] = { 1, 2, 4 };
+   static const U32 sNumThreadCounts = sizeof(sThreadCounts) / sizeof(sThreadCounts[0]);
+
+   TSRenderState renderState;
+   TSShapeInstance *insts[sNumThreadCounts];
+   Vector<F64> frameTimes[sNumThreadCounts];
+
+   for (U32 m=0; m<sNumThreadCounts; m++)
+   {
+      insts[m] = new TSShapeInstance(shape, &renderState, false);
+      insts[m]->setSequence(insts[m]->addThread(), shape->findSequence("Run"), 0.0f);
+      for (U32 i=1; i<sThreadCounts[m]; i++)
+         insts[m]->setSequence(insts[m]->addThread(), shape->findSequence(sBlendSequences[i-1].name), 0.1f * i);
+      frameTimes[m].reserve(iterations);
+   }
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      for (U32 m=0; m<sNumThreadCounts; m++)
+      {
+         insts[m]->advanceTime(0.013f);
+
+         F64 start = getTimeUS();
+         insts[m]->animate();
+         frameTimes[m].push_back(getTimeUS() - start);
+      }
+   }
+
+   for (U32 m=0; m<sNumThreadCounts; m++)
+   {
+      char mode[32];
+      dSprintf(mode, sizeof(mode), "%u thread%s", sThreadCounts[m], sThreadCounts[m] > 1 ? "s" : "");
+      addBenchResult("blended animation", mode, frameTimes[m]);
+      printf("  %-10s median %8.2f us  mean %8.2f us  (%u nodes)\n",
+             mode, getMedian(frameTimes[m]), getMean(frameTimes[m]), shape->nodes.size());
+      delete insts[m];
+   }
+
+   delete shape;
+}
+
+//-----------------------------------------------------------------------------
+// Integer sets
+
+/// Bits the random sets may use, enough to spill out of the inline words
+static const S32 sIntegerSetBits = TSIntegerSet::InlineBits * 3;
+
+static void initIntegerSet(MRandomLCG &rand, TSIntegerSet &set, Vector<bool> &bits)
+{
+   // Random length and density, so sets have different numbers of words
+   const S32 size = rand.randI(0, sIntegerSetBits);
+   const S32 density = rand.randI(1, 4);
+   set.clearAll();
+   bits.setSize(sIntegerSetBits * 2);
+   for (S32 i=0; i<bits.size(); i++)
+   {
+      bits[i] = i < size && rand.randI(0, density) == 0;
+      if (bits[i])
+         set.set(i);
+   }
+}
+
+/// Whether the set holds the same bits as a plain array
+static bool matchesIntegerSet(const TSIntegerSet &set, const Vector<bool> &bits)
+{
+   S32 count = 0;
+   S32 first = MAX_TS_SET_SIZE;
+   S32 end = 0;
+   for (S32 i=0; i<bits.size(); i++)
+   {
+      if (set.test(i) != bits[i])
+         return false;
+      if (!bits[i])
+         continue;
+      count++;
+      first = getMin(first, i);
+      end = i + 1;
+   }
+
+   if (set.count() != count || set.start() != first || set.end() != end || set.testAll() != (count != 0))
+      return false;
+
+   S32 visited = 0;
+   for (S32 i=set.start(); i<MAX_TS_SET_SIZE; set.next(i))
+   {
+      if (i >= bits.size() || !bits[i])
+         return false;
+      visited++;
+   }
+   return visited == count;
+}
+
+/// Checks the set operations against plain arrays of bools
+static void checkIntegerSet(U32 iterations)
+{
+   printf("integer set (%u iterations)\n", iterations);
+
+   MRandomLCG rand(1);
+   TSIntegerSet a, b;
+   Vector<bool> bitsA, bitsB;
+   U32 numMismatched = 0;
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      initIntegerSet(rand, a, bitsA);
+      initIntegerSet(rand, b, bitsB);
+      numMismatched += !matchesIntegerSet(a, bitsA) || !matchesIntegerSet(b, bitsB);
+
+      // Binary ops, on copies so a and b stay as they are
+      for (U32 op=0; op<5; op++)
+      {
+         TSIntegerSet result(a);
+         Vector<bool> bits(bitsA);
+         for (S32 i=0; i<bits.size(); i++)
+         {
+            switch (op)
+            {
+               case 0: bits[i] = bits[i] && bitsB[i]; break;
+               case 1: bits[i] = bits[i] || bitsB[i]; break;
+               case 2: bits[i] = bits[i] != bitsB[i]; break;
+               case 3: bits[i] = bits[i] && !bitsB[i]; break;
+               default: bits[i] = bitsB[i]; break;
+            }
+         }
+
+         switch (op)
+         {
+            case 0: result.intersect(b); break;
+            case 1: result.overlap(b); break;
+            case 2: result.difference(b); break;
+            case 3: result.takeAway(b); break;
+            default: result = b; break;
+         }
+         numMismatched += !matchesIntegerSet(result, bits);
+      }
+
+      // Ranges, which may end part way through a word
+      const S32 upto = rand.randI(0, sIntegerSetBits + 40);
+      S32 count = 0;
+      for (S32 i=0; i<upto; i++)
+         count += bitsA[i];
+      numMismatched += a.count(upto) != count || a.testAll(upto) != (count != 0);
+
+      TSIntegerSet cleared(a), filled(a);
+      Vector<bool> clearedBits(bitsA), filledBits(bitsA);
+      cleared.clearAll(upto);
+      filled.setAll(upto);
+      for (S32 i=0; i<upto; i++)
+      {
+         clearedBits[i] = false;
+         filledBits[i] = true;
+      }
+      numMismatched += !matchesIntegerSet(cleared, clearedBits) || !matchesIntegerSet(filled, filledBits);
+
+      // Inserting and erasing shift the bits above the index
+      const S32 index = rand.randI(0, sIntegerSetBits);
+      const bool value = rand.randI(0, 1) != 0;
+      a.insert(index, value);
+      bitsA.insert(index, value);
+      bitsA.decrement();
+      numMismatched += !matchesIntegerSet(a, bitsA);
+
+      a.erase(index);
+      bitsA.erase(index);
+      bitsA.push_back(false);
+      numMismatched += !matchesIntegerSet(a, bitsA);
+
+      a.clear(index);
+      bitsA[index] = false;
+      numMismatched += !matchesIntegerSet(a, bitsA);
+   }
+
+   printf("  %u mismatched\n", numMismatched);
+   checkBenchResult(numMismatched == 0, "integer set", "set operations don't match plain arrays");
+}
+
+//-----------------------------------------------------------------------------
+// Name lookup
+
+/// What findNode did before names were hashed
+static S32 findNodeLinear(const TSShape *shape, const String &name)
+{
+   S32 nameIndex = -1;
+   for (S32 i=0; i<shape->names.size(); i++)
+   {
+      if (shape->names[i].equal(name, String::NoCase))
+      {
+         nameIndex = i;
+         break;
+      }
+   }
+
+   for (S32 i=0; i<shape->nodes.size(); i++)
+      if (shape->nodes[i].nameIndex == nameIndex)
+         return i;
+   return -1;
+}
+
+static void benchNameLookup(U32 iterations)
+{
+   printf("name lookup (%u iterations)\n", iterations);
+
+   TSShape *shape = loadBenchShape();
+   if (!shape)
+   {
+      Log::errorf("Couldn't load soldier_rigged.cached.dts from %s", sDataDir);
+      return;
+   }
+
+   // Look up every node by an upper case copy of its name
+   Vector<String> nodeNames;
+   Vector<TSNameId> nodeIds;
+   for (S32 i=0; i<shape->nodes.size(); i++)
+   {
+      nodeNames.push_back(String::ToUpper(shape->getNodeName(i)));
+      nodeIds.push_back(TSShape::internName(nodeNames.last()));
+   }
+
+   Vector<F64> times[3];
+   U32 mismatches = 0;
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      F64 start = getTimeUS();
+      for (U32 i=0; i<nodeNames.size(); i++)
+         mismatches += findNodeLinear(shape, nodeNames[i]) != (S32)i;
+      times[0].push_back(getTimeUS() - start);
+
+      start = getTimeUS();
+      for (U32 i=0; i<nodeNames.size(); i++)
+         mismatches += shape->findNode(nodeNames[i]) != (S32)i;
+      times[1].push_back(getTimeUS() - start);
+
+      start = getTimeUS();
+      for (U32 i=0; i<nodeIds.size(); i++)
+         mismatches += shape->findNode(nodeIds[i]) != (S32)i;
+      times[2].push_back(getTimeUS() - start);
+   }
+
+   static const char *modeNames[] = { "linear", "hashed", "interned" };
+   for (U32 m=0; m<3; m++)
+   {
+      addBenchResult("name lookup", modeNames[m], times[m]);
+      printf("  %-10s median %8.2f us  mean %8.2f us  (%u nodes)%s\n",
+             modeNames[m], getMedian(times[m]), getMean(times[m]), nodeNames.size(),
+             m == 2 && mismatches ? "  MISMATCH" : "");
+   }
+   checkBenchResult(mismatches == 0, "name lookup", "nodes found by name don't match their index");
+
+   delete shape;
+}
+
+//-----------------------------------------------------------------------------
+// Shape loading
+
+struct LoadBenchMode
+{
+   const char *name;
+   bool useMappedLoading;
+};
+
+static const LoadBenchMode sLoadBenchModes[] = {
+   { "stream", false }, // FileStream into a temporary buffer
+   { "mapped", true  }, // assembled straight from the file mapping
+};
+
+static const U32 sNumLoadBenchModes = sizeof(sLoadBenchModes) / sizeof(sLoadBenchModes[0]);
+
+/// Every shape that ships with the example
+static const char *sBundledShapes[] = {
+   "soldier_rigged.cached.dts",
+   "player_Crouch_Backward.dts",
+   "player_Jump.dts",
+   "player_Root.dts",
+   "player_Run.dts",
+   "player_Side.dts",
+};
+
+static const U32 sNumBundledShapes = sizeof(sBundledShapes) / sizeof(sBundledShapes[0]);
+
+static void benchLoading(U32 iterations)
+{
+   printf("loading (%u iterations)\n", iterations);
+
+   const char *path = GetBenchAssetPath("soldier_rigged.cached.dts");
+   Vector<F64> loadTimes[sNumLoadBenchModes];
+   U32 dataSize[sNumLoadBenchModes];
+   Vector<Point3F> translations[sNumLoadBenchModes];
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      for (U32 m=0; m<sNumLoadBenchModes; m++)
+      {
+         TSShape::smUseMappedLoading = sLoadBenchModes[m].useMappedLoading;
+
+         F64 start = getTimeUS();
+         TSShape *shape = TSShape::createFromPath(path);
+         loadTimes[m].push_back(getTimeUS() - start);
+
+         if (!shape)
+         {
+            Log::errorf("Couldn't load soldier_rigged.cached.dts from %s", sDataDir);
+            TSShape::smUseMappedLoading = true;
+            return;
+         }
+
+         dataSize[m] = shape->mShapeDataSize;
+         translations[m] = shape->defaultTranslations;
+         delete shape;
+      }
+   }
+
+   TSShape::smUseMappedLoading = true;
+
+   for (U32 m=0; m<sNumLoadBenchModes; m++)
+   {
+      bool same = dataSize[m] == dataSize[0] && translations[m].size() == translations[0].size() &&
+                  dMemcmp(translations[m].address(), translations[0].address(), translations[0].size() * sizeof(Point3F)) == 0;
+      addBenchResult("loading", sLoadBenchModes[m].name, loadTimes[m]);
+      printf("  %-10s median %8.2f us  mean %8.2f us  (%u bytes)  %s\n",
+             sLoadBenchModes[m].name, getMedian(loadTimes[m]), getMean(loadTimes[m]),
+             dataSize[m], same ? "same" : "DIFFERENT");
+      checkBenchResult(same, "loading", "mapped load doesn't match the stream load");
+   }
+
+   // Every bundled shape with the default loader
+   for (U32 f=0; f<sNumBundledShapes; f++)
+   {
+      Vector<F64> times;
+      U32 numNodes = 0;
+      U32 numSequences = 0;
+
+      for (U32 k=0; k<iterations; k++)
+      {
+         F64 start = getTimeUS();
+         TSShape *shape = TSShape::createFromPath(GetBenchAssetPath(sBundledShapes[f]));
+         times.push_back(getTimeUS() - start);
+
+         if (!shape)
+         {
+            Log::errorf("Couldn't load %s from %s", sBundledShapes[f], sDataDir);
+            break;
+         }
+
+         numNodes = shape->nodes.size();
+         numSequences = shape->sequences.size();
+         delete shape;
+      }
+
+      addBenchResult("loading", sBundledShapes[f], times);
+      printf("    %-28s median %8.2f us  mean %8.2f us  (%u nodes, %u sequences)\n",
+             sBundledShapes[f], getMedian(times), getMean(times), numNodes, numSequences);
+   }
+}
+
+//-----------------------------------------------------------------------------
+// Asynchronous loading
+
+static void benchLoadService(U32 iterations)
+{
+   printf("load service (%u files, %u iterations)\n", sNumBundledShapes, iterations);
+
+   Vector<F64> serialTimes;
+   Vector<F64> serviceTimes;
+   U32 numNodes[sNumBundledShapes];
+   bool same = true;
+
+   // Per file timings from the last run of the service
+   U32 queueTime[sNumBundledShapes];
+   U32 loadTime[sNumBundledShapes];
+   U32 finalizeTime[sNumBundledShapes];
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      F64 start = getTimeUS();
+      for (U32 i=0; i<sNumBundledShapes; i++)
+      {
+         TSShape *shape = TSShape::createFromPath(GetBenchAssetPath(sBundledShapes[i]));
+         numNodes[i] = shape ? shape->nodes.size() : 0;
+         delete shape;
+      }
+      serialTimes.push_back(getTimeUS() - start);
+
+      start = getTimeUS();
+      TSShapeLoadService service;
+      service.setFinalizeRender(false);
+
+      TSShapeLoadService::Request *requests[sNumBundledShapes];
+      for (U32 i=0; i<sNumBundledShapes; i++)
+         requests[i] = service.load(GetBenchAssetPath(sBundledShapes[i]));
+      service.waitAll();
+      serviceTimes.push_back(getTimeUS() - start);
+
+      for (U32 i=0; i<sNumBundledShapes; i++)
+      {
+         TSShape *shape = requests[i]->getShape();
+         same &= (shape ? shape->nodes.size() : 0) == numNodes[i];
+         queueTime[i] = requests[i]->getQueueTime();
+         loadTime[i] = requests[i]->getLoadTime();
+         finalizeTime[i] = requests[i]->getFinalizeTime();
+      }
+   }
+
+   addBenchResult("load service", "serial", serialTimes);
+   addBenchResult("load service", "service", serviceTimes);
+   printf("  %-10s median %8.2f us  mean %8.2f us\n", "serial", getMedian(serialTimes), getMean(serialTimes));
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u threads)  %s\n", "service", getMedian(serviceTimes), getMean(serviceTimes),
+          getMax(Thread::getNumHardwareThreads() - 1, 1U), same ? "same" : "DIFFERENT");
+   checkBenchResult(same, "load service", "shapes don't match the serial load");
+   for (U32 i=0; i<sNumBundledShapes; i++)
+      printf("    %-28s queued %4u ms  load %4u ms  finalize %4u ms\n", sBundledShapes[i], queueTime[i], loadTime[i], finalizeTime[i]);
+}
+
+//-----------------------------------------------------------------------------
+// Crowd animation
+
+static const U32 sCrowdSize = 512;
+
+/// Animates a crowd with TSAnimationBatch and with the per-instance loop,
+/// starting either in step or at scattered positions.
+static void benchCrowd(U32 iterations, bool inStep)
+{
+   U32 frames = getMax(iterations / 10, 1U);
+   printf("crowd %s (%u instances, %u frames)\n", inStep ? "in step" : "scattered", sCrowdSize, frames);
+
+   TSShape *shape = loadBenchShape();
+   if (!shape)
+   {
+      Log::errorf("Couldn't load soldier_rigged.cached.dts from %s", sDataDir);
+      return;
+   }
+
+   S32 seq = shape->findSequence("Run");
+   if (seq == -1)
+   {
+      Log::errorf("Couldn't add player_Run.dts from %s", sDataDir);
+      delete shape;
+      return;
+   }
+
+   TSRenderState renderState;
+   Vector<TSShapeInstance*> loopInsts;
+   Vector<TSShapeInstance*> batchInsts;
+   TSAnimationBatch batch;
+
+   for (U32 i=0; i<sCrowdSize; i++)
+   {
+      F32 pos = inStep ? 0.0f : (F32)i / sCrowdSize;
+      for (U32 m=0; m<2; m++)
+      {
+         TSShapeInstance *inst = new TSShapeInstance(shape, &renderState, false);
+         inst->setSequence(inst->addThread(), seq, pos);
+         inst->setCurrentDetail(0);
+         if (m == 0)
+            loopInsts.push_back(inst);
+         else
+         {
+            batchInsts.push_back(inst);
+            batch.addInstance(inst);
+         }
+      }
+   }
+
+   Vector<F64> loopTimes;
+   Vector<F64> batchTimes;
+   F32 maxError = 0.0f;
+   U32 numThreads = 0;
+   U32 numPairs = 0;
+
+   for (U32 k=0; k<frames; k++)
+   {
+      F64 start = getTimeUS();
+      for (U32 i=0; i<loopInsts.size(); i++)
+      {
+         loopInsts[i]->advanceTime(0.013f);
+         loopInsts[i]->animate();
+      }
+      loopTimes.push_back(getTimeUS() - start);
+
+      start = getTimeUS();
+      batch.update(0.013f);
+      batchTimes.push_back(getTimeUS() - start);
+      numThreads += batch.getNumSampledThreads();
+      numPairs += batch.getNumKeyframePairs();
+
+      for (U32 i=0; i<sCrowdSize; i++)
+      {
+         const Vector<MatrixF> &ref = loopInsts[i]->mNodeTransforms;
+         const Vector<MatrixF> &out = batchInsts[i]->mNodeTransforms;
+         for (U32 n=0; n<out.size(); n++)
+         {
+            const F32 *a = out[n];
+            const F32 *b = ref[n];
+            for (U32 j=0; j<16; j++)
+               maxError = getMax(maxError, mFabs(a[j] - b[j]));
+         }
+      }
+   }
+
+   const char *benchName = inStep ? "crowd in step" : "crowd scattered";
+   addBenchResult(benchName, "loop", loopTimes);
+   addBenchResult(benchName, "batch", batchTimes);
+   printf("  %-10s median %8.2f us  mean %8.2f us\n", "loop", getMedian(loopTimes), getMean(loopTimes));
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u threads on %u keyframe pairs per frame)  max error %g\n", "batch",
+          getMedian(batchTimes), getMean(batchTimes), numThreads / frames, numPairs / frames, maxError);
+
+   for (U32 i=0; i<sCrowdSize; i++)
+   {
+      delete loopInsts[i];
+      delete batchInsts[i];
+   }
+   delete shape;
+}
+
+//-----------------------------------------------------------------------------
+// Idle crowd
+
+/// Turns a node about z, like a head looking around
+class BenchLookCallback : public TSCallback
+{
+public:
+   F32 mAngle;
+
+   BenchLookCallback() : mAngle(0.0f) {;}
+
+   virtual void setNodeTransform(TSShapeInstance *si, S32 nodeIndex, MatrixF &localTransform)
+   {
+      MatrixF rot(EulerF(0.0f, 0.0f, mAngle));
+      localTransform.mul(rot);
+   }
+};
+
+/// Animates a crowd held on the last frame of a sequence, with a callback
+/// on the neck which changes every frame. Compares redoing every node with
+/// TSShapeInstance::setNodeDirty(), then times a crowd without callbacks
+/// where nothing changes.
+static void benchIdleCrowd(U32 iterations)
+{
+   U32 frames = getMax(iterations / 10, 1U);
+   printf("idle crowd (%u instances, %u frames)\n", sCrowdSize, frames);
+
+   TSShape *shape = loadBenchShape();
+   if (!shape)
+   {
+      Log::errorf("Couldn't load soldier_rigged.cached.dts from %s", sDataDir);
+      return;
+   }
+
+   S32 seq = shape->findSequence("Run");
+   S32 neck = shape->findNode("Bip01_Neck");
+   if (seq == -1 || neck == -1)
+   {
+      Log::errorf("Couldn't add player_Run.dts from %s", sDataDir);
+      delete shape;
+      return;
+   }
+
+   // Held on the last frame
+   shape->sequences[seq].flags &= ~TSShape::Cyclic;
+
+   TSRenderState renderState;
+   BenchLookCallback look;
+   Vector<TSShapeInstance*> insts[3];
+   for (U32 m=0; m<3; m++)
+   {
+      for (U32 i=0; i<sCrowdSize; i++)
+      {
+         TSShapeInstance *inst = new TSShapeInstance(shape, &renderState, false);
+         inst->setSequence(inst->addThread(), seq, 1.0f);
+         if (m < 2)
+            inst->setNodeAnimationState(neck, 0, &look);
+         inst->setCurrentDetail(0);
+         inst->animate();
+         insts[m].push_back(inst);
+      }
+   }
+
+   Vector<F64> times[2];
+   Vector<F64> idleTimes;
+   F32 maxError = 0.0f;
+   U32 numIdleDirty = 0;
+
+   for (U32 k=0; k<frames; k++)
+   {
+      look.mAngle = k * 0.01f;
+
+      for (U32 m=0; m<2; m++)
+      {
+         F64 start = getTimeUS();
+         for (U32 i=0; i<sCrowdSize; i++)
+         {
+            TSShapeInstance *inst = insts[m][i];
+            if (m == 0)
+            {
+               inst->advanceTime(0.013f);
+               inst->setDirty(TSShapeInstance::TransformDirty);
+            }
+            else
+            {
+               // advancing a thread always dirties a shape with callbacks,
+               // so the held thread is left alone and only the neck redone
+               inst->setNodeDirty(neck);
+            }
+            inst->animate();
+         }
+         times[m].push_back(getTimeUS() - start);
+      }
+
+      // Nothing changes
+      F64 start = getTimeUS();
+      for (U32 i=0; i<sCrowdSize; i++)
+      {
+         TSShapeInstance *inst = insts[2][i];
+         inst->advanceTime(0.013f);
+         if (inst->isAnimationDirty(0))
+         {
+            numIdleDirty++;
+            inst->animate();
+         }
+      }
+      idleTimes.push_back(getTimeUS() - start);
+
+      for (U32 i=0; i<sCrowdSize; i++)
+      {
+         const Vector<MatrixF> &ref = insts[0][i]->mNodeTransforms;
+         const Vector<MatrixF> &out = insts[1][i]->mNodeTransforms;
+         for (U32 n=0; n<out.size(); n++)
+         {
+            const F32 *a = out[n];
+            const F32 *b = ref[n];
+            for (U32 j=0; j<16; j++)
+               maxError = getMax(maxError, mFabs(a[j] - b[j]));
+         }
+      }
+   }
+
+   addBenchResult("idle crowd", "all nodes", times[0]);
+   addBenchResult("idle crowd", "dirty", times[1]);
+   addBenchResult("idle crowd", "unchanged", idleTimes);
+   printf("  %-10s median %8.2f us  mean %8.2f us\n", "all nodes", getMedian(times[0]), getMean(times[0]));
+   printf("  %-10s median %8.2f us  mean %8.2f us  max error %g\n", "dirty", getMedian(times[1]), getMean(times[1]), maxError);
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u animated)\n", "unchanged", getMedian(idleTimes), getMean(idleTimes), numIdleDirty);
+
+   for (U32 m=0; m<3; m++)
+      for (U32 i=0; i<sCrowdSize; i++)
+         delete insts[m][i];
+   delete shape;
+}
+
+//-----------------------------------------------------------------------------
+// Track compression
+
+static const char *sCompressionFiles[] = {
+   "player_Crouch_Backward.dts",
+   "player_Jump.dts",
+   "player_Root.dts",
+   "player_Run.dts",
+   "player_Side.dts",
+};
+
+static const U32 sNumCompressionFiles = sizeof(sCompressionFiles) / sizeof(sCompressionFiles[0]);
+
+/// Tolerances the tracks are compressed with, in radians and shape units
+static const F32 sCompressRotTolerance = 0.0005f;
+static const F32 sCompressPosTolerance = 0.0005f;
+
+/// Samples every rotation and translation track of every sequence between
+/// each pair of keyframes; returns the number of samples taken
+static U32 sampleAllTracks(const TSShape *shape, QuatF &rotSum, Point3F &posSum)
+{
+   U32 samples = 0;
+   for (S32 i=0; i<shape->sequences.size(); i++)
+   {
+      const TSShape::Sequence &seq = shape->sequences[i];
+      for (S32 k=0; k<seq.numKeyframes; k++)
+      {
+         S32 k2 = (k + 1) % seq.numKeyframes;
+         for (S32 j=0; j<seq.rotationNodes.size(); j++)
+         {
+            QuatF q1, q2, q;
+            shape->getRotation(seq, k, j, &q1);
+            shape->getRotation(seq, k2, j, &q2);
+            TSTransform::interpolate(q1, q2, 0.5f, &q);
+            rotSum.x += q.x;
+            samples++;
+         }
+         for (S32 j=0; j<seq.translationNodes.size(); j++)
+         {
+            Point3F p;
+            TSTransform::interpolate(shape->getTranslation(seq, k, j), shape->getTranslation(seq, k2, j), 0.5f, &p);
+            posSum += p;
+            samples++;
+         }
+      }
+   }
+   return samples;
+}
+
+/// Compresses the sequences of each player shape, saves and reloads it, and
+/// compares the reloaded keyframes against the original ones
+static void benchCompression(U32 iterations)
+{
+   printf("track compression (%u iterations)\n", iterations);
+
+   for (U32 i=0; i<sNumCompressionFiles; i++)
+   {
+      TSShape *shape = TSShape::createFromPath(GetBenchAssetPath(sCompressionFiles[i]));
+      TSShape *compressed = TSShape::createFromPath(GetBenchAssetPath(sCompressionFiles[i]));
+      if (!shape || !compressed)
+      {
+         Log::errorf("Couldn't load %s from %s", sCompressionFiles[i], sDataDir);
+         delete shape;
+         delete compressed;
+         continue;
+      }
+
+      compressed->compressSequences(sCompressRotTolerance, sCompressPosTolerance);
+
+      // Fixed size, as a growing MemStream reports EOS while it is written
+      MemStream stream(4 << 20, (void*)NULL);
+      compressed->write(&stream);
+      delete compressed;
+
+      stream.setPosition(0);
+      TSShape *reloaded = new TSShape;
+      if (!reloaded->read(&stream))
+      {
+         Log::errorf("Couldn't reload compressed %s", sCompressionFiles[i]);
+         delete shape;
+         delete reloaded;
+         continue;
+      }
+
+      U32 denseSize = shape->nodeRotations.size() * sizeof(Quat16) + shape->nodeTranslations.size() * sizeof(Point3F);
+      U32 packedSize = reloaded->nodeRotations.size() * sizeof(Quat16) + reloaded->nodeTranslations.size() * sizeof(Point3F) +
+                       reloaded->compressedTracks.size() * sizeof(TSShape::CompressedTrack) +
+                       reloaded->compressedKeyFrames.size() * sizeof(U16) + reloaded->compressedKeyData.size() * sizeof(U16);
+
+      // Error at every keyframe
+      F32 maxRotError = 0.0f;
+      F32 maxPosError = 0.0f;
+      for (S32 s=0; s<shape->sequences.size() && s<reloaded->sequences.size(); s++)
+      {
+         const TSShape::Sequence &seq = shape->sequences[s];
+         const TSShape::Sequence &seq2 = reloaded->sequences[s];
+         for (S32 k=0; k<seq.numKeyframes; k++)
+         {
+            for (S32 j=0; j<seq.rotationNodes.size(); j++)
+            {
+               QuatF q1, q2;
+               shape->getRotation(seq, k, j, &q1).normalize();
+               reloaded->getRotation(seq2, k, j, &q2).normalize();
+               if (q1.dot(q2) < 0.0f)
+                  q2.neg();
+               QuatF d = q1 - q2;
+               F32 chord = mSqrt(d.x*d.x + d.y*d.y + d.z*d.z + d.w*d.w);
+               maxRotError = getMax(maxRotError, 4.0f * mAsin(getMin(chord * 0.5f, 1.0f)));
+            }
+            for (S32 j=0; j<seq.translationNodes.size(); j++)
+               maxPosError = getMax(maxPosError, (shape->getTranslation(seq, k, j) - reloaded->getTranslation(seq2, k, j)).len());
+         }
+      }
+
+      Vector<F64> times[2];
+      QuatF rotSum(0, 0, 0, 0);
+      Point3F posSum(0, 0, 0);
+      U32 samples = 0;
+      for (U32 k=0; k<iterations; k++)
+      {
+         F64 start = getTimeUS();
+         samples = sampleAllTracks(shape, rotSum, posSum);
+         times[0].push_back(getTimeUS() - start);
+
+         start = getTimeUS();
+         sampleAllTracks(reloaded, rotSum, posSum);
+         times[1].push_back(getTimeUS() - start);
+      }
+
+      char mode[64];
+      dSprintf(mode, sizeof(mode), "%s dense", sCompressionFiles[i]);
+      addBenchResult("track compression", mode, times[0]);
+      dSprintf(mode, sizeof(mode), "%s packed", sCompressionFiles[i]);
+      addBenchResult("track compression", mode, times[1]);
+
+      F64 denseNs = samples ? getMedian(times[0]) * 1000.0 / samples : 0.0;
+      F64 packedNs = samples ? getMedian(times[1]) * 1000.0 / samples : 0.0;
+      printf("  %-28s %6u -> %6u bytes (%.2fx)  max error %.4f deg %.5f  sample %5.1f ns -> %5.1f ns\n",
+             sCompressionFiles[i], denseSize, packedSize, packedSize ? (F32)denseSize / packedSize : 0.0f,
+             mRadToDeg(maxRotError), maxPosError, denseNs, packedNs);
+
+      // Each key is fitted to the tolerance, with a little float slack
+      checkBenchResult(reloaded->sequences.size() == shape->sequences.size() &&
+                       maxRotError <= sCompressRotTolerance * 1.01f + 1e-5f &&
+                       maxPosError <= sCompressPosTolerance * 1.01f + 1e-5f,
+                       "track compression", sCompressionFiles[i]);
+
+      delete shape;
+      delete reloaded;
+   }
+}
+
+//-----------------------------------------------------------------------------
+// Sequence streaming
+
+/// Bytes of node and ground keyframes held in a shape's arrays
+static U32 getKeyframeSize(const TSShape *shape)
+{
+   return shape->nodeRotations.size() * sizeof(Quat16) + shape->nodeTranslations.size() * sizeof(Point3F) +
+          shape->nodeUniformScales.size() * sizeof(F32) + shape->nodeAlignedScales.size() * sizeof(Point3F) +
+          shape->nodeArbitraryScaleRots.size() * sizeof(Quat16) + shape->nodeArbitraryScaleFactors.size() * sizeof(Point3F) +
+          shape->groundRotations.size() * sizeof(Quat16) + shape->groundTranslations.size() * sizeof(Point3F);
+}
+
+/// Plays the player shapes in turn, one at a time, with the keyframes loaded
+/// up front and streamed under a small budget, and compares the poses
+static void benchStreaming(U32 iterations)
+{
+   const U32 budget = 64 << 10;
+   printf("sequence streaming (%u frames, %u KB budget)\n", iterations, budget >> 10);
+
+   Vector<TSShape*> shapes[2];
+   Vector<TSShapeInstance*> insts[2];
+   Vector<TSThread*> threads[2];
+   TSRenderState renderState;
+   U32 eagerSize = 0;
+
+   for (U32 m=0; m<2; m++)
+   {
+      TSShape::smStreamSequences = (m == 1);
+      for (U32 i=0; i<sNumCompressionFiles; i++)
+      {
+         TSShape *shape = TSShape::createFromPath(GetBenchAssetPath(sCompressionFiles[i]));
+         if (!shape || !shape->sequences.size())
+         {
+            Log::errorf("Couldn't load %s from %s", sCompressionFiles[i], sDataDir);
+            delete shape;
+            continue;
+         }
+         if (m == 0)
+            eagerSize += getKeyframeSize(shape);
+
+         TSShapeInstance *inst = new TSShapeInstance(shape, &renderState, false);
+         threads[m].push_back(inst->addThread());
+         inst->setSequence(threads[m].last(), 0, 0.0f);
+         inst->setCurrentDetail(0);
+         shapes[m].push_back(shape);
+         insts[m].push_back(inst);
+      }
+   }
+   TSShape::smStreamSequences = false;
+
+   U32 headerSize = 0;
+   for (U32 i=0; i<shapes[1].size(); i++)
+      headerSize += getKeyframeSize(shapes[1][i]);
+
+   TSSequenceCache::setBudget(budget);
+   U32 startLoads = TSSequenceCache::getNumLoads();
+
+   Vector<F64> times[2];
+   F32 maxError = 0.0f;
+   U32 peakResident = 0;
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      TSSequenceCache::advanceFrame();
+
+      // Switch to the next shape every 16 frames
+      U32 i = (k / 16) % insts[0].size();
+      for (U32 m=0; m<2; m++)
+      {
+         F64 start = getTimeUS();
+         TSShapeInstance *inst = insts[m][i];
+         if ((k & 15) == 0)
+            inst->setSequence(threads[m][i], (k / 16 / insts[m].size()) % shapes[m][i]->sequences.size(), 0.0f);
+         inst->advanceTime(0.033f);
+         inst->animate();
+         times[m].push_back(getTimeUS() - start);
+      }
+      peakResident = getMax(peakResident, TSSequenceCache::getResidentSize());
+
+      {
+         const Vector<MatrixF> &ref = insts[0][i]->mNodeTransforms;
+         const Vector<MatrixF> &out = insts[1][i]->mNodeTransforms;
+         for (U32 n=0; n<out.size(); n++)
+         {
+            const F32 *a = out[n];
+            const F32 *b = ref[n];
+            for (U32 j=0; j<16; j++)
+               maxError = getMax(maxError, mFabs(a[j] - b[j]));
+         }
+      }
+   }
+
+   addBenchResult("sequence streaming", "eager", times[0]);
+   addBenchResult("sequence streaming", "streamed", times[1]);
+   printf("  %-10s median %8.2f us  mean %8.2f us  %7u bytes of keyframes\n", "eager",
+          getMedian(times[0]), getMean(times[0]), eagerSize);
+   printf("  %-10s median %8.2f us  mean %8.2f us  %7u bytes peak (%u resident)  %u page-ins  max error %g\n", "streamed",
+          getMedian(times[1]), getMean(times[1]), headerSize + peakResident, TSSequenceCache::getResidentSize(),
+          TSSequenceCache::getNumLoads() - startLoads, maxError);
+
+   for (U32 m=0; m<2; m++)
+   {
+      for (U32 i=0; i<insts[m].size(); i++)
+      {
+         delete insts[m][i];
+         delete shapes[m][i];
+      }
+   }
+   TSSequenceCache::setBudget(16 << 20);
+}
+
+//-----------------------------------------------------------------------------
+// Shape blobs
+
+/// Bytes of aligned vertex data held by the standard meshes of a shape
+static U32 getStandardVertexSize(const TSShape *shape)
+{
+   U32 size = 0;
+   for (S32 i=0; i<shape->meshes.size(); i++)
+   {
+      const TSMesh *mesh = shape->meshes[i];
+      if (mesh && mesh->getMeshType() == TSMesh::StandardMeshType)
+         size += mesh->mVertexData.mem_size();
+   }
+   return size;
+}
+
+static const char *sBlobFiles[] = {
+   "soldier_rigged.cached.dts",
+   "cube.dae",
+};
+
+static const U32 sNumBlobFiles = sizeof(sBlobFiles) / sizeof(sBlobFiles[0]);
+
+/// Writes a shape out as a dts and as a blob, then compares loading the two
+/// and checks the blob meshes match
+static void benchBlobFile(const char *file, U32 iterations)
+{
+   TSShape *ref = TSShape::createFromPath(GetBenchAssetPath(file));
+   if (!ref)
+   {
+      Log::errorf("Couldn't load %s from %s", file, sDataDir);
+      return;
+   }
+
+   String dtsPath = GetBenchAssetPath("blobbench.dts");
+   String blobPath = GetBenchAssetPath("blobbench.dtsblob");
+   U32 blobSize = 0;
+   {
+      FileStream dtsStream, blobStream;
+      if (!dtsStream.open(dtsPath, FileStream::Write) || !blobStream.open(blobPath, FileStream::Write))
+      {
+         Log::errorf("Couldn't write to %s", sDataDir);
+         delete ref;
+         return;
+      }
+      ref->write(&dtsStream);
+      ref->writeBlob(&blobStream);
+      blobSize = blobStream.getPosition();
+   }
+
+   Vector<F64> times[2];
+   U32 privateSize[2] = { 0, 0 };
+   U32 sharedSize = 0;
+   bool same = true;
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      for (U32 m=0; m<2; m++)
+      {
+         F64 start = getTimeUS();
+         TSShape *shape = m == 0 ? TSShape::createFromPath(dtsPath) : TSShape::createFromBlob(blobPath);
+         times[m].push_back(getTimeUS() - start);
+
+         if (!shape)
+         {
+            same = false;
+            continue;
+         }
+
+         if (k == 0)
+         {
+            U32 shared = shape->getBlobVertexSize();
+            privateSize[m] = shape->mShapeDataSize + getStandardVertexSize(shape) - shared;
+            if (m == 1)
+               sharedSize = shared;
+
+            same &= shape->meshes.size() == ref->meshes.size();
+            for (S32 i=0; same && i<shape->meshes.size(); i++)
+            {
+               const TSMesh *a = shape->meshes[i];
+               const TSMesh *b = ref->meshes[i];
+               if (!a || !b)
+               {
+                  same &= a == b;
+                  continue;
+               }
+               same &= a->mVertexData.mem_size() == b->mVertexData.mem_size() &&
+                       a->indices.size() == b->indices.size() && a->mBounds == b->mBounds;
+               if (same && a->getMeshType() == TSMesh::StandardMeshType)
+                  same &= dMemcmp(a->mVertexData.address(), b->mVertexData.address(), a->mVertexData.mem_size()) == 0;
+            }
+         }
+
+         delete shape;
+      }
+   }
+
+   char mode[64];
+   dSprintf(mode, sizeof(mode), "%s dts", file);
+   addBenchResult("shape blob", mode, times[0]);
+   dSprintf(mode, sizeof(mode), "%s blob", file);
+   addBenchResult("shape blob", mode, times[1]);
+
+   printf("  %s (%u byte blob)\n", file, blobSize);
+   printf("    %-8s median %8.2f us  mean %8.2f us  %7u bytes private\n", "dts",
+          getMedian(times[0]), getMean(times[0]), privateSize[0]);
+   printf("    %-8s median %8.2f us  mean %8.2f us  %7u bytes private  %7u bytes shared  %s\n", "blob",
+          getMedian(times[1]), getMean(times[1]), privateSize[1], sharedSize, same ? "same" : "DIFFERENT");
+   checkBenchResult(same, "shape blob", file);
+
+   delete ref;
+   Platform::fileDelete(dtsPath.c_str());
+   Platform::fileDelete(blobPath.c_str());
+}
+
+static void benchBlob(U32 iterations)
+{
+   printf("shape blob (%u iterations)\n", iterations);
+
+   // Loading the dae writes a cached dts next to it
+   bool hadCache = Platform::isFile(GetBenchAssetPath("cube.cached.dts"));
+
+   for (U32 i=0; i<sNumBlobFiles; i++)
+      benchBlobFile(sBlobFiles[i], iterations);
+
+   if (!hadCache)
+      Platform::fileDelete(GetBenchAssetPath("cube.cached.dts"));
+}
+
+//-----------------------------------------------------------------------------
+// Vertex packing
+
+/// Packs the meshes of the blob test shapes, skins included, and measures
+/// the size and the error of the packed vertices
+static void benchPacking(U32 iterations)
+{
+   printf("vertex packing (%u iterations)\n", iterations);
+
+   bool oldAllowHardwareSkinning = TSShape::smAllowHardwareSkinning;
+   TSShape::smAllowHardwareSkinning = false;
+   TSShape::smPackVertices = true;
+
+   bool hadCache = Platform::isFile(GetBenchAssetPath("cube.cached.dts"));
+
+   for (U32 f=0; f<sNumBlobFiles; f++)
+   {
+      TSShape *shape = TSShape::createFromPath(GetBenchAssetPath(sBlobFiles[f]));
+      if (!shape)
+      {
+         Log::errorf("Couldn't load %s from %s", sBlobFiles[f], sDataDir);
+         continue;
+      }
+
+      Vector<F64> times;
+      U32 fullSize = 0, packedSize = 0, numVerts = 0;
+      F32 posError = 0.0f, normalError = 0.0f, uvError = 0.0f;
+
+      for (S32 i=0; i<shape->meshes.size(); i++)
+      {
+         TSMesh *mesh = shape->meshes[i];
+         if (!mesh || !mesh->mVertexData.isReady() || !mesh->mNumVerts)
+            continue;
+
+         for (U32 k=0; k<iterations; k++)
+         {
+            F64 start = getTimeUS();
+            mesh->packVertexData(&shape->mPackedVertexFormat, shape->mPackedVertSize);
+            times.push_back(getTimeUS() - start);
+         }
+
+         fullSize += mesh->mVertexData.mem_size();
+         packedSize += mesh->mPackedVertexData.size();
+         numVerts += mesh->mNumVerts;
+
+         // Position error is relative to the size of the mesh
+         const F32 meshSize = getMax(getMax(mesh->mPackedPosScale.x, mesh->mPackedPosScale.y), mesh->mPackedPosScale.z) * 2.0f;
+         for (U32 v=0; v<mesh->mNumVerts; v++)
+         {
+            const TSMesh::__TSMeshVertexBase &src = mesh->mVertexData.getBase(v);
+            const TSMesh::__TSMeshPackedVertex &dst = *(const TSMesh::__TSMeshPackedVertex*)(mesh->mPackedVertexData.address() + v * mesh->mPackedVertSize);
+
+            Point3F pos(TSMesh::unpackSnorm16(dst._vert[0]), TSMesh::unpackSnorm16(dst._vert[1]), TSMesh::unpackSnorm16(dst._vert[2]));
+            pos.convolve(mesh->mPackedPosScale);
+            pos += mesh->mPackedPosBias;
+            posError = getMax(posError, (pos - src.vert()).len() / meshSize);
+
+            Point3F normal = src.normal();
+            normal.normalizeSafe();
+            normalError = getMax(normalError, mRadToDeg(mAcos(mClampF(mDot(normal, TSMesh::decodeOctNormal(dst._normal)), -1.0f, 1.0f))));
+
+            uvError = getMax(uvError, mFabs(TSMesh::unpackHalf(dst._tvert[0]) - src.tvert().x));
+            uvError = getMax(uvError, mFabs(TSMesh::unpackHalf(dst._tvert[1]) - src.tvert().y));
+         }
+      }
+
+      if (numVerts)
+      {
+         addBenchResult("vertex packing", sBlobFiles[f], times);
+         printf("  %-26s %6u verts  %8u -> %7u bytes (%.2fx)  pack %8.2f us  error pos %g normal %.4f deg uv %g\n",
+                sBlobFiles[f], numVerts, fullSize, packedSize, (F32)fullSize / packedSize, getMedian(times),
+                posError, normalError, uvError);
+      }
+
+      delete shape;
+   }
+
+   TSShape::smPackVertices = false;
+   TSShape::smAllowHardwareSkinning = oldAllowHardwareSkinning;
+
+   if (!hadCache)
+      Platform::fileDelete(GetBenchAssetPath("cube.cached.dts"));
+}
+
+//-----------------------------------------------------------------------------
+// Mesh optimization
+
+/// Shuffles the triangles of every triangle list, like an exporter which
+/// doesn't order them would
+static void shuffleTriangles(TSMesh *mesh, MRandomLCG &rand)
+{
+   for (S32 i=0; i<mesh->primitives.size(); i++)
+   {
+      const TSDrawPrimitive &prim = mesh->primitives[i];
+      if ((prim.matIndex & TSDrawPrimitive::TypeMask) != TSDrawPrimitive::Triangles)
+         continue;
+
+      U32 *tris = mesh->indices.address() + prim.start;
+      for (S32 t=prim.numElements/3 - 1; t>0; t--)
+      {
+         S32 other = rand.randI(0, t);
+         for (U32 c=0; c<3; c++)
+         {
+            U32 tmp = tris[t*3 + c];
+            tris[t*3 + c] = tris[other*3 + c];
+            tris[other*3 + c] = tmp;
+         }
+      }
+   }
+}
+
+static void benchMeshOptimize(U32 iterations)
+{
+   printf("mesh optimization (%u iterations)\n", iterations);
+
+   bool hadCache = Platform::isFile(GetBenchAssetPath("cube.cached.dts"));
+
+   for (U32 f=0; f<sNumBlobFiles; f++)
+   {
+      // Load time with the meshes optimized in parallel, and without. The
+      // first load writes the dae cache, and creates the thread pool.
+      Vector<F64> loadTimes[2];
+      for (U32 m=0; m<2; m++)
+      {
+         TSShape::smOptimizeMeshes = m == 1;
+         delete TSShape::createFromPath(GetBenchAssetPath(sBlobFiles[f]));
+
+         for (U32 k=0; k<iterations; k++)
+         {
+            F64 start = getTimeUS();
+            TSShape *shape = TSShape::createFromPath(GetBenchAssetPath(sBlobFiles[f]));
+            loadTimes[m].push_back(getTimeUS() - start);
+            delete shape;
+         }
+      }
+      TSShape::smOptimizeMeshes = false;
+
+      char mode[64];
+      dSprintf(mode, sizeof(mode), "%s load", sBlobFiles[f]);
+      addBenchResult("mesh optimization", mode, loadTimes[0]);
+      dSprintf(mode, sizeof(mode), "%s load optimized", sBlobFiles[f]);
+      addBenchResult("mesh optimization", mode, loadTimes[1]);
+
+      printf("  %s load median %8.2f us, optimized %8.2f us\n", sBlobFiles[f],
+             getMedian(loadTimes[0]), getMedian(loadTimes[1]));
+
+      TSShape *shape = TSShape::createFromPath(GetBenchAssetPath(sBlobFiles[f]));
+      if (!shape)
+      {
+         Log::errorf("Couldn't load %s from %s", sBlobFiles[f], sDataDir);
+         continue;
+      }
+
+      // Triangle order of each mesh as loaded, shuffled and optimized
+      MRandomLCG rand(1);
+      for (S32 i=0; i<shape->meshes.size(); i++)
+      {
+         TSMesh *mesh = shape->meshes[i];
+         if (!mesh || mesh->getNumPolys() == 0)
+            continue;
+
+         F32 loadedACMR = mesh->getACMR();
+         shuffleTriangles(mesh, rand);
+         F32 shuffledACMR = mesh->getACMR();
+
+         Vector<U32> shuffled(mesh->indices);
+         Vector<F64> times;
+         for (U32 k=0; k<iterations; k++)
+         {
+            dCopyArray(mesh->indices.address(), shuffled.address(), shuffled.size());
+
+            F64 start = getTimeUS();
+            mesh->optimizeTriangleOrder();
+            times.push_back(getTimeUS() - start);
+         }
+
+         dSprintf(mode, sizeof(mode), "%s mesh %d", sBlobFiles[f], i);
+         addBenchResult("mesh optimization", mode, times);
+         printf("    mesh %-3d %6d tris  acmr loaded %.3f  shuffled %.3f  optimized %.3f  median %8.2f us\n",
+                i, mesh->getNumPolys(), loadedACMR, shuffledACMR, mesh->getACMR(), getMedian(times));
+      }
+
+      delete shape;
+   }
+
+   if (!hadCache)
+      Platform::fileDelete(GetBenchAssetPath("cube.cached.dts"));
+}
+
+//-----------------------------------------------------------------------------
+// Detail selection
+
+static const U32 sDetailGridSize = 64;
+
+/// Scene state for a camera at mCameraPos looking down +y
+class BenchSceneRenderState : public TSSceneRenderState
+{
+public:
+   Point3F mCameraPos;
+   MatrixF mIdentity;
+
+   BenchSceneRenderState() : mCameraPos(0,0,0), mIdentity(true) {;}
+
+   virtual TSMaterialInstance *getOverrideMaterial( TSMaterialInstance *inst ) const { return inst; }
+   virtual Point3F getCameraPosition() const { return mCameraPos; }
+   virtual Point3F getDiffuseCameraPosition() const { return mCameraPos; }
+   virtual RectF getViewport() const { return RectF(0,0,800,600); }
+   virtual Point2F getWorldToScreenScale() const { return Point2F(400,400); }
+   virtual const MatrixF *getWorldMatrix() const { return &mIdentity; }
+   virtual bool isShadowPass() const { return false; }
+   virtual const MatrixF *getViewMatrix() const { return &mIdentity; }
+   virtual const MatrixF *getProjectionMatrix() const { return &mIdentity; }
+};
+
+/// Selects detail levels for a grid of instances one at a time, and with
+/// TSShapeInstance::setDetailsFromPosAndScale.
+static void benchDetailSelection(U32 iterations)
+{
+   const U32 count = sDetailGridSize * sDetailGridSize;
+   printf("detail selection (%u instances, %u iterations)\n", count, iterations);
+
+   TSShape *shape = loadBenchShape();
+   if (!shape)
+   {
+      Log::errorf("Couldn't load soldier_rigged.cached.dts from %s", sDataDir);
+      return;
+   }
+
+   TSRenderState renderState;
+   BenchSceneRenderState sceneState;
+
+   Vector<TSShapeInstance*> insts;
+   Vector<Point3F> positions;
+   Vector<Point3F> scales;
+   MRandomLCG rand(1);
+   for (U32 i=0; i<count; i++)
+   {
+      insts.push_back(new TSShapeInstance(shape, &renderState, false));
+      positions.push_back(Point3F(((S32)(i % sDetailGridSize) - (S32)sDetailGridSize / 2) * 4.0f,
+                                  (i / sDetailGridSize) * 4.0f - 8.0f, 0.0f));
+      scales.push_back(Point3F(1,1,1) * rand.randF(0.8f, 1.2f));
+   }
+
+   Frustum frustum;
+   frustum.set(false, mDegToRad(90.0f), 800.0f / 600.0f, 0.1f, 1000.0f);
+
+   Vector<F64> loopTimes;
+   Vector<F64> batchTimes;
+   Vector<F64> cullTimes;
+   Vector<S32> loopDetails;
+   Vector<U32> visible;
+   U32 numMismatched = 0;
+   U32 numVisible = 0;
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      F64 start = getTimeUS();
+      for (U32 i=0; i<count; i++)
+         insts[i]->setDetailFromPosAndScale(&sceneState, positions[i], scales[i]);
+      loopTimes.push_back(getTimeUS() - start);
+
+      loopDetails.setSize(count);
+      for (U32 i=0; i<count; i++)
+         loopDetails[i] = insts[i]->getCurrentDetail();
+
+      start = getTimeUS();
+      TSShapeInstance::setDetailsFromPosAndScale(&sceneState, insts.address(), positions.address(), scales.address(), count);
+      batchTimes.push_back(getTimeUS() - start);
+
+      for (U32 i=0; i<count; i++)
+         numMismatched += insts[i]->getCurrentDetail() != loopDetails[i];
+
+      start = getTimeUS();
+      numVisible = TSShapeInstance::setDetailsFromPosAndScale(&sceneState, insts.address(), positions.address(), scales.address(), count,
+                                                              frustum.getPlanes(), frustum.getNumPlanes(), 0.0f, &visible);
+      cullTimes.push_back(getTimeUS() - start);
+   }
+
+   addBenchResult("detail selection", "loop", loopTimes);
+   addBenchResult("detail selection", "batch", batchTimes);
+   addBenchResult("detail selection", "culled", cullTimes);
+   printf("  %-10s median %8.2f us  mean %8.2f us\n", "loop", getMedian(loopTimes), getMean(loopTimes));
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u mismatched)\n", "batch",
+          getMedian(batchTimes), getMean(batchTimes), numMismatched);
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u visible)\n", "culled",
+          getMedian(cullTimes), getMean(cullTimes), numVisible);
+   checkBenchResult(numMismatched == 0, "detail selection", "batched details don't match setDetailFromPosAndScale");
+
+   // Camera bobbing back and forth, counting how many times instances
+   // change detail level with and without hysteresis.
+   static const F32 sHysteresis[] = { 0.0f, 0.1f };
+   for (U32 h=0; h<2; h++)
+   {
+      U32 numChanges = 0;
+      for (U32 k=0; k<=iterations; k++)
+      {
+         sceneState.mCameraPos.y = (k & 1) ? 0.5f : 0.0f;
+         for (U32 i=0; i<count; i++)
+            loopDetails[i] = insts[i]->getCurrentDetail();
+
+         TSShapeInstance::setDetailsFromPosAndScale(&sceneState, insts.address(), positions.address(), scales.address(), count,
+                                                    NULL, 0, sHysteresis[h]);
+
+         if (k == 0)
+            continue;
+         for (U32 i=0; i<count; i++)
+            numChanges += insts[i]->getCurrentDetail() != loopDetails[i];
+      }
+
+      printf("  hysteresis %.2f: %.1f detail changes per frame\n", sHysteresis[h], (F32)numChanges / iterations);
+   }
+
+   for (U32 i=0; i<count; i++)
+      delete insts[i];
+   delete shape;
+}
+
+//-----------------------------------------------------------------------------
+// Render queue
+
+static const U32 sRenderQueueProps = 1000;
+static const U32 sRenderQueueCharacters = 32;
+
+/// Sorts the render instances of a field of props and a few characters by
+/// distance, and into batches.
+static void benchRenderQueue(U32 iterations)
+{
+   printf("render queue (%u props, %u characters, %u iterations)\n", sRenderQueueProps, sRenderQueueCharacters, iterations);
+
+   bool hadCache = Platform::isFile(GetBenchAssetPath("cube.cached.dts"));
+
+   TSShape *propShape = TSShape::createFromPath(GetBenchAssetPath("cube.dae"));
+   TSShape *charShape = loadBenchShape();
+   if (!propShape || !charShape)
+   {
+      Log::errorf("Couldn't load cube.dae and soldier_rigged.cached.dts from %s", sDataDir);
+      delete propShape;
+      delete charShape;
+      return;
+   }
+
+   propShape->initRender();
+   charShape->initRender();
+
+   TSRenderState renderState;
+   BenchSceneRenderState sceneState;
+   renderState.setSceneState(&sceneState);
+
+   Vector<TSShapeInstance*> insts;
+   Vector<MatrixF> transforms;
+   MRandomLCG rand(1);
+   for (U32 i=0; i<sRenderQueueProps + sRenderQueueCharacters; i++)
+   {
+      TSShapeInstance *inst = new TSShapeInstance(i < sRenderQueueProps ? propShape : charShape, &renderState);
+      inst->setCurrentDetail(0);
+      inst->animate();
+      insts.push_back(inst);
+
+      MatrixF mat(true);
+      mat.setPosition(Point3F(rand.randF(-100.0f, 100.0f), rand.randF(0.0f, 200.0f), 0.0f));
+      transforms.push_back(mat);
+   }
+
+   Vector<F64> times[2];
+   U32 numInsts = 0;
+   U32 numBatches = 0;
+   U32 firstFrameAllocs = 0;
+   for (U32 m=0; m<2; m++)
+   {
+      renderState.setBatchRenderInsts(m == 1);
+      for (U32 k=0; k<iterations; k++)
+      {
+         renderState.reset();
+         for (U32 i=0; i<insts.size(); i++)
+         {
+            renderState.setInstanceTransform(&transforms[i]);
+            insts[i]->render(renderState);
+         }
+         renderState.setInstanceTransform(NULL);
+         if (m == 0 && k == 0)
+            firstFrameAllocs = renderState.getFrameHeapAllocs();
+
+         F64 start = getTimeUS();
+         renderState.sortRenderInsts();
+         times[m].push_back(getTimeUS() - start);
+      }
+
+      numInsts = renderState.mRenderInsts.size();
+      numBatches = renderState.mRenderBatches.size();
+   }
+
+   addBenchResult("render queue", "distance", times[0]);
+   addBenchResult("render queue", "batched", times[1]);
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u render instances)\n", "distance",
+          getMedian(times[0]), getMean(times[0]), numInsts);
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u batches)\n", "batched",
+          getMedian(times[1]), getMean(times[1]), numBatches);
+   printf("  frame: %u render insts allocated, %u bytes, %u heap allocs (%u in the first frame)\n",
+          renderState.getFrameRenderInsts(), renderState.getFrameBytes(), renderState.getFrameHeapAllocs(), firstFrameAllocs);
+
+   for (U32 i=0; i<insts.size(); i++)
+      delete insts[i];
+   delete propShape;
+   delete charShape;
+
+   if (!hadCache)
+      Platform::fileDelete(GetBenchAssetPath("cube.cached.dts"));
+}
+
+//-----------------------------------------------------------------------------
+// Collision
+
+static const U32 sCollisionRays = 256;
+
+static void benchCollision(U32 iterations)
+{
+   printf("collision (%u rays, %u iterations)\n", sCollisionRays, iterations);
+
+   TSShape *shape = loadBenchShape();
+   if (!shape)
+   {
+      Log::errorf("Couldn't load soldier_rigged.cached.dts from %s", sDataDir);
+      return;
+   }
+
+   TSRenderState renderState;
+   TSShapeInstance *inst = new TSShapeInstance(shape, &renderState, false);
+
+   S32 seq = shape->findSequence("Run");
+   if (seq != -1)
+      inst->setSequence(inst->addThread(), seq, 0.37f);
+   inst->setCurrentDetail(0);
+   inst->animate();
+
+   // Rays from a ring around the shape, aimed at points scattered over its bounds
+   Vector<Point3F> starts, ends;
+   MRandomLCG rand(1);
+   const Point3F center = shape->bounds.getCenter();
+   const F32 radius = shape->bounds.len() * 2.0f;
+   for (U32 i=0; i<sCollisionRays; i++)
+   {
+      F32 angle = M_2PI_F * i / sCollisionRays;
+      starts.push_back(center + Point3F(mCos(angle) * radius, mSin(angle) * radius, 0.0f));
+      ends.push_back(Point3F(rand.randF(shape->bounds.minExtents.x, shape->bounds.maxExtents.x),
+                             rand.randF(shape->bounds.minExtents.y, shape->bounds.maxExtents.y),
+                             rand.randF(shape->bounds.minExtents.z, shape->bounds.maxExtents.z)));
+      ends.last() += (ends.last() - starts.last()) * 0.5f;
+   }
+
+   Vector<F64> times[3];
+   ConcretePolyList polyList;
+   Vector<RayInfo> loopInfos, rayInfos;
+   Vector<bool> loopHits, hits;
+   loopInfos.setSize(sCollisionRays);
+   rayInfos.setSize(sCollisionRays);
+   loopHits.setSize(sCollisionRays);
+   hits.setSize(sCollisionRays);
+   U32 numPolys = 0;
+   U32 numHits[2] = { 0, 0 };
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      polyList.clear();
+      polyList.setTransform(&MatrixF::Identity, Point3F(1, 1, 1));
+
+      F64 start = getTimeUS();
+      inst->buildPolyList(&polyList, 0);
+      times[0].push_back(getTimeUS() - start);
+      numPolys = polyList.mPolyList.size();
+
+      numHits[0] = 0;
+      start = getTimeUS();
+      for (U32 i=0; i<sCollisionRays; i++)
+         numHits[0] += loopHits[i] = inst->castRay(starts[i], ends[i], &loopInfos[i], 0);
+      times[1].push_back(getTimeUS() - start);
+
+      start = getTimeUS();
+      numHits[1] = inst->castRays(starts.address(), ends.address(), sCollisionRays, rayInfos.address(), hits.address(), 0);
+      times[2].push_back(getTimeUS() - start);
+   }
+
+   addBenchResult("collision", "polylist", times[0]);
+   addBenchResult("collision", "ray loop", times[1]);
+   addBenchResult("collision", "ray batch", times[2]);
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u polys)\n", "polylist", getMedian(times[0]), getMean(times[0]), numPolys);
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u hits)\n", "ray loop", getMedian(times[1]), getMean(times[1]), numHits[0]);
+   printf("  %-10s median %8.2f us  mean %8.2f us  (%u hits)\n", "ray batch", getMedian(times[2]), getMean(times[2]), numHits[1]);
+
+   // Closest hit by testing every triangle of the poly list, which is in
+   // the same space as the rays
+   U32 numMismatched = 0;
+   for (U32 i=0; i<sCollisionRays; i++)
+   {
+      const Point3F dir = ends[i] - starts[i];
+      F32 bestT = 2.0f;
+      for (U32 p=0; p<polyList.mPolyList.size(); p++)
+      {
+         const ConcretePolyList::Poly &poly = polyList.mPolyList[p];
+         const U32 *idx = polyList.mIndexList.address() + poly.vertexStart;
+         for (U32 v=2; v<poly.vertexCount; v++)
+         {
+            F32 t;
+            Point2F bary;
+            if (castRayTriangle(starts[i], dir, polyList.mVertexList[idx[0]], polyList.mVertexList[idx[v-1]],
+                                polyList.mVertexList[idx[v]], t, bary) && t >= 0.0f && t < bestT)
+               bestT = t;
+         }
+      }
+
+      const bool hit = bestT <= 1.0f;
+      if (loopHits[i] != hit || hits[i] != hit ||
+          (hit && (mFabs(loopInfos[i].t - bestT) > 1e-4f || mFabs(rayInfos[i].t - bestT) > 1e-4f)))
+         numMismatched++;
+   }
+   checkBenchResult(numMismatched == 0, "collision", "ray hits don't match testing every triangle");
+
+   delete inst;
+   delete shape;
+}
+
+//-----------------------------------------------------------------------------
+// Imposters
+
+static const U32 sFarFieldSize = 4096;
+
+/// Counts draw calls instead of drawing
+class BenchImposterRenderer : public TSImposterRenderer
+{
+public:
+   U32 numDraws;
+   U32 numImposters;
+
+   BenchImposterRenderer() : numDraws(0), numImposters(0) {}
+
+   virtual void doRenderImposters(TSImposterBatch *batch, TSRenderState *renderState)
+   {
+      numDraws++;
+      numImposters += batch->count;
+   }
+};
+
+static void benchImposters(U32 iterations)
+{
+   printf("imposters (%u iterations)\n", iterations);
+
+   const String soldierPath = GetBenchAssetPath("soldier_rigged.cached.dts");
+   const String cubePath = GetBenchAssetPath("cube.dae");
+   TSShape *soldier = TSShape::createFromPath(soldierPath);
+   TSShape *cube = TSShape::createFromPath(cubePath);
+   if (!soldier || !cube)
+   {
+      Log::errorf("Couldn't load cube.dae and soldier_rigged.cached.dts from %s", sDataDir);
+      delete soldier;
+      delete cube;
+      return;
+   }
+
+   // 8 images around the equator and on 2 rings either side, plus the poles
+   TSLastDetail *soldierDetail = new TSLastDetail(soldier, soldierPath, 8, 2, 30.0f, true, 0, 64);
+
+   Vector<F64> times[3];
+   for (U32 k=0; k<iterations; k++)
+   {
+      // Only this shape's detail exists so far
+      F64 start = getTimeUS();
+      soldierDetail->update(true);
+      times[0].push_back(getTimeUS() - start);
+
+      start = getTimeUS();
+      TSLastDetail::updateImposterImages(true);
+      times[1].push_back(getTimeUS() - start);
+   }
+
+   TSLastDetail *cubeDetail = new TSLastDetail(cube, cubePath, 8, 2, 30.0f, true, 0, 64);
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      F64 start = getTimeUS();
+      TSLastDetail::updateImposterImages(true);
+      times[2].push_back(getTimeUS() - start);
+   }
+
+   // A far field of both shapes, drawn as imposters
+   Vector<MatrixF> transforms;
+   MRandomLCG rand(1);
+   for (U32 i=0; i<sFarFieldSize; i++)
+   {
+      transforms.increment();
+      transforms.last().set(EulerF(0, 0, rand.randF(0, M_2PI_F)));
+      transforms.last().setPosition(Point3F(rand.randF(-2000, 2000), rand.randF(-2000, 2000), 0));
+   }
+
+   TSRenderState renderState;
+   BenchImposterRenderer imposterRenderer;
+   renderState.setImposterRenderer(&imposterRenderer);
+
+   Vector<F64> farFieldTimes;
+   for (U32 k=0; k<iterations * 100; k++)
+   {
+      imposterRenderer.numDraws = imposterRenderer.numImposters = 0;
+
+      F64 start = getTimeUS();
+      renderState.reset();
+      for (U32 i=0; i<sFarFieldSize; i++)
+      {
+         renderState.setInstanceTransform(&transforms[i]);
+         (i & 1 ? cubeDetail : soldierDetail)->render(renderState, 1.0f);
+      }
+      renderState.sortRenderInsts();
+      for (U32 i=0; i<renderState.mImposterBatches.size(); i++)
+         renderState.mImposterBatches[i].render(&renderState);
+      farFieldTimes.push_back(getTimeUS() - start);
+   }
+
+   addBenchResult("imposters", "update", times[0]);
+   addBenchResult("imposters", "pool tiles", times[1]);
+   addBenchResult("imposters", "pool shapes", times[2]);
+   printf("  %-12s median %10.2f us  mean %10.2f us\n", "update", getMedian(times[0]), getMean(times[0]));
+   printf("  %-12s median %10.2f us  mean %10.2f us  (%u threads)\n", "pool tiles", getMedian(times[1]), getMean(times[1]), ThreadPool::getGlobal().getNumWorkers());
+   printf("  %-12s median %10.2f us  mean %10.2f us  (2 shapes)\n", "pool shapes", getMedian(times[2]), getMean(times[2]));
+   addBenchResult("imposters", "far field", farFieldTimes);
+   printf("  %-12s median %10.2f us  mean %10.2f us  (%u imposters, %u draws)\n", "far field", getMedian(farFieldTimes), getMean(farFieldTimes), imposterRenderer.numImposters, imposterRenderer.numDraws);
+
+   soldierDetail->deleteImposterCacheTextures();
+   cubeDetail->deleteImposterCacheTextures();
+   delete soldierDetail;
+   delete cubeDetail;
+   delete soldier;
+   delete cube;
+}
+
+//-----------------------------------------------------------------------------
+// Broadphase
+
+static const U32 sBroadphaseProps = 10000;
+static const U32 sBroadphaseRays = 256;
+
+/// Culls and casts rays against a field of props through TSBroadphase,
+/// and by testing every prop.
+static void benchBroadphase(U32 iterations)
+{
+   printf("broadphase (%u props, %u iterations)\n", sBroadphaseProps, iterations);
+
+   TSShape *shape = loadBenchShape();
+   if (!shape)
+   {
+      Log::errorf("Couldn't load soldier_rigged.cached.dts from %s", sDataDir);
+      return;
+   }
+
+   // Every prop shares one posed instance
+   TSRenderState renderState;
+   TSShapeInstance *inst = new TSShapeInstance(shape, &renderState, false);
+   inst->setCurrentDetail(0);
+   inst->animate();
+
+   Vector<MatrixF> transforms;
+   MRandomLCG rand(1);
+   for (U32 i=0; i<sBroadphaseProps; i++)
+   {
+      transforms.increment();
+      transforms.last().set(EulerF(0, 0, rand.randF(0, M_2PI_F)));
+      transforms.last().setPosition(Point3F(rand.randF(-500, 500), rand.randF(-500, 500), 0));
+   }
+
+   // A camera in each corner of the field looking in
+   Frustum frustums[4];
+   for (U32 i=0; i<4; i++)
+   {
+      MatrixF cam(EulerF(0, 0, M_PI_F * 0.25f + M_HALFPI_F * i));
+      Point3F pos;
+      cam.getColumn(1, &pos);
+      cam.setPosition(pos * -700.0f + Point3F(0, 0, 2));
+      frustums[i].set(false, mDegToRad(60.0f), 800.0f / 600.0f, 0.1f, 600.0f, cam);
+   }
+
+   // Rays across the field at head height
+   Vector<Point3F> starts, ends;
+   for (U32 i=0; i<sBroadphaseRays; i++)
+   {
+      starts.push_back(Point3F(rand.randF(-500, 500), rand.randF(-500, 500), 1.5f));
+      ends.push_back(Point3F(rand.randF(-500, 500), rand.randF(-500, 500), rand.randF(0.0f, 1.5f)));
+   }
+
+   TSBroadphase broadphase;
+   Vector<S32> proxies;
+   proxies.setSize(sBroadphaseProps);
+   Vector<F64> times[7];
+   Vector<S32> visible[4];
+   Vector<S32> loopVisible[4];
+   Vector<F32> loopT, treeT;
+   loopT.setSize(sBroadphaseRays);
+   treeT.setSize(sBroadphaseRays);
+   U32 numVisible[2] = { 0, 0 };
+   U32 numHits[2] = { 0, 0 };
+   U32 numReinserted = 0;
+   RayInfo rayInfo;
+   RayInfo bestInfo;
+
+   for (U32 k=0; k<iterations; k++)
+   {
+      broadphase.clear();
+      F64 start = getTimeUS();
+      for (U32 i=0; i<sBroadphaseProps; i++)
+         proxies[i] = broadphase.createProxy(inst, transforms[i]);
+      times[0].push_back(getTimeUS() - start);
+
+      // Nudge a tenth of the props
+      start = getTimeUS();
+      numReinserted = 0;
+      for (U32 i=0; i<sBroadphaseProps; i+=10)
+      {
+         transforms[i].setPosition(transforms[i].getPosition() + Point3F(rand.randF(-0.2f, 0.2f), rand.randF(-0.2f, 0.2f), 0));
+         numReinserted += broadphase.updateProxy(proxies[i], transforms[i]);
+      }
+      times[1].push_back(getTimeUS() - start);
+
+      numVisible[0] = 0;
+      start = getTimeUS();
+      for (U32 f=0; f<4; f++)
+      {
+         loopVisible[f].clear();
+         for (U32 i=0; i<sBroadphaseProps; i++)
+         {
+            if (!frustums[f].isCulled(broadphase.getFatBounds(proxies[i])))
+               loopVisible[f].push_back(proxies[i]);
+         }
+         numVisible[0] += loopVisible[f].size();
+      }
+      times[2].push_back(getTimeUS() - start);
+
+      for (U32 f=0; f<4; f++)
+         visible[f].clear();
+      start = getTimeUS();
+      broadphase.queryFrustums(frustums, 4, visible);
+      times[3].push_back(getTimeUS() - start);
+      numVisible[1] = visible[0].size() + visible[1].size() + visible[2].size() + visible[3].size();
+
+      // Closest hit by testing the bounds of every prop
+      numHits[0] = 0;
+      start = getTimeUS();
+      for (U32 r=0; r<sBroadphaseRays; r++)
+      {
+         bestInfo.t = 2.0f;
+         for (U32 i=0; i<sBroadphaseProps; i++)
+         {
+            if (!broadphase.getFatBounds(proxies[i]).collideLine(starts[r], ends[r]))
+               continue;
+
+            MatrixF invMat = transforms[i];
+            invMat.inverse();
+            Point3F a, b;
+            invMat.mulP(starts[r], &a);
+            invMat.mulP(ends[r], &b);
+            if (inst->castRay(a, b, &rayInfo, 0) && rayInfo.t < bestInfo.t)
+               bestInfo = rayInfo;
+         }
+         numHits[0] += bestInfo.t <= 1.0f;
+         loopT[r] = bestInfo.t;
+      }
+      times[4].push_back(getTimeUS() - start);
+
+      numHits[1] = 0;
+      start = getTimeUS();
+      for (U32 r=0; r<sBroadphaseRays; r++)
+      {
+         const bool hit = broadphase.castRay(starts[r], ends[r], &rayInfo);
+         numHits[1] += hit;
+         treeT[r] = hit ? rayInfo.t : 2.0f;
+      }
+      times[5].push_back(getTimeUS() - start);
+
+      Vector<S32> results;
+      start = getTimeUS();
+      for (U32 r=0; r<sBroadphaseRays; r++)
+      {
+         results.clear();
+         broadphase.queryBox(Box3F(starts[r] - Point3F(5, 5, 5), starts[r] + Point3F(5, 5, 5)), results);
+      }
+      times[6].push_back(getTimeUS() - start);
+   }
+
+   // Every frustum sees the same props, and every ray hits the same point
+   U32 numMismatched = 0;
+   for (U32 f=0; f<4; f++)
+   {
+      dQsort(loopVisible[f].address(), loopVisible[f].size(), sizeof(S32), compareS32);
+      dQsort(visible[f].address(), visible[f].size(), sizeof(S32), compareS32);
+      numMismatched += loopVisible[f].size() != visible[f].size() ||
+                       dMemcmp(loopVisible[f].address(), visible[f].address(), visible[f].size() * sizeof(S32)) != 0;
+   }
+   for (U32 r=0; r<sBroadphaseRays; r++)
+      numMismatched += (loopT[r] <= 1.0f) != (treeT[r] <= 1.0f) || (loopT[r] <= 1.0f && mFabs(loopT[r] - treeT[r]) > 1e-5f);
+
+   addBenchResult("broadphase", "build", times[0]);
+   addBenchResult("broadphase", "update", times[1]);
+   addBenchResult("broadphase", "cull loop", times[2]);
+   addBenchResult("broadphase", "cull tree", times[3]);
+   addBenchResult("broadphase", "ray loop", times[4]);
+   addBenchResult("broadphase", "ray tree", times[5]);
+   addBenchResult("broadphase", "box tree", times[6]);
+   printf("  %-10s median %10.2f us  mean %10.2f us  (height %d)\n", "build", getMedian(times[0]), getMean(times[0]), broadphase.getHeight());
+   printf("  %-10s median %10.2f us  mean %10.2f us  (%u reinserted)\n", "update", getMedian(times[1]), getMean(times[1]), numReinserted);
+   printf("  %-10s median %10.2f us  mean %10.2f us  (%u visible in 4 frustums)\n", "cull loop", getMedian(times[2]), getMean(times[2]), numVisible[0]);
+   printf("  %-10s median %10.2f us  mean %10.2f us  (%u visible in 4 frustums)\n", "cull tree", getMedian(times[3]), getMean(times[3]), numVisible[1]);
+   printf("  %-10s median %10.2f us  mean %10.2f us  (%u hits)\n", "ray loop", getMedian(times[4]), getMean(times[4]), numHits[0]);
+   printf("  %-10s median %10.2f us  mean %10.2f us  (%u hits)\n", "ray tree", getMedian(times[5]), getMean(times[5]), numHits[1]);
+   printf("  %-10s median %10.2f us  mean %10.2f us\n", "box tree", getMedian(times[6]), getMean(times[6]));
+   checkBenchResult(numMismatched == 0, "broadphase", "results don't match testing every prop");
+
+   delete inst;
+   delete shape;
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+   const char *jsonFile = NULL;
+   const char *traceFile = NULL;
+   U32 iterations = 1000;
+   U32 numArgs = 0;
+
+   for (S32 i=1; i<argc; i++)
+   {
+      if (!dStrcmp(argv[i], "--json") && i + 1 < argc)
+         jsonFile = argv[++i];
+      else if (!dStrcmp(argv[i], "--trace") && i + 1 < argc)
+         traceFile = argv[++i];
+      else if (numArgs++ == 0)
+         sDataDir = argv[i];
+      else
+         iterations = atoi(argv[i]);
+   }
+
+   if (iterations == 0)
+      iterations = 1;
+
+   DTShapeInit::init();
+   Log::addConsumer(OnBenchLog);
+
+#ifdef LIBDTSHAPE_ENABLE_PROFILER
+   if (traceFile && gProfiler)
+   {
+      gProfiler->enable(true);
+      gProfiler->startTraceCapture();
+   }
+#else
+   if (traceFile)
+      Log::warnf("--trace needs a build with LIBDTSHAPE_ENABLE_PROFILER");
+#endif
+
+   checkIntegerSet(iterations);
+   benchSkinning(iterations);
+   benchAnimation(iterations);
+   benchBlendAnimation(iterations);
+   benchNameLookup(iterations);
+   benchLoading(getMax(iterations / 10, 1U));
+   benchLoadService(getMax(iterations / 100, 1U));
+   benchCrowd(iterations, true);
+   benchCrowd(iterations, false);
+   benchIdleCrowd(iterations);
+   benchCompression(getMax(iterations / 10, 1U));
+   benchStreaming(iterations);
+   benchBlob(getMax(iterations / 10, 1U));
+   benchPacking(getMax(iterations / 100, 1U));
+   benchMeshOptimize(getMax(iterations / 100, 1U));
+   benchDetailSelection(getMax(iterations / 10, 1U));
+   benchRenderQueue(getMax(iterations / 10, 1U));
+   benchCollision(getMax(iterations / 10, 1U));
+   benchImposters(getMax(iterations / 100, 1U));
+   benchBroadphase(getMax(iterations / 100, 1U));
+
+#ifdef LIBDTSHAPE_ENABLE_PROFILER
+   if (traceFile && gProfiler)
+   {
+      sShowLog = true;
+      gProfiler->dumpThreadSummary();
+      gProfiler->writeChromeTrace(traceFile);
+      gProfiler->enable(false);
+      sShowLog = false;
+   }
+#endif
+
+   if (jsonFile && writeBenchResults(jsonFile, iterations))
+      printf("wrote %u results to %s\n", sBenchResults.size(), jsonFile);
+
+   if (sNumFailedChecks)
+      printf("%u result checks FAILED\n", sNumFailedChecks);
+
+   Log::removeConsumer(OnBenchLog);
+   DTShapeInit::shutdown();
+   return sNumFailedChecks ? 1 : 0;
+}
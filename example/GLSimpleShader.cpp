@@ -38,17 +38,31 @@ uniform mat4 worldMatrixProjection;\n\
 uniform mat4 worldMatrix;\n\
 uniform vec3 lightPos;\n\
 uniform vec3 lightColor;\n\
+uniform vec3 positionScale;\n\
+uniform vec3 positionBias;\n\
+uniform float packedNormals;\n\
 \n\
 varying vec2 vTexCoord0;\n\
 varying vec4 vColor0;\n\
 \n\
+vec3 decodeOctNormal(vec2 e)\n\
+{\n\
+vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));\n\
+if (n.z < 0.0)\n\
+   n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n\
+return normalize(n);\n\
+}\n\
+\n\
 void main()\n\
 {\n\
 vec3 normal, lightDir;\n\
 vec4 diffuse;\n\
 float NdotL;\n\
 \n\
-normal = normalize(mat3(worldMatrix) * aNormal);\n\
+vec3 inNormal = packedNormals > 0.5 ? decodeOctNormal(aNormal.xy) : aNormal;\n\
+vec4 inPosition = vec4(aPosition.xyz * positionScale + positionBias, 1.0);\n\
+\n\
+normal = normalize(mat3(worldMatrix) * inNormal);\n\
 \n\
 lightDir = normalize(vec3(lightPos));\n\
 \n\
@@ -56,7 +70,7 @@ NdotL = max(dot(normal, lightDir), 0.0);\n\
 \n\
 diffuse = vec4(lightColor, 1.0);\n\
 \n\
-gl_Position = worldMatrixProjection * aPosition;\n\
+gl_Position = worldMatrixProjection * inPosition;\n\
 vTexCoord0 = aTexCoord0;\n\
 vColor0 = NdotL * diffuse;\n\
 vColor0.a = 1.0;\n\
@@ -126,17 +140,31 @@ uniform mat4 worldMatrixProjection;\n\
 uniform mat4 worldMatrix;\n\
 uniform vec3 lightPos;\n\
 uniform vec3 lightColor;\n\
+uniform vec3 positionScale;\n\
+uniform vec3 positionBias;\n\
+uniform float packedNormals;\n\
 \n\
 varying vec2 vTexCoord0;\n\
 varying vec4 vColor0;\n\
 \n\
+vec3 decodeOctNormal(vec2 e)\n\
+{\n\
+vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));\n\
+if (n.z < 0.0)\n\
+   n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n\
+return normalize(n);\n\
+}\n\
+\n\
 void main()\n\
 {\n\
 vec3 normal, lightDir;\n\
 vec4 diffuse;\n\
 float NdotL;\n\
 \n\
-normal = normalize(mat3(worldMatrix) * aNormal);\n\
+vec3 inNormal = packedNormals > 0.5 ? decodeOctNormal(aNormal.xy) : aNormal;\n\
+vec4 inPosition = vec4(aPosition.xyz * positionScale + positionBias, 1.0);\n\
+\n\
+normal = normalize(mat3(worldMatrix) * inNormal);\n\
 \n\
 lightDir = normalize(vec3(lightPos));\n\
 \n\
@@ -144,7 +172,7 @@ NdotL = max(dot(normal, lightDir), 0.0);\n\
 \n\
 diffuse = vec4(lightColor, 1.0);\n\
 \n\
-gl_Position = worldMatrixProjection * aPosition;\n\
+gl_Position = worldMatrixProjection * inPosition;\n\
 vTexCoord0 = aTexCoord0;\n\
 vColor0 = NdotL * diffuse;\n\
 vColor0.a = 1.0;\n\
@@ -238,6 +266,8 @@ mModelViewMatrix(1)
   
   dMemset(mLightPos, '\0', sizeof(mLightPos));
   dMemset(mLightColor, '\0', sizeof(mLightColor));
+  
+  setPackedVertices(Point3F(1,1,1), Point3F(0,0,0), false);
 }
 
 GLSimpleShader::~GLSimpleShader()
@@ -293,6 +323,9 @@ GLuint GLSimpleShader::linkProgram(GLuint *shaders)
   mUniforms[3] = glGetUniformLocation(program, "lightColor");
   mUniforms[4] = glGetUniformLocation(program, "sampler");
   mUniforms[5] = glGetUniformLocation(program, "boneTransforms");
+  mUniforms[6] = glGetUniformLocation(program, "positionScale");
+  mUniforms[7] = glGetUniformLocation(program, "positionBias");
+  mUniforms[8] = glGetUniformLocation(program, "packedNormals");
   
   return program;
 }
@@ -351,6 +384,17 @@ void GLSimpleShader::setModelViewMatrix(MatrixF &modelview)
   mModelViewMatrix = modelview;
 }
 
+void GLSimpleShader::setPackedVertices(const Point3F &posScale, const Point3F &posBias, bool packedNormals)
+{
+  mPositionScale[0] = posScale.x;
+  mPositionScale[1] = posScale.y;
+  mPositionScale[2] = posScale.z;
+  mPositionBias[0] = posBias.x;
+  mPositionBias[1] = posBias.y;
+  mPositionBias[2] = posBias.z;
+  mPackedNormals = packedNormals ? 1.0f : 0.0f;
+}
+
 void GLSimpleShader::updateBoneTransforms(U32 numTransforms, MatrixF *transformList)
 {
   glUniformMatrix4fv(mUniforms[kGLSimpleUniformBoneTransforms], numTransforms, GL_TRUE, (F32*)transformList);
@@ -367,5 +411,9 @@ void GLSimpleShader::updateTransforms()
   
   glUniform3fv(mUniforms[kGLSimpleUniformLightColor], 1, mLightColor);
   glUniform3fv(mUniforms[kGLSimpleUniformLightPos], 1, mLightPos);
+  
+  glUniform3fv(mUniforms[kGLSimpleUniformPositionScale], 1, mPositionScale);
+  glUniform3fv(mUniforms[kGLSimpleUniformPositionBias], 1, mPositionBias);
+  glUniform1f(mUniforms[kGLSimpleUniformPackedNormals], mPackedNormals);
 }
 
@@ -69,6 +69,10 @@ enum {
 
    kGLSimpleUniformBoneTransforms,
    
+   kGLSimpleUniformPositionScale,
+   kGLSimpleUniformPositionBias,
+   kGLSimpleUniformPackedNormals,
+   
    kGLSimpleUniform_MAX,
 };
 
@@ -176,6 +180,8 @@ public:
    void setProjectionMatrix(MatrixF &proj);
    void setModelViewMatrix(MatrixF &modelview);
    
+   void setPackedVertices(const Point3F &posScale, const Point3F &posBias, bool packedNormals);
+   
    void updateBoneTransforms(U32 numTransforms, MatrixF *transformList);
    void updateTransforms();
    
@@ -185,6 +191,10 @@ public:
    F32 mLightPos[3];
    F32 mLightColor[3];
    
+   F32 mPositionScale[3];
+   F32 mPositionBias[3];
+   F32 mPackedNormals;
+   
    GLuint            mProgram;
    GLint             mUniforms[kGLSimpleUniform_MAX];
 
@@ -29,6 +29,33 @@
 static GLenum drawTypes[] = { GL_TRIANGLES, GL_TRIANGLE_STRIP, GL_TRIANGLE_FAN };
 #define getDrawType(a) (drawTypes[a])
 
+#ifdef HAVE_OPENGLES2
+#define GL_HALF_FLOAT_TYPE GL_HALF_FLOAT_OES // requires OES_vertex_half_float
+#else
+#define GL_HALF_FLOAT_TYPE GL_HALF_FLOAT
+#endif
+
+// GL attribute layout of each vertex element type
+struct GLDeclType
+{
+   GLint size;
+   GLenum type;
+   GLboolean normalized;
+};
+
+static const GLDeclType glDeclTypes[GFXDeclType_COUNT] = {
+   { 1, GL_FLOAT, GL_FALSE },               // GFXDeclType_Float
+   { 2, GL_FLOAT, GL_FALSE },               // GFXDeclType_Float2
+   { 3, GL_FLOAT, GL_FALSE },               // GFXDeclType_Float3
+   { 4, GL_FLOAT, GL_FALSE },               // GFXDeclType_Float4
+   { 4, GL_UNSIGNED_BYTE, GL_TRUE },        // GFXDeclType_Color
+   { 4, GL_UNSIGNED_BYTE, GL_FALSE },       // GFXDeclType_UByte4
+   { 2, GL_HALF_FLOAT_TYPE, GL_FALSE },     // GFXDeclType_Half2
+   { 2, GL_SHORT, GL_TRUE },                // GFXDeclType_Short2N
+   { 4, GL_SHORT, GL_TRUE },                // GFXDeclType_Short4N
+};
+#define getDeclType(a) (glDeclTypes[a])
+
 extern GLStateTracker gGLStateTracker;
 
 GLTSMeshRenderer::GLTSMeshRenderer() : mPB(0), mNumIndices(0)
@@ -60,6 +87,10 @@ void GLTSMeshRenderer::prepare(TSMesh *mesh, TSMeshInstanceRenderData *meshRende
   U32 size;
   GLTSMeshInstanceRenderData *renderData = (GLTSMeshInstanceRenderData*)meshRenderData;
   
+  // Upload the packed vertices if the mesh has them
+  const GFXVertexFormat *fmt = mesh->hasPackedVertexData() ? mesh->mPackedVertexFormat : mesh->mVertexFormat;
+  const void *vertexData = mesh->hasPackedVertexData() ? (const void*)mesh->mPackedVertexData.address() : (const void*)mesh->mVertexData.address();
+  
   // Update vertex buffer
   // (NOTE: if we're a Skin mesh and want to save a copy, we can also use mapVerts)
   if (renderData)
@@ -68,7 +99,7 @@ void GLTSMeshRenderer::prepare(TSMesh *mesh, TSMeshInstanceRenderData *meshRende
      if (renderData->mVB == 0 || renderData->mNumVerts != mesh->mNumVerts)
      {
         renderData->mNumVerts = mesh->mNumVerts;
-        size = mesh->mVertexFormat->getSizeInBytes() * renderData->mNumVerts;
+        size = fmt->getSizeInBytes() * renderData->mNumVerts;
         
         // Load vertices
         if (renderData->mVB == 0)
@@ -86,13 +117,13 @@ void GLTSMeshRenderer::prepare(TSMesh *mesh, TSMeshInstanceRenderData *meshRende
           return;
         }
         glBindBuffer(GL_ARRAY_BUFFER, renderData->mVB);
-        size = mesh->mVertexFormat->getSizeInBytes() * renderData->mNumVerts;
+        size = fmt->getSizeInBytes() * renderData->mNumVerts;
      }
      
      // Now, load the transformed vertices straight from mVertexData
      char *vertexPtr = (char*)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
      
-     dMemcpy( vertexPtr, mesh->mVertexData.address(), size );
+     dMemcpy( vertexPtr, vertexData, size );
      
      glUnmapBuffer(GL_ARRAY_BUFFER);
      glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -145,13 +176,14 @@ void GLTSMeshRenderer::bindArrays(const GFXVertexFormat *fmt)
   for ( U32 i=0; i < fmt->getElementCount(); i++ )
   {
      const GFXVertexElement &element = fmt->getElement( i );
+     const GLDeclType &decl = getDeclType( element.getType() );
      
      if ( element.isSemantic( GFXSemantic::POSITION ) )
      {
         attribs |= kGLSimpleVertexAttribFlag_Position;
         if (!hasPos)
         {
-           glVertexAttribPointer(kGLSimpleVertexAttrib_Position, element.getSizeInBytes() / 4, GL_FLOAT, GL_FALSE, stride, buffer );
+           glVertexAttribPointer(kGLSimpleVertexAttrib_Position, decl.size, decl.type, decl.normalized, stride, buffer );
            hasPos = true;
         }
         buffer += element.getSizeInBytes();
@@ -161,7 +193,7 @@ void GLTSMeshRenderer::bindArrays(const GFXVertexFormat *fmt)
         attribs |= kGLSimpleVertexAttribFlag_Normal;
         if (!hasNormal)
         {
-           glVertexAttribPointer(kGLSimpleVertexAttrib_Normal, element.getSizeInBytes() / 4, GL_FLOAT, GL_TRUE, stride, buffer );
+           glVertexAttribPointer(kGLSimpleVertexAttrib_Normal, decl.size, decl.type, GL_TRUE, stride, buffer );
            hasNormal = true;
         }
         buffer += element.getSizeInBytes();
@@ -171,7 +203,7 @@ void GLTSMeshRenderer::bindArrays(const GFXVertexFormat *fmt)
         attribs |= kGLSimpleVertexAttribFlag_Color;
         if (!hasColor)
         {
-           glVertexAttribPointer(kGLSimpleVertexAttrib_Color, element.getSizeInBytes(), GL_UNSIGNED_BYTE, GL_TRUE, stride, buffer );
+           glVertexAttribPointer(kGLSimpleVertexAttrib_Color, decl.size, decl.type, decl.normalized, stride, buffer );
            hasColor = true;
         }
         buffer += element.getSizeInBytes();
@@ -181,7 +213,7 @@ void GLTSMeshRenderer::bindArrays(const GFXVertexFormat *fmt)
         attribs |= kGLSimpleVertexAttribFlag_BlendIndices;
         if (!hasBlendIndices)
         {
-           glVertexAttribPointer(kGLSimpleVertexAttrib_BlendIndices, element.getSizeInBytes(), GL_UNSIGNED_BYTE, GL_FALSE, stride, buffer );
+           glVertexAttribPointer(kGLSimpleVertexAttrib_BlendIndices, decl.size, decl.type, decl.normalized, stride, buffer );
            hasBlendIndices = true;
         }
         buffer += element.getSizeInBytes();
@@ -191,17 +223,17 @@ void GLTSMeshRenderer::bindArrays(const GFXVertexFormat *fmt)
         attribs |= kGLSimpleVertexAttribFlag_BlendWeights;
         if (!hasBlendWeights)
         {
-           glVertexAttribPointer(kGLSimpleVertexAttrib_BlendWeights, element.getSizeInBytes() / 4, GL_FLOAT, GL_FALSE, stride, buffer );
+           glVertexAttribPointer(kGLSimpleVertexAttrib_BlendWeights, decl.size, decl.type, decl.normalized, stride, buffer );
            hasBlendWeights = true;
         }
         buffer += element.getSizeInBytes();
      }
      else // Everything else is a texture coordinate.
      {
-        if (!hasTexcoord && (element.getSizeInBytes() / 4) == 2)
+        if (!hasTexcoord && decl.size == 2 && element.isSemantic( GFXSemantic::TEXCOORD ))
         {
            attribs |= kGLSimpleVertexAttribFlag_TexCoords;
-           glVertexAttribPointer(kGLSimpleVertexAttrib_TexCoords, element.getSizeInBytes() / 4, GL_FLOAT, GL_FALSE, stride, buffer);
+           glVertexAttribPointer(kGLSimpleVertexAttrib_TexCoords, decl.size, decl.type, decl.normalized, stride, buffer);
            hasTexcoord = true;
         }
         buffer += element.getSizeInBytes();
@@ -228,7 +260,15 @@ void GLTSMeshRenderer::doRenderInst(TSMesh *mesh, TSRenderInst *inst, TSRenderSt
 {
   //Platform::outputDebugString("[TSM:%x:%x]Rendering with material %s", this, inst->renderData, inst->matInst ? inst->matInst->getName() : "NIL");
   
-  ((GLTSMaterialInstance*)inst->matInst)->activate((GLTSSceneRenderState*)renderState->getSceneState(), inst);
+  GLTSMaterialInstance *matInst = (GLTSMaterialInstance*)inst->matInst;
+  
+  // Packed positions are relative to the mesh bounds, and normals octahedral
+  if (mesh->hasPackedVertexData())
+     matInst->mShader->setPackedVertices(mesh->mPackedPosScale, mesh->mPackedPosBias, true);
+  else
+     matInst->mShader->setPackedVertices(Point3F(1,1,1), Point3F(0,0,0), false);
+  
+  matInst->activate((GLTSSceneRenderState*)renderState->getSceneState(), inst);
   
   S32 matIdx = -1;
   
@@ -237,7 +277,8 @@ void GLTSMeshRenderer::doRenderInst(TSMesh *mesh, TSRenderInst *inst, TSRenderSt
   glBindBuffer(GL_ARRAY_BUFFER, renderData->mVB);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mPB);
   
-  bindArrays(mesh->mVertexFormat);
+  const GFXVertexFormat *fmt = mesh->hasPackedVertexData() ? mesh->mPackedVertexFormat : mesh->mVertexFormat;
+  bindArrays(fmt);
   GLenum __error = glGetError();
   
   // basically, go through primitives & draw
@@ -257,7 +298,7 @@ void GLTSMeshRenderer::doRenderInst(TSMesh *mesh, TSRenderInst *inst, TSRenderSt
      glDrawElements(getDrawType(prim.matIndex >> 30), prim.numElements, GL_UNSIGNED_SHORT, ptr+prim.start);
   }
   
-  unbindArrays(mesh->mVertexFormat);
+  unbindArrays(fmt);
   
   // unbind
   glBindBuffer(GL_ARRAY_BUFFER, 0);
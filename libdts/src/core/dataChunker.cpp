@@ -98,4 +98,100 @@ void DataChunker::freeBlocks(bool keepOne)
       mCurBlock->curIndex = 0;
 }
 
+//----------------------------------------------------------------------------
+
+FrameChunker::FrameChunker(U32 size)
+{
+   AssertFatal(sizeof(Block) <= MaxAlign, "FrameChunker - block header overlaps the block data");
+
+   mFirstBlock    = NULL;
+   mCurBlock      = NULL;
+   mCurIndex      = 0;
+   mChunkSize     = size;
+   mBytesUsed     = 0;
+   mNumHeapAllocs = 0;
+   mBytesReserved = 0;
+}
+
+FrameChunker::~FrameChunker()
+{
+   freeBlocks();
+}
+
+void *FrameChunker::alloc(U32 size, U32 align)
+{
+   AssertFatal(isPow2(align) && align <= MaxAlign, "FrameChunker::alloc - alignment must be a power of two no larger than MaxAlign");
+
+   for (;;)
+   {
+      if (mCurBlock)
+      {
+         const U32 start = (mCurIndex + align - 1) & ~(align - 1);
+         const U32 end = start + size;
+
+         if (end <= mCurBlock->size)
+         {
+            mBytesUsed += end - mCurIndex;
+            mCurIndex = end;
+            return mCurBlock->getData() + start;
+         }
+
+         // Move on to the next block if it's big enough, so the blocks get
+         // used in the same order each frame
+         Block *next = mCurBlock->next;
+         if (next && next->size >= size)
+         {
+            mBytesUsed += mCurBlock->size - mCurIndex;
+            mCurBlock = next;
+            mCurIndex = 0;
+            continue;
+         }
+      }
+
+      // Add a block after the current one
+      const U32 blockSize = getMax(mChunkSize, size);
+      Block *block = (Block*)dMalloc_aligned(MaxAlign + blockSize, MaxAlign);
+      block->size = blockSize;
+
+      if (mCurBlock)
+      {
+         mBytesUsed += mCurBlock->size - mCurIndex;
+         block->next = mCurBlock->next;
+         mCurBlock->next = block;
+      }
+      else
+      {
+         block->next = mFirstBlock;
+         mFirstBlock = block;
+      }
+
+      mCurBlock = block;
+      mCurIndex = 0;
+      mNumHeapAllocs++;
+      mBytesReserved += blockSize;
+   }
+}
+
+void FrameChunker::reset()
+{
+   mCurBlock = mFirstBlock;
+   mCurIndex = 0;
+   mBytesUsed = 0;
+   mNumHeapAllocs = 0;
+}
+
+void FrameChunker::freeBlocks()
+{
+   while (mFirstBlock)
+   {
+      Block *next = mFirstBlock->next;
+      dFree_aligned(mFirstBlock);
+      mFirstBlock = next;
+   }
+
+   mCurBlock = NULL;
+   reset();
+   mBytesReserved = 0;
+}
+
 END_NS
@@ -299,6 +299,69 @@ private:
    void        *mFreeListHead;
 };
 
+//----------------------------------------------------------------------------
+
+/// Chunked allocator for data which only lives for a frame.
+///
+/// Unlike DataChunker, reset() keeps every block and takes constant time, so
+/// once the chunker has grown to the size of a frame it stops going to the
+/// heap. Allocations can be aligned to any power of two, e.g. a cache line.
+class FrameChunker
+{
+public:
+   enum
+   {
+      ChunkSize = 16384, ///< Default size of each block
+      MaxAlign = 64      ///< Largest alignment alloc() supports
+   };
+
+   FrameChunker(U32 size = ChunkSize);
+   ~FrameChunker();
+
+   /// Returns memory which stays valid until the next reset().  align must
+   /// be a power of two no larger than MaxAlign.
+   void *alloc(U32 size, U32 align = 16);
+
+   /// Use like so:  MyType* t = chunker.alloc<MyType>();
+   template<typename T>
+   T* alloc(U32 align = 16)  { return reinterpret_cast<T*>(alloc(U32(sizeof(T)), align)); }
+
+   /// Makes every block available again, keeping them allocated
+   void reset();
+
+   /// Frees every block
+   void freeBlocks();
+
+   /// Bytes handed out since the last reset(), including alignment
+   U32 getBytesUsed() const { return mBytesUsed; }
+
+   /// Blocks allocated from the heap since the last reset()
+   U32 getNumHeapAllocs() const { return mNumHeapAllocs; }
+
+   /// Total size of every block
+   U32 getBytesReserved() const { return mBytesReserved; }
+
+private:
+   /// Blocks are allocated MaxAlign aligned and their data starts MaxAlign
+   /// bytes in, so an aligned offset into the data is an aligned pointer
+   struct Block
+   {
+      Block *next;
+      U32   size;
+
+      U8 *getData() { return reinterpret_cast<U8*>(this) + MaxAlign; }
+   };
+
+   Block *mFirstBlock;
+   Block *mCurBlock;
+   U32   mCurIndex;     ///< Next free byte in mCurBlock
+   U32   mChunkSize;
+
+   U32   mBytesUsed;
+   U32   mNumHeapAllocs;
+   U32   mBytesReserved;
+};
+
 END_NS
 
 #endif
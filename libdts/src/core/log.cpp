@@ -28,6 +28,9 @@
 
 #include "core/strings/stringFunctions.h"
 #include "core/util/tVector.h"
+#include "platform/threads/mutex.h"
+#include "platform/threads/thread.h"
+#include "platform/platformIntrinsics.h"
 
 //-----------------------------------------------------------------------------
 
@@ -42,6 +45,11 @@ namespace Log {
 static bool active = false;
 static bool useTimestamp = false;
 
+// Serializes output from loader and worker threads. printingThread is only
+// written under printMutex, but read before taking it, so it is atomic.
+static Mutex printMutex;
+static volatile U32 printingThread = 0;
+
 void init()
 {
    AssertFatal(active == false, "Log::init should only be called once.");
@@ -64,7 +72,14 @@ static void _printf(LogEntry::Level level, LogEntry::Type type, const char* fmt,
 {
    if (!active)
 	   return;
-   Log::active = false;
+
+   // Ignore anything logged by the consumers themselves
+   const U32 threadId = Thread::getCurrentThreadId();
+   if (dAtomicRead(printingThread) == threadId)
+      return;
+
+   MutexHandle handle(printMutex);
+   dCompareAndSwap(printingThread, 0, threadId);
    
    char buffer[8192];
    U32 offset = 0;
@@ -84,7 +99,7 @@ static void _printf(LogEntry::Level level, LogEntry::Type type, const char* fmt,
    for(S32 i = 0; i < gConsumers.size(); i++)
       gConsumers[i](level, &entry);
    
-   Log::active = true;
+   dCompareAndSwap(printingThread, threadId, 0);
 }
 
 //------------------------------------------------------------------------------
@@ -0,0 +1,92 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "core/util/radixSort.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+void dRadixSort64( U64 *keys, U32 *values, const U32 count, U64 *tmpKeys, U32 *tmpValues )
+{
+   if ( count < 2 )
+      return;
+
+   // Count every byte of every key in one go
+   U32 histogram[8][256];
+   dMemset( histogram, 0, sizeof( histogram ) );
+
+   for ( U32 i = 0; i < count; i++ )
+   {
+      U64 key = keys[i];
+      for ( U32 b = 0; b < 8; b++, key >>= 8 )
+         histogram[b][key & 0xFF]++;
+   }
+
+   U64 *srcKeys = keys;
+   U32 *srcValues = values;
+   U64 *dstKeys = tmpKeys;
+   U32 *dstValues = tmpValues;
+
+   for ( U32 b = 0; b < 8; b++ )
+   {
+      U32 *counts = histogram[b];
+      const U32 shift = b * 8;
+
+      // Nothing to do if every key has the same byte here
+      if ( counts[( srcKeys[0] >> shift ) & 0xFF] == count )
+         continue;
+
+      U32 offset = 0;
+      for ( U32 i = 0; i < 256; i++ )
+      {
+         const U32 num = counts[i];
+         counts[i] = offset;
+         offset += num;
+      }
+
+      for ( U32 i = 0; i < count; i++ )
+      {
+         const U32 dst = counts[( srcKeys[i] >> shift ) & 0xFF]++;
+         dstKeys[dst] = srcKeys[i];
+         dstValues[dst] = srcValues[i];
+      }
+
+      U64 *swapKeys = srcKeys;
+      srcKeys = dstKeys;
+      dstKeys = swapKeys;
+
+      U32 *swapValues = srcValues;
+      srcValues = dstValues;
+      dstValues = swapValues;
+   }
+
+   if ( srcKeys != keys )
+   {
+      dMemcpy( keys, srcKeys, count * sizeof( U64 ) );
+      dMemcpy( values, srcValues, count * sizeof( U32 ) );
+   }
+}
+
+END_NS
@@ -0,0 +1,51 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _RADIXSORT_H_
+#define _RADIXSORT_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+/// Sorts 'count' 64-bit keys into ascending order, moving each value along
+/// with its key. Keys which are equal keep their order.
+///
+/// Works a byte at a time from the lowest byte, skipping bytes which are the
+/// same in every key, so keys which only use their upper bits cost no more
+/// than 32-bit keys.
+///
+/// @param keys      Keys to sort, sorted in place
+/// @param values    Value for each key, moved in place
+/// @param count     Number of keys
+/// @param tmpKeys   Workspace of 'count' keys
+/// @param tmpValues Workspace of 'count' values
+void dRadixSort64( U64 *keys, U32 *values, const U32 count, U64 *tmpKeys, U32 *tmpValues );
+
+END_NS
+
+#endif // _RADIXSORT_H_
@@ -32,6 +32,20 @@ BEGIN_NS(DTShape)
 namespace TriListOpt
 {
 
+namespace
+{
+   struct VertData
+   {
+      S32 cachePosition;
+      F32 score;
+      U32 firstTri;  ///< Start of this vertex's triangles in the triangle list
+      U32 numTris;   ///< Triangles not yet emitted, which are kept at the front
+   };
+
+   // Vertices in the cache plus the (up to) three which push the oldest out
+   const U32 SizeCacheBuffer = MaxSizeVertexCache + 3;
+}
+
 void OptimizeTriangleOrdering(const dsize_t numVerts, const dsize_t numIndices, const U32 *indices, IndexType *outIndices)
 {
    PROFILE_SCOPE(TriListOpt_OptimizeTriangleOrdering);
@@ -43,308 +57,210 @@ void OptimizeTriangleOrdering(const dsize_t numVerts, const dsize_t numIndices,
    }
 
    const U32 NumPrimitives = numIndices / 3;
-   AssertFatal(NumPrimitives == U32(mFloor(numIndices / 3.0f)), "Number of indicies not divisible by 3, not a good triangle list.");
+   AssertFatal(NumPrimitives * 3 == numIndices, "Number of indicies not divisible by 3, not a good triangle list.");
 
    //
    // Step 1: Run through the data, and initialize
    //
-   TempAlloc<VertData> vertexData(numVerts);
-   TempAlloc<TriData> triangleData(NumPrimitives);
-
-   U32 curIdx = 0;
-   for(int tri = 0; tri < NumPrimitives; tri++)
+   // All working data lives in one block: the vertices, the triangles of each
+   // vertex, a copy of the input indices (so the output may overwrite them)
+   // and whether each triangle has been emitted.
+   const dsize_t vertBytes = numVerts * sizeof(VertData);
+   const dsize_t listBytes = numIndices * sizeof(U32);
+   TempAlloc<U8> scratch(vertBytes + listBytes * 2 + NumPrimitives);
+
+   VertData *vertexData = (VertData*)scratch.ptr;
+   U32 *triList = (U32*)(scratch.ptr + vertBytes);
+   U32 *triVerts = (U32*)(scratch.ptr + vertBytes + listBytes);
+   bool *triEmitted = (bool*)(scratch.ptr + vertBytes + listBytes * 2);
+
+   dCopyArray(triVerts, indices, numIndices);
+   dMemset(vertexData, 0, vertBytes);
+   dMemset(triEmitted, 0, NumPrimitives);
+
+   // Count the triangles on each vertex, and lay out the per-vertex lists
+   for(U32 i = 0; i < numIndices; i++)
    {
-      TriData &curTri = triangleData[tri];
-
-      for(int c = 0; c < 3; c++)
-      {  
-         const U32 &curVIdx = indices[curIdx];
-         AssertFatal(curVIdx < numVerts, "Out of range index.");
-
-         // Add this vert to the list of verts that define the triangle
-         curTri.vertIdx[c] = curVIdx;
-
-         VertData &curVert = vertexData[curVIdx];
-
-         // Increment the number of triangles that reference this vertex
-         curVert.numUnaddedReferences++;
-
-         curIdx++;
-      }
+      AssertFatal(triVerts[i] < numVerts, "Out of range index.");
+      vertexData[triVerts[i]].numTris++;
    }
 
-   // Allocate per-vertex triangle lists, and calculate the starting score of
-   // each of the verts
-   for(int v = 0; v < numVerts; v++)
+   U32 listOffset = 0;
+   for(U32 v = 0; v < numVerts; v++)
    {
       VertData &curVert = vertexData[v];
-      curVert.triIndex = new S32[curVert.numUnaddedReferences];
-      curVert.score = FindVertexScore::score(curVert);
+      curVert.cachePosition = -1;
+      curVert.score = FindVertexScore::score(-1, curVert.numTris);
+      curVert.firstTri = listOffset;
+      listOffset += curVert.numTris;
+      curVert.numTris = 0;
    }
 
-   // These variables will be used later, but need to be declared now
-   S32 nextNextBestTriIdx = -1, nextBestTriIdx = -1;
-   F32 nextNextBestTriScore = -1.0f, nextBestTriScore = -1.0f;
-
-#define _VALIDATE_TRI_IDX(idx) if(idx > -1) { AssertFatal(idx < NumPrimitives, "Out of range triangle index."); AssertFatal(!triangleData[idx].isInList, "Triangle already in list, bad."); }
-#define _CHECK_NEXT_NEXT_BEST(score, idx) { if(score > nextNextBestTriScore) { nextNextBestTriIdx = idx; nextNextBestTriScore = score; } }
-#define _CHECK_NEXT_BEST(score, idx) { if(score > nextBestTriScore) { _CHECK_NEXT_NEXT_BEST(nextBestTriScore, nextBestTriIdx); nextBestTriIdx = idx; nextBestTriScore = score; } _VALIDATE_TRI_IDX(nextBestTriIdx); }
-
    // Fill-in per-vertex triangle lists, and sum the scores of each vertex used
    // per-triangle, to get the starting triangle score
-   curIdx = 0;
-   for(int tri = 0; tri < NumPrimitives; tri++)
+   S32 bestTriIdx = -1;
+   F32 bestTriScore = -1.0f;
+   for(U32 tri = 0; tri < NumPrimitives; tri++)
    {
-      TriData &curTri = triangleData[tri];
-
-      for(int c = 0; c < 3; c++)
-      {  
-         const U32 &curVIdx = indices[curIdx];
-         AssertFatal(curVIdx < numVerts, "Out of range index.");
-         VertData &curVert = vertexData[curVIdx];
-
-         // Add triangle to triangle list
-         curVert.triIndex[curVert.numReferences++] = tri;
-
-         // Add vertex score to triangle score
-         curTri.score += curVert.score;
-
-         curIdx++;
+      F32 score = 0.0f;
+      for(U32 c = 0; c < 3; c++)
+      {
+         VertData &curVert = vertexData[triVerts[tri * 3 + c]];
+         triList[curVert.firstTri + curVert.numTris++] = tri;
+         score += curVert.score;
       }
 
-      // This will pick the first triangle to add to the list in 'Step 2'
-      _CHECK_NEXT_BEST(curTri.score, tri);
-      _CHECK_NEXT_NEXT_BEST(curTri.score, tri);
+      if(score > bestTriScore)
+      {
+         bestTriIdx = tri;
+         bestTriScore = score;
+      }
    }
 
    //
    // Step 2: Start emitting triangles...this is the emit loop
    //
-   LRUCacheModel lruCache;
-   for(int outIdx = 0; outIdx < numIndices; /* this space intentionally left blank */ )
+   U32 cache[SizeCacheBuffer];
+   U32 newCache[SizeCacheBuffer];
+   U32 cacheSize = 0;
+   U32 nextInputTri = 0;
+
+   for(U32 outIdx = 0; outIdx < numIndices; /* this space intentionally left blank */ )
    {
-      // If there is no next best triangle, than search for the next highest
-      // scored triangle that isn't in the list already
-      if(nextBestTriIdx < 0)
+      // If no triangle touching the cache is left, carry on with the next
+      // triangle in input order which hasn't been emitted yet
+      if(bestTriIdx < 0)
       {
-         // TODO: Something better than linear performance here...
-         nextBestTriScore = nextNextBestTriScore = -1.0f;
-         nextBestTriIdx = nextNextBestTriIdx = -1;
-
-         for(int tri = 0; tri < NumPrimitives; tri++)
-         {
-            TriData &curTri = triangleData[tri];
-
-            if(!curTri.isInList)
-            {
-               _CHECK_NEXT_BEST(curTri.score, tri);
-               _CHECK_NEXT_NEXT_BEST(curTri.score, tri);
-            }
-         }
+         while(triEmitted[nextInputTri])
+            nextInputTri++;
+         bestTriIdx = nextInputTri;
       }
-      AssertFatal(nextBestTriIdx > -1, "Ran out of 'nextBestTriangle' before I ran out of indices...not good.");
+      AssertFatal(!triEmitted[bestTriIdx], "Next best triangle already in list, this is no good.");
 
-      // Emit the next best triangle
-      TriData &nextBestTri = triangleData[nextBestTriIdx];
-      AssertFatal(!nextBestTri.isInList, "Next best triangle already in list, this is no good.");
-      for(int i = 0; i < 3; i++)
+      // Emit the next best triangle, and remove it from the lists of its verts
+      const U32 *bestVerts = triVerts + bestTriIdx * 3;
+      for(U32 i = 0; i < 3; i++)
       {
-         // Emit index
-         outIndices[outIdx++] = IndexType(nextBestTri.vertIdx[i]);
+         outIndices[outIdx++] = IndexType(bestVerts[i]);
 
-         // Update the list of triangles on the vert
-         VertData &curVert = vertexData[nextBestTri.vertIdx[i]];
-         curVert.numUnaddedReferences--;
-         for(int t = 0; t < curVert.numReferences; t++)
+         VertData &curVert = vertexData[bestVerts[i]];
+         U32 *tris = triList + curVert.firstTri;
+         for(U32 t = 0; t < curVert.numTris; t++)
          {
-            if(curVert.triIndex[t] == nextBestTriIdx)
+            if(tris[t] == U32(bestTriIdx))
             {
-               curVert.triIndex[t] = -1;
+               tris[t] = tris[--curVert.numTris];
                break;
             }
          }
+      }
+      triEmitted[bestTriIdx] = true;
 
-         // Update cache
-         lruCache.useVertex(nextBestTri.vertIdx[i], &curVert);
+      // The emitted verts move to the front of the cache, followed by
+      // everything else that was in it
+      U32 newCacheSize = 0;
+      for(U32 i = 0; i < 3; i++)
+      {
+         if(newCacheSize == 0 || (newCache[0] != bestVerts[i] && (newCacheSize == 1 || newCache[1] != bestVerts[i])))
+            newCache[newCacheSize++] = bestVerts[i];
       }
-      nextBestTri.isInList = true;
-
-      // Enforce cache size, this will update the cache position of all verts
-      // still in the cache. It will also update the score of the verts in the
-      // cache, and give back a list of triangle indicies that need updating.
-      Vector<U32> trisToUpdate;
-      lruCache.enforceSize(MaxSizeVertexCache, trisToUpdate);
-
-      // Now update scores for triangles that need updates, and find the new best
-      // triangle score/index
-      nextBestTriIdx = -1;
-      nextBestTriScore = -1.0f;
-      for(Vector<U32>::iterator itr = trisToUpdate.begin(); itr != trisToUpdate.end(); itr++)
+      for(U32 i = 0; i < cacheSize; i++)
       {
-         TriData &tri = triangleData[*itr];
-
-         // If this triangle isn't already emitted, re-score it
-         if(!tri.isInList)
-         {
-            tri.score = 0.0f;
-
-            for(int i = 0; i < 3; i++)
-               tri.score += vertexData[tri.vertIdx[i]].score;
+         const U32 vIdx = cache[i];
+         if(vIdx != bestVerts[0] && vIdx != bestVerts[1] && vIdx != bestVerts[2])
+            newCache[newCacheSize++] = vIdx;
+      }
 
-            _CHECK_NEXT_BEST(tri.score, *itr);
-            _CHECK_NEXT_NEXT_BEST(tri.score, *itr);
-         }
+      // Update the position and score of every vert that was or is in the
+      // cache. Verts past the end of the cache have just been pushed out.
+      for(U32 i = 0; i < newCacheSize; i++)
+      {
+         VertData &curVert = vertexData[newCache[i]];
+         curVert.cachePosition = i < MaxSizeVertexCache ? S32(i) : -1;
+         curVert.score = FindVertexScore::score(curVert.cachePosition, curVert.numTris);
       }
 
-      // If there was no love finding a good triangle, than see if there is a
-      // next-next-best triangle, and if there isn't one of those...well than
-      // I guess we have to find one next time
-      if(nextBestTriIdx < 0 && nextNextBestTriIdx > -1)
+      // Now update scores for the remaining triangles of those verts, and
+      // find the new best triangle score/index
+      bestTriIdx = -1;
+      bestTriScore = -1.0f;
+      for(U32 i = 0; i < newCacheSize; i++)
       {
-         if(!triangleData[nextNextBestTriIdx].isInList)
+         const VertData &curVert = vertexData[newCache[i]];
+         const U32 *tris = triList + curVert.firstTri;
+         for(U32 t = 0; t < curVert.numTris; t++)
          {
-            nextBestTriIdx = nextNextBestTriIdx;
-            nextBestTriScore = nextNextBestTriScore;
-            _VALIDATE_TRI_IDX(nextNextBestTriIdx);
-         }
+            const U32 tri = tris[t];
+            const U32 *verts = triVerts + tri * 3;
+            const F32 score = vertexData[verts[0]].score + vertexData[verts[1]].score + vertexData[verts[2]].score;
 
-         // Nuke the next-next best
-         nextNextBestTriIdx = -1;
-         nextNextBestTriScore = -1.0f;
+            if(score > bestTriScore)
+            {
+               bestTriIdx = tri;
+               bestTriScore = score;
+            }
+         }
       }
 
-      // Validate triangle we are marking as next-best
-      _VALIDATE_TRI_IDX(nextBestTriIdx);
+      cacheSize = getMin(newCacheSize, MaxSizeVertexCache);
+      dCopyArray(cache, newCache, cacheSize);
    }
-
-#undef _CHECK_NEXT_BEST
-#undef _CHECK_NEXT_NEXT_BEST
-#undef _VALIDATE_TRI_IDX
-
-   // FrameTemp will call destructInPlace to clean up vertex lists
 }
 
-//------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
-LRUCacheModel::~LRUCacheModel()
+U32 OptimizeVertexFetch(const dsize_t numVerts, const dsize_t numIndices, IndexType *indices, U32 *outRemap)
 {
-   for( LRUCacheEntry* entry = mCacheHead; entry != NULL; )
-   {
-      LRUCacheEntry* next = entry->next;
-      delete entry;
-      entry = next;
-   }
-}
+   PROFILE_SCOPE(TriListOpt_OptimizeVertexFetch);
 
-//------------------------------------------------------------------------------
-
-void LRUCacheModel::useVertex(const U32 vIdx, VertData *vData)
-{
-   LRUCacheEntry *search = mCacheHead;
-   LRUCacheEntry *last = NULL;
+   const U32 Unused = U32(-1);
+   for(U32 v = 0; v < numVerts; v++)
+      outRemap[v] = Unused;
 
-   while(search != NULL)
+   // Number verts in the order they are first used
+   U32 nextVert = 0;
+   for(U32 i = 0; i < numIndices; i++)
    {
-      if(search->vIdx == vIdx)
-         break;
-
-      last = search;
-      search = search->next;
+      AssertFatal(indices[i] < numVerts, "Out of range index.");
+      U32 &remap = outRemap[indices[i]];
+      if(remap == Unused)
+         remap = nextVert++;
+      indices[i] = remap;
    }
 
-   // If this vertex wasn't found in the cache, create a new entry
-   if(search == NULL)
+   const U32 numUsed = nextVert;
+   for(U32 v = 0; v < numVerts; v++)
    {
-      search = new LRUCacheEntry;
-      search->vIdx = vIdx;
-      search->vData = vData;
+      if(outRemap[v] == Unused)
+         outRemap[v] = nextVert++;
    }
 
-   if(search != mCacheHead)
-   {
-      // Unlink the entry from the linked list
-      if(last)
-         last->next = search->next;
-
-      // Vertex that got passed in is now at the head of the cache
-      search->next = mCacheHead;
-      mCacheHead = search;
-   }
+   return numUsed;
 }
 
 //------------------------------------------------------------------------------
 
-void LRUCacheModel::enforceSize(const dsize_t maxSize, Vector<U32> &outTrisToUpdate)
+F32 CalcACMR(const dsize_t numVerts, const dsize_t numIndices, const U32 *indices, const U32 cacheSize)
 {
-   // Clear list of triangles to update scores for
-   outTrisToUpdate.clear();
-
-   dsize_t length = 0;
-   LRUCacheEntry *next = mCacheHead;
-   LRUCacheEntry *last = NULL;
-   
-   // Run through list, up to the max size
-   while(next != NULL && length < MaxSizeVertexCache)
-   {
-      VertData &vData = *next->vData;
-
-      // Update cache position on verts still in cache
-      vData.cachePosition = length++;
-
-      for(int i = 0; i < vData.numReferences; i++)
-      {
-         const S32 &triIdx = vData.triIndex[i];
-         if(triIdx > -1)
-         {
-            int j = 0;
-            for(; j < outTrisToUpdate.size(); j++)
-               if(outTrisToUpdate[j] == triIdx)
-                  break;
-            if(j == outTrisToUpdate.size())
-               outTrisToUpdate.push_back(triIdx);
-         }
-      }
-
-      // Update score
-      vData.score = FindVertexScore::score(vData);
-
-      last = next;
-      next = next->next;
-   }
-
-   // NULL out the pointer to the next entry on the last valid entry
-   last->next = NULL;
-
-   // If next != NULL, than we need to prune entries from the tail of the cache
-   while(next != NULL)
-   {
-      // Update cache position on verts which are going to get tossed from cache
-      next->vData->cachePosition = -1;
-
-      LRUCacheEntry *curEntry = next;
-      next = next->next;
-
-      delete curEntry;
-   }
-}
+   const U32 NumPrimitives = numIndices / 3;
+   if(NumPrimitives == 0)
+      return 0.0f;
 
-//------------------------------------------------------------------------------
+   // A vertex is still in the FIFO if fewer than cacheSize misses have
+   // happened since it was last added
+   TempAlloc<U32> addedAt(numVerts);
+   dMemset(addedAt.ptr, 0, numVerts * sizeof(U32));
 
-S32 LRUCacheModel::getCachePosition(const U32 vIdx)
-{
-   dsize_t length = 0;
-   LRUCacheEntry *next = mCacheHead;
-   while(next != NULL)
+   U32 misses = 0;
+   for(U32 i = 0; i < numIndices; i++)
    {
-      if(next->vIdx == vIdx)
-         return length;
-      
-      length++;
-      next = next->next;
+      AssertFatal(indices[i] < numVerts, "Out of range index.");
+      U32 &added = addedAt[indices[i]];
+      if(added == 0 || misses - added >= cacheSize)
+         added = ++misses;
    }
 
-   return -1;
+   return F32(misses) / NumPrimitives;
 }
 
 //------------------------------------------------------------------------------
@@ -354,45 +270,59 @@ S32 LRUCacheModel::getCachePosition(const U32 vIdx)
 namespace FindVertexScore
 {
 
-F32 score(const VertData &vertexData)
+namespace
 {
-   // If nobody needs this vertex, return -1.0
-   if(vertexData.numUnaddedReferences < 1)
-      return -1.0f;
-
-   F32 Score = 0.0f;
-
-   if(vertexData.cachePosition < 0)
-   {
-      // Vertex is not in FIFO cache - no score.
-   }
-   else
+   // Scores for each cache position and each valence, so the emit loop
+   // doesn't call mPow
+   struct ScoreTables
    {
-      if(vertexData.cachePosition < 3)
-      {
-         // This vertex was used in the last triangle,
-         // so it has a fixed score, whichever of the three
-         // it's in. Otherwise, you can get very different
-         // answers depending on whether you add
-         // the triangle 1,2,3 or 3,1,2 - which is silly.
-         Score = FindVertexScore::LastTriScore;
-      }
-      else
+      F32 cachePosition[MaxSizeVertexCache];
+      F32 valence[MaxValence + 1];
+
+      ScoreTables()
       {
-         AssertFatal(vertexData.cachePosition < MaxSizeVertexCache, "Out of range cache position for vertex");
+         for(U32 i = 0; i < MaxSizeVertexCache; i++)
+         {
+            if(i < 3)
+            {
+               // This vertex was used in the last triangle,
+               // so it has a fixed score, whichever of the three
+               // it's in. Otherwise, you can get very different
+               // answers depending on whether you add
+               // the triangle 1,2,3 or 3,1,2 - which is silly.
+               cachePosition[i] = LastTriScore;
+            }
+            else
+            {
+               // Points for being high in the cache.
+               const F32 Scaler = 1.0f / (MaxSizeVertexCache - 3);
+               cachePosition[i] = mPow(1.0f - (i - 3) * Scaler, CacheDecayPower);
+            }
+         }
 
-         // Points for being high in the cache.
-         const float Scaler = 1.0f / (MaxSizeVertexCache - 3);
-         Score = 1.0f - (vertexData.cachePosition - 3) * Scaler;
-         Score = mPow(Score, FindVertexScore::CacheDecayPower);
+         // Bonus points for having a low number of tris still to
+         // use the vert, so we get rid of lone verts quickly.
+         valence[0] = 0.0f;
+         for(U32 i = 1; i <= MaxValence; i++)
+            valence[i] = ValenceBoostScale * mPow(F32(i), -ValenceBoostPower);
       }
-   }
+   };
+
+   const ScoreTables sScoreTables;
+}
+
+F32 score(const S32 cachePosition, const U32 numUnaddedReferences)
+{
+   // If nobody needs this vertex, return -1.0
+   if(numUnaddedReferences < 1)
+      return -1.0f;
+
+   AssertFatal(cachePosition < S32(MaxSizeVertexCache), "Out of range cache position for vertex");
 
+   // Vertex is not in FIFO cache - no score.
+   F32 Score = cachePosition < 0 ? 0.0f : sScoreTables.cachePosition[cachePosition];
 
-   // Bonus points for having a low number of tris still to
-   // use the vert, so we get rid of lone verts quickly.
-   float ValenceBoost = mPow(vertexData.numUnaddedReferences, -FindVertexScore::ValenceBoostPower);
-   Score += FindVertexScore::ValenceBoostScale * ValenceBoost;
+   Score += sScoreTables.valence[getMin(numUnaddedReferences, MaxValence)];
 
    return Score;
 }
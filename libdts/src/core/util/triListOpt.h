@@ -35,48 +35,8 @@ namespace TriListOpt
 
    const U32 MaxSizeVertexCache = 32;
 
-   struct VertData
-   {
-      S32 cachePosition;
-      F32 score;
-      U32 numReferences;
-      U32 numUnaddedReferences;
-      S32 *triIndex;
-
-      VertData() : cachePosition(-1), score(0.0f), numReferences(0), numUnaddedReferences(0), triIndex(NULL) {}
-      ~VertData() { if(triIndex != NULL) delete [] triIndex; triIndex = NULL; }
-   };
-
-   struct TriData
-   {
-      bool isInList;
-      F32 score;
-      U32 vertIdx[3];
-
-      TriData() : isInList(false), score(0.0f) { dMemset(vertIdx, 0, sizeof(vertIdx)); }
-   };
-
-   class LRUCacheModel
-   {
-      struct LRUCacheEntry
-      {
-         LRUCacheEntry *next;
-         U32 vIdx;
-         VertData *vData;
-
-         LRUCacheEntry() : next(NULL), vIdx(0), vData(NULL) {}
-      };
-
-      LRUCacheEntry *mCacheHead;
-
-   public:
-      LRUCacheModel() : mCacheHead(NULL) {}
-      ~LRUCacheModel();
-      void enforceSize(const dsize_t maxSize, Vector<U32> &outTrisToUpdate);
-      void useVertex(const U32 vIdx, VertData *vData);
-      S32 getCachePosition(const U32 vIdx);
-   };
-
+   /// FIFO size used when measuring cache misses, typical of current hardware
+   const U32 DefaultSizeFIFOCache = 16;
 
    /// This method will look at the index buffer for a triangle list, and generate
    /// a new index buffer which is optimized using Tom Forsyth's paper:
@@ -88,8 +48,25 @@ namespace TriListOpt
    /// @param outIndices Output index buffer
    ///
    /// @note Both 'indices' and 'outIndices' can point to the same memory.
+   /// @note Makes a single temporary allocation, and may be called from
+   ///       several threads at once.
    void OptimizeTriangleOrdering(const dsize_t numVerts, const dsize_t numIndices, const U32 *indices, IndexType *outIndices);
 
+   /// Reorders vertices so they are stored in the order the triangle list
+   /// first uses them, and rewrites 'indices' to match. Vertices which are
+   /// not used are moved to the end, in their original order.
+   /// @param   numVerts Number of vertices indexed by the 'indices'
+   /// @param numIndices Number of elements in 'indices'
+   /// @param    indices Index buffer, remapped in place
+   /// @param  outRemap  Receives the new position of each of the numVerts vertices
+   /// @return The number of vertices used by 'indices'
+   U32 OptimizeVertexFetch(const dsize_t numVerts, const dsize_t numIndices, IndexType *indices, U32 *outRemap);
+
+   /// Returns the average number of post-transform cache misses per triangle
+   /// (ACMR) when drawing the triangle list through a FIFO cache of cacheSize
+   /// entries. Ranges from 3.0 with no reuse down to about 0.5 for a regular grid.
+   F32 CalcACMR(const dsize_t numVerts, const dsize_t numIndices, const U32 *indices, const U32 cacheSize = DefaultSizeFIFOCache);
+
    namespace FindVertexScore
    {
       const F32 CacheDecayPower = 1.5f;
@@ -97,7 +74,10 @@ namespace TriListOpt
       const F32 ValenceBoostScale = 2.0f;
       const F32 ValenceBoostPower = 0.5f;
 
-      F32 score(const VertData &vertexData);
+      /// Vertices used by more triangles than this score as if used by this many
+      const U32 MaxValence = 32;
+
+      F32 score(const S32 cachePosition, const U32 numUnaddedReferences);
    };
 };
 //-----------------------------------------------------------------------------
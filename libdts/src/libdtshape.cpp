@@ -26,6 +26,8 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "libdtshape.h"
 #include "ts/tsRender.h"
 #include "core/log.h"
+#include "platform/threads/thread.h"
+#include "platform/threads/threadPool.h"
 
 BEGIN_NS(DTShapeInit)
 
@@ -33,6 +35,8 @@ using namespace DTShape;
 
 void init(U32 opts)
 {
+   ThreadManager::setMainThread();
+   
    Log::init();
    
    Processor::init();
@@ -48,7 +52,7 @@ void init(U32 opts)
 
 void shutdown()
 {
-   
+   ThreadPool::destroyGlobal();
 }
 
 END_NS
@@ -163,6 +163,40 @@ public:
    static File *openFile(const String &file, File::AccessMode mode);
 };
 
+/// A read-only file mapped into memory as a whole.
+///
+/// By default the pages are mapped copy-on-write, so the data may be modified
+/// in place without the changes reaching the file. A shared mapping is
+/// read-only: its pages are shared with every other process mapping the same
+/// file, and writing to them faults.
+class FileMapping
+{
+private:
+   FileMapping(const FileMapping&);              ///< This is here to disable the copy constructor.
+   FileMapping& operator=(const FileMapping&);   ///< This is here to disable assignment.
+
+protected:
+   void *mData;   ///< Start of the mapped view
+   U32 mSize;     ///< Size of the file in bytes
+
+   FileMapping() : mData(NULL), mSize(0) {;}
+
+public:
+   virtual ~FileMapping() {}
+
+   /// Gets the start of the mapped file
+   void *getData() const { return mData; }
+
+   /// Gets the size of the mapped file in bytes
+   U32 getSize() const { return mSize; }
+
+   /// Maps a file into memory
+   ///
+   /// @param shared Map the file read-only and shared between processes
+   /// @returns The mapping, or NULL if the file could not be opened or mapped
+   static FileMapping *mapFile(const String &file, bool shared = false);
+};
+
 END_NS
 
 #endif // _FILE_IO_H_
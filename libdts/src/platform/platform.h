@@ -124,6 +124,10 @@ enum ProcessorProperties
    CPU_PROP_LE        = (1<<12), ///< This processor is LITTLE ENDIAN.  
    CPU_PROP_64bit     = (1<<13), ///< This processor is 64-bit capable
    CPU_PROP_ALTIVEC   = (1<<14),  ///< Supports AltiVec instruction set extension (PPC only).
+   CPU_PROP_AVX       = (1<<15), ///< Supports AVX instruction set extension, and the OS saves the YMM registers.
+   CPU_PROP_AVX2      = (1<<16), ///< Supports AVX2 instruction set extension.
+   CPU_PROP_FMA       = (1<<17), ///< Supports FMA3 instruction set extension.
+   CPU_PROP_AVX512F   = (1<<18), ///< Supports AVX-512 Foundation, and the OS saves the ZMM registers.
 };
 
 /// Processor info manager. 
@@ -44,24 +44,51 @@ enum CPUFlags
    BIT_SSE3xt  = BIT(9),
    BIT_SSE4_1  = BIT(19),
    BIT_SSE4_2  = BIT(20),
+   BIT_FMA     = BIT(12),
+   BIT_OSXSAVE = BIT(27),
+   BIT_AVX     = BIT(28),
+
+   // Structured extended feature flags (cpuid leaf 7)
+   BIT_AVX2    = BIT(5),
+   BIT_AVX512F = BIT(16),
+
+   // Register state the OS saves on a context switch (XCR0)
+   BIT_XCR0_SSE      = BIT(1),
+   BIT_XCR0_AVX      = BIT(2),
+   BIT_XCR0_AVX512   = BIT(5) | BIT(6) | BIT(7),
 };
 
 // fill the specified structure with information obtained from asm code
 void SetProcessorInfo(Platform::SystemInfo_struct::Processor& pInfo,
-   char* vendor, U32 processor, U32 properties, U32 properties2)
+   char* vendor, U32 processor, U32 properties, U32 properties2, U32 properties3, U32 osFeatures)
 {
    Platform::SystemInfo.processor.properties |= (properties & BIT_FPU)   ? CPU_PROP_FPU : 0;
    Platform::SystemInfo.processor.properties |= (properties & BIT_RDTSC) ? CPU_PROP_RDTSC : 0;
    Platform::SystemInfo.processor.properties |= (properties & BIT_MMX)   ? CPU_PROP_MMX : 0;
 
+   // These are reported the same way by all vendors
+   pInfo.properties |= (properties2 & BIT_SSE3) ? CPU_PROP_SSE3 : 0;
+   pInfo.properties |= (properties2 & BIT_SSE3xt) ? CPU_PROP_SSE3xt : 0;
+   pInfo.properties |= (properties2 & BIT_SSE4_1) ? CPU_PROP_SSE4_1 : 0;
+   pInfo.properties |= (properties2 & BIT_SSE4_2) ? CPU_PROP_SSE4_2 : 0;
+
+   // The AVX family is only usable if the OS also saves the wider registers
+   const U32 ymmState = BIT_XCR0_SSE | BIT_XCR0_AVX;
+   const U32 zmmState = ymmState | BIT_XCR0_AVX512;
+   if ((properties2 & BIT_OSXSAVE) && (osFeatures & ymmState) == ymmState)
+   {
+      pInfo.properties |= (properties2 & BIT_AVX) ? CPU_PROP_AVX : 0;
+      pInfo.properties |= (properties2 & BIT_FMA) ? CPU_PROP_FMA : 0;
+      pInfo.properties |= (properties3 & BIT_AVX2) ? CPU_PROP_AVX2 : 0;
+
+      if ((osFeatures & zmmState) == zmmState)
+         pInfo.properties |= (properties3 & BIT_AVX512F) ? CPU_PROP_AVX512F : 0;
+   }
+
    if (dStricmp(vendor, "GenuineIntel") == 0)
    {
       pInfo.properties |= (properties & BIT_SSE) ? CPU_PROP_SSE : 0;
       pInfo.properties |= (properties & BIT_SSE2) ? CPU_PROP_SSE2 : 0;
-      pInfo.properties |= (properties2 & BIT_SSE3) ? CPU_PROP_SSE3 : 0;
-      pInfo.properties |= (properties2 & BIT_SSE3xt) ? CPU_PROP_SSE3xt : 0;
-      pInfo.properties |= (properties2 & BIT_SSE4_1) ? CPU_PROP_SSE4_1 : 0;
-      pInfo.properties |= (properties2 & BIT_SSE4_2) ? CPU_PROP_SSE4_2 : 0;
 
       pInfo.type = CPU_Intel_Unknown;
       // switch on processor family code
@@ -25,6 +25,14 @@
 #include <math.h>
 #include "core/log.h"
 
+#if defined(LIBDTSHAPE_CPU_X86) || defined(LIBDTSHAPE_CPU_X86_64)
+#  if defined(LIBDTSHAPE_COMPILER_VISUALC)
+#     include <intrin.h>
+#  elif defined(LIBDTSHAPE_COMPILER_GCC)
+#     include <cpuid.h>
+#  endif
+#endif
+
 //-----------------------------------------------------------------------------
 
 BEGIN_NS(DTShape)
@@ -34,7 +42,7 @@ BEGIN_NS(DTShape)
 Platform::SystemInfo_struct Platform::SystemInfo;
 
 extern void SetProcessorInfo(Platform::SystemInfo_struct::Processor& pInfo,
-   char* vendor, U32 processor, U32 properties, U32 properties2); // platform/platformCPU.cc
+   char* vendor, U32 processor, U32 properties, U32 properties2, U32 properties3, U32 osFeatures); // platform/platformCPU.cc
 
 // asm cpu detection routine from platform code
 extern "C"
@@ -46,11 +54,82 @@ void detectX86CPUInfo(char *vendor, U32 *processor, U32 *properties);
 static U32 sTime[2];
 static char vendor[13] = {0,};
 static U32 properties = 0;
+static U32 properties2 = 0;
+static U32 properties3 = 0;
+static U32 osFeatures = 0;
 static U32 processor  = 0;
 //U32 clockticks = 0;
 //U32 timeHi = 0;
 //U32 timeLo = 0;
 
+#if defined(LIBDTSHAPE_CPU_X86) || defined(LIBDTSHAPE_CPU_X86_64)
+
+/// Executes cpuid, returning eax, ebx, ecx and edx in regs
+static void getCPUID(U32 leaf, U32 subLeaf, U32 regs[4])
+{
+#if defined(LIBDTSHAPE_COMPILER_VISUALC)
+   int info[4];
+   __cpuidex(info, leaf, subLeaf);
+   regs[0] = info[0];
+   regs[1] = info[1];
+   regs[2] = info[2];
+   regs[3] = info[3];
+#elif defined(LIBDTSHAPE_COMPILER_GCC)
+   __cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+   regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+/// Reads the low word of XCR0. Only valid if cpuid reports OSXSAVE.
+static U32 getXCR0()
+{
+#if defined(LIBDTSHAPE_COMPILER_VISUALC) && (_MSC_FULL_VER >= 160040219)
+   return (U32)_xgetbv(0);
+#elif defined(LIBDTSHAPE_COMPILER_GCC)
+   U32 eax, edx;
+   // xgetbv, encoded directly for assemblers which don't know it
+   asm volatile(".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0));
+   return eax;
+#else
+   return 0;
+#endif
+}
+
+static void detectCPUFeatures()
+{
+   U32 regs[4];
+
+   getCPUID(0, 0, regs);
+   const U32 maxLeaf = regs[0];
+
+   // Vendor string is stored in ebx, edx, ecx
+   dMemcpy(vendor, &regs[1], 4);
+   dMemcpy(vendor + 4, &regs[3], 4);
+   dMemcpy(vendor + 8, &regs[2], 4);
+   vendor[12] = 0;
+
+   if (maxLeaf >= 1)
+   {
+      getCPUID(1, 0, regs);
+      processor = regs[0];
+      properties = regs[3];
+      properties2 = regs[2];
+   }
+
+   if (maxLeaf >= 7)
+   {
+      getCPUID(7, 0, regs);
+      properties3 = regs[1];
+   }
+
+   // OSXSAVE
+   if (properties2 & BIT(27))
+      osFeatures = getXCR0();
+}
+
+#endif
+
 void Processor::init()
 {
    // Reference:
@@ -63,12 +142,14 @@ void Processor::init()
    Platform::SystemInfo.processor.mhz  = 0;
    Platform::SystemInfo.processor.properties = CPU_PROP_C;
 
-   /*clockticks = */properties = processor = sTime[0] = 0;
+   /*clockticks = */properties = properties2 = properties3 = osFeatures = processor = sTime[0] = 0;
    dStrcpy(vendor, "");
 
-   //detectX86CPUInfo(vendor, &processor, &properties);
+#if defined(LIBDTSHAPE_CPU_X86) || defined(LIBDTSHAPE_CPU_X86_64)
+   detectCPUFeatures();
+#endif
    SetProcessorInfo(Platform::SystemInfo.processor,
-      vendor, processor, properties, 0);
+      vendor, processor, properties, properties2, properties3, osFeatures);
 
 #if 0
    //--------------------------------------
@@ -155,6 +236,14 @@ void Processor::init()
       Log::printf("   3DNow detected");
    if (Platform::SystemInfo.processor.properties & CPU_PROP_SSE)
       Log::printf("   SSE detected");
+   if (Platform::SystemInfo.processor.properties & CPU_PROP_SSE4_1)
+      Log::printf("   SSE4.1 detected");
+   if (Platform::SystemInfo.processor.properties & CPU_PROP_AVX2)
+      Log::printf("   AVX2 detected");
+   if (Platform::SystemInfo.processor.properties & CPU_PROP_FMA)
+      Log::printf("   FMA detected");
+   if (Platform::SystemInfo.processor.properties & CPU_PROP_AVX512F)
+      Log::printf("   AVX-512 detected");
    Log::printf(" ");
 }
 
@@ -28,6 +28,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -420,6 +421,46 @@ File *File::openFile(const String &file, File::AccessMode mode)
    return NULL;
 }
 
+class PosixFileMapping : public FileMapping
+{
+public:
+   PosixFileMapping(void *data, U32 size)
+   {
+      mData = data;
+      mSize = size;
+   }
+
+   virtual ~PosixFileMapping()
+   {
+      munmap(mData, mSize);
+   }
+};
+
+FileMapping *FileMapping::mapFile(const String &file, bool shared)
+{
+   int fd = ::open(file.c_str(), O_RDONLY);
+   if (fd == -1)
+      return NULL;
+
+   struct stat st;
+   void *data = MAP_FAILED;
+   if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= (off_t)U32_MAX)
+   {
+      if (shared)
+         data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      else
+         data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   }
+
+   // The mapping holds its own reference to the file
+   ::close(fd);
+
+   if (data == MAP_FAILED)
+      return NULL;
+
+   return new PosixFileMapping(data, (U32)st.st_size);
+}
+
 bool Platform::createPath(const char * filename)
 {
    return false; // TODO
@@ -0,0 +1,223 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "platform/threads/mutex.h"
+#include "platform/threads/semaphore.h"
+#include "platform/threads/thread.h"
+#include "platform/profiler.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+// Mutex
+//-----------------------------------------------------------------------------
+
+struct PlatformMutexData
+{
+   pthread_mutex_t mutex;
+};
+
+Mutex::Mutex()
+{
+   mData = new PlatformMutexData;
+   pthread_mutex_init( &mData->mutex, NULL );
+}
+
+Mutex::~Mutex()
+{
+   pthread_mutex_destroy( &mData->mutex );
+   delete mData;
+}
+
+void Mutex::lock()
+{
+   pthread_mutex_lock( &mData->mutex );
+}
+
+bool Mutex::tryLock()
+{
+   return pthread_mutex_trylock( &mData->mutex ) == 0;
+}
+
+void Mutex::unlock()
+{
+   pthread_mutex_unlock( &mData->mutex );
+}
+
+//-----------------------------------------------------------------------------
+// Semaphore
+//-----------------------------------------------------------------------------
+
+// Unnamed POSIX semaphores are not available on OSX, so this
+// is built from a mutex and condition variable.
+struct PlatformSemaphoreData
+{
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;
+   S32 count;
+};
+
+Semaphore::Semaphore( S32 initialCount )
+{
+   mData = new PlatformSemaphoreData;
+   pthread_mutex_init( &mData->mutex, NULL );
+   pthread_cond_init( &mData->cond, NULL );
+   mData->count = initialCount;
+}
+
+Semaphore::~Semaphore()
+{
+   pthread_cond_destroy( &mData->cond );
+   pthread_mutex_destroy( &mData->mutex );
+   delete mData;
+}
+
+void Semaphore::acquire()
+{
+   pthread_mutex_lock( &mData->mutex );
+   while ( mData->count <= 0 )
+      pthread_cond_wait( &mData->cond, &mData->mutex );
+   mData->count--;
+   pthread_mutex_unlock( &mData->mutex );
+}
+
+bool Semaphore::tryAcquire()
+{
+   bool acquired = false;
+
+   pthread_mutex_lock( &mData->mutex );
+   if ( mData->count > 0 )
+   {
+      mData->count--;
+      acquired = true;
+   }
+   pthread_mutex_unlock( &mData->mutex );
+
+   return acquired;
+}
+
+void Semaphore::release( S32 count )
+{
+   if ( count <= 0 )
+      return;
+
+   pthread_mutex_lock( &mData->mutex );
+   mData->count += count;
+   if ( count == 1 )
+      pthread_cond_signal( &mData->cond );
+   else
+      pthread_cond_broadcast( &mData->cond );
+   pthread_mutex_unlock( &mData->mutex );
+}
+
+//-----------------------------------------------------------------------------
+// Thread
+//-----------------------------------------------------------------------------
+
+struct PlatformThreadData
+{
+   pthread_t thread;
+   bool started;
+};
+
+static void *_threadEntry( void *arg )
+{
+   Thread *thread = reinterpret_cast<Thread*>( arg );
+   thread->run( NULL );
+
+#ifdef LIBDTSHAPE_ENABLE_PROFILER
+   if ( gProfiler )
+      gProfiler->releaseThread();
+#endif
+   return NULL;
+}
+
+Thread::Thread( ThreadRunFunction func, void *data )
+   :  mRunFunction( func ),
+      mRunData( data )
+{
+   mData = new PlatformThreadData;
+   mData->started = false;
+}
+
+Thread::~Thread()
+{
+   AssertFatal( !mData->started, "Thread::~Thread - thread was not joined before being deleted!" );
+   delete mData;
+}
+
+void Thread::start()
+{
+   AssertFatal( !mData->started, "Thread::start - thread already started!" );
+   mData->started = pthread_create( &mData->thread, NULL, _threadEntry, this ) == 0;
+   AssertFatal( mData->started, "Thread::start - unable to create thread!" );
+}
+
+bool Thread::join()
+{
+   if ( !mData->started )
+      return false;
+
+   pthread_join( mData->thread, NULL );
+   mData->started = false;
+   return true;
+}
+
+bool Thread::isAlive() const
+{
+   return mData->started;
+}
+
+void Thread::run( void *data )
+{
+   if ( mRunFunction )
+      mRunFunction( mRunData );
+}
+
+U32 Thread::getCurrentThreadId()
+{
+   // pthread_t is opaque, so hand out our own small sequential ids
+   static volatile U32 sNextThreadId = 1;
+   static __thread U32 sThreadId = 0;
+
+   if ( sThreadId == 0 )
+      sThreadId = __sync_fetch_and_add( &sNextThreadId, 1 );
+
+   return sThreadId;
+}
+
+U32 Thread::getNumHardwareThreads()
+{
+   long count = sysconf( _SC_NPROCESSORS_ONLN );
+   return count > 0 ? (U32)count : 1;
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
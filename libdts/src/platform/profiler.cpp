@@ -28,15 +28,25 @@
 
 #if defined(LIBDTSHAPE_OS_MAC)
 #include <CoreServices/CoreServices.h> // For high resolution timer
+#include <mach/mach_time.h>
+#elif !defined(LIBDTSHAPE_OS_WIN32)
+#include <time.h> // for clock_gettime
+#endif
+
+#if defined(LIBDTSHAPE_COMPILER_VISUALC) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h> // for __rdtsc
 #endif
 
 #include "core/stream/fileStream.h"
 #include "core/strings/stringFunctions.h"
 
 #include "platform/profiler.h"
+#include "platform/threads/thread.h"
+#include "platform/platformIntrinsics.h"
 
 #include "core/log.h"
 #include "core/util/hashFunction.h"
+#include "core/util/tVector.h"
 
 #ifdef LIBDTSHAPE_ENABLE_PROFILE_PATH
 static char sProfilerBuf[1024];
@@ -51,6 +61,7 @@ BEGIN_NS(DTShape)
 
 #ifdef LIBDTSHAPE_ENABLE_PROFILER
 ProfilerRootData *ProfilerRootData::sRootList = NULL;
+U32 ProfilerRootData::sRootCount = 0;
 Profiler *gProfiler = NULL;
 
 // Uncomment the following line to enable a debugging aid for mismatched profiler blocks.
@@ -72,99 +83,145 @@ Vector<const char*> gProfilerNodeStack;
 #define PROFILER_DEBUG_POP_NODE() ;
 #endif
 
-#if defined(LIBDTSHAPE_SUPPORTS_VC_INLINE_X86_ASM)
-// platform specific get hires times...
-void startHighResolutionTimer(U32 time[2])
-{
-   //time[0] = Platform::getRealMilliseconds();
-
-   __asm
-   {
-      push eax
-      push edx
-      push ecx
-      rdtsc
-      mov ecx, time
-      mov DWORD PTR [ecx], eax
-      mov DWORD PTR [ecx + 4], edx
-      pop ecx
-      pop edx
-      pop eax
-   }
-}
+#if defined(LIBDTSHAPE_COMPILER_VISUALC)
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILER_THREAD_LOCAL __thread
+#endif
 
-U32 endHighResolutionTimer(U32 time[2])
+/// Reads a monotonic system clock, used to calibrate the profiler ticks.
+static U64 getSystemNanoseconds()
 {
-   U32 ticks;
-   //ticks = Platform::getRealMilliseconds() - time[0];
-   //return ticks;
-
-   __asm
-   {
-      push  eax
-      push  edx
-      push  ecx
-      //db    0fh, 31h
-      rdtsc
-      mov   ecx, time
-      sub   edx, DWORD PTR [ecx+4]
-      sbb   eax, DWORD PTR [ecx]
-      mov   DWORD PTR ticks, eax
-      pop   ecx
-      pop   edx
-      pop   eax
-   }
-   return ticks;
+#if defined(LIBDTSHAPE_OS_WIN32)
+   LARGE_INTEGER frequency, count;
+   QueryPerformanceFrequency(&frequency);
+   QueryPerformanceCounter(&count);
+   return (U64)((F64)count.QuadPart * 1.0e9 / (F64)frequency.QuadPart);
+#elif defined(LIBDTSHAPE_OS_MAC)
+   static mach_timebase_info_data_t sTimebase;
+   if (sTimebase.denom == 0)
+      mach_timebase_info(&sTimebase);
+   return mach_absolute_time() * sTimebase.numer / sTimebase.denom;
+#else
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (U64)ts.tv_sec * 1000000000ULL + (U64)ts.tv_nsec;
+#endif
 }
 
-#elif defined(LIBDTSHAPE_SUPPORTS_GCC_INLINE_X86_ASM)
-
 // platform specific get hires times...
-void startHighResolutionTimer(U32 time[2])
+#if defined(LIBDTSHAPE_COMPILER_VISUALC) && (defined(_M_IX86) || defined(_M_X64))
+
+static inline U64 readProfilerTicks()
 {
-   __asm__ __volatile__(
-      "rdtsc\n"
-      : "=a" (time[0]), "=d" (time[1])
-      );
+   return __rdtsc();
 }
 
-U32 endHighResolutionTimer(U32 time[2])
+#elif defined(LIBDTSHAPE_SUPPORTS_GCC_INLINE_X86_ASM)
+
+static inline U64 readProfilerTicks()
 {
-   U32 ticks;
+   U32 lo, hi;
    __asm__ __volatile__(
       "rdtsc\n"
-      "sub  0x4(%%ecx),  %%edx\n"
-      "sbb  (%%ecx),  %%eax\n"
-      : "=a" (ticks) : "c" (time)
+      : "=a" (lo), "=d" (hi)
       );
-   return ticks;
+   return ((U64)hi << 32) | lo;
 }
 
 #elif defined(LIBDTSHAPE_OS_MAC)
 
+static inline U64 readProfilerTicks()
+{
+   return mach_absolute_time();
+}
 
-#import <mach/mach_time.h>
+#else
 
-void startHighResolutionTimer(U32 time[2]) {
-	time[0] = mach_absolute_time();
+static inline U64 readProfilerTicks()
+{
+   return getSystemNanoseconds();
 }
 
-U32 endHighResolutionTimer(U32 time[2])  {
-	return mach_absolute_time() - time[0];
-}
+#endif
 
-#else
+//-----------------------------------------------------------------------------
 
-void startHighResolutionTimer(U32 time[2])
+/// A completed zone, as written to a thread's ring.
+struct ProfilerZoneEvent
 {
-}
+   ProfilerRootData *mRoot;
+   U64 mStartTicks;
+   U64 mEndTicks;
+   U64 mChildTicks;     ///< Time spent in recorded child zones.
+};
+
+/// A zone kept for writeChromeTrace().
+struct ProfilerTraceEvent
+{
+   ProfilerRootData *mRoot;
+   U64 mStartTicks;
+   U64 mEndTicks;
+   U32 mThreadId;
+};
 
-U32 endHighResolutionTimer(U32 time[2])
+struct ProfilerZoneTotals
 {
-   return 1;
-}
+   U32 mInvokeCount;
+   U64 mTotalTicks;
+   U64 mSelfTicks;
+   U64 mMaxTicks;
+};
+
+/// Profiler state for one thread. The zone stack is only touched by the
+/// thread itself; the ring has that thread as its single producer and
+/// Profiler::_flushThreadEvents() as its single consumer.
+struct ProfilerThreadData
+{
+   enum
+   {
+      MaxStackDepth = 256,
+      RingSize = 1 << 14,     ///< Must be a power of two.
+   };
 
-#endif
+   struct StackEntry
+   {
+      ProfilerRootData *mRoot;   ///< NULL if this zone isn't being recorded.
+      U64 mStartTicks;
+      U64 mChildTicks;
+   };
+
+   ProfilerThreadData *mNext;
+   volatile U32 mInUse;    ///< Cleared by Profiler::releaseThread() so another thread can take it.
+   U32 mThreadId;
+   char mName[64];
+
+   S32 mStackDepth;
+   bool mRecording;     ///< Latched from Profiler::enable() when the stack is empty.
+   StackEntry mStack[MaxStackDepth];
+
+   ProfilerZoneEvent *mRing;
+   volatile U32 mWriteCount;
+   volatile U32 mReadCount;
+   volatile U32 mDroppedCount;
+
+   // The rest is only touched with the flush mutex held
+   Vector<ProfilerZoneTotals> mTotals;
+   U32 mSummaryDroppedCount;
+};
+
+enum
+{
+   MaxTraceEvents = 1 << 21,
+   FlushIntervalMs = 16,
+};
+
+static PROFILER_THREAD_LOCAL ProfilerThreadData *sThreadData = NULL;
+
+static Vector<ProfilerTraceEvent> sTraceEvents;
+static U32 sNumDroppedTraceEvents = 0;
+
+//-----------------------------------------------------------------------------
 
 Profiler::Profiler()
 {
@@ -202,6 +259,15 @@ Profiler::Profiler()
    mDumpToConsole   = false;
    mDumpToFile      = false;
    mDumpFileName[0] = '\0';
+
+   mThreadList = NULL;
+   mCalibrationTicks = readProfilerTicks();
+   mCalibrationNanoseconds = getSystemNanoseconds();
+   mNanosecondsPerTick = 0;
+   mLastFlushTicks = mCalibrationTicks;
+   mLastSummaryTicks = mCalibrationTicks;
+   mSummaryInterval = 0;
+   mCapturingTrace = false;
 }
 
 Profiler::~Profiler()
@@ -209,6 +275,15 @@ Profiler::~Profiler()
    reset();
    free(mRootProfilerData);
    gProfiler = NULL;
+
+   // Any other threads are gone by now
+   while (mThreadList)
+   {
+      ProfilerThreadData *thread = mThreadList;
+      mThreadList = thread->mNext;
+      free(thread->mRing);
+      delete thread;
+   }
 }
 
 void Profiler::reset()
@@ -236,6 +311,16 @@ void Profiler::reset()
    mCurrentProfilerData->mSubTime = 0;
    mCurrentProfilerData->mSubDepth = 0;
    mCurrentProfilerData->mLastSeenProfiler = 0;
+
+   MutexHandle handle(mFlushMutex);
+   _flushThreadEvents();
+   for (ProfilerThreadData *thread = mThreadList; thread; thread = thread->mNext)
+   {
+      if (thread->mTotals.size())
+         dMemset(thread->mTotals.address(), 0, thread->mTotals.size() * sizeof(ProfilerZoneTotals));
+      thread->mSummaryDroppedCount = thread->mDroppedCount;
+   }
+   mLastSummaryTicks = readProfilerTicks();
 }
 
 static Profiler aProfiler; // allocate the global profiler
@@ -247,9 +332,18 @@ ProfilerRootData::ProfilerRootData(const char *name)
          AssertFatal( false, avar( "Duplicate profile name: %s", name ) );
 
    mName = name;
-   mNameHash = Torque::hash((const U8*)name, dStrlen(name), 0);
-   mNextRoot = sRootList;
-   sRootList = this;
+   mNameHash = hash((const U8*)name, dStrlen(name), 0);
+
+   // Roots are usually function statics, so they may be created on any thread
+   do
+   {
+      mNextRoot = sRootList;
+   } while (!dCompareAndSwap(sRootList, mNextRoot, this));
+   do
+   {
+      mIndex = sRootCount;
+   } while (!dCompareAndSwap(sRootCount, mIndex, mIndex + 1));
+
    mTotalTime = 0;
    mTotalInvokeCount = 0;
    mFirstProfilerData = NULL;
@@ -318,6 +412,11 @@ String Profiler::constructProfilePath(ProfilerData * pd)
 #endif
 void Profiler::hashPush(ProfilerRootData *root)
 {
+   ProfilerThreadData *thread = sThreadData;
+   if(!thread)
+      thread = _registerThread();
+   _pushThreadZone(thread, root);
+
 #ifdef LIBDTSHAPE_MULTITHREAD
    // Ignore non-main-thread profiler activity.
    if( !ThreadManager::isMainThread() )
@@ -386,7 +485,7 @@ void Profiler::hashPush(ProfilerRootData *root)
    }
    root->mTotalInvokeCount++;
    nextProfiler->mInvokeCount++;
-   startHighResolutionTimer(nextProfiler->mStartTime);
+   nextProfiler->mStartTime = readProfilerTicks();
    mCurrentProfilerData->mLastSeenProfiler = nextProfiler;
    mCurrentProfilerData = nextProfiler;
 }
@@ -413,12 +512,31 @@ void Profiler::dumpToFile(const char* fileName)
 
 void Profiler::hashPop(ProfilerRootData *expected)
 {
+   ProfilerThreadData *thread = sThreadData;
+   AssertFatal(thread, "Profiler::hashPop - no matching hashPush on this thread!");
+   _popThreadZone(thread);
+
 #ifdef LIBDTSHAPE_MULTITHREAD
    // Ignore non-main-thread profiler activity.
    if( !ThreadManager::isMainThread() )
       return;
 #endif
 
+   // Collect the other threads' zones once the main thread is between frames
+   if(thread->mStackDepth == 0 && thread->mRecording)
+   {
+      const U64 now = readProfilerTicks();
+      const bool ringFilling = thread->mWriteCount - thread->mReadCount >= ProfilerThreadData::RingSize / 2;
+      if((ringFilling || (now - mLastFlushTicks) * getNanosecondsPerTick() >= FlushIntervalMs * 1.0e6) && mFlushMutex.tryLock())
+      {
+         _flushThreadEvents();
+         mLastFlushTicks = now;
+         if(mSummaryInterval && (now - mLastSummaryTicks) * mNanosecondsPerTick >= mSummaryInterval * 1.0e6)
+            _dumpThreadSummary();
+         mFlushMutex.unlock();
+      }
+   }
+
    mStackDepth--;
    PROFILER_DEBUG_POP_NODE();
    AssertFatal(mStackDepth >= 0, "Stack underflow in profiler.  You may have mismatched PROFILE_START and PROFILE_ENDs");
@@ -435,7 +553,7 @@ void Profiler::hashPop(ProfilerRootData *expected)
          AssertISV(expected == mCurrentProfilerData->mRoot, "Profiler::hashPop - didn't get expected ProfilerRoot!");
       }
 
-      F64 fElapsed = endHighResolutionTimer(mCurrentProfilerData->mStartTime);
+      F64 fElapsed = (F64)(readProfilerTicks() - mCurrentProfilerData->mStartTime);
 
       mCurrentProfilerData->mTotalTime += fElapsed;
       mCurrentProfilerData->mParent->mSubTime += fElapsed; // mark it in the parent as well...
@@ -451,10 +569,10 @@ void Profiler::hashPop(ProfilerRootData *expected)
       if(mDumpToConsole || mDumpToFile)
       {
          dump();
-         startHighResolutionTimer(mCurrentProfilerData->mStartTime);
+         mCurrentProfilerData->mStartTime = readProfilerTicks();
       }
       if(!mEnabled && mNextEnable)
-         startHighResolutionTimer(mCurrentProfilerData->mStartTime);
+         mCurrentProfilerData->mStartTime = readProfilerTicks();
 
 #if defined(LIBDTSHAPE_OS_WIN32)
       // The high performance counters under win32 are unreliable when running on multiple
@@ -605,7 +723,7 @@ void Profiler::dump()
       Log::printf("Ordered by stack trace total time -");
       Log::printf("%% Time  %% NSTime  Invoke #  Name");
 
-      mCurrentProfilerData->mTotalTime = endHighResolutionTimer(mCurrentProfilerData->mStartTime);
+      mCurrentProfilerData->mTotalTime = (F64)(readProfilerTicks() - mCurrentProfilerData->mStartTime);
 
       char depthBuffer[MaxStackDepth * 2 + 1];
       depthBuffer[0] = 0;
@@ -645,7 +763,7 @@ void Profiler::dump()
          dStrcpy(buffer, "%%NSTime  %% Time  Invoke #  Name\n");
          fws.write(dStrlen(buffer), buffer);
 
-      mCurrentProfilerData->mTotalTime = endHighResolutionTimer(mCurrentProfilerData->mStartTime);
+      mCurrentProfilerData->mTotalTime = (F64)(readProfilerTicks() - mCurrentProfilerData->mStartTime);
 
       char depthBuffer[MaxStackDepth * 2 + 1];
       depthBuffer[0] = 0;
@@ -683,6 +801,355 @@ void Profiler::enableMarker(const char *marker, bool enable)
    }
 }
 
+//-----------------------------------------------------------------------------
+
+static void initThreadName(ProfilerThreadData *thread)
+{
+   thread->mThreadId = Thread::getCurrentThreadId();
+   if(ThreadManager::isMainThread())
+      dStrcpy(thread->mName, "Main");
+   else
+      dSprintf(thread->mName, sizeof(thread->mName), "Thread %u", thread->mThreadId);
+
+   thread->mStackDepth = 0;
+   thread->mRecording = false;
+}
+
+ProfilerThreadData *Profiler::_registerThread()
+{
+   // Take over the data of a thread which has exited, if there is one. Its
+   // ring was drained when it was released, so only the totals are left.
+   for(ProfilerThreadData *thread = mThreadList; thread; thread = thread->mNext)
+   {
+      if(thread->mInUse || !dCompareAndSwap(thread->mInUse, 0, 1))
+         continue;
+
+      MutexHandle handle(mFlushMutex);
+      initThreadName(thread);
+      if(thread->mTotals.size())
+         dMemset(thread->mTotals.address(), 0, thread->mTotals.size() * sizeof(ProfilerZoneTotals));
+      thread->mSummaryDroppedCount = thread->mDroppedCount;
+
+      sThreadData = thread;
+      return thread;
+   }
+
+   ProfilerThreadData *thread = new ProfilerThreadData;
+   thread->mInUse = 1;
+   initThreadName(thread);
+   thread->mRing = (ProfilerZoneEvent *) malloc(sizeof(ProfilerZoneEvent) * ProfilerThreadData::RingSize);
+   thread->mWriteCount = 0;
+   thread->mReadCount = 0;
+   thread->mDroppedCount = 0;
+   thread->mSummaryDroppedCount = 0;
+
+   // Entries are recycled rather than unlinked, so a plain push is enough
+   do
+   {
+      thread->mNext = mThreadList;
+   } while(!dCompareAndSwap(mThreadList, thread->mNext, thread));
+
+   sThreadData = thread;
+   return thread;
+}
+
+void Profiler::releaseThread()
+{
+   ProfilerThreadData *thread = sThreadData;
+   if(!thread)
+      return;
+
+   AssertFatal(thread->mStackDepth == 0, "Profiler::releaseThread - thread exited inside a profile block");
+
+   // Drain the ring while it still belongs to this thread
+   {
+      MutexHandle handle(mFlushMutex);
+      _flushThreadEvents();
+   }
+
+   sThreadData = NULL;
+   dCompareAndSwap(thread->mInUse, 1, 0);
+}
+
+void Profiler::_pushThreadZone(ProfilerThreadData *thread, ProfilerRootData *root)
+{
+   const S32 depth = thread->mStackDepth++;
+   AssertFatal(depth < ProfilerThreadData::MaxStackDepth,
+                  "Stack overflow in profiler.  You may have mismatched PROFILE_START and PROFILE_ENDs");
+   if(depth == 0)
+      thread->mRecording = mNextEnable;
+
+   ProfilerThreadData::StackEntry &entry = thread->mStack[depth];
+   if(thread->mRecording && root->mEnabled)
+   {
+      entry.mRoot = root;
+      entry.mChildTicks = 0;
+      entry.mStartTicks = readProfilerTicks();
+   }
+   else
+      entry.mRoot = NULL;
+}
+
+void Profiler::_popThreadZone(ProfilerThreadData *thread)
+{
+   const S32 depth = --thread->mStackDepth;
+   AssertFatal(depth >= 0, "Stack underflow in profiler.  You may have mismatched PROFILE_START and PROFILE_ENDs");
+
+   const ProfilerThreadData::StackEntry &entry = thread->mStack[depth];
+   if(!entry.mRoot)
+      return;
+
+   const U64 endTicks = readProfilerTicks();
+   for(S32 i = depth - 1; i >= 0; i--)
+   {
+      if(thread->mStack[i].mRoot)
+      {
+         thread->mStack[i].mChildTicks += endTicks - entry.mStartTicks;
+         break;
+      }
+   }
+
+   const U32 writeCount = thread->mWriteCount;
+   if(writeCount - thread->mReadCount >= ProfilerThreadData::RingSize)
+   {
+      // Nobody is flushing often enough; drop the zone rather than block
+      thread->mDroppedCount++;
+      return;
+   }
+
+   ProfilerZoneEvent &event = thread->mRing[writeCount & (ProfilerThreadData::RingSize - 1)];
+   event.mRoot = entry.mRoot;
+   event.mStartTicks = entry.mStartTicks;
+   event.mEndTicks = endTicks;
+   event.mChildTicks = entry.mChildTicks;
+
+   // Publish; the atomic add keeps the event stores ahead of the new count
+   dFetchAndAdd(thread->mWriteCount, 1);
+}
+
+void Profiler::_updateCalibration()
+{
+   // The counter is assumed to be invariant, so the longer the baseline the
+   // better the estimate. Make sure there's at least a millisecond of it.
+   U64 ticks, nanoseconds;
+   do
+   {
+      ticks = readProfilerTicks() - mCalibrationTicks;
+      nanoseconds = getSystemNanoseconds() - mCalibrationNanoseconds;
+   } while(nanoseconds < 1000000);
+
+   if(ticks)
+      mNanosecondsPerTick = (F64)nanoseconds / (F64)ticks;
+}
+
+F64 Profiler::getNanosecondsPerTick()
+{
+   if(mNanosecondsPerTick == 0)
+      _updateCalibration();
+   return mNanosecondsPerTick;
+}
+
+U32 Profiler::getNumDroppedEvents() const
+{
+   U32 count = 0;
+   for(ProfilerThreadData *thread = mThreadList; thread; thread = thread->mNext)
+      count += thread->mDroppedCount;
+   return count;
+}
+
+void Profiler::setThreadName(const char *name)
+{
+   ProfilerThreadData *thread = sThreadData;
+   if(!thread)
+      thread = _registerThread();
+   dStrncpy(thread->mName, name, sizeof(thread->mName) - 1);
+   thread->mName[sizeof(thread->mName) - 1] = 0;
+}
+
+void Profiler::flushThreadEvents()
+{
+   MutexHandle handle(mFlushMutex);
+   _flushThreadEvents();
+}
+
+void Profiler::_flushThreadEvents()
+{
+   _updateCalibration();
+
+   for(ProfilerThreadData *thread = mThreadList; thread; thread = thread->mNext)
+   {
+      const U32 readCount = thread->mReadCount;
+      const U32 writeCount = dAtomicRead(thread->mWriteCount);
+
+      for(U32 i = readCount; i != writeCount; i++)
+      {
+         const ProfilerZoneEvent &event = thread->mRing[i & (ProfilerThreadData::RingSize - 1)];
+
+         const U32 index = event.mRoot->mIndex;
+         if(index >= thread->mTotals.size())
+         {
+            const U32 oldSize = thread->mTotals.size();
+            thread->mTotals.setSize(ProfilerRootData::sRootCount);
+            dMemset(thread->mTotals.address() + oldSize, 0, (thread->mTotals.size() - oldSize) * sizeof(ProfilerZoneTotals));
+         }
+
+         const U64 elapsed = event.mEndTicks - event.mStartTicks;
+         ProfilerZoneTotals &totals = thread->mTotals[index];
+         totals.mInvokeCount++;
+         totals.mTotalTicks += elapsed;
+         totals.mSelfTicks += elapsed - event.mChildTicks;
+         if(elapsed > totals.mMaxTicks)
+            totals.mMaxTicks = elapsed;
+
+         if(mCapturingTrace)
+         {
+            if(sTraceEvents.size() < MaxTraceEvents)
+            {
+               sTraceEvents.increment();
+               ProfilerTraceEvent &traceEvent = sTraceEvents.last();
+               traceEvent.mRoot = event.mRoot;
+               traceEvent.mStartTicks = event.mStartTicks;
+               traceEvent.mEndTicks = event.mEndTicks;
+               traceEvent.mThreadId = thread->mThreadId;
+            }
+            else
+               sNumDroppedTraceEvents++;
+         }
+      }
+
+      dFetchAndAdd(thread->mReadCount, writeCount - readCount);
+   }
+}
+
+void Profiler::dumpThreadSummary()
+{
+   MutexHandle handle(mFlushMutex);
+   _flushThreadEvents();
+   _dumpThreadSummary();
+}
+
+void Profiler::_dumpThreadSummary()
+{
+   const U64 now = readProfilerTicks();
+   const F64 msPerTick = mNanosecondsPerTick * 1.0e-6;
+
+   Log::printf("Profiler thread summary (%.1f ms):", (now - mLastSummaryTicks) * msPerTick);
+
+   Vector<ProfilerRootData *> roots;
+   roots.setSize(ProfilerRootData::sRootCount);
+   for(ProfilerRootData *walk = ProfilerRootData::sRootList; walk; walk = walk->mNextRoot)
+      if(walk->mIndex < roots.size())
+         roots[walk->mIndex] = walk;
+
+   Vector<U32> order;
+   for(ProfilerThreadData *thread = mThreadList; thread; thread = thread->mNext)
+   {
+      // Gather the zones this thread entered, ordered by self time
+      order.clear();
+      for(U32 i = 0; i < thread->mTotals.size(); i++)
+      {
+         if(!thread->mTotals[i].mInvokeCount)
+            continue;
+
+         U32 pos = order.size();
+         order.increment();
+         while(pos > 0 && thread->mTotals[order[pos - 1]].mSelfTicks < thread->mTotals[i].mSelfTicks)
+         {
+            order[pos] = order[pos - 1];
+            pos--;
+         }
+         order[pos] = i;
+      }
+
+      const U32 dropped = thread->mDroppedCount - thread->mSummaryDroppedCount;
+      thread->mSummaryDroppedCount += dropped;
+      if(order.empty() && !dropped)
+         continue;
+
+      Log::printf("  %s (thread %u), %u zones dropped", thread->mName, thread->mThreadId, dropped);
+      Log::printf("     Self ms   Total ms   Invoke #     Avg us     Max us  Name");
+      for(U32 i = 0; i < order.size(); i++)
+      {
+         ProfilerZoneTotals &totals = thread->mTotals[order[i]];
+         Log::printf("  %10.3f %10.3f %10u %10.2f %10.2f  %s",
+                     totals.mSelfTicks * msPerTick,
+                     totals.mTotalTicks * msPerTick,
+                     totals.mInvokeCount,
+                     totals.mTotalTicks * msPerTick * 1000.0 / totals.mInvokeCount,
+                     totals.mMaxTicks * msPerTick * 1000.0,
+                     roots[order[i]] ? roots[order[i]]->mName : "?");
+      }
+
+      dMemset(thread->mTotals.address(), 0, thread->mTotals.size() * sizeof(ProfilerZoneTotals));
+   }
+
+   mLastSummaryTicks = now;
+}
+
+void Profiler::startTraceCapture()
+{
+   MutexHandle handle(mFlushMutex);
+
+   // Zones from before the capture only go into the totals
+   _flushThreadEvents();
+   sTraceEvents.clear();
+   sNumDroppedTraceEvents = 0;
+   mCapturingTrace = true;
+}
+
+bool Profiler::writeChromeTrace(const char *fileName)
+{
+   MutexHandle handle(mFlushMutex);
+   _flushThreadEvents();
+   mCapturingTrace = false;
+
+   FileStream fws;
+   if(!fws.open(fileName, FileStream::Write))
+   {
+      Log::errorf("Profiler: unable to write trace to %s", fileName);
+      sTraceEvents.clear();
+      return false;
+   }
+
+   char buffer[512];
+   dStrcpy(buffer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+   fws.write(dStrlen(buffer), buffer);
+
+   const char *separator = "";
+   for(ProfilerThreadData *thread = mThreadList; thread; thread = thread->mNext)
+   {
+      dSprintf(buffer, sizeof(buffer), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+               separator, thread->mThreadId, thread->mName);
+      fws.write(dStrlen(buffer), buffer);
+      separator = ",\n";
+   }
+
+   // Chrome wants microseconds
+   const F64 usPerTick = mNanosecondsPerTick * 1.0e-3;
+   for(U32 i = 0; i < sTraceEvents.size(); i++)
+   {
+      const ProfilerTraceEvent &event = sTraceEvents[i];
+      dSprintf(buffer, sizeof(buffer), "%s{\"name\":\"%s\",\"cat\":\"DTShape\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+               separator, event.mRoot->mName, event.mThreadId,
+               (event.mStartTicks - mCalibrationTicks) * usPerTick,
+               (event.mEndTicks - event.mStartTicks) * usPerTick);
+      fws.write(dStrlen(buffer), buffer);
+      separator = ",\n";
+   }
+
+   dStrcpy(buffer, "\n]}\n");
+   fws.write(dStrlen(buffer), buffer);
+   fws.close();
+
+   Log::printf("Profiler: wrote %u zones to %s", sTraceEvents.size(), fileName);
+   if(sNumDroppedTraceEvents)
+      Log::warnf("Profiler: trace capture was full, %u zones were dropped", sNumDroppedTraceEvents);
+
+   sTraceEvents.clear();
+   sTraceEvents.compact();
+   return true;
+}
+
 #endif
 
 //-----------------------------------------------------------------------------
@@ -27,6 +27,12 @@
 #include "libDTShapeConfig.h"
 #endif
 
+#ifdef LIBDTSHAPE_ENABLE_PROFILER
+#ifndef _PLATFORM_THREADS_MUTEX_H_
+#include "platform/threads/mutex.h"
+#endif
+#endif
+
 //-----------------------------------------------------------------------------
 
 BEGIN_NS(DTShape)
@@ -37,6 +43,7 @@ BEGIN_NS(DTShape)
 
 struct ProfilerData;
 struct ProfilerRootData;
+struct ProfilerThreadData;
 /// The Profiler is used to see how long a specific chunk of code takes to execute.
 /// All values outputted by the profiler are percentages of the time that it takes
 /// to run entire main loop.
@@ -74,6 +81,23 @@ struct ProfilerRootData;
 /// //possibly some code here
 /// PROFILE_END();
 /// @endcode
+///
+/// The percentage tree above only covers the main thread. In addition, every
+/// thread that enters a profile block gets its own zone stack and a lock-free
+/// ring of completed zones. The rings are drained on the main thread (or by
+/// flushThreadEvents()) into per-thread totals, which can be printed with
+/// dumpThreadSummary() or periodically via setSummaryInterval(), and which
+/// can be captured to a Chrome trace file (chrome://tracing, Perfetto):
+/// @code
+/// gProfiler->enable(true);
+/// gProfiler->startTraceCapture();
+/// // ... frames ...
+/// gProfiler->writeChromeTrace("frames.json");
+/// @endcode
+///
+/// Zones are timed with the CPU timestamp counter where available, and the
+/// counter is calibrated against the system clock when converting to
+/// nanoseconds.
 class Profiler
 {
    enum {
@@ -93,14 +117,43 @@ class Profiler
    bool mDumpToConsole;
    bool mDumpToFile;
    char mDumpFileName[DumpFileNameLength];
+
+   /// Threads that have entered a profile block, linked lock-free. Entries
+   /// are never unlinked; releaseThread() frees one for the next thread.
+   ProfilerThreadData * volatile mThreadList;
+
+   /// Serializes draining of the thread rings.
+   Mutex mFlushMutex;
+
+   U64 mCalibrationTicks;
+   U64 mCalibrationNanoseconds;
+   F64 mNanosecondsPerTick;
+
+   U64 mLastFlushTicks;
+   U64 mLastSummaryTicks;
+   U32 mSummaryInterval;
+
+   bool mCapturingTrace;
+
    void dump();
    void validate();
+
+   ProfilerThreadData *_registerThread();
+   void _pushThreadZone(ProfilerThreadData *thread, ProfilerRootData *root);
+   void _popThreadZone(ProfilerThreadData *thread);
+   void _flushThreadEvents();
+   void _dumpThreadSummary();
+   void _updateCalibration();
 public:
    Profiler();
    ~Profiler();
 
    /// Reset the data in the profiler
    void reset();
+   /// Called by a thread as it exits, so the next thread to enter a profile
+   /// block reuses its ring instead of allocating another. Thread does this
+   /// for its threads; threads created some other way have to call it.
+   void releaseThread();
    /// Dumps the profile to console
    void dumpToConsole();
    /// Dumps the profile data to a file
@@ -115,6 +168,34 @@ public:
    void hashPop(ProfilerRootData *expected=NULL);
    /// Enable a profiler marker
    void enableMarker(const char *marker, bool enabled);
+
+   /// @name Per-thread Zones
+   /// @{
+
+   /// Names the calling thread in summaries and traces.
+   void setThreadName(const char *name);
+   /// Drains the zone rings of every thread into the per-thread totals
+   /// (and the trace capture, if one is running). Safe to call from any thread.
+   void flushThreadEvents();
+   /// Prints the per-thread zone totals gathered since the last summary, then
+   /// clears them.
+   void dumpThreadSummary();
+   /// Prints a thread summary every @a ms milliseconds. This is checked
+   /// whenever the main thread leaves its outermost profile block; pass 0
+   /// to disable.
+   void setSummaryInterval(U32 ms) { mSummaryInterval = ms; }
+   /// Starts recording individual zones for writeChromeTrace().
+   void startTraceCapture();
+   /// Writes the zones recorded since startTraceCapture() as Chrome trace
+   /// JSON, and stops the capture.
+   bool writeChromeTrace(const char *fileName);
+   bool isCapturingTrace() const { return mCapturingTrace; }
+   /// Returns the calibrated length of a profiler tick.
+   F64 getNanosecondsPerTick();
+   /// Returns the number of zones lost because a thread's ring was full.
+   U32 getNumDroppedEvents() const;
+
+   /// @}
 #ifdef LIBDTSHAPE_ENABLE_PROFILE_PATH
    /// Get current profile path
    String getProfilePath();
@@ -134,9 +215,11 @@ struct ProfilerRootData
    F64 mTotalTime;
    F64 mSubTime;
    U32 mTotalInvokeCount;
+   U32 mIndex;          ///< Slot in the per-thread zone totals.
    bool mEnabled;
 
    static ProfilerRootData *sRootList;
+   static U32 sRootCount;
 
    ProfilerRootData(const char *name);
 };
@@ -159,7 +242,7 @@ struct ProfilerData
    U32 mHash;
    U32 mSubDepth;
    U32 mInvokeCount;
-   U32 mStartTime[2];
+   U64 mStartTime;
    F64 mTotalTime;
    F64 mSubTime;
 #ifdef LIBDTSHAPE_ENABLE_PROFILE_PATH
@@ -0,0 +1,88 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _PLATFORM_THREADS_MUTEX_H_
+#define _PLATFORM_THREADS_MUTEX_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+struct PlatformMutexData;
+
+/// A simple non-recursive mutual exclusion lock.
+///
+/// Implemented per platform in platform/posix/threads.cpp and
+/// platform/win32/threads.cpp.
+class Mutex
+{
+protected:
+   PlatformMutexData *mData;
+
+   Mutex( const Mutex& );              ///< Not copyable.
+   Mutex& operator=( const Mutex& );   ///< Not assignable.
+
+public:
+   Mutex();
+   ~Mutex();
+
+   /// Blocks until the lock is acquired.
+   void lock();
+
+   /// Acquires the lock if it is free, returning false otherwise.
+   bool tryLock();
+
+   void unlock();
+};
+
+/// Holds a Mutex locked for the lifetime of the handle.
+///
+/// @code
+/// {
+///    MutexHandle handle( mMutex );
+///    // ... protected code ...
+/// }
+/// @endcode
+class MutexHandle
+{
+protected:
+   Mutex &mMutex;
+
+   MutexHandle& operator=( const MutexHandle& );
+
+public:
+   MutexHandle( Mutex &mutex ) : mMutex( mutex ) { mMutex.lock(); }
+   ~MutexHandle() { mMutex.unlock(); }
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _PLATFORM_THREADS_MUTEX_H_
@@ -0,0 +1,69 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _PLATFORM_THREADS_SEMAPHORE_H_
+#define _PLATFORM_THREADS_SEMAPHORE_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+struct PlatformSemaphoreData;
+
+/// A counting semaphore.
+///
+/// acquire() blocks while the count is zero and then decrements it,
+/// release() increments it and wakes up any waiting threads.
+class Semaphore
+{
+protected:
+   PlatformSemaphoreData *mData;
+
+   Semaphore( const Semaphore& );
+   Semaphore& operator=( const Semaphore& );
+
+public:
+   Semaphore( S32 initialCount = 0 );
+   ~Semaphore();
+
+   /// Blocks until the count is non-zero, then decrements it.
+   void acquire();
+
+   /// Decrements the count if non-zero, returning false otherwise.
+   bool tryAcquire();
+
+   /// Increments the count by the specified amount.
+   void release( S32 count = 1 );
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _PLATFORM_THREADS_SEMAPHORE_H_
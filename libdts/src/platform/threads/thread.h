@@ -0,0 +1,104 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _PLATFORM_THREADS_THREAD_H_
+#define _PLATFORM_THREADS_THREAD_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+struct PlatformThreadData;
+
+typedef void (*ThreadRunFunction)( void *data );
+
+/// A native OS thread.
+///
+/// Either pass a ThreadRunFunction to the constructor or derive from
+/// Thread and override run().  The thread does not start executing
+/// until start() is called, and must be joined before it is deleted.
+class Thread
+{
+protected:
+   PlatformThreadData *mData;
+
+   ThreadRunFunction mRunFunction;
+   void *mRunData;
+
+   Thread( const Thread& );
+   Thread& operator=( const Thread& );
+
+public:
+   Thread( ThreadRunFunction func = NULL, void *data = NULL );
+   virtual ~Thread();
+
+   /// Starts executing run() on a new thread.
+   void start();
+
+   /// Blocks until the thread has exited.  Returns false if the
+   /// thread was never started.
+   bool join();
+
+   /// Returns true if the thread has been started and not yet joined.
+   bool isAlive() const;
+
+   /// Thread entry point.  The default implementation calls the
+   /// ThreadRunFunction passed to the constructor.
+   virtual void run( void *data );
+
+   /// Returns an identifier for the calling thread.
+   static U32 getCurrentThreadId();
+
+   /// Returns the number of hardware threads reported by the OS.
+   static U32 getNumHardwareThreads();
+};
+
+/// Keeps track of which thread owns the library, so code which is not
+/// thread safe (such as the profiler) can ignore other threads.
+class ThreadManager
+{
+protected:
+   static U32 smMainThreadId;
+
+public:
+   /// Marks the calling thread as the main thread.  Called by DTShapeInit::init().
+   static void setMainThread() { smMainThreadId = Thread::getCurrentThreadId(); }
+
+   static U32 getMainThreadId() { return smMainThreadId; }
+
+   /// Returns true if called from the main thread, or if no main
+   /// thread has been set yet.
+   static bool isMainThread() { return smMainThreadId == 0 || smMainThreadId == Thread::getCurrentThreadId(); }
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _PLATFORM_THREADS_THREAD_H_
@@ -0,0 +1,188 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "platform/threads/threadPool.h"
+#include "platform/threads/thread.h"
+#include "platform/profiler.h"
+#include "core/strings/stringFunctions.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+ThreadPool *ThreadPool::smGlobal = NULL;
+
+/// Guards creation and destruction of smGlobal
+static Mutex sGlobalMutex;
+
+class ThreadPool::WorkerThread : public Thread
+{
+protected:
+   ThreadPool *mPool;
+   U32 mWorkerIndex;
+
+public:
+   WorkerThread( ThreadPool *pool, U32 workerIndex ) : mPool( pool ), mWorkerIndex( workerIndex ) {}
+
+   virtual void run( void *data )
+   {
+#ifdef LIBDTSHAPE_ENABLE_PROFILER
+      if ( gProfiler )
+      {
+         char name[32];
+         dSprintf( name, sizeof( name ), "ThreadPool worker %u", mWorkerIndex );
+         gProfiler->setThreadName( name );
+      }
+#endif
+
+      for ( ;; )
+      {
+         mPool->mWakeSemaphore.acquire();
+
+         if ( mPool->mShutdown )
+            return;
+
+         mPool->_doWork( mWorkerIndex );
+         mPool->mDoneSemaphore.release();
+      }
+   }
+};
+
+ThreadPool::ThreadPool( S32 numThreads )
+   :  mFunction( NULL ),
+      mData( NULL ),
+      mNextIndex( 0 ),
+      mCount( 0 ),
+      mGrainSize( 1 ),
+      mShutdown( false )
+{
+   if ( numThreads < 0 )
+      numThreads = (S32)Thread::getNumHardwareThreads() - 1;
+
+   // Worker 0 is always the thread calling parallelFor
+   for ( S32 i = 0; i < numThreads; i++ )
+   {
+      Thread *thread = new WorkerThread( this, i + 1 );
+      mThreads.push_back( thread );
+      thread->start();
+   }
+}
+
+ThreadPool::~ThreadPool()
+{
+   mShutdown = true;
+   mWakeSemaphore.release( mThreads.size() );
+
+   for ( U32 i = 0; i < mThreads.size(); i++ )
+   {
+      mThreads[i]->join();
+      delete mThreads[i];
+   }
+   mThreads.clear();
+}
+
+bool ThreadPool::_getWork( U32 &start, U32 &end )
+{
+   MutexHandle handle( mIndexMutex );
+
+   if ( mNextIndex >= mCount )
+      return false;
+
+   start = mNextIndex;
+   end = getMin( mCount, start + mGrainSize );
+   mNextIndex = end;
+   return true;
+}
+
+void ThreadPool::_doWork( U32 workerIndex )
+{
+   U32 start, end;
+   while ( _getWork( start, end ) )
+   {
+      for ( U32 i = start; i < end; i++ )
+         mFunction( mData, i, workerIndex );
+   }
+}
+
+void ThreadPool::parallelFor( U32 count, WorkFunction func, void *data, U32 grainSize )
+{
+   if ( count == 0 )
+      return;
+
+   PROFILE_SCOPE( ThreadPool_parallelFor );
+
+   // Inline jobs run as worker 0 too, so they wait their turn like any other
+   MutexHandle jobHandle( mJobMutex );
+
+   // Not worth waking anyone up for
+   if ( mThreads.empty() || count == 1 )
+   {
+      for ( U32 i = 0; i < count; i++ )
+         func( data, i, 0 );
+      return;
+   }
+
+   // Aim for a few blocks per worker so uneven items balance out
+   if ( grainSize == 0 )
+      grainSize = getMax( 1U, count / ( getNumWorkers() * 4 ) );
+
+   mIndexMutex.lock();
+   mFunction = func;
+   mData = data;
+   mNextIndex = 0;
+   mCount = count;
+   mGrainSize = grainSize;
+   mIndexMutex.unlock();
+
+   mWakeSemaphore.release( mThreads.size() );
+
+   _doWork( 0 );
+
+   // Wait for everyone to finish their last block
+   for ( U32 i = 0; i < mThreads.size(); i++ )
+      mDoneSemaphore.acquire();
+
+   mFunction = NULL;
+   mData = NULL;
+}
+
+ThreadPool &ThreadPool::getGlobal()
+{
+   MutexHandle handle( sGlobalMutex );
+   if ( !smGlobal )
+      smGlobal = new ThreadPool();
+   return *smGlobal;
+}
+
+void ThreadPool::destroyGlobal()
+{
+   MutexHandle handle( sGlobalMutex );
+   SAFE_DELETE( smGlobal );
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
@@ -0,0 +1,136 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _PLATFORM_THREADS_THREADPOOL_H_
+#define _PLATFORM_THREADS_THREADPOOL_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+#ifndef _TVECTOR_H_
+#include "core/util/tVector.h"
+#endif
+#ifndef _PLATFORM_THREADS_MUTEX_H_
+#include "platform/threads/mutex.h"
+#endif
+#ifndef _PLATFORM_THREADS_SEMAPHORE_H_
+#include "platform/threads/semaphore.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+class Thread;
+
+/// A fixed set of worker threads for running data parallel loops.
+///
+/// The pool runs one job at a time.  A job is a function which is called
+/// once for each index in [0, count), spread over the workers and the
+/// calling thread.  The worker index passed to the function is stable for
+/// the duration of the call and is always less than getNumWorkers(), so
+/// it can be used to select per-thread scratch memory.
+///
+/// @code
+/// static void skinOne( void *data, U32 index, U32 worker ) { ... }
+/// ThreadPool::getGlobal().parallelFor( instances.size(), skinOne, &instances );
+/// @endcode
+class ThreadPool
+{
+public:
+   typedef void (*WorkFunction)( void *data, U32 index, U32 workerIndex );
+
+protected:
+   class WorkerThread;
+   friend class WorkerThread;
+
+   Vector<Thread*> mThreads;
+
+   /// Serializes calls to parallelFor.
+   Mutex mJobMutex;
+
+   /// Protects the index range of the current job.
+   Mutex mIndexMutex;
+
+   /// Workers wait on this for a new job.
+   Semaphore mWakeSemaphore;
+
+   /// Released by each worker as it finishes the current job.
+   Semaphore mDoneSemaphore;
+
+   /// @name Current job
+   /// @{
+   WorkFunction mFunction;
+   void *mData;
+   U32 mNextIndex;
+   U32 mCount;
+   U32 mGrainSize;
+   bool mShutdown;
+   /// @}
+
+   static ThreadPool *smGlobal;
+
+   /// Grabs the next range of indices from the current job.
+   bool _getWork( U32 &start, U32 &end );
+
+   /// Runs the current job until no indices are left.
+   void _doWork( U32 workerIndex );
+
+public:
+
+   /// Creates a pool with the specified number of worker threads, not
+   /// counting the calling thread.  If numThreads is -1 one thread is
+   /// created per logical processor, minus one for the calling thread.
+   ThreadPool( S32 numThreads = -1 );
+   ~ThreadPool();
+
+   /// Returns the number of threads which participate in a job, including
+   /// the calling thread.
+   U32 getNumWorkers() const { return mThreads.size() + 1; }
+
+   /// Calls func( data, i, worker ) for each i in [0, count) and returns
+   /// once all of them have completed.  Indices are handed out in blocks
+   /// of grainSize; pass 0 to pick a block size from count.
+   ///
+   /// Calls from different threads are serialized, including those small
+   /// enough to run inline on the calling thread, so each worker index is
+   /// only ever in use by one thread at a time.
+   ///
+   /// @note Must not be called from inside a WorkFunction.
+   void parallelFor( U32 count, WorkFunction func, void *data, U32 grainSize = 0 );
+
+   /// Returns the shared pool, creating it on first use.  Safe to call
+   /// from any thread.
+   static ThreadPool &getGlobal();
+
+   /// Destroys the shared pool.  Called by DTShapeInit::shutdown().
+   static void destroyGlobal();
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _PLATFORM_THREADS_THREADPOOL_H_
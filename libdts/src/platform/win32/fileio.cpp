@@ -509,6 +509,65 @@ File *File::openFile(const String &file, File::AccessMode mode)
    return NULL;
 }
 
+class WinFileMapping : public FileMapping
+{
+public:
+   WinFileMapping(void *data, U32 size)
+   {
+      mData = data;
+      mSize = size;
+   }
+
+   virtual ~WinFileMapping()
+   {
+      UnmapViewOfFile(mData);
+   }
+};
+
+FileMapping *FileMapping::mapFile(const String &file, bool shared)
+{
+   TempAlloc< TCHAR > fname( file.length() + 1 );
+
+#ifdef UNICODE
+   convertUTF8toUTF16( file.c_str(), (UTF16*)fname.ptr, fname.size );
+#else
+   dStrcpy(fname, file.c_str());
+#endif
+   backslash( fname );
+
+   HANDLE handle = CreateFile(fname,
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      NULL,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+      NULL);
+   if (handle == INVALID_HANDLE_VALUE)
+      return NULL;
+
+   void *data = NULL;
+   LARGE_INTEGER size;
+   if (GetFileSizeEx(handle, &size) && size.QuadPart > 0 && size.QuadPart <= U32_MAX)
+   {
+      // PAGE_WRITECOPY + FILE_MAP_COPY gives a private copy-on-write view,
+      // PAGE_READONLY + FILE_MAP_READ a view shared with other processes
+      HANDLE mapping = CreateFileMapping(handle, NULL, shared ? PAGE_READONLY : PAGE_WRITECOPY, 0, 0, NULL);
+      if (mapping)
+      {
+         data = MapViewOfFile(mapping, shared ? FILE_MAP_READ : FILE_MAP_COPY, 0, 0, 0);
+
+         // The view holds its own references to the mapping and file
+         CloseHandle(mapping);
+      }
+   }
+   CloseHandle(handle);
+
+   if (!data)
+      return NULL;
+
+   return new WinFileMapping(data, (U32)size.QuadPart);
+}
+
 S32 Platform::compareFileTimes(const FileTime &a, const FileTime &b)
 {
    if(a.v2 > b.v2)
@@ -0,0 +1,189 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "platform/threads/mutex.h"
+#include "platform/threads/semaphore.h"
+#include "platform/threads/thread.h"
+#include "platform/profiler.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+// Mutex
+//-----------------------------------------------------------------------------
+
+struct PlatformMutexData
+{
+   CRITICAL_SECTION criticalSection;
+};
+
+Mutex::Mutex()
+{
+   mData = new PlatformMutexData;
+   InitializeCriticalSection( &mData->criticalSection );
+}
+
+Mutex::~Mutex()
+{
+   DeleteCriticalSection( &mData->criticalSection );
+   delete mData;
+}
+
+void Mutex::lock()
+{
+   EnterCriticalSection( &mData->criticalSection );
+}
+
+bool Mutex::tryLock()
+{
+   return TryEnterCriticalSection( &mData->criticalSection ) != 0;
+}
+
+void Mutex::unlock()
+{
+   LeaveCriticalSection( &mData->criticalSection );
+}
+
+//-----------------------------------------------------------------------------
+// Semaphore
+//-----------------------------------------------------------------------------
+
+struct PlatformSemaphoreData
+{
+   HANDLE semaphore;
+};
+
+Semaphore::Semaphore( S32 initialCount )
+{
+   mData = new PlatformSemaphoreData;
+   mData->semaphore = CreateSemaphore( NULL, initialCount, S32_MAX, NULL );
+}
+
+Semaphore::~Semaphore()
+{
+   CloseHandle( mData->semaphore );
+   delete mData;
+}
+
+void Semaphore::acquire()
+{
+   WaitForSingleObject( mData->semaphore, INFINITE );
+}
+
+bool Semaphore::tryAcquire()
+{
+   return WaitForSingleObject( mData->semaphore, 0 ) == WAIT_OBJECT_0;
+}
+
+void Semaphore::release( S32 count )
+{
+   if ( count > 0 )
+      ReleaseSemaphore( mData->semaphore, count, NULL );
+}
+
+//-----------------------------------------------------------------------------
+// Thread
+//-----------------------------------------------------------------------------
+
+struct PlatformThreadData
+{
+   HANDLE thread;
+};
+
+static unsigned __stdcall _threadEntry( void *arg )
+{
+   Thread *thread = reinterpret_cast<Thread*>( arg );
+   thread->run( NULL );
+
+#ifdef LIBDTSHAPE_ENABLE_PROFILER
+   if ( gProfiler )
+      gProfiler->releaseThread();
+#endif
+   return 0;
+}
+
+Thread::Thread( ThreadRunFunction func, void *data )
+   :  mRunFunction( func ),
+      mRunData( data )
+{
+   mData = new PlatformThreadData;
+   mData->thread = NULL;
+}
+
+Thread::~Thread()
+{
+   AssertFatal( mData->thread == NULL, "Thread::~Thread - thread was not joined before being deleted!" );
+   delete mData;
+}
+
+void Thread::start()
+{
+   AssertFatal( mData->thread == NULL, "Thread::start - thread already started!" );
+   mData->thread = (HANDLE)_beginthreadex( NULL, 0, _threadEntry, this, 0, NULL );
+   AssertFatal( mData->thread != NULL, "Thread::start - unable to create thread!" );
+}
+
+bool Thread::join()
+{
+   if ( mData->thread == NULL )
+      return false;
+
+   WaitForSingleObject( mData->thread, INFINITE );
+   CloseHandle( mData->thread );
+   mData->thread = NULL;
+   return true;
+}
+
+bool Thread::isAlive() const
+{
+   return mData->thread != NULL;
+}
+
+void Thread::run( void *data )
+{
+   if ( mRunFunction )
+      mRunFunction( mRunData );
+}
+
+U32 Thread::getCurrentThreadId()
+{
+   return ::GetCurrentThreadId();
+}
+
+U32 Thread::getNumHardwareThreads()
+{
+   SYSTEM_INFO info;
+   GetSystemInfo( &info );
+   return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
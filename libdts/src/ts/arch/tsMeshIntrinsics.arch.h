@@ -25,17 +25,57 @@
 
 //-----------------------------------------------------------------------------
 
+#if defined(LIBDTSHAPE_CPU_X86) || defined(LIBDTSHAPE_CPU_X86_64)
+# // Kernels using instruction sets beyond the compiler baseline are built
+# // with a per-function target, so the rest of the library still runs on
+# // older CPUs. initMeshIntrinsics only selects them if the CPU supports them.
+#  if defined(LIBDTSHAPE_COMPILER_VISUALC)
+#     define LIBDTSHAPE_TARGET_ISA(isa)
+#     if (_MSC_VER >= 1500)
+#        define LIBDTSHAPE_MESHINTRINSICS_SSE4
+#     endif
+#     if (_MSC_VER >= 1800)
+#        define LIBDTSHAPE_MESHINTRINSICS_AVX2
+#     endif
+#     if (_MSC_VER >= 1910)
+#        define LIBDTSHAPE_MESHINTRINSICS_AVX512
+#     endif
+#  elif defined(__clang__) || (LIBDTSHAPE_COMPILER_GCC >= 40900)
+#     define LIBDTSHAPE_TARGET_ISA(isa) __attribute__((target(isa)))
+#     define LIBDTSHAPE_MESHINTRINSICS_SSE4
+#     define LIBDTSHAPE_MESHINTRINSICS_AVX2
+#     define LIBDTSHAPE_MESHINTRINSICS_AVX512
+#  endif
+#endif
+
+//-----------------------------------------------------------------------------
+
 BEGIN_NS(DTShape)
 
 //-----------------------------------------------------------------------------
 
-#if defined(LIBDTSHAPE_CPU_X86)
+struct Quat16;
+class PlaneF;
+
+#if defined(LIBDTSHAPE_CPU_X86) || defined(LIBDTSHAPE_CPU_X86_64)
 # // x86 CPU family implementations
 extern void zero_vert_normal_bulk_SSE(const dsize_t count, U8 * __restrict const outPtr, const dsize_t outStride);
 extern void m_matF_x_BatchedVertWeightList_SSE(const MatrixF &mat, const dsize_t count, const TSSkinMesh::BatchData::BatchedVertWeight * __restrict batch, U8 * const __restrict outPtr, const dsize_t outStride);
-#if (_MSC_VER >= 1500)
+extern void m_matF_x_SoAVertexStream_SSE(const MatrixF *boneTransforms, const TSSkinMesh::BatchData::SoAVertexStream &stream, U8 * const __restrict outPtr, const dsize_t outStride);
+extern void m_sphere_pixel_size_bulk_SSE(const dsize_t count, const Point3F * __restrict center, const F32 * __restrict lodRadius, const F32 * __restrict cullRadius, const Point3F &eye, const F32 pixelScale, const PlaneF *planes, const U32 numPlanes, F32 * __restrict outPixelSize);
+#  if defined(LIBDTSHAPE_MESHINTRINSICS_SSE4)
 extern void m_matF_x_BatchedVertWeightList_SSE4(const MatrixF &mat, const dsize_t count, const TSSkinMesh::BatchData::BatchedVertWeight * __restrict batch, U8 * const __restrict outPtr, const dsize_t outStride);
-#endif
+extern void m_quat16_nlerp_bulk_SSE4(const dsize_t count, const Quat16 * const *key1, const Quat16 * const *key2, const F32 *keyPos, QuatF * const *out);
+extern void m_quatF_point3F_set_matF_bulk_SSE4(const dsize_t count, const QuatF * __restrict rot, const Point3F * __restrict tran, MatrixF * __restrict out);
+#  endif
+#  if defined(LIBDTSHAPE_MESHINTRINSICS_AVX2)
+extern void zero_vert_normal_bulk_AVX(const dsize_t count, U8 * __restrict const outPtr, const dsize_t outStride);
+extern void m_matF_x_BatchedVertWeightList_AVX2(const MatrixF &mat, const dsize_t count, const TSSkinMesh::BatchData::BatchedVertWeight * __restrict batch, U8 * const __restrict outPtr, const dsize_t outStride);
+extern void m_matF_x_SoAVertexStream_AVX2(const MatrixF *boneTransforms, const TSSkinMesh::BatchData::SoAVertexStream &stream, U8 * const __restrict outPtr, const dsize_t outStride);
+#  endif
+#  if defined(LIBDTSHAPE_MESHINTRINSICS_AVX512)
+extern void m_matF_x_BatchedVertWeightList_AVX512(const MatrixF &mat, const dsize_t count, const TSSkinMesh::BatchData::BatchedVertWeight * __restrict batch, U8 * const __restrict outPtr, const dsize_t outStride);
+#  endif
 #
 #elif defined(LIBDTSHAPE_CPU_PPC)
 # // PPC CPU family implementations
@@ -0,0 +1,317 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "ts/tsMesh.h"
+#include "ts/arch/tsMeshIntrinsics.arch.h"
+
+#if defined(LIBDTSHAPE_MESHINTRINSICS_AVX2)
+#include "ts/tsMeshIntrinsics.h"
+#include <immintrin.h>
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+LIBDTSHAPE_TARGET_ISA("avx")
+void zero_vert_normal_bulk_AVX(const dsize_t count, U8 * __restrict const outPtr, const dsize_t outStride)
+{
+   char *outData = reinterpret_cast<char *>(outPtr);
+
+   // _vert, _tangentW, _normal and _tangent.x fit in one register. Only the
+   // tangent components need to be kept.
+   const __m256 zero = _mm256_setzero_ps();
+
+   for(dsize_t i = 0; i < count; i++)
+   {
+      F32 *curElem = reinterpret_cast<F32 *>(outData);
+
+      _mm_prefetch(reinterpret_cast<const char *>(outData + outStride * 8), _MM_HINT_T0);
+
+      __m256 v = _mm256_loadu_ps(curElem);
+      v = _mm256_blend_ps(zero, v, 0x88);
+      _mm256_storeu_ps(curElem, v);
+
+      outData += outStride;
+   }
+}
+
+//------------------------------------------------------------------------------
+
+LIBDTSHAPE_TARGET_ISA("avx2,fma")
+void m_matF_x_BatchedVertWeightList_AVX2(const MatrixF &mat, 
+                                    const dsize_t count,
+                                    const TSSkinMesh::BatchData::BatchedVertWeight * __restrict batch,
+                                    U8 * const __restrict outPtr,
+                                    const dsize_t outStride)
+{
+   const dsize_t inStride = sizeof(TSSkinMesh::BatchData::BatchedVertWeight);
+
+   // Same approach as the SSE version, but two input elements are 
+   // processed at once, one in each 128-bit lane.
+
+   // Load matrix columns into both lanes
+   MatrixF transMat;
+   mat.transposeTo(transMat);
+
+   const __m256 col0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&transMat[0]));
+   const __m256 col1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&transMat[4]));
+   const __m256 col2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&transMat[8]));
+   const __m256 col3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&transMat[12]));
+
+   // Masks off w, so the accumulated w of the output is left alone
+   const __m256 _w_mask = _mm256_setr_ps(1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f);
+
+#define INPUT_PREFETCH_LOOKAHEAD 64
+#define OUTPUT_PREFETCH_LOOKAHEAD (INPUT_PREFETCH_LOOKAHEAD >> 1)
+
+   dsize_t i = 0;
+   for(; i + 2 <= count; i += 2)
+   {
+      const TSSkinMesh::BatchData::BatchedVertWeight &inElem0 = batch[i];
+      const TSSkinMesh::BatchData::BatchedVertWeight &inElem1 = batch[i + 1];
+
+      // Each element is { vert, weight, normal, vidx }. Load two of them, then
+      // gather both verts into one register and both normals into another.
+      const __m256 in0 = _mm256_loadu_ps(reinterpret_cast<const F32 *>(&inElem0));
+      const __m256 in1 = _mm256_loadu_ps(reinterpret_cast<const F32 *>(&inElem1));
+
+      _mm_prefetch(reinterpret_cast<const char *>(batch) + inStride * (i + INPUT_PREFETCH_LOOKAHEAD), _MM_HINT_T0);
+      _mm_prefetch(reinterpret_cast<const char *>(outPtr) + outStride * (inElem0.vidx + OUTPUT_PREFETCH_LOOKAHEAD), _MM_HINT_T0);
+
+      const __m256 inPos = _mm256_permute2f128_ps(in0, in1, 0x20);
+      const __m256 inNrm = _mm256_permute2f128_ps(in0, in1, 0x31);
+
+      // pos = x * col0 + y * col1 + z * col2 + col3
+      __m256 tempPos = _mm256_fmadd_ps(_mm256_permute_ps(inPos, _MM_SHUFFLE(0, 0, 0, 0)), col0, col3);
+      tempPos = _mm256_fmadd_ps(_mm256_permute_ps(inPos, _MM_SHUFFLE(1, 1, 1, 1)), col1, tempPos);
+      tempPos = _mm256_fmadd_ps(_mm256_permute_ps(inPos, _MM_SHUFFLE(2, 2, 2, 2)), col2, tempPos);
+
+      // nrm = x * col0 + y * col1 + z * col2
+      __m256 tempNrm = _mm256_mul_ps(_mm256_permute_ps(inNrm, _MM_SHUFFLE(0, 0, 0, 0)), col0);
+      tempNrm = _mm256_fmadd_ps(_mm256_permute_ps(inNrm, _MM_SHUFFLE(1, 1, 1, 1)), col1, tempNrm);
+      tempNrm = _mm256_fmadd_ps(_mm256_permute_ps(inNrm, _MM_SHUFFLE(2, 2, 2, 2)), col2, tempNrm);
+
+      // Bone weight across xyz of each lane
+      const __m256 weight = _mm256_mul_ps(_mm256_permute_ps(inPos, _MM_SHUFFLE(3, 3, 3, 3)), _w_mask);
+
+      tempPos = _mm256_mul_ps(tempPos, weight);
+      tempNrm = _mm256_mul_ps(tempNrm, weight);
+
+      // Accumulate one element at a time; both may refer to the same vertex
+      TSMesh::__TSMeshVertexBase *outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElem0.vidx * outStride);
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), _mm256_castps256_ps128(tempPos)));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), _mm256_castps256_ps128(tempNrm)));
+
+      outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElem1.vidx * outStride);
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), _mm256_extractf128_ps(tempPos, 1)));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), _mm256_extractf128_ps(tempNrm, 1)));
+   }
+
+   // Odd element at the end
+   if(i < count)
+   {
+      const TSSkinMesh::BatchData::BatchedVertWeight &inElem = batch[i];
+      TSMesh::__TSMeshVertexBase *outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElem.vidx * outStride);
+
+      const __m128 inPos = _mm_load_ps(inElem.vert);
+      const __m128 inNrm = _mm_load_ps(inElem.normal);
+
+      __m128 tempPos = _mm_fmadd_ps(_mm_permute_ps(inPos, _MM_SHUFFLE(0, 0, 0, 0)), _mm256_castps256_ps128(col0), _mm256_castps256_ps128(col3));
+      tempPos = _mm_fmadd_ps(_mm_permute_ps(inPos, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_castps256_ps128(col1), tempPos);
+      tempPos = _mm_fmadd_ps(_mm_permute_ps(inPos, _MM_SHUFFLE(2, 2, 2, 2)), _mm256_castps256_ps128(col2), tempPos);
+
+      __m128 tempNrm = _mm_mul_ps(_mm_permute_ps(inNrm, _MM_SHUFFLE(0, 0, 0, 0)), _mm256_castps256_ps128(col0));
+      tempNrm = _mm_fmadd_ps(_mm_permute_ps(inNrm, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_castps256_ps128(col1), tempNrm);
+      tempNrm = _mm_fmadd_ps(_mm_permute_ps(inNrm, _MM_SHUFFLE(2, 2, 2, 2)), _mm256_castps256_ps128(col2), tempNrm);
+
+      const __m128 weight = _mm_mul_ps(_mm_permute_ps(inPos, _MM_SHUFFLE(3, 3, 3, 3)), _mm256_castps256_ps128(_w_mask));
+
+      tempPos = _mm_mul_ps(tempPos, weight);
+      tempNrm = _mm_mul_ps(tempNrm, weight);
+
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), tempPos));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), tempNrm));
+   }
+
+#undef INPUT_PREFETCH_LOOKAHEAD
+#undef OUTPUT_PREFETCH_LOOKAHEAD
+}
+
+//------------------------------------------------------------------------------
+
+/// Transposes the 4x4 matrix in each 128-bit lane of r0..r3
+LIBDTSHAPE_TARGET_ISA("avx2,fma")
+static inline void _transposeLanes4x4_AVX(__m256 &r0, __m256 &r1, __m256 &r2, __m256 &r3)
+{
+   const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+   const __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+   const __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+   const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+   r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+   r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+   r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+   r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+/// Stores xyz of v into dst, keeping the w already in dst
+LIBDTSHAPE_TARGET_ISA("avx2,fma")
+static inline void _storeXYZ_AVX(F32 *dst, const __m128 v)
+{
+   _mm_store_ps(dst, _mm_blend_ps(v, _mm_load_ps(dst), 0x8));
+}
+
+/// Loads one row of eight matrices, transposed so c0..c3 hold columns 0..3
+LIBDTSHAPE_TARGET_ISA("avx2,fma")
+static inline void _gatherRow_AVX(const F32 * const *m, const U32 row, __m256 &c0, __m256 &c1, __m256 &c2, __m256 &c3)
+{
+   c0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(m[0] + row * 4)), _mm_loadu_ps(m[4] + row * 4), 1);
+   c1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(m[1] + row * 4)), _mm_loadu_ps(m[5] + row * 4), 1);
+   c2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(m[2] + row * 4)), _mm_loadu_ps(m[6] + row * 4), 1);
+   c3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(m[3] + row * 4)), _mm_loadu_ps(m[7] + row * 4), 1);
+   _transposeLanes4x4_AVX(c0, c1, c2, c3);
+}
+
+/// Loads one row of a matrix shared by all eight vertices
+LIBDTSHAPE_TARGET_ISA("avx2,fma")
+static inline void _broadcastRow_AVX(const F32 *m, const U32 row, __m256 &c0, __m256 &c1, __m256 &c2, __m256 &c3)
+{
+   c0 = _mm256_broadcast_ss(m + row * 4 + 0);
+   c1 = _mm256_broadcast_ss(m + row * 4 + 1);
+   c2 = _mm256_broadcast_ss(m + row * 4 + 2);
+   c3 = _mm256_broadcast_ss(m + row * 4 + 3);
+}
+
+/// Stores the vertex in the low or high lane of vert and norm
+LIBDTSHAPE_TARGET_ISA("avx2,fma")
+static inline void _storeVertex_AVX(U8 *outPtr, const dsize_t outStride, const S32 vertexIndex, const __m128 vert, const __m128 norm)
+{
+   TSMesh::__TSMeshVertexBase *outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + vertexIndex * outStride);
+   _storeXYZ_AVX(outElem->_vert, vert);
+   _storeXYZ_AVX(outElem->_normal, norm);
+}
+
+LIBDTSHAPE_TARGET_ISA("avx2,fma")
+void m_matF_x_SoAVertexStream_AVX2(const MatrixF *boneTransforms,
+                                   const TSSkinMesh::BatchData::SoAVertexStream &stream,
+                                   U8 * const __restrict outPtr,
+                                   const dsize_t outStride)
+{
+   // Same approach as the SSE version, with eight vertices processed at
+   // once. Vertices 0-3 of each group are in the low 128-bit lane and 4-7
+   // in the high lane, so the matrices can be transposed within each lane.
+   // Everything is kept in named registers as the compiler will not
+   // unroll small loops over arrays of vectors at -O2.
+   const __m256 zero = _mm256_setzero_ps();
+
+   for(dsize_t i = 0; i < stream.numVerts; i += 8)
+   {
+      const __m256 inX = _mm256_load_ps(stream.vertX + i);
+      const __m256 inY = _mm256_load_ps(stream.vertY + i);
+      const __m256 inZ = _mm256_load_ps(stream.vertZ + i);
+      const __m256 inNX = _mm256_load_ps(stream.normX + i);
+      const __m256 inNY = _mm256_load_ps(stream.normY + i);
+      const __m256 inNZ = _mm256_load_ps(stream.normZ + i);
+
+      __m256 posX = zero, posY = zero, posZ = zero, posW = zero;
+      __m256 nrmX = zero, nrmY = zero, nrmZ = zero, nrmW = zero;
+
+      for(U32 b = 0; b < stream.numBones; b++)
+      {
+         const __m256 weight = _mm256_load_ps(stream.weight[b] + i);
+
+         // Skip if none of the eight vertices use this influence
+         if(_mm256_movemask_ps(_mm256_cmp_ps(weight, zero, _CMP_NEQ_UQ)) == 0)
+            continue;
+
+         // Rows 0..2 of the bone matrix for each vertex, one column per register
+         __m256 r00, r01, r02, r03, r10, r11, r12, r13, r20, r21, r22, r23;
+
+         // Neighbouring vertices usually share bones, in which case the
+         // matrix can be broadcast rather than gathered and transposed
+         const S32 *boneIdx = stream.bone[b] + i;
+         const __m256i idx = _mm256_load_si256(reinterpret_cast<const __m256i *>(boneIdx));
+         if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(idx, _mm256_set1_epi32(boneIdx[0]))) == -1)
+         {
+            const F32 *m = boneTransforms[boneIdx[0]];
+            _broadcastRow_AVX(m, 0, r00, r01, r02, r03);
+            _broadcastRow_AVX(m, 1, r10, r11, r12, r13);
+            _broadcastRow_AVX(m, 2, r20, r21, r22, r23);
+         }
+         else
+         {
+            const F32 *m[8];
+            for(U32 k = 0; k < 8; k++)
+               m[k] = boneTransforms[boneIdx[k]];
+
+            _gatherRow_AVX(m, 0, r00, r01, r02, r03);
+            _gatherRow_AVX(m, 1, r10, r11, r12, r13);
+            _gatherRow_AVX(m, 2, r20, r21, r22, r23);
+         }
+
+         // pos = row . (x, y, z, 1), nrm = row . (x, y, z, 0)
+         posX = _mm256_fmadd_ps(_mm256_fmadd_ps(r00, inX, _mm256_fmadd_ps(r01, inY, _mm256_fmadd_ps(r02, inZ, r03))), weight, posX);
+         posY = _mm256_fmadd_ps(_mm256_fmadd_ps(r10, inX, _mm256_fmadd_ps(r11, inY, _mm256_fmadd_ps(r12, inZ, r13))), weight, posY);
+         posZ = _mm256_fmadd_ps(_mm256_fmadd_ps(r20, inX, _mm256_fmadd_ps(r21, inY, _mm256_fmadd_ps(r22, inZ, r23))), weight, posZ);
+         nrmX = _mm256_fmadd_ps(_mm256_fmadd_ps(r00, inNX, _mm256_fmadd_ps(r01, inNY, _mm256_mul_ps(r02, inNZ))), weight, nrmX);
+         nrmY = _mm256_fmadd_ps(_mm256_fmadd_ps(r10, inNX, _mm256_fmadd_ps(r11, inNY, _mm256_mul_ps(r12, inNZ))), weight, nrmY);
+         nrmZ = _mm256_fmadd_ps(_mm256_fmadd_ps(r20, inNX, _mm256_fmadd_ps(r21, inNY, _mm256_mul_ps(r22, inNZ))), weight, nrmZ);
+      }
+
+      // Back to one 128-bit lane per vertex, e.g. posX now holds vertex 0 and 4
+      _transposeLanes4x4_AVX(posX, posY, posZ, posW);
+      _transposeLanes4x4_AVX(nrmX, nrmY, nrmZ, nrmW);
+
+      const S32 *vertexIndex = stream.vertexIndex + i;
+      if(stream.numVerts - i >= 8)
+      {
+         _storeVertex_AVX(outPtr, outStride, vertexIndex[0], _mm256_castps256_ps128(posX), _mm256_castps256_ps128(nrmX));
+         _storeVertex_AVX(outPtr, outStride, vertexIndex[1], _mm256_castps256_ps128(posY), _mm256_castps256_ps128(nrmY));
+         _storeVertex_AVX(outPtr, outStride, vertexIndex[2], _mm256_castps256_ps128(posZ), _mm256_castps256_ps128(nrmZ));
+         _storeVertex_AVX(outPtr, outStride, vertexIndex[3], _mm256_castps256_ps128(posW), _mm256_castps256_ps128(nrmW));
+         _storeVertex_AVX(outPtr, outStride, vertexIndex[4], _mm256_extractf128_ps(posX, 1), _mm256_extractf128_ps(nrmX, 1));
+         _storeVertex_AVX(outPtr, outStride, vertexIndex[5], _mm256_extractf128_ps(posY, 1), _mm256_extractf128_ps(nrmY, 1));
+         _storeVertex_AVX(outPtr, outStride, vertexIndex[6], _mm256_extractf128_ps(posZ, 1), _mm256_extractf128_ps(nrmZ, 1));
+         _storeVertex_AVX(outPtr, outStride, vertexIndex[7], _mm256_extractf128_ps(posW, 1), _mm256_extractf128_ps(nrmW, 1));
+      }
+      else
+      {
+         // The last group is partly padding
+         F32 pos[4][8];
+         F32 nrm[4][8];
+         _mm256_storeu_ps(pos[0], posX); _mm256_storeu_ps(pos[1], posY); _mm256_storeu_ps(pos[2], posZ); _mm256_storeu_ps(pos[3], posW);
+         _mm256_storeu_ps(nrm[0], nrmX); _mm256_storeu_ps(nrm[1], nrmY); _mm256_storeu_ps(nrm[2], nrmZ); _mm256_storeu_ps(nrm[3], nrmW);
+
+         for(dsize_t j = 0; j < stream.numVerts - i; j++)
+            _storeVertex_AVX(outPtr, outStride, vertexIndex[j], _mm_loadu_ps(pos[j & 3] + (j & 4)), _mm_loadu_ps(nrm[j & 3] + (j & 4)));
+      }
+   }
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // LIBDTSHAPE_MESHINTRINSICS_AVX2
@@ -0,0 +1,129 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "ts/tsMesh.h"
+#include "ts/arch/tsMeshIntrinsics.arch.h"
+
+#if defined(LIBDTSHAPE_MESHINTRINSICS_AVX512)
+#include "ts/tsMeshIntrinsics.h"
+#include <immintrin.h>
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+LIBDTSHAPE_TARGET_ISA("avx512f")
+void m_matF_x_BatchedVertWeightList_AVX512(const MatrixF &mat, 
+                                    const dsize_t count,
+                                    const TSSkinMesh::BatchData::BatchedVertWeight * __restrict batch,
+                                    U8 * const __restrict outPtr,
+                                    const dsize_t outStride)
+{
+   const dsize_t inStride = sizeof(TSSkinMesh::BatchData::BatchedVertWeight);
+
+   // Same approach as the AVX2 version, with four input elements processed
+   // at once, one in each 128-bit lane.
+
+   // Load matrix columns into all lanes
+   MatrixF transMat;
+   mat.transposeTo(transMat);
+
+   const __m512 col0 = _mm512_broadcast_f32x4(_mm_loadu_ps(&transMat[0]));
+   const __m512 col1 = _mm512_broadcast_f32x4(_mm_loadu_ps(&transMat[4]));
+   const __m512 col2 = _mm512_broadcast_f32x4(_mm_loadu_ps(&transMat[8]));
+   const __m512 col3 = _mm512_broadcast_f32x4(_mm_loadu_ps(&transMat[12]));
+
+   // Selects xyz of each lane
+   const __mmask16 xyzMask = 0x7777;
+
+#define INPUT_PREFETCH_LOOKAHEAD 64
+#define OUTPUT_PREFETCH_LOOKAHEAD (INPUT_PREFETCH_LOOKAHEAD >> 1)
+
+   dsize_t i = 0;
+   for(; i + 4 <= count; i += 4)
+   {
+      const TSSkinMesh::BatchData::BatchedVertWeight *inElems = batch + i;
+
+      // Elements 0, 1 and 2, 3
+      const __m512 in01 = _mm512_loadu_ps(reinterpret_cast<const F32 *>(inElems));
+      const __m512 in23 = _mm512_loadu_ps(reinterpret_cast<const F32 *>(inElems + 2));
+
+      _mm_prefetch(reinterpret_cast<const char *>(batch) + inStride * (i + INPUT_PREFETCH_LOOKAHEAD), _MM_HINT_T0);
+      _mm_prefetch(reinterpret_cast<const char *>(batch) + inStride * (i + INPUT_PREFETCH_LOOKAHEAD + 2), _MM_HINT_T0);
+      _mm_prefetch(reinterpret_cast<const char *>(outPtr) + outStride * (inElems[0].vidx + OUTPUT_PREFETCH_LOOKAHEAD), _MM_HINT_T0);
+
+      // Gather the four verts into one register and the four normals into another
+      const __m512 inPos = _mm512_shuffle_f32x4(in01, in23, _MM_SHUFFLE(2, 0, 2, 0));
+      const __m512 inNrm = _mm512_shuffle_f32x4(in01, in23, _MM_SHUFFLE(3, 1, 3, 1));
+
+      // pos = x * col0 + y * col1 + z * col2 + col3
+      __m512 tempPos = _mm512_fmadd_ps(_mm512_permute_ps(inPos, _MM_SHUFFLE(0, 0, 0, 0)), col0, col3);
+      tempPos = _mm512_fmadd_ps(_mm512_permute_ps(inPos, _MM_SHUFFLE(1, 1, 1, 1)), col1, tempPos);
+      tempPos = _mm512_fmadd_ps(_mm512_permute_ps(inPos, _MM_SHUFFLE(2, 2, 2, 2)), col2, tempPos);
+
+      // nrm = x * col0 + y * col1 + z * col2
+      __m512 tempNrm = _mm512_mul_ps(_mm512_permute_ps(inNrm, _MM_SHUFFLE(0, 0, 0, 0)), col0);
+      tempNrm = _mm512_fmadd_ps(_mm512_permute_ps(inNrm, _MM_SHUFFLE(1, 1, 1, 1)), col1, tempNrm);
+      tempNrm = _mm512_fmadd_ps(_mm512_permute_ps(inNrm, _MM_SHUFFLE(2, 2, 2, 2)), col2, tempNrm);
+
+      // Bone weight across xyz of each lane, w is zeroed so the accumulated w
+      // of the output is left alone
+      const __m512 weight = _mm512_maskz_permute_ps(xyzMask, inPos, _MM_SHUFFLE(3, 3, 3, 3));
+
+      tempPos = _mm512_mul_ps(tempPos, weight);
+      tempNrm = _mm512_mul_ps(tempNrm, weight);
+
+      // Accumulate one element at a time; several may refer to the same vertex
+      TSMesh::__TSMeshVertexBase *outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElems[0].vidx * outStride);
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), _mm512_castps512_ps128(tempPos)));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), _mm512_castps512_ps128(tempNrm)));
+
+      outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElems[1].vidx * outStride);
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), _mm512_extractf32x4_ps(tempPos, 1)));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), _mm512_extractf32x4_ps(tempNrm, 1)));
+
+      outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElems[2].vidx * outStride);
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), _mm512_extractf32x4_ps(tempPos, 2)));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), _mm512_extractf32x4_ps(tempNrm, 2)));
+
+      outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElems[3].vidx * outStride);
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), _mm512_extractf32x4_ps(tempPos, 3)));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), _mm512_extractf32x4_ps(tempNrm, 3)));
+   }
+
+#undef INPUT_PREFETCH_LOOKAHEAD
+#undef OUTPUT_PREFETCH_LOOKAHEAD
+
+   // Any AVX-512 CPU also has AVX2 and FMA, so let that handle the remainder
+   if(i < count)
+      m_matF_x_BatchedVertWeightList_AVX2(mat, count - i, batch + i, outPtr, outStride);
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // LIBDTSHAPE_MESHINTRINSICS_AVX512
@@ -21,8 +21,9 @@
 //-----------------------------------------------------------------------------
 #include "ts/tsMesh.h"
 
-#if defined(LIBDTSHAPE_CPU_X86)
+#if defined(LIBDTSHAPE_CPU_X86) || defined(LIBDTSHAPE_CPU_X86_64)
 #include "ts/tsMeshIntrinsics.h"
+#include "math/mPlane.h"
 #include <xmmintrin.h>
 
 //-----------------------------------------------------------------------------
@@ -186,8 +187,187 @@ void m_matF_x_BatchedVertWeightList_SSE(const MatrixF &mat,
    }
 }
 
+//------------------------------------------------------------------------------
+
+/// Stores xyz of v into dst, keeping the w already in dst
+static inline void _storeXYZ_SSE(F32 *dst, const __m128 v)
+{
+   const __m128 old = _mm_load_ps(dst);
+   const __m128 zw = _mm_shuffle_ps(v, old, _MM_SHUFFLE(3, 3, 2, 2)); // (v.z, v.z, old.w, old.w)
+   _mm_store_ps(dst, _mm_shuffle_ps(v, zw, _MM_SHUFFLE(2, 0, 1, 0))); // (v.x, v.y, v.z, old.w)
+}
+
+/// Loads one row of four matrices, transposed so c0..c3 hold columns 0..3
+static inline void _gatherRow_SSE(const F32 *m0, const F32 *m1, const F32 *m2, const F32 *m3, const U32 row, __m128 &c0, __m128 &c1, __m128 &c2, __m128 &c3)
+{
+   c0 = _mm_loadu_ps(m0 + row * 4);
+   c1 = _mm_loadu_ps(m1 + row * 4);
+   c2 = _mm_loadu_ps(m2 + row * 4);
+   c3 = _mm_loadu_ps(m3 + row * 4);
+   _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+}
+
+/// Loads one row of a matrix shared by all four vertices
+static inline void _broadcastRow_SSE(const F32 *m, const U32 row, __m128 &c0, __m128 &c1, __m128 &c2, __m128 &c3)
+{
+   c0 = _mm_load1_ps(m + row * 4 + 0);
+   c1 = _mm_load1_ps(m + row * 4 + 1);
+   c2 = _mm_load1_ps(m + row * 4 + 2);
+   c3 = _mm_load1_ps(m + row * 4 + 3);
+}
+
+static inline void _storeVertex_SSE(U8 *outPtr, const dsize_t outStride, const S32 vertexIndex, const __m128 vert, const __m128 norm)
+{
+   TSMesh::__TSMeshVertexBase *outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + vertexIndex * outStride);
+   _storeXYZ_SSE(outElem->_vert, vert);
+   _storeXYZ_SSE(outElem->_normal, norm);
+}
+
+void m_matF_x_SoAVertexStream_SSE(const MatrixF *boneTransforms,
+                                  const TSSkinMesh::BatchData::SoAVertexStream &stream,
+                                  U8 * const __restrict outPtr,
+                                  const dsize_t outStride)
+{
+   // Four vertices are processed at once, one per element. The bone matrices
+   // for the four vertices are loaded by row and transposed, so that each
+   // register holds one matrix element for every vertex.
+   const __m128 zero = _mm_setzero_ps();
+
+   for(dsize_t i = 0; i < stream.numVerts; i += 4)
+   {
+      const __m128 inX = _mm_load_ps(stream.vertX + i);
+      const __m128 inY = _mm_load_ps(stream.vertY + i);
+      const __m128 inZ = _mm_load_ps(stream.vertZ + i);
+      const __m128 inNX = _mm_load_ps(stream.normX + i);
+      const __m128 inNY = _mm_load_ps(stream.normY + i);
+      const __m128 inNZ = _mm_load_ps(stream.normZ + i);
+
+      __m128 posX = zero, posY = zero, posZ = zero, posW = zero;
+      __m128 nrmX = zero, nrmY = zero, nrmZ = zero, nrmW = zero;
+
+      for(U32 b = 0; b < stream.numBones; b++)
+      {
+         const __m128 weight = _mm_load_ps(stream.weight[b] + i);
+
+         // Skip if none of the four vertices use this influence
+         if(_mm_movemask_ps(_mm_cmpneq_ps(weight, zero)) == 0)
+            continue;
+
+         // Rows 0..2 of the bone matrix for each vertex, one column per register
+         __m128 r00, r01, r02, r03, r10, r11, r12, r13, r20, r21, r22, r23;
+
+         const S32 *boneIdx = stream.bone[b] + i;
+         if(boneIdx[0] == boneIdx[1] && boneIdx[0] == boneIdx[2] && boneIdx[0] == boneIdx[3])
+         {
+            // Neighbouring vertices usually share bones, so skip the transpose
+            const F32 *m = boneTransforms[boneIdx[0]];
+            _broadcastRow_SSE(m, 0, r00, r01, r02, r03);
+            _broadcastRow_SSE(m, 1, r10, r11, r12, r13);
+            _broadcastRow_SSE(m, 2, r20, r21, r22, r23);
+         }
+         else
+         {
+            const F32 *m0 = boneTransforms[boneIdx[0]];
+            const F32 *m1 = boneTransforms[boneIdx[1]];
+            const F32 *m2 = boneTransforms[boneIdx[2]];
+            const F32 *m3 = boneTransforms[boneIdx[3]];
+            _gatherRow_SSE(m0, m1, m2, m3, 0, r00, r01, r02, r03);
+            _gatherRow_SSE(m0, m1, m2, m3, 1, r10, r11, r12, r13);
+            _gatherRow_SSE(m0, m1, m2, m3, 2, r20, r21, r22, r23);
+         }
+
+         // pos = (row . (x, y, z, 1)) * weight, nrm = (row . (x, y, z, 0)) * weight
+         posX = _mm_add_ps(posX, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, inX), _mm_mul_ps(r01, inY)), _mm_add_ps(_mm_mul_ps(r02, inZ), r03)), weight));
+         posY = _mm_add_ps(posY, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r10, inX), _mm_mul_ps(r11, inY)), _mm_add_ps(_mm_mul_ps(r12, inZ), r13)), weight));
+         posZ = _mm_add_ps(posZ, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r20, inX), _mm_mul_ps(r21, inY)), _mm_add_ps(_mm_mul_ps(r22, inZ), r23)), weight));
+         nrmX = _mm_add_ps(nrmX, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, inNX), _mm_mul_ps(r01, inNY)), _mm_mul_ps(r02, inNZ)), weight));
+         nrmY = _mm_add_ps(nrmY, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r10, inNX), _mm_mul_ps(r11, inNY)), _mm_mul_ps(r12, inNZ)), weight));
+         nrmZ = _mm_add_ps(nrmZ, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r20, inNX), _mm_mul_ps(r21, inNY)), _mm_mul_ps(r22, inNZ)), weight));
+      }
+
+      // Back to one register per vertex
+      _MM_TRANSPOSE4_PS(posX, posY, posZ, posW);
+      _MM_TRANSPOSE4_PS(nrmX, nrmY, nrmZ, nrmW);
+
+      // The last group may be partly padding
+      const S32 *vertexIndex = stream.vertexIndex + i;
+      const dsize_t numLeft = stream.numVerts - i;
+      _storeVertex_SSE(outPtr, outStride, vertexIndex[0], posX, nrmX);
+      if(numLeft > 1)
+         _storeVertex_SSE(outPtr, outStride, vertexIndex[1], posY, nrmY);
+      if(numLeft > 2)
+         _storeVertex_SSE(outPtr, outStride, vertexIndex[2], posZ, nrmZ);
+      if(numLeft > 3)
+         _storeVertex_SSE(outPtr, outStride, vertexIndex[3], posW, nrmW);
+   }
+}
+
+//------------------------------------------------------------------------------
+
+void m_sphere_pixel_size_bulk_SSE(const dsize_t count,
+                                  const Point3F * __restrict center,
+                                  const F32 * __restrict lodRadius,
+                                  const F32 * __restrict cullRadius,
+                                  const Point3F &eye,
+                                  const F32 pixelScale,
+                                  const PlaneF *planes,
+                                  const U32 numPlanes,
+                                  F32 * __restrict outPixelSize)
+{
+   const __m128 eyeX = _mm_set1_ps(eye.x);
+   const __m128 eyeY = _mm_set1_ps(eye.y);
+   const __m128 eyeZ = _mm_set1_ps(eye.z);
+   const __m128 scale = _mm_set1_ps(pixelScale);
+   const __m128 minDist = _mm_set1_ps(0.01f);
+   const __m128 culledSize = _mm_set1_ps(-1.0f);
+
+   dsize_t i = 0;
+   for(; i + 4 <= count; i += 4)
+   {
+      // Four centers are 12 floats, shuffle them into x, y and z registers
+      const F32 *in = &center[i].x;
+      const __m128 a = _mm_loadu_ps(in);       // x0 y0 z0 x1
+      const __m128 b = _mm_loadu_ps(in + 4);   // y1 z1 x2 y2
+      const __m128 c = _mm_loadu_ps(in + 8);   // z2 x3 y3 z3
+
+      const __m128 x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+      const __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+      const __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0));
+
+      // Culled if entirely behind any plane
+      const __m128 negCullRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(cullRadius + i));
+      __m128 culled = _mm_setzero_ps();
+      for(U32 p = 0; p < numPlanes; p++)
+      {
+         const PlaneF &plane = planes[p];
+         const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                                        _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.d)));
+         culled = _mm_or_ps(culled, _mm_cmplt_ps(dist, negCullRadius));
+      }
+
+      const __m128 dx = _mm_sub_ps(x, eyeX);
+      const __m128 dy = _mm_sub_ps(y, eyeY);
+      const __m128 dz = _mm_sub_ps(z, eyeZ);
+      const __m128 dist = _mm_max_ps(_mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz))), minDist);
+      const __m128 size = _mm_mul_ps(_mm_div_ps(_mm_loadu_ps(lodRadius + i), dist), scale);
+
+      _mm_storeu_ps(outPixelSize + i, _mm_or_ps(_mm_and_ps(culled, culledSize), _mm_andnot_ps(culled, size)));
+   }
+
+   // Whatever doesn't fill a register
+   for(; i < count; i++)
+   {
+      bool culled = false;
+      for(U32 p = 0; p < numPlanes; p++)
+         culled |= planes[p].distToPlane(center[i]) < -cullRadius[i];
+
+      const F32 dist = getMax((center[i] - eye).len(), 0.01f);
+      outPixelSize[i] = culled ? -1.0f : (lodRadius[i] / dist) * pixelScale;
+   }
+}
+
 //-----------------------------------------------------------------------------
 
 END_NS
 
-#endif // LIBDTSHAPE_CPU_X86
\ No newline at end of file
+#endif // LIBDTSHAPE_CPU_X86 || LIBDTSHAPE_CPU_X86_64
\ No newline at end of file
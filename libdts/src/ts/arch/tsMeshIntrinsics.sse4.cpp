@@ -22,8 +22,10 @@
 
 #include "platform/platform.h"
 #include "ts/tsMesh.h"
+#include "ts/tsTransform.h"
+#include "ts/arch/tsMeshIntrinsics.arch.h"
 
-#if defined(LIBDTSHAPE_CPU_X86) && (_MSC_VER >= 1500)
+#if defined(LIBDTSHAPE_MESHINTRINSICS_SSE4)
 #include "ts/tsMeshIntrinsics.h"
 #include <smmintrin.h>
 
@@ -33,6 +35,7 @@ BEGIN_NS(DTShape)
 
 //-----------------------------------------------------------------------------
 
+LIBDTSHAPE_TARGET_ISA("sse4.1")
 void m_matF_x_BatchedVertWeightList_SSE4(const MatrixF &mat, 
                                     const dsize_t count,
                                     const TSSkinMesh::BatchData::BatchedVertWeight * __restrict batch,
@@ -42,79 +45,322 @@ void m_matF_x_BatchedVertWeightList_SSE4(const MatrixF &mat,
    const char * __restrict iPtr = reinterpret_cast<const char *>(batch);
    const dsize_t inStride = sizeof(TSSkinMesh::BatchData::BatchedVertWeight);
 
-   __m128 sseMat[3];
-   sseMat[0] = _mm_loadu_ps(&mat[0]);
-   sseMat[1] = _mm_loadu_ps(&mat[4]);
-   sseMat[2] = _mm_loadu_ps(&mat[8]);
+   // The previous version of this used dpps against the matrix rows, which
+   // let the bone weight (stored in w of the input vert) scale the
+   // translation, and is slower than the shuffle/mul/add approach of the SSE
+   // version anyway. This follows the SSE version, but processes two input
+   // elements per iteration to keep more independent work in flight, and
+   // uses blendps to mask off w.
+
+   // Load matrix, transposed, into registers
+   MatrixF transMat;
+   mat.transposeTo(transMat);
+
+   __m128 sseMat[4];
+   sseMat[0] = _mm_loadu_ps(&transMat[0]);
+   sseMat[1] = _mm_loadu_ps(&transMat[4]);
+   sseMat[2] = _mm_loadu_ps(&transMat[8]);
+   sseMat[3] = _mm_loadu_ps(&transMat[12]);
+
+   const __m128 zero = _mm_setzero_ps();
 
    // temp registers
-   __m128 inPos, tempPos;
-   __m128 inNrm, tempNrm;
-   __m128 temp0, temp1, temp2, temp3;
+   __m128 inPos0, inNrm0, tempPos0, tempNrm0;
+   __m128 inPos1, inNrm1, tempPos1, tempNrm1;
+   __m128 weight0, weight1;
 
    // pre-populate cache
-   const TSSkinMesh::BatchData::BatchedVertWeight &firstElem = batch[0];
-   for(int i = 0; i < 8; i++)
+   if(count > 0)
+   {
+      const TSSkinMesh::BatchData::BatchedVertWeight &firstElem = batch[0];
+      for(int i = 0; i < 8; i++)
+      {
+         _mm_prefetch(reinterpret_cast<const char *>(iPtr +  inStride * i), _MM_HINT_T0);
+         _mm_prefetch(reinterpret_cast<const char *>(outPtr +  outStride * (i + firstElem.vidx)), _MM_HINT_T0);
+      }
+   }
+
+#define INPUT_PREFETCH_LOOKAHEAD 64
+#define OUTPUT_PREFETCH_LOOKAHEAD (INPUT_PREFETCH_LOOKAHEAD >> 1)
+
+   dsize_t i = 0;
+   for(; i + 2 <= count; i += 2)
    {
-      _mm_prefetch(reinterpret_cast<const char *>(iPtr +  inStride * i), _MM_HINT_T0);
-      _mm_prefetch(reinterpret_cast<const char *>(outPtr +  outStride * (i + firstElem.vidx)), _MM_HINT_T0);
+      const TSSkinMesh::BatchData::BatchedVertWeight &inElem0 = batch[i];
+      const TSSkinMesh::BatchData::BatchedVertWeight &inElem1 = batch[i + 1];
+
+      inPos0 = _mm_load_ps(inElem0.vert);
+      inNrm0 = _mm_load_ps(inElem0.normal);
+      inPos1 = _mm_load_ps(inElem1.vert);
+      inNrm1 = _mm_load_ps(inElem1.normal);
+
+      _mm_prefetch(iPtr + inStride * (i + INPUT_PREFETCH_LOOKAHEAD), _MM_HINT_T0);
+      _mm_prefetch(reinterpret_cast<const char *>(outPtr) + outStride * (inElem0.vidx + OUTPUT_PREFETCH_LOOKAHEAD), _MM_HINT_T0);
+
+      // x
+      tempPos0 = _mm_mul_ps(_mm_shuffle_ps(inPos0, inPos0, _MM_SHUFFLE(0, 0, 0, 0)), sseMat[0]);
+      tempNrm0 = _mm_mul_ps(_mm_shuffle_ps(inNrm0, inNrm0, _MM_SHUFFLE(0, 0, 0, 0)), sseMat[0]);
+      tempPos1 = _mm_mul_ps(_mm_shuffle_ps(inPos1, inPos1, _MM_SHUFFLE(0, 0, 0, 0)), sseMat[0]);
+      tempNrm1 = _mm_mul_ps(_mm_shuffle_ps(inNrm1, inNrm1, _MM_SHUFFLE(0, 0, 0, 0)), sseMat[0]);
+
+      // y
+      tempPos0 = _mm_add_ps(tempPos0, _mm_mul_ps(_mm_shuffle_ps(inPos0, inPos0, _MM_SHUFFLE(1, 1, 1, 1)), sseMat[1]));
+      tempNrm0 = _mm_add_ps(tempNrm0, _mm_mul_ps(_mm_shuffle_ps(inNrm0, inNrm0, _MM_SHUFFLE(1, 1, 1, 1)), sseMat[1]));
+      tempPos1 = _mm_add_ps(tempPos1, _mm_mul_ps(_mm_shuffle_ps(inPos1, inPos1, _MM_SHUFFLE(1, 1, 1, 1)), sseMat[1]));
+      tempNrm1 = _mm_add_ps(tempNrm1, _mm_mul_ps(_mm_shuffle_ps(inNrm1, inNrm1, _MM_SHUFFLE(1, 1, 1, 1)), sseMat[1]));
+
+      // z
+      tempPos0 = _mm_add_ps(tempPos0, _mm_mul_ps(_mm_shuffle_ps(inPos0, inPos0, _MM_SHUFFLE(2, 2, 2, 2)), sseMat[2]));
+      tempNrm0 = _mm_add_ps(tempNrm0, _mm_mul_ps(_mm_shuffle_ps(inNrm0, inNrm0, _MM_SHUFFLE(2, 2, 2, 2)), sseMat[2]));
+      tempPos1 = _mm_add_ps(tempPos1, _mm_mul_ps(_mm_shuffle_ps(inPos1, inPos1, _MM_SHUFFLE(2, 2, 2, 2)), sseMat[2]));
+      tempNrm1 = _mm_add_ps(tempNrm1, _mm_mul_ps(_mm_shuffle_ps(inNrm1, inNrm1, _MM_SHUFFLE(2, 2, 2, 2)), sseMat[2]));
+
+      // translate
+      tempPos0 = _mm_add_ps(tempPos0, sseMat[3]);
+      tempPos1 = _mm_add_ps(tempPos1, sseMat[3]);
+
+      // bone weight across xyz, w is zeroed so the w of the output is left alone
+      weight0 = _mm_blend_ps(_mm_shuffle_ps(inPos0, inPos0, _MM_SHUFFLE(3, 3, 3, 3)), zero, 0x8);
+      weight1 = _mm_blend_ps(_mm_shuffle_ps(inPos1, inPos1, _MM_SHUFFLE(3, 3, 3, 3)), zero, 0x8);
+
+      tempPos0 = _mm_mul_ps(tempPos0, weight0);
+      tempNrm0 = _mm_mul_ps(tempNrm0, weight0);
+      tempPos1 = _mm_mul_ps(tempPos1, weight1);
+      tempNrm1 = _mm_mul_ps(tempNrm1, weight1);
+
+      // Accumulate one element at a time; both may refer to the same vertex
+      TSMesh::__TSMeshVertexBase *outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElem0.vidx * outStride);
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), tempPos0));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), tempNrm0));
+
+      outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElem1.vidx * outStride);
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), tempPos1));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), tempNrm1));
    }
 
-   for(int i = 0; i < count; i++)
+#undef INPUT_PREFETCH_LOOKAHEAD
+#undef OUTPUT_PREFETCH_LOOKAHEAD
+
+   // Odd element at the end
+   if(i < count)
    {
       const TSSkinMesh::BatchData::BatchedVertWeight &inElem = batch[i];
       TSMesh::__TSMeshVertexBase *outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + inElem.vidx * outStride);
 
-      // process x (hiding the prefetches in the delays)
-      inPos = _mm_load_ps(inElem.vert);
-      inNrm = _mm_load_ps(inElem.normal);
+      inPos0 = _mm_load_ps(inElem.vert);
+      inNrm0 = _mm_load_ps(inElem.normal);
 
-      // prefetch input 
-#define INPUT_PREFETCH_LOOKAHEAD 64
-      const char *prefetchInput = reinterpret_cast<const char *>(batch) + inStride * (i + INPUT_PREFETCH_LOOKAHEAD);
-      _mm_prefetch(prefetchInput, _MM_HINT_T0);
+      tempPos0 = _mm_mul_ps(_mm_shuffle_ps(inPos0, inPos0, _MM_SHUFFLE(0, 0, 0, 0)), sseMat[0]);
+      tempNrm0 = _mm_mul_ps(_mm_shuffle_ps(inNrm0, inNrm0, _MM_SHUFFLE(0, 0, 0, 0)), sseMat[0]);
+      tempPos0 = _mm_add_ps(tempPos0, _mm_mul_ps(_mm_shuffle_ps(inPos0, inPos0, _MM_SHUFFLE(1, 1, 1, 1)), sseMat[1]));
+      tempNrm0 = _mm_add_ps(tempNrm0, _mm_mul_ps(_mm_shuffle_ps(inNrm0, inNrm0, _MM_SHUFFLE(1, 1, 1, 1)), sseMat[1]));
+      tempPos0 = _mm_add_ps(tempPos0, _mm_mul_ps(_mm_shuffle_ps(inPos0, inPos0, _MM_SHUFFLE(2, 2, 2, 2)), sseMat[2]));
+      tempNrm0 = _mm_add_ps(tempNrm0, _mm_mul_ps(_mm_shuffle_ps(inNrm0, inNrm0, _MM_SHUFFLE(2, 2, 2, 2)), sseMat[2]));
+      tempPos0 = _mm_add_ps(tempPos0, sseMat[3]);
 
-      // prefetch ouput with half the lookahead distance of the input
-#define OUTPUT_PREFETCH_LOOKAHEAD (INPUT_PREFETCH_LOOKAHEAD >> 1)
-      const char *outPrefetch = reinterpret_cast<const char*>(outPtr) + outStride * (inElem.vidx + OUTPUT_PREFETCH_LOOKAHEAD);
-      _mm_prefetch(outPrefetch, _MM_HINT_T0);
+      weight0 = _mm_blend_ps(_mm_shuffle_ps(inPos0, inPos0, _MM_SHUFFLE(3, 3, 3, 3)), zero, 0x8);
+
+      tempPos0 = _mm_mul_ps(tempPos0, weight0);
+      tempNrm0 = _mm_mul_ps(tempNrm0, weight0);
+
+      _mm_store_ps(outElem->_vert, _mm_add_ps(_mm_load_ps(outElem->_vert), tempPos0));
+      _mm_store_ps(outElem->_normal, _mm_add_ps(_mm_load_ps(outElem->_normal), tempNrm0));
+   }
+}
+
+//-----------------------------------------------------------------------------
 
-      // Multiply position
-      tempPos = _mm_dp_ps(inPos, sseMat[0], 0xF1);
-      temp0 = _mm_dp_ps(inPos, sseMat[1], 0xF2);
-      temp1 = _mm_dp_ps(inPos, sseMat[2], 0xF4);
-      
-      temp0 = _mm_or_ps(temp0, temp1);
-      tempPos = _mm_or_ps(tempPos, temp0);
+/// Decodes a Quat16 into x, y, z, w, using the same division as
+/// Quat16::getQuatF() so the results match exactly
+LIBDTSHAPE_TARGET_ISA("sse4.1")
+static inline __m128 _loadQuat16_SSE4(const Quat16 *q, const __m128 maxVal)
+{
+   const __m128i v = _mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(q)));
+   return _mm_div_ps(_mm_cvtepi32_ps(v), maxVal);
+}
+
+LIBDTSHAPE_TARGET_ISA("sse4.1")
+void m_quat16_nlerp_bulk_SSE4(const dsize_t count,
+                              const Quat16 * const *key1,
+                              const Quat16 * const *key2,
+                              const F32 *keyPos,
+                              QuatF * const *out)
+{
+   // Four tracks per iteration, transposed so each register holds one
+   // component. Every operation is done in the same order as
+   // TSTransform::interpolate(), and there is no fused multiply-add, so
+   // the results are identical to the C version.
+   const __m128 maxVal = _mm_set1_ps(F32(Quat16::MAX_VAL));
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 signBit = _mm_set1_ps(-0.0f);
+   const __m128 split = _mm_set1_ps(0.857f);
+   const __m128 loA = _mm_set1_ps(0.699368f);
+   const __m128 loB = _mm_set1_ps(-1.819985f);
+   const __m128 loC = _mm_set1_ps(2.126369f);
+   const __m128 hiA = _mm_set1_ps(0.454012f);
+   const __m128 hiB = _mm_set1_ps(-1.403517f);
+   const __m128 hiC = _mm_set1_ps(1.949542f);
+
+   dsize_t i = 0;
+   for(; i + 4 <= count; i += 4)
+   {
+      __m128 x1 = _loadQuat16_SSE4(key1[i], maxVal);
+      __m128 y1 = _loadQuat16_SSE4(key1[i + 1], maxVal);
+      __m128 z1 = _loadQuat16_SSE4(key1[i + 2], maxVal);
+      __m128 w1 = _loadQuat16_SSE4(key1[i + 3], maxVal);
+      _MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+
+      __m128 x2 = _loadQuat16_SSE4(key2[i], maxVal);
+      __m128 y2 = _loadQuat16_SSE4(key2[i + 1], maxVal);
+      __m128 z2 = _loadQuat16_SSE4(key2[i + 2], maxVal);
+      __m128 w2 = _loadQuat16_SSE4(key2[i + 3], maxVal);
+      _MM_TRANSPOSE4_PS(x2, y2, z2, w2);
+
+      const __m128 t = _mm_loadu_ps(keyPos + i);
+
+      // Flip the first quat where they are more than 90 degrees apart
+      __m128 dot = _mm_mul_ps(x1, x2);
+      dot = _mm_add_ps(dot, _mm_mul_ps(y1, y2));
+      dot = _mm_add_ps(dot, _mm_mul_ps(z1, z2));
+      dot = _mm_add_ps(dot, _mm_mul_ps(w1, w2));
+      const __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, zero), signBit);
+      x1 = _mm_xor_ps(x1, flip);
+      y1 = _mm_xor_ps(y1, flip);
+      z1 = _mm_xor_ps(z1, flip);
+      w1 = _mm_xor_ps(w1, flip);
+
+      x1 = _mm_add_ps(x1, _mm_mul_ps(t, _mm_sub_ps(x2, x1)));
+      y1 = _mm_add_ps(y1, _mm_mul_ps(t, _mm_sub_ps(y2, y1)));
+      z1 = _mm_add_ps(z1, _mm_mul_ps(t, _mm_sub_ps(z2, z1)));
+      w1 = _mm_add_ps(w1, _mm_mul_ps(t, _mm_sub_ps(w2, w1)));
+
+      // Renormalize with the same polynomial approximation of 1/sqrt
+      __m128 dist2 = _mm_mul_ps(x1, x1);
+      dist2 = _mm_add_ps(dist2, _mm_mul_ps(y1, y1));
+      dist2 = _mm_add_ps(dist2, _mm_mul_ps(z1, z1));
+      dist2 = _mm_add_ps(dist2, _mm_mul_ps(w1, w1));
+
+      const __m128 lo = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(loA, dist2), loB), dist2), loC);
+      const __m128 hi = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(hiA, dist2), hiB), dist2), hiC);
+      const __m128 oneOverL = _mm_blendv_ps(hi, lo, _mm_cmplt_ps(dist2, split));
+
+      x1 = _mm_mul_ps(x1, oneOverL);
+      y1 = _mm_mul_ps(y1, oneOverL);
+      z1 = _mm_mul_ps(z1, oneOverL);
+      w1 = _mm_mul_ps(w1, oneOverL);
+
+      _MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+      _mm_storeu_ps(&out[i]->x, x1);
+      _mm_storeu_ps(&out[i + 1]->x, y1);
+      _mm_storeu_ps(&out[i + 2]->x, z1);
+      _mm_storeu_ps(&out[i + 3]->x, w1);
+   }
+
+   // Remaining tracks
+   QuatF q1, q2;
+   for(; i < count; i++)
+   {
+      key1[i]->getQuatF(&q1);
+      key2[i]->getQuatF(&q2);
+      TSTransform::interpolate(q1, q2, keyPos[i], out[i]);
+   }
+}
+
+//-----------------------------------------------------------------------------
 
-      // Multiply normal
-      tempNrm = _mm_dp_ps(inNrm, sseMat[0], 0x71);
-      temp2 = _mm_dp_ps(inNrm, sseMat[1], 0x72);
-      temp3 = _mm_dp_ps(inNrm, sseMat[2], 0x74);
+LIBDTSHAPE_TARGET_ISA("sse4.1")
+void m_quatF_point3F_set_matF_bulk_SSE4(const dsize_t count,
+                                        const QuatF * __restrict rot,
+                                        const Point3F * __restrict tran,
+                                        MatrixF * __restrict out)
+{
+   // Four transforms per iteration, following QuatF::setMatrix() and
+   // m_quatF_set_matF_C operation for operation
+   const __m128 one = _mm_set1_ps(1.0f);
+   const __m128 two = _mm_set1_ps(2.0f);
+   const __m128 zero = _mm_setzero_ps();
+   const __m128 identityEpsilon = _mm_set1_ps(10E-20f);
+   const __m128 lastRow = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+
+   dsize_t i = 0;
+   for(; i + 4 <= count; i += 4)
+   {
+      __m128 x = _mm_loadu_ps(&rot[i].x);
+      __m128 y = _mm_loadu_ps(&rot[i + 1].x);
+      __m128 z = _mm_loadu_ps(&rot[i + 2].x);
+      __m128 w = _mm_loadu_ps(&rot[i + 3].x);
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+
+      // Near identity rotations give an exact identity
+      __m128 len2 = _mm_mul_ps(x, x);
+      len2 = _mm_add_ps(len2, _mm_mul_ps(y, y));
+      len2 = _mm_add_ps(len2, _mm_mul_ps(z, z));
+      const __m128 isIdentity = _mm_cmplt_ps(len2, identityEpsilon);
 
-      temp2 = _mm_or_ps(temp2, temp3);
-      tempNrm = _mm_or_ps(tempNrm, temp2);
+      const __m128 xs = _mm_mul_ps(x, two);
+      const __m128 ys = _mm_mul_ps(y, two);
+      const __m128 zs = _mm_mul_ps(z, two);
+      const __m128 wx = _mm_mul_ps(w, xs);
+      const __m128 wy = _mm_mul_ps(w, ys);
+      const __m128 wz = _mm_mul_ps(w, zs);
+      const __m128 xx = _mm_mul_ps(x, xs);
+      const __m128 xy = _mm_mul_ps(x, ys);
+      const __m128 xz = _mm_mul_ps(x, zs);
+      const __m128 yy = _mm_mul_ps(y, ys);
+      const __m128 yz = _mm_mul_ps(y, zs);
+      const __m128 zz = _mm_mul_ps(z, zs);
 
-      // Load bone weight and multiply
-      temp3 = _mm_shuffle_ps(inPos, inPos, _MM_SHUFFLE(3, 3, 3, 3));
+      __m128 m00 = _mm_blendv_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), one, isIdentity);
+      __m128 m01 = _mm_blendv_ps(_mm_add_ps(xy, wz), zero, isIdentity);
+      __m128 m02 = _mm_blendv_ps(_mm_sub_ps(xz, wy), zero, isIdentity);
+      __m128 m10 = _mm_blendv_ps(_mm_sub_ps(xy, wz), zero, isIdentity);
+      __m128 m11 = _mm_blendv_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), one, isIdentity);
+      __m128 m12 = _mm_blendv_ps(_mm_add_ps(yz, wx), zero, isIdentity);
+      __m128 m20 = _mm_blendv_ps(_mm_add_ps(xz, wy), zero, isIdentity);
+      __m128 m21 = _mm_blendv_ps(_mm_sub_ps(yz, wx), zero, isIdentity);
+      __m128 m22 = _mm_blendv_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), one, isIdentity);
 
-      tempPos = _mm_mul_ps(tempPos, temp3);
-      tempNrm = _mm_mul_ps(tempNrm, temp3);
+      __m128 px = _mm_setr_ps(tran[i].x, tran[i + 1].x, tran[i + 2].x, tran[i + 3].x);
+      __m128 py = _mm_setr_ps(tran[i].y, tran[i + 1].y, tran[i + 2].y, tran[i + 3].y);
+      __m128 pz = _mm_setr_ps(tran[i].z, tran[i + 1].z, tran[i + 2].z, tran[i + 3].z);
 
-      inPos = _mm_load_ps(outElem->_vert);   //< load position for accumulation
-      inNrm = _mm_load_ps(outElem->_normal); //< load normal for accumulation
+      // Back to one row per register
+      _MM_TRANSPOSE4_PS(m00, m01, m02, px);
+      _MM_TRANSPOSE4_PS(m10, m11, m12, py);
+      _MM_TRANSPOSE4_PS(m20, m21, m22, pz);
 
-      // accumulate with previous values
-      tempNrm = _mm_add_ps(tempNrm, inNrm);
-      tempPos = _mm_add_ps(tempPos, inPos);
+      F32 *m = out[i];
+      _mm_storeu_ps(m, m00);
+      _mm_storeu_ps(m + 4, m10);
+      _mm_storeu_ps(m + 8, m20);
+      _mm_storeu_ps(m + 12, lastRow);
 
-      _mm_store_ps(outElem->_vert, tempPos);   //< output position
-      _mm_store_ps(outElem->_normal, tempNrm); //< output normal
+      m = out[i + 1];
+      _mm_storeu_ps(m, m01);
+      _mm_storeu_ps(m + 4, m11);
+      _mm_storeu_ps(m + 8, m21);
+      _mm_storeu_ps(m + 12, lastRow);
+
+      m = out[i + 2];
+      _mm_storeu_ps(m, m02);
+      _mm_storeu_ps(m + 4, m12);
+      _mm_storeu_ps(m + 8, m22);
+      _mm_storeu_ps(m + 12, lastRow);
+
+      m = out[i + 3];
+      _mm_storeu_ps(m, px);
+      _mm_storeu_ps(m + 4, py);
+      _mm_storeu_ps(m + 8, pz);
+      _mm_storeu_ps(m + 12, lastRow);
    }
+
+   // Remaining transforms
+   for(; i < count; i++)
+      TSTransform::setMatrix(rot[i], tran[i], &out[i]);
 }
 
 //-----------------------------------------------------------------------------
 
 END_NS
 
-#endif // LIBDTSHAPE_CPU_X86
\ No newline at end of file
+#endif // LIBDTSHAPE_MESHINTRINSICS_SSE4
\ No newline at end of file
@@ -265,10 +265,6 @@ void TSShapeLoader::recurseSubshape(AppNode* appNode, S32 parentIndex, bool recu
    }
    else
    {
-      // Check that adding this node will not exceed the maximum node count
-      if (shape->nodes.size() >= MAX_TS_SET_SIZE)
-         return;
-
       myIndex = shape->nodes.size();
       String nodeName = getUniqueName(appNode->getName(), cmpShapeName, shape->names);
 
@@ -360,12 +356,6 @@ void TSShapeLoader::generateSubshapes()
          recurseSubshape(subshape->branches[iBranch], -1, true);
 
       shape->subShapeNumNodes.push_back(shape->nodes.size() - firstNode);
-
-      if (shape->nodes.size() >= MAX_TS_SET_SIZE)
-      {
-         Log::warnf("Shape exceeds the maximum node count (%d). Ignoring additional nodes.",
-            MAX_TS_SET_SIZE);
-      }
    }
 }
 
@@ -21,7 +21,10 @@
 //-----------------------------------------------------------------------------
 
 #include "ts/tsShapeInstance.h"
+#include "ts/tsMeshIntrinsics.h"
+#include "ts/tsAnimationBatch.h"
 #include "platform/profiler.h"
+#include "core/log.h"
 
 //-----------------------------------------------------------------------------
 
@@ -75,6 +78,27 @@ void TSShapeInstance::animateNodes(S32 ss)
    // @todo: When a node is added, we need to make sure to resize the nodeTransforms array as well
    mNodeTransforms.setSize(mShape->nodes.size());
 
+   // Any skin output from updateSkins() is about to go stale
+   for (S32 i = 0; i < mMeshObjects.size(); i++)
+   {
+      mMeshObjects[i].mSkinnedMesh = NULL;
+      mMeshObjects[i].clearCollisionSkin();
+   }
+
+   // Streamed keyframes must be in memory while they are sampled below.
+   // Threads whose keyframes could not be loaded are skipped, leaving
+   // their nodes on the default transforms.
+   TSIntegerSet unloadedThreads;
+   for (S32 i = 0; i < mThreadList.size(); i++)
+   {
+      if (!mShape->touchSequence(mThreadList[i]->getSeqIndex()))
+      {
+         Log::errorf("TSShapeInstance::animateNodes - Could not load keyframes for sequence '%s'",
+            mShape->getSequenceName(mThreadList[i]->getSeqIndex()).c_str());
+         unloadedThreads.set(i);
+      }
+   }
+
    // temporary storage for node transforms
    mCurrentRenderState->smNodeCurrentRotations.setSize(mShape->nodes.size());
    mCurrentRenderState->smNodeCurrentTranslations.setSize(mShape->nodes.size());
@@ -102,6 +126,8 @@ void TSShapeInstance::animateNodes(S32 ss)
          firstBlend = i;
          break;
       }
+      if (unloadedThreads.test(i))
+         continue;
       rotBeenSet.takeAway(th->getSequence()->rotationMatters);
       tranBeenSet.takeAway(th->getSequence()->translationMatters);
       scaleBeenSet.takeAway(th->getSequence()->scaleMatters);
@@ -148,63 +174,237 @@ void TSShapeInstance::animateNodes(S32 ss)
    if (scaleCurrentlyAnimated())
       handleDefaultScale(a,b,scaleBeenSet);
 
+   // rotation tracks are gathered here and sampled together below
+   const bool soaSampling = TSShape::smUseSoASampling;
+   mCurrentRenderState->smSampleKeys1.clear();
+   mCurrentRenderState->smSampleKeys2.clear();
+   mCurrentRenderState->smSampleKeyPos.clear();
+   mCurrentRenderState->smSampleRotations.clear();
+
    // handle non-blend sequences
    for (i=0; i<firstBlend; i++)
    {
       TSThread * th = mThreadList[i];
+      if (unloadedThreads.test(i))
+         continue;
 
-      j=0;
-      start = th->getSequence()->rotationMatters.start();
-      end   = b;
-      for (nodeIndex=start; nodeIndex<end; th->getSequence()->rotationMatters.next(nodeIndex), j++)
+      if (th->keyframePair)
       {
-         // skip nodes outside of this detail
-         if (nodeIndex<a)
-            continue;
-         if (!rotBeenSet.test(nodeIndex))
+         // keys already decoded for every thread on this keyframe pair
+         const TSKeyframePair & pair = *th->keyframePair;
+         j=0;
+         start = th->getSequence()->rotationMatters.start();
+         end   = b;
+         for (nodeIndex=start; nodeIndex<end; th->getSequence()->rotationMatters.next(nodeIndex), j++)
+         {
+            if (nodeIndex<a || rotBeenSet.test(nodeIndex))
+               continue;
+
+            TSTransform::interpolate(pair.rotations1[j],pair.rotations2[j],th->keyPos,&mCurrentRenderState->smNodeCurrentRotations[nodeIndex]);
+            rotBeenSet.set(nodeIndex);
+            mCurrentRenderState->smRotationThreads[nodeIndex] = th;
+         }
+      }
+      else if (th->getSequence()->isCompressed())
+      {
+         // compressed keys are decoded and interpolated here on either path,
+         // rather than gathered for the bulk interpolation below
+         const TSShape::Sequence & seq = *th->getSequence();
+         AssertFatal(seq.rotationNodes.size() == seq.rotationMatters.count(), "TSShapeInstance::animateNodes - sequence tracks out of date");
+
+         const TSShape::CompressedTrack * track = mShape->compressedTracks.address() + seq.firstCompressedTrack;
+         for (j=0; j<seq.rotationNodes.size(); j++, track++)
          {
+            nodeIndex = seq.rotationNodes[j];
+            if (nodeIndex>=b)
+               break;
+            if (nodeIndex<a || rotBeenSet.test(nodeIndex))
+               continue;
+
             QuatF q1,q2;
-            mShape->getRotation(*th->getSequence(),th->keyNum1,j,&q1);
-            mShape->getRotation(*th->getSequence(),th->keyNum2,j,&q2);
+            mShape->getCompressedRotation(*track,th->keyNum1,&q1);
+            mShape->getCompressedRotation(*track,th->keyNum2,&q2);
             TSTransform::interpolate(q1,q2,th->keyPos,&mCurrentRenderState->smNodeCurrentRotations[nodeIndex]);
             rotBeenSet.set(nodeIndex);
             mCurrentRenderState->smRotationThreads[nodeIndex] = th;
          }
       }
+      else if (soaSampling)
+      {
+         const TSShape::Sequence & seq = *th->getSequence();
+         AssertFatal(seq.rotationNodes.size() == seq.rotationMatters.count(), "TSShapeInstance::animateNodes - sequence tracks out of date");
 
-      j=0;
-      start = th->getSequence()->translationMatters.start();
-      end   = b;
-      for (nodeIndex=start; nodeIndex<end; th->getSequence()->translationMatters.next(nodeIndex), j++)
+         const Quat16 * keys = mShape->getRotationKeys(seq);
+         for (j=0; j<seq.rotationNodes.size(); j++, keys += seq.numKeyframes)
+         {
+            nodeIndex = seq.rotationNodes[j];
+            if (nodeIndex>=b)
+               break;
+            // skip nodes outside of this detail
+            if (nodeIndex<a || rotBeenSet.test(nodeIndex))
+               continue;
+
+            mCurrentRenderState->smSampleKeys1.push_back(keys + th->keyNum1);
+            mCurrentRenderState->smSampleKeys2.push_back(keys + th->keyNum2);
+            mCurrentRenderState->smSampleKeyPos.push_back(th->keyPos);
+            mCurrentRenderState->smSampleRotations.push_back(&mCurrentRenderState->smNodeCurrentRotations[nodeIndex]);
+            rotBeenSet.set(nodeIndex);
+            mCurrentRenderState->smRotationThreads[nodeIndex] = th;
+         }
+      }
+      else
       {
-         if (nodeIndex<a)
-            continue;
-         if (!tranBeenSet.test(nodeIndex))
+         j=0;
+         start = th->getSequence()->rotationMatters.start();
+         end   = b;
+         for (nodeIndex=start; nodeIndex<end; th->getSequence()->rotationMatters.next(nodeIndex), j++)
+         {
+            // skip nodes outside of this detail
+            if (nodeIndex<a)
+               continue;
+            if (!rotBeenSet.test(nodeIndex))
+            {
+               QuatF q1,q2;
+               mShape->getRotation(*th->getSequence(),th->keyNum1,j,&q1);
+               mShape->getRotation(*th->getSequence(),th->keyNum2,j,&q2);
+               TSTransform::interpolate(q1,q2,th->keyPos,&mCurrentRenderState->smNodeCurrentRotations[nodeIndex]);
+               rotBeenSet.set(nodeIndex);
+               mCurrentRenderState->smRotationThreads[nodeIndex] = th;
+            }
+         }
+      }
+
+      if (th->keyframePair)
+      {
+         const TSKeyframePair & pair = *th->keyframePair;
+         j=0;
+         start = th->getSequence()->translationMatters.start();
+         end   = b;
+         for (nodeIndex=start; nodeIndex<end; th->getSequence()->translationMatters.next(nodeIndex), j++)
+         {
+            if (nodeIndex<a || tranBeenSet.test(nodeIndex))
+               continue;
+
+            if (maskPosNodes.test(nodeIndex))
+               handleMaskedPositionNode(th,nodeIndex,j);
+            else
+            {
+               TSTransform::interpolate(pair.translations1[j],pair.translations2[j],th->keyPos,&mCurrentRenderState->smNodeCurrentTranslations[nodeIndex]);
+               mCurrentRenderState->smTranslationThreads[nodeIndex] = th;
+            }
+            tranBeenSet.set(nodeIndex);
+         }
+      }
+      else if (th->getSequence()->isCompressed())
+      {
+         const TSShape::Sequence & seq = *th->getSequence();
+         AssertFatal(seq.translationNodes.size() == seq.translationMatters.count(), "TSShapeInstance::animateNodes - sequence tracks out of date");
+
+         const TSShape::CompressedTrack * track = mShape->compressedTracks.address() + seq.firstCompressedTrack + seq.rotationNodes.size();
+         for (j=0; j<seq.translationNodes.size(); j++, track++)
          {
+            nodeIndex = seq.translationNodes[j];
+            if (nodeIndex>=b)
+               break;
+            if (nodeIndex<a || tranBeenSet.test(nodeIndex))
+               continue;
+
             if (maskPosNodes.test(nodeIndex))
                handleMaskedPositionNode(th,nodeIndex,j);
             else
             {
-               const Point3F & p1 = mShape->getTranslation(*th->getSequence(),th->keyNum1,j);
-               const Point3F & p2 = mShape->getTranslation(*th->getSequence(),th->keyNum2,j);
+               Point3F p1 = mShape->getCompressedTranslation(*track,th->keyNum1);
+               Point3F p2 = mShape->getCompressedTranslation(*track,th->keyNum2);
                TSTransform::interpolate(p1,p2,th->keyPos,&mCurrentRenderState->smNodeCurrentTranslations[nodeIndex]);
                mCurrentRenderState->smTranslationThreads[nodeIndex] = th;
             }
             tranBeenSet.set(nodeIndex);
          }
       }
+      else if (soaSampling)
+      {
+         const TSShape::Sequence & seq = *th->getSequence();
+         AssertFatal(seq.translationNodes.size() == seq.translationMatters.count(), "TSShapeInstance::animateNodes - sequence tracks out of date");
+
+         const Point3F * keys = mShape->getTranslationKeys(seq);
+         for (j=0; j<seq.translationNodes.size(); j++, keys += seq.numKeyframes)
+         {
+            nodeIndex = seq.translationNodes[j];
+            if (nodeIndex>=b)
+               break;
+            if (nodeIndex<a || tranBeenSet.test(nodeIndex))
+               continue;
+
+            if (maskPosNodes.test(nodeIndex))
+               handleMaskedPositionNode(th,nodeIndex,j);
+            else
+            {
+               TSTransform::interpolate(keys[th->keyNum1],keys[th->keyNum2],th->keyPos,&mCurrentRenderState->smNodeCurrentTranslations[nodeIndex]);
+               mCurrentRenderState->smTranslationThreads[nodeIndex] = th;
+            }
+            tranBeenSet.set(nodeIndex);
+         }
+      }
+      else
+      {
+         j=0;
+         start = th->getSequence()->translationMatters.start();
+         end   = b;
+         for (nodeIndex=start; nodeIndex<end; th->getSequence()->translationMatters.next(nodeIndex), j++)
+         {
+            if (nodeIndex<a)
+               continue;
+            if (!tranBeenSet.test(nodeIndex))
+            {
+               if (maskPosNodes.test(nodeIndex))
+                  handleMaskedPositionNode(th,nodeIndex,j);
+               else
+               {
+                  const Point3F & p1 = mShape->getTranslation(*th->getSequence(),th->keyNum1,j);
+                  const Point3F & p2 = mShape->getTranslation(*th->getSequence(),th->keyNum2,j);
+                  TSTransform::interpolate(p1,p2,th->keyPos,&mCurrentRenderState->smNodeCurrentTranslations[nodeIndex]);
+                  mCurrentRenderState->smTranslationThreads[nodeIndex] = th;
+               }
+               tranBeenSet.set(nodeIndex);
+            }
+         }
+      }
 
       if (scaleCurrentlyAnimated())
          handleAnimatedScale(th,a,b,scaleBeenSet);
    }
 
    // compute transforms
-   for (i=a; i<b; i++)
+   if (soaSampling)
    {
-      if (!mHandsOffNodes.test(i))
-         TSTransform::setMatrix(mCurrentRenderState->smNodeCurrentRotations[i],mCurrentRenderState->smNodeCurrentTranslations[i],&mCurrentRenderState->smNodeLocalTransforms[i]);
-      else
-         mCurrentRenderState->smNodeLocalTransforms[i] = mNodeTransforms[i];     // in case mNodeTransform was changed externally
+      m_quat16_nlerp_bulk(mCurrentRenderState->smSampleKeys1.size(),
+                          mCurrentRenderState->smSampleKeys1.address(),
+                          mCurrentRenderState->smSampleKeys2.address(),
+                          mCurrentRenderState->smSampleKeyPos.address(),
+                          mCurrentRenderState->smSampleRotations.address());
+
+      if (a < b)
+         m_quatF_point3F_set_matF_bulk(b-a,
+                                       &mCurrentRenderState->smNodeCurrentRotations[a],
+                                       &mCurrentRenderState->smNodeCurrentTranslations[a],
+                                       &mCurrentRenderState->smNodeLocalTransforms[a]);
+
+      if (mHandsOffNodes.testAll())
+      {
+         for (i=a; i<b; i++)
+            if (mHandsOffNodes.test(i))
+               mCurrentRenderState->smNodeLocalTransforms[i] = mNodeTransforms[i];     // in case mNodeTransform was changed externally
+      }
+   }
+   else
+   {
+      for (i=a; i<b; i++)
+      {
+         if (!mHandsOffNodes.test(i))
+            TSTransform::setMatrix(mCurrentRenderState->smNodeCurrentRotations[i],mCurrentRenderState->smNodeCurrentTranslations[i],&mCurrentRenderState->smNodeLocalTransforms[i]);
+         else
+            mCurrentRenderState->smNodeLocalTransforms[i] = mNodeTransforms[i];     // in case mNodeTransform was changed externally
+      }
    }
 
    // add scale onto transforms
@@ -220,6 +420,7 @@ void TSShapeInstance::animateNodes(S32 ss)
       S32 nodeIndex = mNodeCallbacks[i].nodeIndex;
       if (nodeIndex>=start && nodeIndex<end)
       {
+         mNodeCallbacks[i].baseTransform = mCurrentRenderState->smNodeLocalTransforms[nodeIndex];
          mNodeCallbacks[i].callback->setNodeTransform(this, nodeIndex, mCurrentRenderState->smNodeLocalTransforms[nodeIndex]);
          mCurrentRenderState->smNodeLocalTransformDirty.set(nodeIndex);
       }
@@ -229,7 +430,7 @@ void TSShapeInstance::animateNodes(S32 ss)
    for (i=firstBlend; i<mThreadList.size(); i++)
    {
       TSThread * th = mThreadList[i];
-      if (th->blendDisabled)
+      if (th->blendDisabled || unloadedThreads.test(i))
          continue;
 
       handleBlendSequence(th,a,b);
@@ -239,15 +440,89 @@ void TSShapeInstance::animateNodes(S32 ss)
    if (inTransition())
       handleTransitionNodes(a,b);
 
-   // multiply transforms...
-   for (i=a; i<b; i++)
+   // multiply transforms, parents first...
+   for (S32 k=a; k<b; k++)
    {
+      i = mShape->mNodeOrder[k];
       S32 parentIdx = mShape->nodes[i].parentIndex;
       if (parentIdx < 0)
          mNodeTransforms[i] = mCurrentRenderState->smNodeLocalTransforms[i];
       else
          mNodeTransforms[i].mul(mNodeTransforms[parentIdx],mCurrentRenderState->smNodeLocalTransforms[i]);
+
+      mDirtyNodes.clear(i);
+   }
+
+   // keep the local transforms for animateDirtyNodes()
+   if (mHandsOffNodes.testAll() || mCallbackNodes.testAll())
+   {
+      mNodeLocalTransforms.setSize(mShape->nodes.size());
+      for (i=a; i<b; i++)
+         mNodeLocalTransforms[i] = mCurrentRenderState->smNodeLocalTransforms[i];
+   }
+   else
+      mNodeLocalTransforms.clear();
+}
+
+void TSShapeInstance::animateDirtyNodes(S32 ss)
+{
+   PROFILE_SCOPE( TSShapeInstance_animateDirtyNodes );
+
+   // Only hands-off and callback nodes can be redone on their own. Blends
+   // and transitions are applied on top of the callbacks, so need everything.
+   bool fullUpdate = inTransition() || mNodeLocalTransforms.size() != mShape->nodes.size();
+   for (S32 i=0; i<mThreadList.size() && !fullUpdate; i++)
+      fullUpdate = mThreadList[i]->getSequence()->isBlend() && !mThreadList[i]->blendDisabled;
+
+   if (fullUpdate)
+   {
+      animateNodes(ss);
+      return;
+   }
+
+   // Any skin output from updateSkins() is about to go stale
+   for (S32 i = 0; i < mMeshObjects.size(); i++)
+   {
+      mMeshObjects[i].mSkinnedMesh = NULL;
+      mMeshObjects[i].clearCollisionSkin();
+   }
+
+   // Visiting parents before their children passes dirty nodes down in one go
+   const S32 a = mShape->subShapeFirstNode[ss];
+   const S32 b = a + mShape->subShapeNumNodes[ss];
+   for (S32 k=a; k<b; k++)
+   {
+      const S32 i = mShape->mNodeOrder[k];
+      const S32 parentIdx = mShape->nodes[i].parentIndex;
+      if (!mDirtyNodes.test(i))
+      {
+         if (parentIdx < 0 || !mDirtyNodes.test(parentIdx))
+            continue;
+         mDirtyNodes.set(i);
+      }
+      else if (mHandsOffNodes.test(i))
+         mNodeLocalTransforms[i] = mNodeTransforms[i];
+      else if (mCallbackNodes.test(i))
+      {
+         for (S32 j=0; j<mNodeCallbacks.size(); j++)
+         {
+            if (mNodeCallbacks[j].nodeIndex == i)
+            {
+               mNodeLocalTransforms[i] = mNodeCallbacks[j].baseTransform;
+               mNodeCallbacks[j].callback->setNodeTransform(this, i, mNodeLocalTransforms[i]);
+               break;
+            }
+         }
+      }
+
+      if (parentIdx < 0)
+         mNodeTransforms[i] = mNodeLocalTransforms[i];
+      else
+         mNodeTransforms[i].mul(mNodeTransforms[parentIdx],mNodeLocalTransforms[i]);
    }
+
+   for (S32 i=a; i<b; i++)
+      mDirtyNodes.clear(i);
 }
 
 void TSShapeInstance::handleDefaultScale(S32 a, S32 b, TSIntegerSet & scaleBeenSet)
@@ -491,6 +766,7 @@ void TSShapeInstance::handleAnimatedScale(TSThread * thread, S32 a, S32 b, TSInt
    F32 uniformScale = 1.0f;
    Point3F alignedScale(0.0f, 0.0f, 0.0f);
    TSScale arbitraryScale;
+   const TSKeyframePair * pair = thread->keyframePair;
    for (S32 nodeIndex=start; nodeIndex<end; thread->getSequence()->scaleMatters.next(nodeIndex), j++)
    {
       if (nodeIndex<a)
@@ -505,8 +781,8 @@ void TSShapeInstance::handleAnimatedScale(TSThread * thread, S32 a, S32 b, TSInt
             case 4:  // uniform -> aligned
             case 8:  // uniform -> arbitrary
             {
-               F32 s1 = mShape->getUniformScale(*thread->getSequence(),thread->keyNum1,j);
-               F32 s2 = mShape->getUniformScale(*thread->getSequence(),thread->keyNum2,j);
+               F32 s1 = pair ? pair->scales1[j].mScale.x : mShape->getUniformScale(*thread->getSequence(),thread->keyNum1,j);
+               F32 s2 = pair ? pair->scales2[j].mScale.x : mShape->getUniformScale(*thread->getSequence(),thread->keyNum2,j);
                uniformScale = TSTransform::interpolate(s1,s2,thread->keyPos);
                alignedScale.set(uniformScale,uniformScale,uniformScale);
                break;
@@ -514,16 +790,24 @@ void TSShapeInstance::handleAnimatedScale(TSThread * thread, S32 a, S32 b, TSInt
             case 5:  // aligned -> aligned
             case 9:  // aligned -> arbitrary
             {
-               const Point3F & s1 = mShape->getAlignedScale(*thread->getSequence(),thread->keyNum1,j);
-               const Point3F & s2 = mShape->getAlignedScale(*thread->getSequence(),thread->keyNum2,j);
+               const Point3F & s1 = pair ? pair->scales1[j].mScale : mShape->getAlignedScale(*thread->getSequence(),thread->keyNum1,j);
+               const Point3F & s2 = pair ? pair->scales2[j].mScale : mShape->getAlignedScale(*thread->getSequence(),thread->keyNum2,j);
                TSTransform::interpolate(s1,s2,thread->keyPos,&alignedScale);
                break;
             }
             case 10: // arbitrary -> arbitary
             {
                TSScale s1,s2;
-               mShape->getArbitraryScale(*thread->getSequence(),thread->keyNum1,j,&s1);
-               mShape->getArbitraryScale(*thread->getSequence(),thread->keyNum2,j,&s2);
+               if (pair)
+               {
+                  s1 = pair->scales1[j];
+                  s2 = pair->scales2[j];
+               }
+               else
+               {
+                  mShape->getArbitraryScale(*thread->getSequence(),thread->keyNum1,j,&s1);
+                  mShape->getArbitraryScale(*thread->getSequence(),thread->keyNum2,j,&s2);
+               }
                TSTransform::interpolate(s1,s2,thread->keyPos,&arbitraryScale);
                break;
             }
@@ -863,6 +1147,8 @@ void TSShapeInstance::animate(S32 dl)
    // animate nodes?
    if (dirtyFlags & TransformDirty)
       animateNodes(ss);
+   else if (dirtyFlags & NodeDirty)
+      animateDirtyNodes(ss);
 
    // animate objects?
    if (dirtyFlags & VisDirty)
@@ -877,6 +1163,21 @@ void TSShapeInstance::animate(S32 dl)
    mDirtyFlags[ss] = 0;
 }
 
+void TSShapeInstance::setNodeDirty(S32 nodeIndex)
+{
+   mDirtyNodes.set(nodeIndex);
+   setDirty(NodeDirty);
+}
+
+bool TSShapeInstance::isAnimationDirty(S32 dl) const
+{
+   if (dl < 0)
+      return false;
+
+   S32 ss = mShape->details[dl].subShapeNum;
+   return ss >= 0 && mDirtyFlags[ss] != 0;
+}
+
 void TSShapeInstance::animateNodeSubtrees(bool forceFull)
 {
    // animate all the nodes for all the detail levels...
@@ -890,7 +1191,7 @@ void TSShapeInstance::animateNodeSubtrees(bool forceFull)
       if (mDirtyFlags[i] & TransformDirty)
       {
          animateNodes(i);
-         mDirtyFlags[i] &= ~TransformDirty;
+         mDirtyFlags[i] &= ~(TransformDirty | NodeDirty);
       }
    }
 }
@@ -0,0 +1,290 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "ts/tsAnimationBatch.h"
+
+#include "ts/tsShapeInstance.h"
+#include "ts/tsRenderState.h"
+#include "platform/threads/threadPool.h"
+#include "platform/profiler.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+void TSKeyframePair::decode()
+{
+   PROFILE_SCOPE( TSKeyframePair_decode );
+
+   rotations1.clear();
+   rotations2.clear();
+   translations1.clear();
+   translations2.clear();
+   scales1.clear();
+   scales2.clear();
+
+   valid = shape->touchSequence( sequence );
+   if ( !valid )
+      return;
+
+   const TSShape::Sequence &seq = shape->sequences[sequence];
+
+   const S32 numRotations = seq.rotationMatters.count();
+   rotations1.setSize( numRotations );
+   rotations2.setSize( numRotations );
+   for ( S32 j = 0; j < numRotations; j++ )
+   {
+      shape->getRotation( seq, keyNum1, j, &rotations1[j] );
+      shape->getRotation( seq, keyNum2, j, &rotations2[j] );
+   }
+
+   const S32 numTranslations = seq.translationMatters.count();
+   translations1.setSize( numTranslations );
+   translations2.setSize( numTranslations );
+   for ( S32 j = 0; j < numTranslations; j++ )
+   {
+      translations1[j] = shape->getTranslation( seq, keyNum1, j );
+      translations2[j] = shape->getTranslation( seq, keyNum2, j );
+   }
+
+   if ( !seq.animatesScale() )
+      return;
+
+   const S32 numScales = seq.scaleMatters.count();
+   scales1.setSize( numScales );
+   scales2.setSize( numScales );
+   for ( S32 j = 0; j < numScales; j++ )
+   {
+      if ( seq.animatesArbitraryScale() )
+      {
+         shape->getArbitraryScale( seq, keyNum1, j, &scales1[j] );
+         shape->getArbitraryScale( seq, keyNum2, j, &scales2[j] );
+      }
+      else if ( seq.animatesAlignedScale() )
+      {
+         scales1[j].mScale = shape->getAlignedScale( seq, keyNum1, j );
+         scales2[j].mScale = shape->getAlignedScale( seq, keyNum2, j );
+      }
+      else
+      {
+         const F32 s1 = shape->getUniformScale( seq, keyNum1, j );
+         const F32 s2 = shape->getUniformScale( seq, keyNum2, j );
+         scales1[j].mScale.set( s1, s1, s1 );
+         scales2[j].mScale.set( s2, s2, s2 );
+      }
+   }
+}
+
+//-----------------------------------------------------------------------------
+
+TSAnimationBatch::TSAnimationBatch()
+   : mNumPairs( 0 ),
+     mDelta( 0.0f )
+{
+}
+
+TSAnimationBatch::~TSAnimationBatch()
+{
+   for ( U32 i = 0; i < mWorkspaces.size(); i++ )
+      delete mWorkspaces[i];
+   for ( U32 i = 0; i < mPairs.size(); i++ )
+      delete mPairs[i];
+}
+
+void TSAnimationBatch::addInstance( TSShapeInstance *inst )
+{
+   AssertFatal( inst, "TSAnimationBatch::addInstance - NULL instance" );
+   mInstances.push_back( inst );
+}
+
+void TSAnimationBatch::removeInstance( TSShapeInstance *inst )
+{
+   for ( U32 i = 0; i < mInstances.size(); i++ )
+   {
+      if ( mInstances[i] == inst )
+      {
+         mInstances.erase( i );
+         return;
+      }
+   }
+}
+
+void TSAnimationBatch::clear()
+{
+   mInstances.clear();
+   mThreadRefs.clear();
+   mNumPairs = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void TSAnimationBatch::_addThreadRefs( TSShapeInstance *inst )
+{
+   const S32 dl = inst->mCurrentDetailLevel;
+   if ( dl < 0 )
+      return;
+
+   const S32 ss = inst->mShape->details[dl].subShapeNum;
+   if ( ss < 0 || !( inst->mDirtyFlags[ss] & TSShapeInstance::TransformDirty ) )
+      return;
+
+   // Threads are sorted, so the blends come last
+   for ( U32 i = 0; i < inst->mThreadList.size(); i++ )
+   {
+      TSThread *th = inst->mThreadList[i];
+      if ( th->getSequence()->isBlend() )
+         break;
+
+      mThreadRefs.increment();
+      ThreadRef &ref = mThreadRefs.last();
+      ref.shape = inst->mShape;
+      ref.sequence = th->sequence;
+      ref.keyNum1 = th->keyNum1;
+      ref.keyNum2 = th->keyNum2;
+      ref.thread = th;
+   }
+}
+
+static inline bool samePair( const TSAnimationBatch::ThreadRef &a, const TSAnimationBatch::ThreadRef &b )
+{
+   return a.shape == b.shape &&
+          a.sequence == b.sequence &&
+          a.keyNum1 == b.keyNum1 &&
+          a.keyNum2 == b.keyNum2;
+}
+
+static S32 QSORT_CALLBACK compareThreadRefs( const void *a, const void *b )
+{
+   const TSAnimationBatch::ThreadRef *ra = (const TSAnimationBatch::ThreadRef*)a;
+   const TSAnimationBatch::ThreadRef *rb = (const TSAnimationBatch::ThreadRef*)b;
+
+   if ( ra->shape != rb->shape )
+      return ra->shape < rb->shape ? -1 : 1;
+   if ( ra->sequence != rb->sequence )
+      return ra->sequence - rb->sequence;
+   if ( ra->keyNum1 != rb->keyNum1 )
+      return ra->keyNum1 - rb->keyNum1;
+   return ra->keyNum2 - rb->keyNum2;
+}
+
+//-----------------------------------------------------------------------------
+
+void TSAnimationBatch::_advanceInstance( void *data, U32 index, U32 workerIndex )
+{
+   TSAnimationBatch *batch = reinterpret_cast<TSAnimationBatch*>( data );
+   TSShapeInstance *inst = batch->mInstances[index];
+
+   inst->advanceTime( batch->mDelta );
+
+   // Sort now, as animate() would, so the blends can be told apart
+   const S32 dl = inst->mCurrentDetailLevel;
+   if ( dl >= 0 )
+   {
+      const S32 ss = inst->mShape->details[dl].subShapeNum;
+      if ( ss >= 0 && ( inst->mDirtyFlags[ss] & TSShapeInstance::ThreadDirty ) )
+      {
+         inst->sortThreads();
+         inst->mDirtyFlags[ss] &= ~TSShapeInstance::ThreadDirty;
+      }
+   }
+}
+
+void TSAnimationBatch::_decodePair( void *data, U32 index, U32 workerIndex )
+{
+   TSAnimationBatch *batch = reinterpret_cast<TSAnimationBatch*>( data );
+   batch->mPairs[index]->decode();
+}
+
+void TSAnimationBatch::_animateInstance( void *data, U32 index, U32 workerIndex )
+{
+   TSAnimationBatch *batch = reinterpret_cast<TSAnimationBatch*>( data );
+   TSShapeInstance *inst = batch->mInstances[index];
+
+   TSRenderState *renderState = inst->mCurrentRenderState;
+   inst->mCurrentRenderState = batch->mWorkspaces[workerIndex];
+   inst->animate();
+   inst->mCurrentRenderState = renderState;
+
+   // The pairs are only valid for this update
+   for ( U32 i = 0; i < inst->mThreadList.size(); i++ )
+      inst->mThreadList[i]->keyframePair = NULL;
+}
+
+void TSAnimationBatch::update( F32 delta, ThreadPool *pool )
+{
+   PROFILE_SCOPE( TSAnimationBatch_update );
+
+   if ( !pool )
+      pool = &ThreadPool::getGlobal();
+
+   while ( mWorkspaces.size() < pool->getNumWorkers() )
+      mWorkspaces.push_back( new TSRenderState() );
+
+   mDelta = delta;
+   pool->parallelFor( mInstances.size(), _advanceInstance, this );
+
+   // Find the distinct keyframe pairs being sampled
+   mThreadRefs.clear();
+   for ( U32 i = 0; i < mInstances.size(); i++ )
+      _addThreadRefs( mInstances[i] );
+   dQsort( mThreadRefs.address(), mThreadRefs.size(), sizeof( ThreadRef ), compareThreadRefs );
+
+   mNumPairs = 0;
+   for ( U32 i = 0; i < mThreadRefs.size(); i++ )
+   {
+      const ThreadRef &ref = mThreadRefs[i];
+      if ( i > 0 && samePair( mThreadRefs[i - 1], ref ) )
+         continue;
+
+      if ( mNumPairs == mPairs.size() )
+         mPairs.push_back( new TSKeyframePair() );
+
+      TSKeyframePair *pair = mPairs[mNumPairs++];
+      pair->shape = ref.shape;
+      pair->sequence = ref.sequence;
+      pair->keyNum1 = ref.keyNum1;
+      pair->keyNum2 = ref.keyNum2;
+   }
+
+   pool->parallelFor( mNumPairs, _decodePair, this );
+
+   // Point each thread at its pair, in the same order they were found
+   S32 pairIndex = -1;
+   for ( U32 i = 0; i < mThreadRefs.size(); i++ )
+   {
+      const ThreadRef &ref = mThreadRefs[i];
+      if ( i == 0 || !samePair( mThreadRefs[i - 1], ref ) )
+         pairIndex++;
+
+      const TSKeyframePair *pair = mPairs[pairIndex];
+      ref.thread->keyframePair = pair->valid ? pair : NULL;
+   }
+
+   pool->parallelFor( mInstances.size(), _animateInstance, this );
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
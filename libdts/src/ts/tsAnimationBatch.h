@@ -0,0 +1,166 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _TSANIMATIONBATCH_H_
+#define _TSANIMATIONBATCH_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+#ifndef _TVECTOR_H_
+#include "core/util/tVector.h"
+#endif
+#ifndef _TSTRANSFORM_H_
+#include "ts/tsTransform.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+class TSShape;
+class TSShapeInstance;
+class TSThread;
+class TSRenderState;
+class ThreadPool;
+
+/// The keys of one sequence decoded at a pair of keyframes, shared by
+/// every thread sampling between those keyframes.  Each thread still
+/// interpolates them with its own keyPos.  Tracks are in the same order as
+/// the sequence's rotationMatters, translationMatters and scaleMatters.
+struct TSKeyframePair
+{
+   const TSShape *shape;
+   S32 sequence;
+   S32 keyNum1;
+   S32 keyNum2;
+
+   /// False if the keyframes of a streamed sequence could not be read
+   bool valid;
+
+   Vector<QuatF> rotations1;
+   Vector<QuatF> rotations2;
+   Vector<Point3F> translations1;
+   Vector<Point3F> translations2;
+
+   /// Uniform and aligned scales only fill in mScale
+   Vector<TSScale> scales1;
+   Vector<TSScale> scales2;
+
+   /// Decodes the keys at keyNum1 and keyNum2.
+   void decode();
+};
+
+/// Advances and animates a large number of shape instances in one go.
+///
+/// This replaces calling advanceTime() and animate() on each instance in
+/// turn.  Work is spread over a ThreadPool, each worker using its own node
+/// transform workspace, so the TSRenderState the instances were created
+/// with is left alone.
+///
+/// After advancing, the keys of each distinct (sequence, keyframe pair)
+/// sampled by the instances are decoded once, then every instance
+/// interpolates them at its own position.  A crowd playing a handful of
+/// sequences only decodes a few keyframe pairs per frame however far out
+/// of step its members are.  Blend sequences are sampled by each instance.
+///
+/// @code
+/// TSAnimationBatch batch;
+/// for ( U32 i = 0; i < crowd.size(); i++ )
+///    batch.addInstance( crowd[i] );
+///
+/// // each frame
+/// batch.update( dt );
+/// @endcode
+class TSAnimationBatch
+{
+public:
+
+   /// A thread which samples a keyframe pair this update
+   struct ThreadRef
+   {
+      const TSShape *shape;
+      S32 sequence;
+      S32 keyNum1;
+      S32 keyNum2;
+      TSThread *thread;
+   };
+
+protected:
+
+   Vector<TSShapeInstance*> mInstances;
+
+   /// @name Per update
+   /// @{
+   Vector<ThreadRef> mThreadRefs;
+   Vector<TSKeyframePair*> mPairs;     ///< Kept between updates to reuse their memory
+   U32 mNumPairs;
+   F32 mDelta;
+   /// @}
+
+   /// Node transform workspace for each pool worker
+   Vector<TSRenderState*> mWorkspaces;
+
+   /// Adds the non-blend threads of an instance which are about to be
+   /// sampled to mThreadRefs.
+   void _addThreadRefs( TSShapeInstance *inst );
+
+   static void _advanceInstance( void *data, U32 index, U32 workerIndex );
+   static void _decodePair( void *data, U32 index, U32 workerIndex );
+   static void _animateInstance( void *data, U32 index, U32 workerIndex );
+
+public:
+
+   TSAnimationBatch();
+   ~TSAnimationBatch();
+
+   /// Adds an instance to the batch.  An instance should only be added once.
+   void addInstance( TSShapeInstance *inst );
+
+   void removeInstance( TSShapeInstance *inst );
+
+   void clear();
+
+   U32 getNumInstances() const { return mInstances.size(); }
+
+   /// Advances all threads on all instances by delta seconds, then animates
+   /// each instance at its current detail level, as advanceTime() followed
+   /// by animate() would.  Uses the global pool if pool is NULL.
+   ///
+   /// @note Thread triggers are updated from the worker threads.
+   void update( F32 delta, ThreadPool *pool = NULL );
+
+   /// Number of threads sampled from decoded keyframe pairs by the last update()
+   U32 getNumSampledThreads() const { return mThreadRefs.size(); }
+
+   /// Number of keyframe pairs decoded by the last update()
+   U32 getNumKeyframePairs() const { return mNumPairs; }
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _TSANIMATIONBATCH_H_
@@ -0,0 +1,804 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "ts/tsBroadphase.h"
+#include "ts/tsShapeInstance.h"
+#include "ts/tsMaterialList.h"
+#include "collision/abstractPolyList.h"
+#include "collision/collision.h"
+#include "math/util/frustum.h"
+#include "platform/profiler.h"
+#include "math/mMathFn.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+static inline F32 surfaceArea( const Box3F &box )
+{
+   Point3F ext = box.getExtents();
+   return 2.0f * ( ext.x * ext.y + ext.y * ext.z + ext.z * ext.x );
+}
+
+static inline void combineBoxes( const Box3F &a, const Box3F &b, Box3F &out )
+{
+   out = a;
+   out.minExtents.setMin( b.minExtents );
+   out.maxExtents.setMax( b.maxExtents );
+}
+
+//-----------------------------------------------------------------------------
+
+TSBroadphase::TSBroadphase( F32 margin )
+{
+   mMargin = margin;
+   clear();
+}
+
+void TSBroadphase::clear()
+{
+   mNodes.clear();
+   mProxies.clear();
+   mRoot = NullNode;
+   mFreeList = NullNode;
+   mNumProxies = 0;
+}
+
+S32 TSBroadphase::_allocateNode()
+{
+   S32 node;
+   if ( mFreeList != NullNode )
+   {
+      node = mFreeList;
+      mFreeList = mNodes[node].parent;
+   }
+   else
+   {
+      node = mNodes.size();
+      mNodes.increment();
+      mProxies.increment();
+   }
+
+   Node &n = mNodes[node];
+   n.parent = NullNode;
+   n.child1 = NullNode;
+   n.child2 = NullNode;
+   n.height = 0;
+
+   mProxies[node].instance = NULL;
+   return node;
+}
+
+void TSBroadphase::_freeNode( S32 node )
+{
+   mNodes[node].parent = mFreeList;
+   mNodes[node].height = -1;
+   mProxies[node].instance = NULL;
+   mFreeList = node;
+}
+
+//-----------------------------------------------------------------------------
+
+void TSBroadphase::_insertLeaf( S32 leaf )
+{
+   if ( mRoot == NullNode )
+   {
+      mRoot = leaf;
+      mNodes[leaf].parent = NullNode;
+      return;
+   }
+
+   // Walk down to the sibling which makes the tree grow the least,
+   // counting the area each ancestor gains on the way.
+   const Box3F leafBox = mNodes[leaf].bounds;
+   S32 index = mRoot;
+   Box3F combined;
+   while ( mNodes[index].child1 != NullNode )
+   {
+      const Node &node = mNodes[index];
+
+      F32 area = surfaceArea( node.bounds );
+      combineBoxes( node.bounds, leafBox, combined );
+      F32 combinedArea = surfaceArea( combined );
+
+      // Cost of pairing the leaf with this node
+      F32 cost = 2.0f * combinedArea;
+
+      // Cost pushed down to the children
+      F32 inheritanceCost = 2.0f * ( combinedArea - area );
+
+      F32 childCost[2];
+      const S32 children[2] = { node.child1, node.child2 };
+      for ( U32 i = 0; i < 2; i++ )
+      {
+         const Node &child = mNodes[children[i]];
+         combineBoxes( child.bounds, leafBox, combined );
+         if ( child.child1 == NullNode )
+            childCost[i] = surfaceArea( combined ) + inheritanceCost;
+         else
+            childCost[i] = surfaceArea( combined ) - surfaceArea( child.bounds ) + inheritanceCost;
+      }
+
+      if ( cost < childCost[0] && cost < childCost[1] )
+         break;
+
+      index = childCost[0] < childCost[1] ? children[0] : children[1];
+   }
+
+   // Replace the sibling with a new parent of both
+   const S32 sibling = index;
+   const S32 oldParent = mNodes[sibling].parent;
+   const S32 newParent = _allocateNode();
+
+   Node &parent = mNodes[newParent];
+   parent.parent = oldParent;
+   combineBoxes( mNodes[sibling].bounds, leafBox, parent.bounds );
+   parent.height = mNodes[sibling].height + 1;
+   parent.child1 = sibling;
+   parent.child2 = leaf;
+
+   if ( oldParent != NullNode )
+   {
+      if ( mNodes[oldParent].child1 == sibling )
+         mNodes[oldParent].child1 = newParent;
+      else
+         mNodes[oldParent].child2 = newParent;
+   }
+   else
+      mRoot = newParent;
+
+   mNodes[sibling].parent = newParent;
+   mNodes[leaf].parent = newParent;
+
+   // Refit and balance the ancestors
+   index = newParent;
+   while ( index != NullNode )
+   {
+      index = _balance( index );
+
+      Node &node = mNodes[index];
+      const Node &child1 = mNodes[node.child1];
+      const Node &child2 = mNodes[node.child2];
+      node.height = 1 + getMax( child1.height, child2.height );
+      combineBoxes( child1.bounds, child2.bounds, node.bounds );
+
+      index = node.parent;
+   }
+}
+
+void TSBroadphase::_removeLeaf( S32 leaf )
+{
+   if ( leaf == mRoot )
+   {
+      mRoot = NullNode;
+      return;
+   }
+
+   const S32 parent = mNodes[leaf].parent;
+   const S32 grandParent = mNodes[parent].parent;
+   const S32 sibling = mNodes[parent].child1 == leaf ? mNodes[parent].child2 : mNodes[parent].child1;
+
+   _freeNode( parent );
+
+   if ( grandParent == NullNode )
+   {
+      mRoot = sibling;
+      mNodes[sibling].parent = NullNode;
+      return;
+   }
+
+   // Put the sibling in the parent's place and refit upwards
+   if ( mNodes[grandParent].child1 == parent )
+      mNodes[grandParent].child1 = sibling;
+   else
+      mNodes[grandParent].child2 = sibling;
+   mNodes[sibling].parent = grandParent;
+
+   S32 index = grandParent;
+   while ( index != NullNode )
+   {
+      index = _balance( index );
+
+      Node &node = mNodes[index];
+      const Node &child1 = mNodes[node.child1];
+      const Node &child2 = mNodes[node.child2];
+      combineBoxes( child1.bounds, child2.bounds, node.bounds );
+      node.height = 1 + getMax( child1.height, child2.height );
+
+      index = node.parent;
+   }
+}
+
+S32 TSBroadphase::_balance( S32 iA )
+{
+   Node &A = mNodes[iA];
+   if ( A.child1 == NullNode || A.height < 2 )
+      return iA;
+
+   const S32 iB = A.child1;
+   const S32 iC = A.child2;
+   const S32 balance = mNodes[iC].height - mNodes[iB].height;
+
+   // Rotate the taller child up into A's place, giving A the shorter
+   // of its children.
+   if ( balance > 1 || balance < -1 )
+   {
+      const S32 iUp = balance > 1 ? iC : iB;
+      const S32 iKeep = balance > 1 ? iB : iC;
+
+      Node &up = mNodes[iUp];
+      const S32 iF = up.child1;
+      const S32 iG = up.child2;
+
+      up.child1 = iA;
+      up.parent = A.parent;
+      A.parent = iUp;
+
+      if ( up.parent != NullNode )
+      {
+         if ( mNodes[up.parent].child1 == iA )
+            mNodes[up.parent].child1 = iUp;
+         else
+            mNodes[up.parent].child2 = iUp;
+      }
+      else
+         mRoot = iUp;
+
+      // Keep the taller grandchild under up
+      S32 iTall = iF, iShort = iG;
+      if ( mNodes[iF].height < mNodes[iG].height )
+      {
+         iTall = iG;
+         iShort = iF;
+      }
+
+      up.child2 = iTall;
+      if ( balance > 1 )
+         A.child2 = iShort;
+      else
+         A.child1 = iShort;
+      mNodes[iShort].parent = iA;
+
+      const Node &keep = mNodes[iKeep];
+      const Node &shortNode = mNodes[iShort];
+      const Node &tall = mNodes[iTall];
+
+      combineBoxes( keep.bounds, shortNode.bounds, A.bounds );
+      A.height = 1 + getMax( keep.height, shortNode.height );
+
+      combineBoxes( A.bounds, tall.bounds, up.bounds );
+      up.height = 1 + getMax( A.height, tall.height );
+
+      return iUp;
+   }
+
+   return iA;
+}
+
+//-----------------------------------------------------------------------------
+
+S32 TSBroadphase::_getObjectDetail( const Proxy &proxy ) const
+{
+   const TSShape *shape = proxy.instance->getShape();
+   if ( proxy.detail < 0 || proxy.detail >= shape->details.size() )
+      return -1;
+
+   const TSShape::Detail &detail = shape->details[proxy.detail];
+   return detail.subShapeNum < 0 ? -1 : detail.objectDetailNum;
+}
+
+void TSBroadphase::_computeLocalBounds( S32 proxy )
+{
+   Proxy &data = mProxies[proxy];
+   Box3F &bounds = data.localBounds;
+
+   if ( data.meshIndex < 0 )
+   {
+      if ( data.detail < 0 )
+         bounds = data.instance->getShape()->bounds;
+      else
+         data.instance->computeBounds( data.detail, bounds );
+   }
+   else
+   {
+      // Fall back to the whole shape if the mesh isn't in this detail
+      TSShapeInstance::MeshObjectInstance &meshObj = data.instance->mMeshObjects[data.meshIndex];
+      const S32 od = _getObjectDetail( data );
+      TSMesh *mesh = od >= 0 ? meshObj.getMesh( od ) : NULL;
+      if ( mesh )
+         mesh->computeBounds( meshObj.getTransform(), bounds, 0 );
+      else
+         bounds = data.instance->getShape()->bounds;
+   }
+}
+
+void TSBroadphase::_getWorldBounds( S32 proxy, Box3F &bounds ) const
+{
+   const Proxy &data = mProxies[proxy];
+   bounds = data.localBounds;
+   data.transform.mul( bounds );
+}
+
+bool TSBroadphase::_moveProxy( S32 proxy, const Box3F &bounds )
+{
+   if ( mNodes[proxy].bounds.isContained( bounds ) )
+      return false;
+
+   _removeLeaf( proxy );
+
+   Box3F &fat = mNodes[proxy].bounds;
+   fat = bounds;
+   fat.minExtents -= Point3F( mMargin, mMargin, mMargin );
+   fat.maxExtents += Point3F( mMargin, mMargin, mMargin );
+
+   _insertLeaf( proxy );
+   return true;
+}
+
+//-----------------------------------------------------------------------------
+
+S32 TSBroadphase::createProxy( TSShapeInstance *instance, const MatrixF &transform, S32 detail, S32 meshIndex, void *userData )
+{
+   AssertFatal( instance, "TSBroadphase::createProxy - no instance" );
+   AssertFatal( meshIndex < instance->mMeshObjects.size(), "TSBroadphase::createProxy - mesh index out of range" );
+
+   const S32 proxy = _allocateNode();
+
+   Proxy &data = mProxies[proxy];
+   data.instance = instance;
+   data.meshIndex = meshIndex;
+   data.detail = detail;
+   data.transform = transform;
+   data.invTransform = transform;
+   data.invTransform.inverse();
+   data.userData = userData;
+
+   Box3F bounds;
+   _computeLocalBounds( proxy );
+   _getWorldBounds( proxy, bounds );
+
+   Box3F &fat = mNodes[proxy].bounds;
+   fat = bounds;
+   fat.minExtents -= Point3F( mMargin, mMargin, mMargin );
+   fat.maxExtents += Point3F( mMargin, mMargin, mMargin );
+
+   _insertLeaf( proxy );
+   mNumProxies++;
+
+   return proxy;
+}
+
+void TSBroadphase::destroyProxy( S32 proxy )
+{
+   AssertFatal( proxy >= 0 && proxy < mNodes.size() && mNodes[proxy].height == 0, "TSBroadphase::destroyProxy - invalid proxy" );
+
+   _removeLeaf( proxy );
+   _freeNode( proxy );
+   mNumProxies--;
+}
+
+bool TSBroadphase::updateProxy( S32 proxy, const MatrixF &transform )
+{
+   AssertFatal( proxy >= 0 && proxy < mNodes.size() && mNodes[proxy].height == 0, "TSBroadphase::updateProxy - invalid proxy" );
+
+   Proxy &data = mProxies[proxy];
+   data.transform = transform;
+   data.invTransform = transform;
+   data.invTransform.inverse();
+
+   Box3F bounds;
+   _getWorldBounds( proxy, bounds );
+   return _moveProxy( proxy, bounds );
+}
+
+bool TSBroadphase::updateProxy( S32 proxy )
+{
+   AssertFatal( proxy >= 0 && proxy < mNodes.size() && mNodes[proxy].height == 0, "TSBroadphase::updateProxy - invalid proxy" );
+
+   Box3F bounds;
+   _computeLocalBounds( proxy );
+   _getWorldBounds( proxy, bounds );
+   return _moveProxy( proxy, bounds );
+}
+
+//-----------------------------------------------------------------------------
+
+void TSBroadphase::queryBox( const Box3F &box, Vector<S32> &results ) const
+{
+   if ( mRoot == NullNode )
+      return;
+
+   S32 stack[MaxStackDepth];
+   U32 count = 0;
+   stack[count++] = mRoot;
+
+   while ( count )
+   {
+      const S32 index = stack[--count];
+      const Node &node = mNodes[index];
+
+      if ( !node.bounds.isOverlapped( box ) )
+         continue;
+
+      if ( node.child1 == NullNode )
+         results.push_back( index );
+      else
+      {
+         AssertFatal( count + 2 <= MaxStackDepth, "TSBroadphase::queryBox - stack overflow" );
+         stack[count++] = node.child1;
+         stack[count++] = node.child2;
+      }
+   }
+}
+
+/// Slab test of a segment against a box, using the reciprocal of the
+/// segment's direction.  Returns the entry distance along the segment.
+static inline bool rayOverlapsBox( const Box3F &box, const Point3F &start, const Point3F &invDir, F32 maxT, F32 &enterT )
+{
+   F32 t0 = 0.0f, t1 = maxT;
+   for ( U32 i = 0; i < 3; i++ )
+   {
+      F32 tMin = ( box.minExtents[i] - start[i] ) * invDir[i];
+      F32 tMax = ( box.maxExtents[i] - start[i] ) * invDir[i];
+      if ( tMin > tMax )
+      {
+         F32 tmp = tMin;
+         tMin = tMax;
+         tMax = tmp;
+      }
+      t0 = tMin > t0 ? tMin : t0;
+      t1 = tMax < t1 ? tMax : t1;
+      if ( t0 > t1 )
+         return false;
+   }
+
+   enterT = t0;
+   return true;
+}
+
+static inline void getInverseDirection( const Point3F &start, const Point3F &end, Point3F &invDir )
+{
+   // Large rather than infinite so that a zero direction
+   // doesn't give 0 * inf when the start is on a slab
+   const Point3F dir = end - start;
+   for ( U32 i = 0; i < 3; i++ )
+      invDir[i] = mFabs( dir[i] ) > 1e-12f ? 1.0f / dir[i] : ( dir[i] < 0.0f ? -1e30f : 1e30f );
+}
+
+void TSBroadphase::queryRay( const Point3F &start, const Point3F &end, Vector<S32> &results ) const
+{
+   if ( mRoot == NullNode )
+      return;
+
+   Point3F invDir;
+   getInverseDirection( start, end, invDir );
+
+   S32 stack[MaxStackDepth];
+   U32 count = 0;
+   stack[count++] = mRoot;
+
+   F32 enterT;
+   while ( count )
+   {
+      const S32 index = stack[--count];
+      const Node &node = mNodes[index];
+
+      if ( !rayOverlapsBox( node.bounds, start, invDir, 1.0f, enterT ) )
+         continue;
+
+      if ( node.child1 == NullNode )
+         results.push_back( index );
+      else
+      {
+         AssertFatal( count + 2 <= MaxStackDepth, "TSBroadphase::queryRay - stack overflow" );
+         stack[count++] = node.child1;
+         stack[count++] = node.child2;
+      }
+   }
+}
+
+void TSBroadphase::queryFrustums( const Frustum *frustums, U32 numFrustums, Vector<S32> *results ) const
+{
+   AssertFatal( numFrustums <= MaxFrustums, "TSBroadphase::queryFrustums - too many frustums" );
+   if ( mRoot == NullNode || numFrustums == 0 )
+      return;
+
+   PROFILE_SCOPE( TSBroadphase_QueryFrustums );
+
+   // Each entry carries the frustums the node still has to be tested
+   // against, and those which already hold it entirely.
+   struct Entry
+   {
+      S32 node;
+      U32 testMask;
+      U32 insideMask;
+   };
+
+   Entry stack[MaxStackDepth];
+   U32 count = 0;
+
+   stack[count].node = mRoot;
+   stack[count].testMask = numFrustums == 32 ? 0xFFFFFFFF : ( 1 << numFrustums ) - 1;
+   stack[count].insideMask = 0;
+   count++;
+
+   while ( count )
+   {
+      const Entry entry = stack[--count];
+      const Node &node = mNodes[entry.node];
+
+      U32 testMask = entry.testMask;
+      U32 insideMask = entry.insideMask;
+      for ( U32 i = 0; i < numFrustums; i++ )
+      {
+         const U32 bit = 1 << i;
+         if ( !( testMask & bit ) )
+            continue;
+
+         const S32 result = frustums[i].testPotentialIntersection( node.bounds );
+         if ( result == GeometryOutside )
+            testMask &= ~bit;
+         else if ( result == GeometryInside )
+         {
+            testMask &= ~bit;
+            insideMask |= bit;
+         }
+      }
+
+      const U32 visibleMask = testMask | insideMask;
+      if ( !visibleMask )
+         continue;
+
+      if ( node.child1 == NullNode )
+      {
+         for ( U32 i = 0; i < numFrustums; i++ )
+         {
+            if ( visibleMask & ( 1 << i ) )
+               results[i].push_back( entry.node );
+         }
+      }
+      else
+      {
+         AssertFatal( count + 2 <= MaxStackDepth, "TSBroadphase::queryFrustums - stack overflow" );
+         stack[count].node = node.child1;
+         stack[count].testMask = testMask;
+         stack[count].insideMask = insideMask;
+         count++;
+         stack[count].node = node.child2;
+         stack[count].testMask = testMask;
+         stack[count].insideMask = insideMask;
+         count++;
+      }
+   }
+}
+
+//-----------------------------------------------------------------------------
+
+/// Transforms a normal by the transpose of inverse, the inverse of the
+/// transform the surface went through, so it stays perpendicular to the
+/// surface when the transform has non-uniform scale
+static void mulNormal( const MatrixF &inverse, VectorF &normal )
+{
+   MatrixF invTranspose = inverse;
+   invTranspose.transpose();
+   invTranspose.mulV( normal );
+}
+
+bool TSBroadphase::_castRayProxy( S32 proxy, const Point3F &start, const Point3F &end, RayInfo *info ) const
+{
+   const Proxy &data = mProxies[proxy];
+
+   Point3F shapeStart, shapeEnd;
+   data.invTransform.mulP( start, &shapeStart );
+   data.invTransform.mulP( end, &shapeEnd );
+
+   if ( data.meshIndex < 0 )
+   {
+      if ( !data.instance->castRay( shapeStart, shapeEnd, info, data.detail ) )
+         return false;
+      if ( info )
+         mulNormal( data.invTransform, info->normal );
+   }
+   else
+   {
+      const S32 od = _getObjectDetail( data );
+      if ( od < 0 )
+         return false;
+
+      TSShapeInstance::MeshObjectInstance &meshObj = data.instance->mMeshObjects[data.meshIndex];
+      if ( od >= meshObj.object->numMeshes )
+         return false;
+
+      MatrixF shapeToMesh = meshObj.getTransform();
+      shapeToMesh.inverse();
+
+      Point3F meshStart, meshEnd;
+      shapeToMesh.mulP( shapeStart, &meshStart );
+      shapeToMesh.mulP( shapeEnd, &meshEnd );
+
+      if ( !meshObj.castRay( od, meshStart, meshEnd, info, data.instance->getMaterialList() ) )
+         return false;
+      if ( info )
+      {
+         mulNormal( shapeToMesh, info->normal );
+         mulNormal( data.invTransform, info->normal );
+      }
+   }
+
+   // The transforms are affine so t is the same in every space
+   if ( info )
+   {
+      info->normal.normalizeSafe();
+      info->setContactPoint( start, end );
+   }
+   return true;
+}
+
+bool TSBroadphase::castRay( const Point3F &start, const Point3F &end, RayInfo *info, S32 *hitProxy ) const
+{
+   if ( mRoot == NullNode )
+      return false;
+
+   PROFILE_SCOPE( TSBroadphase_CastRay );
+
+   Point3F invDir;
+   getInverseDirection( start, end, invDir );
+
+   struct Entry
+   {
+      S32 node;
+      F32 enterT;
+   };
+
+   Entry stack[MaxStackDepth];
+   U32 count = 0;
+
+   F32 enterT;
+   if ( !rayOverlapsBox( mNodes[mRoot].bounds, start, invDir, 1.0f, enterT ) )
+      return false;
+   stack[count].node = mRoot;
+   stack[count].enterT = enterT;
+   count++;
+
+   RayInfo rayInfo;
+   F32 bestT = 1.0f;
+   bool found = false;
+
+   while ( count )
+   {
+      const Entry entry = stack[--count];
+
+      // Skip anything which starts beyond the closest hit so far
+      if ( entry.enterT > bestT )
+         continue;
+
+      const Node &node = mNodes[entry.node];
+      if ( node.child1 == NullNode )
+      {
+         if ( !_castRayProxy( entry.node, start, end, info ? &rayInfo : NULL ) )
+            continue;
+
+         if ( !info )
+         {
+            if ( hitProxy )
+               *hitProxy = entry.node;
+            return true;
+         }
+
+         if ( !found || rayInfo.t < bestT )
+         {
+            *info = rayInfo;
+            bestT = rayInfo.t;
+            found = true;
+            if ( hitProxy )
+               *hitProxy = entry.node;
+         }
+         continue;
+      }
+
+      // Push the farther child first so the nearer is visited next
+      F32 t1, t2;
+      const bool hit1 = rayOverlapsBox( mNodes[node.child1].bounds, start, invDir, bestT, t1 );
+      const bool hit2 = rayOverlapsBox( mNodes[node.child2].bounds, start, invDir, bestT, t2 );
+
+      AssertFatal( count + 2 <= MaxStackDepth, "TSBroadphase::castRay - stack overflow" );
+      if ( hit1 && hit2 )
+      {
+         const bool firstNearer = t1 <= t2;
+         stack[count].node = firstNearer ? node.child2 : node.child1;
+         stack[count].enterT = firstNearer ? t2 : t1;
+         count++;
+         stack[count].node = firstNearer ? node.child1 : node.child2;
+         stack[count].enterT = firstNearer ? t1 : t2;
+         count++;
+      }
+      else if ( hit1 )
+      {
+         stack[count].node = node.child1;
+         stack[count].enterT = t1;
+         count++;
+      }
+      else if ( hit2 )
+      {
+         stack[count].node = node.child2;
+         stack[count].enterT = t2;
+         count++;
+      }
+   }
+
+   return found;
+}
+
+bool TSBroadphase::buildPolyList( AbstractPolyList *polyList, const Box3F &box ) const
+{
+   Vector<S32> proxies;
+   queryBox( box, proxies );
+   if ( proxies.empty() )
+      return false;
+
+   PROFILE_SCOPE( TSBroadphase_BuildPolyList );
+
+   MatrixF initialMat;
+   Point3F initialScale;
+   polyList->getTransform( &initialMat, &initialScale );
+
+   bool emitted = false;
+   U32 surfaceKey = 0;
+   MatrixF mat;
+   for ( U32 i = 0; i < proxies.size(); i++ )
+   {
+      const Proxy &data = mProxies[proxies[i]];
+
+      mat.mul( initialMat, data.transform );
+
+      if ( data.meshIndex < 0 )
+      {
+         polyList->setTransform( &mat, initialScale );
+         emitted |= data.instance->buildPolyList( polyList, data.detail );
+      }
+      else
+      {
+         const S32 od = _getObjectDetail( data );
+         if ( od < 0 )
+            continue;
+
+         TSShapeInstance::MeshObjectInstance &meshObj = data.instance->mMeshObjects[data.meshIndex];
+         if ( od >= meshObj.object->numMeshes )
+            continue;
+
+         mat.mul( meshObj.getTransform() );
+         polyList->setTransform( &mat, initialScale );
+         emitted |= meshObj.buildPolyList( od, polyList, surfaceKey, data.instance->getMaterialList() );
+      }
+   }
+
+   polyList->setTransform( &initialMat, initialScale );
+   return emitted;
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
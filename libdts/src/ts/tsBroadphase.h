@@ -0,0 +1,226 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _TSBROADPHASE_H_
+#define _TSBROADPHASE_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+#ifndef _TVECTOR_H_
+#include "core/util/tVector.h"
+#endif
+#ifndef _MBOX_H_
+#include "math/mBox.h"
+#endif
+#ifndef _MMATRIX_H_
+#include "math/mMatrix.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+class TSShapeInstance;
+class Frustum;
+class AbstractPolyList;
+struct RayInfo;
+
+/// Dynamic bounding volume tree over placed shape instances, used to cull
+/// and collide with many of them without testing each one.
+///
+/// Each proxy is a TSShapeInstance placed in the world with a transform,
+/// either as a whole or as one of its mesh objects.  Its bounds come from
+/// TSShapeInstance::computeBounds() (or the mesh bounds) at the proxy's
+/// detail level, and are stored fattened by a margin so that small moves
+/// don't need the tree to be rebuilt: updateProxy() only reinserts a proxy
+/// once its bounds leave the fattened ones.  Insertion picks the sibling
+/// which adds the least surface area and the tree is kept balanced with
+/// rotations, so queries take logarithmic time.
+///
+/// Queries only read the tree and can run on several threads at once, but
+/// creating, updating and destroying proxies must not overlap with them.
+class TSBroadphase
+{
+public:
+   enum Constants
+   {
+      NullNode = -1,
+      MaxFrustums = 32,       ///< Frustums tested at once by queryFrustums()
+      MaxStackDepth = 256,    ///< Size of the traversal stack
+   };
+
+protected:
+   struct Node
+   {
+      Box3F bounds;           ///< Fattened for leaves, the union of the children otherwise
+      S32 parent;             ///< The next free node when on the free list
+      S32 child1;
+      S32 child2;             ///< NullNode for leaves
+      S32 height;             ///< 0 for leaves, -1 for free nodes
+   };
+
+   /// Leaf data, kept apart from Node so that traversals touch less memory
+   struct Proxy
+   {
+      TSShapeInstance *instance;
+      S32 meshIndex;          ///< Index in TSShapeInstance::mMeshObjects, or -1 for the whole instance
+      S32 detail;             ///< Detail level used for bounds and collision
+      MatrixF transform;      ///< Shape to world
+      MatrixF invTransform;   ///< World to shape
+      Box3F localBounds;      ///< Bounds in shape space, from the last computeBounds()
+      void *userData;
+   };
+
+   Vector<Node> mNodes;
+   Vector<Proxy> mProxies;    ///< Same index as mNodes, only valid for leaves
+   S32 mRoot;
+   S32 mFreeList;
+   U32 mNumProxies;
+
+   /// Amount added to each side of a proxy's bounds
+   F32 mMargin;
+
+   S32 _allocateNode();
+   void _freeNode( S32 node );
+
+   void _insertLeaf( S32 leaf );
+   void _removeLeaf( S32 leaf );
+
+   /// Rotates the tree at node if it is out of balance, returning
+   /// the node which takes its place.
+   S32 _balance( S32 node );
+
+   /// Recomputes the shape space bounds of a proxy.
+   void _computeLocalBounds( S32 proxy );
+
+   /// Returns the tight world bounds of a proxy.
+   void _getWorldBounds( S32 proxy, Box3F &bounds ) const;
+
+   /// Moves a proxy to new tight bounds, reinserting it if they are no
+   /// longer inside its fattened bounds.
+   bool _moveProxy( S32 proxy, const Box3F &bounds );
+
+   /// Collides a ray with the shape of a single proxy.
+   bool _castRayProxy( S32 proxy, const Point3F &start, const Point3F &end, RayInfo *info ) const;
+
+   /// Returns the object detail of the proxy's detail level,
+   /// or -1 if it has no geometry (e.g. a billboard).
+   S32 _getObjectDetail( const Proxy &proxy ) const;
+
+public:
+   TSBroadphase( F32 margin = 0.1f );
+
+   /// Removes all the proxies.
+   void clear();
+
+   /// @name Proxies
+   /// @{
+
+   /// Adds a shape instance to the tree.  The instance should already be
+   /// animated, as its current node transforms are used for the bounds.
+   ///
+   /// @param transform  The shape to world transform of the instance
+   /// @param detail     The detail level to take the bounds from and to collide with
+   /// @param meshIndex  A mesh object of the instance to add on its own, or
+   ///                   -1 for the whole instance
+   /// @param userData   Returned by getUserData()
+   /// @return the proxy id
+   S32 createProxy( TSShapeInstance *instance, const MatrixF &transform, S32 detail = 0, S32 meshIndex = -1, void *userData = NULL );
+
+   /// Removes a proxy from the tree.
+   void destroyProxy( S32 proxy );
+
+   /// Moves a proxy to a new transform, keeping the bounds it had.
+   /// @return true if the proxy had to be reinserted
+   bool updateProxy( S32 proxy, const MatrixF &transform );
+
+   /// Recomputes the bounds of a proxy after its instance has been
+   /// animated or its detail level has been changed.
+   /// @return true if the proxy had to be reinserted
+   bool updateProxy( S32 proxy );
+
+   /// Changes the detail level a proxy takes its bounds from and collides with.
+   void setProxyDetail( S32 proxy, S32 detail ) { mProxies[proxy].detail = detail; updateProxy( proxy ); }
+
+   TSShapeInstance* getInstance( S32 proxy ) const { return mProxies[proxy].instance; }
+   S32 getMeshIndex( S32 proxy ) const { return mProxies[proxy].meshIndex; }
+   S32 getProxyDetail( S32 proxy ) const { return mProxies[proxy].detail; }
+   const MatrixF& getTransform( S32 proxy ) const { return mProxies[proxy].transform; }
+   void* getUserData( S32 proxy ) const { return mProxies[proxy].userData; }
+
+   /// Returns the fattened bounds of a proxy.
+   const Box3F& getFatBounds( S32 proxy ) const { return mNodes[proxy].bounds; }
+
+   U32 getNumProxies() const { return mNumProxies; }
+
+   /// Returns the height of the tree, 0 when empty.
+   S32 getHeight() const { return mRoot == NullNode ? 0 : mNodes[mRoot].height + 1; }
+   /// @}
+
+   /// @name Queries
+   /// These test the fattened bounds of the proxies, so they
+   /// can return some which don't quite touch.
+   /// @{
+
+   /// Adds every proxy which overlaps box to results.
+   void queryBox( const Box3F &box, Vector<S32> &results ) const;
+
+   /// Adds every proxy the segment from start to end passes through to results.
+   void queryRay( const Point3F &start, const Point3F &end, Vector<S32> &results ) const;
+
+   /// Culls the proxies against several frustums in one pass over the
+   /// tree, adding those which may be visible in frustums[i] to results[i].
+   /// Subtrees entirely within a frustum are added without testing them
+   /// any further.  Up to MaxFrustums can be tested at once.
+   void queryFrustums( const Frustum *frustums, U32 numFrustums, Vector<S32> *results ) const;
+
+   /// Adds the proxies which may be visible in frustum to results.
+   void queryFrustum( const Frustum &frustum, Vector<S32> &results ) const { queryFrustums( &frustum, 1, &results ); }
+   /// @}
+
+   /// @name Collision
+   /// @{
+
+   /// Casts a ray against the shapes in the tree, visiting the closest
+   /// first and skipping any which are further than the closest hit.
+   ///
+   /// @param info      Filled in with the closest hit in world space, or
+   ///                  NULL to return as soon as anything is hit
+   /// @param hitProxy  Set to the proxy which was hit, if not NULL
+   bool castRay( const Point3F &start, const Point3F &end, RayInfo *info, S32 *hitProxy = NULL ) const;
+
+   /// Adds the polys of every shape overlapping box to polyList, placed
+   /// by each proxy's transform on top of the list's own transform.
+   /// @return true if any polys were added
+   bool buildPolyList( AbstractPolyList *polyList, const Box3F &box ) const;
+   /// @}
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _TSBROADPHASE_H_
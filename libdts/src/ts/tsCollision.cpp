@@ -331,6 +331,101 @@ bool TSShapeInstance::castRayRendered(const Point3F & a, const Point3F & b, RayI
    return found;
 }
 
+U32 TSShapeInstance::castRays(const Point3F *starts, const Point3F *ends, U32 numRays, RayInfo *rayInfos, bool *hits, S32 dl)
+{
+   PROFILE_SCOPE( TSShapeInstance_castRays );
+
+   for (U32 r=0; r<numRays; r++)
+      hits[r] = false;
+
+   // if dl==-1, nothing to do
+   if (dl==-1 || numRays==0)
+      return 0;
+
+   AssertFatal(dl>=0 && dl<mShape->details.size(),"TSShapeInstance::castRays");
+
+   // get subshape and object detail
+   const TSDetail * detail = &mShape->details[dl];
+   S32 ss = detail->subShapeNum;
+   S32 od = detail->objectDetailNum;
+
+   // This detail has no geometry to hit.
+   if ( ss < 0 )
+      return 0;
+
+   S32 start = mShape->subShapeFirstObject[ss];
+   S32 end   = mShape->subShapeNumObjects[ss] + start;
+
+   // rays in the space of the current node, and the node each ray hit in
+   Vector<Point3F> localStarts;
+   Vector<Point3F> localEnds;
+   Vector<const MatrixF*> saveMats;
+   localStarts.setSize(numRays);
+   localEnds.setSize(numRays);
+   saveMats.setSize(numRays);
+
+   RayInfo rayInfo;
+   const MatrixF * previousMat = NULL;
+   MatrixF mat;
+
+   // run through objects and collide
+   for (S32 i=start; i<end; i++)
+   {
+      MeshObjectInstance * mesh = &mMeshObjects[i];
+
+      if (od >= mesh->object->numMeshes)
+         continue;
+
+      if (&mesh->getTransform() != previousMat)
+      {
+         // different node from before, move all the rays into this node's space
+         previousMat = &mesh->getTransform();
+         mat = *previousMat;
+         mat.inverse();
+         for (U32 r=0; r<numRays; r++)
+         {
+            mat.mulP(starts[r],&localStarts[r]);
+            mat.mulP(ends[r],&localEnds[r]);
+         }
+      }
+
+      for (U32 r=0; r<numRays; r++)
+      {
+         // only need one hit per ray if not reporting where
+         if (!rayInfos && hits[r])
+            continue;
+
+         if (mesh->castRay(od,localStarts[r],localEnds[r],rayInfos ? &rayInfo : NULL, mMaterialList))
+         {
+            if (rayInfos && (!hits[r] || rayInfo.t <= rayInfos[r].t))
+            {
+               rayInfos[r] = rayInfo;
+               saveMats[r] = previousMat;
+            }
+            hits[r] = true;
+         }
+      }
+   }
+
+   // finalize the deal...
+   U32 numHits = 0;
+   for (U32 r=0; r<numRays; r++)
+   {
+      if (!hits[r])
+         continue;
+
+      numHits++;
+      if (rayInfos)
+      {
+         saveMats[r]->mulV(rayInfos[r].normal);
+         rayInfos[r].point  = ends[r]-starts[r];
+         rayInfos[r].point *= rayInfos[r].t;
+         rayInfos[r].point += starts[r];
+      }
+   }
+   return numHits;
+}
+
 Point3F TSShapeInstance::support(const Point3F & v, S32 dl)
 {
    // if dl==-1, nothing to do
@@ -484,7 +579,16 @@ bool TSShapeInstance::MeshObjectInstance::buildPolyList( S32 objectDetail, Abstr
 {
    TSMesh * mesh = getMesh(objectDetail);
    if (mesh && !forceHidden && visible>0.01f)
+   {
+      if ( mesh->getMeshType() == TSMesh::SkinMeshType && TSShape::smUseSkinnedCollision )
+      {
+         TSSkinMesh *skinMesh = static_cast<TSSkinMesh*>( mesh );
+         if ( !updateCollisionSkin( skinMesh ) )
+            return false;
+         return skinMesh->buildPolyListSkinned( mSkinnedVerts, polyList, surfaceKey, materials );
+      }
       return mesh->buildPolyList(frame,polyList,surfaceKey,materials);
+   }
    return false;
 }
 
@@ -508,7 +612,11 @@ bool TSShapeInstance::MeshObjectInstance::castRay( S32 objectDetail, const Point
 {
    TSMesh* mesh = getMesh( objectDetail );
    if( mesh && !forceHidden && visible > 0.01f )
+   {
+      if ( mesh->getMeshType() == TSMesh::SkinMeshType && TSShape::smUseSkinnedCollision )
+         return castRaySkinned( static_cast<TSSkinMesh*>( mesh ), start, end, rayInfo, materials );
       return mesh->castRay( frame, start, end, rayInfo, materials );
+   }
    return false;
 }
 
@@ -516,10 +624,30 @@ bool TSShapeInstance::MeshObjectInstance::castRayRendered( S32 objectDetail, con
 {
    TSMesh* mesh = getMesh( objectDetail );
    if( mesh && !forceHidden && visible > 0.01f )
+   {
+      if ( mesh->getMeshType() == TSMesh::SkinMeshType && TSShape::smUseSkinnedCollision )
+         return castRaySkinned( static_cast<TSSkinMesh*>( mesh ), start, end, rayInfo, materials );
       return mesh->castRayRendered( frame, start, end, rayInfo, materials );
+   }
    return false;
 }
 
+bool TSShapeInstance::MeshObjectInstance::castRaySkinned( TSSkinMesh *mesh, const Point3F &start, const Point3F &end, RayInfo *rayInfo, TSMaterialList *materials )
+{
+   if ( !updateCollisionSkin( mesh ) )
+      return false;
+
+   // Refit lazily, so only objects which rays actually reach pay for it
+   if ( mSkinnedRayMesh != mesh )
+   {
+      if ( !mesh->refitRayBVH( mSkinnedVerts, mSkinnedRayNodes ) )
+         return false;
+      mSkinnedRayMesh = mesh;
+   }
+
+   return mesh->castRaySkinned( mSkinnedVerts, mSkinnedRayNodes, start, end, rayInfo, materials );
+}
+
 void TSShape::findColDetails( bool useVisibleMesh, Vector<S32> *outDetails, Vector<S32> *outLOSDetails ) const
 {
    PROFILE_SCOPE( TSShape_findColDetails );
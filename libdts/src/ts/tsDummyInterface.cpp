@@ -130,7 +130,7 @@ bool TSDummyMaterialInstance::isValid()
 
 int TSDummyMaterialInstance::getStateHint()
 {
-   return (int)this;
+   return (int)(size_t)this;
 }
 
 const char* TSDummyMaterialInstance::getName()
@@ -209,30 +209,46 @@ public:
    virtual ~DummyTSMeshRenderer() {;}
    
    /// Prepares vertex buffers and whatnot
-   virtual void prepare(TSMesh *mesh)
+   virtual void prepare(TSMesh *mesh, TSMeshInstanceRenderData *meshRenderData)
    {
-      Platform::outputDebugString("[TSM:%x]Preparing", this);
    }
    
-   /// Renders whatever needs to be drawn
-   virtual void doRender(TSMesh *mesh, TSRenderInst *inst)
+   /// No buffers, so skinning writes directly to mesh->mVertexData
+   virtual U8* mapVerts(TSMesh *mesh, TSMeshInstanceRenderData *meshRenderData)
+   {
+      return NULL;
+   }
+   
+   virtual void unmapVerts(TSMesh *mesh, TSMeshInstanceRenderData *meshRenderData)
+   {
+   }
+   
+   virtual void onAddRenderInst(TSMesh *mesh, TSRenderInst *inst, TSRenderState *renderState)
    {
-      Platform::outputDebugString("[TSM:%x]Rendering with material %s", this, inst->matInst ? inst->matInst->getName() : "NIL");
    }
    
    /// Renders whatever needs to be drawn
-   virtual bool isDirty(TSMesh *mesh)
+   virtual void doRenderInst(TSMesh *mesh, TSRenderInst *inst, TSRenderState *renderState)
    {
-      return true;
+   }
+   
+   /// Returns true if buffers need updating
+   virtual bool isDirty(TSMesh *mesh, TSMeshInstanceRenderData *renderData)
+   {
+      return false;
    }
    
    /// Cleans up Mesh renderer
    virtual void clear()
    {
-      Platform::outputDebugString("[TSM:%x]Clearing", this);
    }
 };
 
+TSMeshInstanceRenderData *TSMeshInstanceRenderData::create()
+{
+   return new TSMeshInstanceRenderData();
+}
+
 
 static TSDummyMaterialManager sMaterialManager;
 
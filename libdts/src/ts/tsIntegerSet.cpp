@@ -24,18 +24,108 @@
 #include "platform/platform.h"
 #include "core/stream/stream.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TS_INTEGERSET_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 //-----------------------------------------------------------------------------
 
 BEGIN_NS(DTShape)
 
 //-----------------------------------------------------------------------------
 
-#define SETUPTO(upto) ( ((1<<(upto&31))-1)*2+1 ) // careful not to shift more than 31 times
+#define SETUPTO(upto) ( (1U<<(upto&31))-1 ) // bits below upto in its word
+
+/// Index of the lowest set bit, dword must not be 0
+static inline S32 lowestBit(U32 dword)
+{
+#if defined(__GNUC__)
+   return __builtin_ctz(dword);
+#elif defined(_MSC_VER)
+   unsigned long idx;
+   _BitScanForward(&idx, dword);
+   return idx;
+#else
+   S32 i = 0;
+   while (!(dword & 1))
+   {
+      dword >>= 1;
+      i++;
+   }
+   return i;
+#endif
+}
+
+/// Index of the highest set bit, dword must not be 0
+static inline S32 highestBit(U32 dword)
+{
+#if defined(__GNUC__)
+   return 31 - __builtin_clz(dword);
+#elif defined(_MSC_VER)
+   unsigned long idx;
+   _BitScanReverse(&idx, dword);
+   return idx;
+#else
+   return getBinLog2(dword);
+#endif
+}
+
+static inline S32 countBits(U32 dword)
+{
+#if defined(__GNUC__)
+   return __builtin_popcount(dword);
+#else
+   dword = dword - ((dword >> 1) & 0x55555555);
+   dword = (dword & 0x33333333) + ((dword >> 2) & 0x33333333);
+   return (((dword + (dword >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+void TSIntegerSet::grow(U32 numWords)
+{
+   if (numWords <= mNumWords)
+      return;
+
+   if (numWords > mCapacity)
+   {
+      U32 newCapacity = getMax(numWords, mCapacity * 2);
+      U32 *newWords = (U32*)dMalloc(newCapacity * sizeof(U32));
+      dMemcpy(newWords, words(), mNumWords * sizeof(U32));
+      if (mCapacity > InlineWords)
+         dFree(mHeap);
+      mHeap = newWords;
+      mCapacity = newCapacity;
+   }
+
+   dMemset(words() + mNumWords, 0, (numWords - mNumWords) * sizeof(U32));
+   mNumWords = numWords;
+}
+
+U32 TSIntegerSet::wordsUpTo(S32 upto) const
+{
+   AssertFatal(upto>=0,"TSIntegerSet: negative range");
+   return getMin(((U32)upto + 31) >> 5, mNumWords);
+}
 
 void TSIntegerSet::clearAll(S32 upto)
 {
-   AssertFatal(upto<=MAX_TS_SET_SIZE,"TSIntegerSet::clearAll: out of range");
+   AssertFatal(upto>=0,"TSIntegerSet::clearAll: negative range");
+
+   if ((U32)upto >= mNumWords * 32)
+   {
+      // clearing everything, drop the words in use
+      mNumWords = 0;
+      return;
+   }
 
+   U32 *bits = words();
    dMemset(bits,0,(upto>>5)*4);
    if (upto&31)
       bits[upto>>5] &= ~SETUPTO(upto);
@@ -43,96 +133,129 @@ void TSIntegerSet::clearAll(S32 upto)
 
 void TSIntegerSet::setAll(S32 upto)
 {
-   AssertFatal(upto<=MAX_TS_SET_SIZE,"TSIntegerSet::setAll: out of range");
+   AssertFatal(upto>=0,"TSIntegerSet::setAll: negative range");
 
-   dMemset(bits,0xFFFFFFFF,(upto>>5)*4);
+   grow(((U32)upto + 31) >> 5);
+
+   U32 *bits = words();
+   dMemset(bits,0xFF,(upto>>5)*4);
    if (upto&31)
       bits[upto>>5] |= SETUPTO(upto);
 }
 
 bool TSIntegerSet::testAll(S32 upto) const
 {
-   AssertFatal(upto<=MAX_TS_SET_SIZE,"TSIntegerSet::testAll: out of range");
-   S32 i;
-   for (i=0; i<(upto>>5); i++)
-      if (bits[i])
-         return true;
-   if (upto&31)
-      return (bits[upto>>5] & SETUPTO(upto)) != 0;
-   return false;
+   const U32 *bits = words();
+   U32 numWords = wordsUpTo(upto);
+   if (numWords == 0)
+      return false;
+
+   // upto may end part way through the last word
+   U32 any = bits[numWords-1];
+   if ((U32)upto < numWords * 32)
+      any &= SETUPTO(upto);
+
+   U32 i = 0;
+#ifdef TS_INTEGERSET_SSE2
+   __m128i acc = _mm_setzero_si128();
+   for (; i+4 <= numWords-1; i+=4)
+      acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*)(bits+i)));
+   any |= _mm_movemask_epi8(_mm_cmpeq_epi32(acc, _mm_setzero_si128())) != 0xFFFF;
+#endif
+   for (; i<numWords-1; i++)
+      any |= bits[i];
+   return any != 0;
 }
 
 S32 TSIntegerSet::count(S32 upto) const
 {
-   AssertFatal(upto<=MAX_TS_SET_SIZE,"TSIntegerSet::count: out of range");
+   const U32 *bits = words();
+   U32 numWords = wordsUpTo(upto);
 
    S32 count = 0;
-   U32 dword = bits[0];
-   for (S32 i = 0; i < upto; i++)
+   for (U32 i = 0; i < numWords; i++)
    {
-      // get next word
-      if (!(i & 0x1F))
-         dword = bits[i>>5];
-      // test bits in word
-      if (dword & (1 << (i & 0x1F)))
-         count++;
+      U32 dword = bits[i];
+      if (i == ((U32)upto >> 5))
+         dword &= SETUPTO(upto);
+      count += countBits(dword);
    }
    return count;
 }
 
+// The binary operations below are plain loops over the words in use, 4
+// words at a time with SSE2 where available.
+
 void TSIntegerSet::intersect(const TSIntegerSet & otherSet)
 {
-   for (S32 i=0; i<MAX_TS_SET_DWORDS; i++)
-      bits[i] &= otherSet.bits[i];
+   // bits past the other set are clear there, so clear here too
+   if (otherSet.mNumWords < mNumWords)
+      mNumWords = otherSet.mNumWords;
+
+   U32 *bits = words();
+   const U32 *other = otherSet.words();
+   U32 i = 0;
+#ifdef TS_INTEGERSET_SSE2
+   for (; i+4 <= mNumWords; i+=4)
+      _mm_storeu_si128((__m128i*)(bits+i), _mm_and_si128(_mm_loadu_si128((const __m128i*)(bits+i)), _mm_loadu_si128((const __m128i*)(other+i))));
+#endif
+   for (; i<mNumWords; i++)
+      bits[i] &= other[i];
 }
 
 void TSIntegerSet::overlap(const TSIntegerSet & otherSet)
 {
-   for (S32 i=0; i<MAX_TS_SET_DWORDS; i++)
-      bits[i] |= otherSet.bits[i];
+   grow(otherSet.mNumWords);
+
+   U32 *bits = words();
+   const U32 *other = otherSet.words();
+   const U32 numWords = otherSet.mNumWords;
+   U32 i = 0;
+#ifdef TS_INTEGERSET_SSE2
+   for (; i+4 <= numWords; i+=4)
+      _mm_storeu_si128((__m128i*)(bits+i), _mm_or_si128(_mm_loadu_si128((const __m128i*)(bits+i)), _mm_loadu_si128((const __m128i*)(other+i))));
+#endif
+   for (; i<numWords; i++)
+      bits[i] |= other[i];
 }
 
 void TSIntegerSet::difference(const TSIntegerSet & otherSet)
 {
-   for (S32 i=0; i<MAX_TS_SET_DWORDS; i++)
-      bits[i] = (bits[i] | otherSet.bits[i]) & ~(bits[i] & otherSet.bits[i]);
+   grow(otherSet.mNumWords);
+
+   U32 *bits = words();
+   const U32 *other = otherSet.words();
+   const U32 numWords = otherSet.mNumWords;
+   U32 i = 0;
+#ifdef TS_INTEGERSET_SSE2
+   for (; i+4 <= numWords; i+=4)
+      _mm_storeu_si128((__m128i*)(bits+i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(bits+i)), _mm_loadu_si128((const __m128i*)(other+i))));
+#endif
+   for (; i<numWords; i++)
+      bits[i] ^= other[i];
 }
 
 void TSIntegerSet::takeAway(const TSIntegerSet & otherSet)
 {
-   for (S32 i=0; i<MAX_TS_SET_DWORDS; i++)
-      bits[i] &= ~otherSet.bits[i];
+   U32 *bits = words();
+   const U32 *other = otherSet.words();
+   const U32 numWords = getMin(mNumWords, otherSet.mNumWords);
+   U32 i = 0;
+#ifdef TS_INTEGERSET_SSE2
+   for (; i+4 <= numWords; i+=4)
+      _mm_storeu_si128((__m128i*)(bits+i), _mm_andnot_si128(_mm_loadu_si128((const __m128i*)(other+i)), _mm_loadu_si128((const __m128i*)(bits+i))));
+#endif
+   for (; i<numWords; i++)
+      bits[i] &= ~other[i];
 }
 
 S32 TSIntegerSet::start() const
 {
-   for (S32 i=0; i<MAX_TS_SET_DWORDS; i++)
+   const U32 *bits = words();
+   for (U32 i=0; i<mNumWords; i++)
    {
-      // search for set bit one dword at a time
-      U32 dword = bits[i];
-      if (dword!=0)
-      {
-         // got dword, now search one byte at a time
-         S32 j = 0;
-         U32 mask = 0xFF;
-         do
-         {
-            if (dword&mask)
-            {
-               // got byte, now search one bit at a time
-               U32 bit = mask & ~(mask<<1); // grabs the smallest bit
-               do
-               {
-                  if (dword&bit)
-                     return (i<<5)+j;
-                  j++;
-                  bit <<= 1;
-               } while (1);
-            }
-            mask <<= 8;
-            j += 8;
-         } while (1);
-      }
+      if (bits[i])
+         return (i<<5) + lowestBit(bits[i]);
    }
 
    return MAX_TS_SET_SIZE;
@@ -140,33 +263,11 @@ S32 TSIntegerSet::start() const
 
 S32 TSIntegerSet::end() const
 {
-   for (S32 i=MAX_TS_SET_DWORDS-1; i>=0; i--)
+   const U32 *bits = words();
+   for (S32 i=mNumWords-1; i>=0; i--)
    {
-      // search for set bit one dword at a time
-      U32 dword = bits[i];
       if (bits[i])
-      {
-         // got dword, now search one byte at a time
-         S32 j = 31;
-         U32 mask = 0xFF000000;
-         do
-         {
-            if (dword&mask)
-            {
-               // got byte, now one bit at a time
-               U32 bit = mask & ~(mask>>1); // grabs the highest bit
-               do
-               {
-                  if (dword&bit)
-                     return (i<<5)+j+1;
-                  j--;
-                  bit >>= 1;
-               } while (1);
-            }
-            mask >>= 8;
-            j -= 8;
-         } while (1);
-      }
+         return (i<<5) + highestBit(bits[i]) + 1;
    }
 
    return 0;
@@ -176,74 +277,59 @@ void TSIntegerSet::next(S32 & i) const
 {
    i++;
    U32 idx = i>>5;
-   U32 bit = 1 << (i&31);
-   U32 dword = bits[idx] & ~(bit-1);
-   while (dword==0)
+   if (idx >= mNumWords)
    {
-      i = (i+32) & ~31;
-      if (i>=MAX_TS_SET_SIZE)
-         return;
-      dword=bits[++idx];
-      bit = 1;
-   }
-   dword = bits[idx];
-   while ( (bit & dword) == 0)
-   {
-      bit <<= 1;
-      i++;
+      i = MAX_TS_SET_SIZE;
+      return;
    }
-}
 
-/* Or would one byte at a time be better...
-void TSIntegerSet::next(S32 & i)
-{
-   U32 idx = i>>3;
-   U8 bit = 1 << (i&7);
-   U8 byte = ((U8*)bits)[idx] & ~(bit*2-1);
-   while (byte==0)
+   // mask off the bits before i in the first word
+   const U32 *bits = words();
+   U32 dword = bits[idx] & ~SETUPTO(i);
+   while (dword==0)
    {
-      i = (i+8) & ~7;
-      if (i>=MAX_TS_SET_SIZE)
+      if (++idx >= mNumWords)
+      {
+         i = MAX_TS_SET_SIZE;
          return;
-      byte=((U8*)bits)[++idx];
-      bit = 1;
-   }
-   byte = ((U8*)bits)[idx];
-   while (bit & byte == 0)
-   {
-      bit <<= 1;
-      i++;
+      }
+      dword = bits[idx];
    }
+   i = (idx<<5) + lowestBit(dword);
 }
-*/
 
 void TSIntegerSet::copy(const TSIntegerSet & otherSet)
 {
-   dMemcpy(bits,otherSet.bits,MAX_TS_SET_DWORDS*4);
+   if (&otherSet == this)
+      return;
+
+   mNumWords = 0;
+   grow(otherSet.mNumWords);
+   dMemcpy(words(),otherSet.words(),mNumWords*4);
 }
 
 void TSIntegerSet::insert(S32 index, bool value)
 {
-   AssertFatal(index<MAX_TS_SET_SIZE,"TSIntegerSet::insert: out of range");
-
-   // shift bits in words after the insertion point
-   U32 endWord = (end() >> 5) + 1;
-   if (endWord >= MAX_TS_SET_DWORDS)
-      endWord = MAX_TS_SET_DWORDS-1;
+   AssertFatal(index>=0,"TSIntegerSet::insert: out of range");
 
-   for (S32 i = endWord; i > (index >> 5); i--)
+   // shift bits in words after the insertion point, making room for the
+   // last set bit to move up
+   S32 top = end();
+   if (index < top)
    {
-      bits[i] = bits[i] << 1;
-      if (bits[i-1] & 0x80000000)
-         bits[i] |= 0x1;
-   }
+      grow(((U32)top >> 5) + 1);
 
-   // shift to create space in target word
-   U32 lowMask = (1 << (index & 0x1f)) - 1;              // bits below the insert point
-   U32 highMask = ~(lowMask | (1 << (index & 0x1f)));    // bits above the insert point
+      U32 *bits = words();
+      for (S32 i = mNumWords - 1; i > (index >> 5); i--)
+         bits[i] = (bits[i] << 1) | (bits[i-1] >> 31);
 
-   S32 word = index >> 5;
-   bits[word] = ((bits[word] << 1) & highMask) | (bits[word] & lowMask);
+      // shift to create space in target word
+      U32 lowMask = (1 << (index & 0x1f)) - 1;              // bits below the insert point
+      U32 highMask = ~(lowMask | (1 << (index & 0x1f)));    // bits above the insert point
+
+      S32 word = index >> 5;
+      bits[word] = ((bits[word] << 1) & highMask) | (bits[word] & lowMask);
+   }
 
    // insert new value
    if (value)
@@ -252,20 +338,20 @@ void TSIntegerSet::insert(S32 index, bool value)
 
 void TSIntegerSet::erase(S32 index)
 {
-   AssertFatal(index<MAX_TS_SET_SIZE,"TSIntegerSet::erase: out of range");
+   AssertFatal(index>=0,"TSIntegerSet::erase: out of range");
+
+   if ((U32)(index >> 5) >= mNumWords)
+      return;
 
    // shift to erase bit in target word
+   U32 *bits = words();
    S32 word = index >> 5;
    U32 lowMask = (1 << (index & 0x1f)) - 1;              // bits below the erase point
 
    bits[word] = ((bits[word] >> 1) & ~lowMask) | (bits[word] & lowMask);
 
    // shift bits in words after the erase point
-   U32 endWord = (end() >> 5) + 1;
-   if (endWord >= MAX_TS_SET_DWORDS)
-      endWord = MAX_TS_SET_DWORDS-1;
-
-   for (S32 i = (index >> 5) + 1; i <= endWord; i++)
+   for (U32 i = word + 1; i < mNumWords; i++)
    {
       if (bits[i] & 0x1)
          bits[i-1] |= 0x80000000;
@@ -274,15 +360,22 @@ void TSIntegerSet::erase(S32 index)
 }
 
 TSIntegerSet::TSIntegerSet()
+   : mNumWords(0), mCapacity(InlineWords)
 {
-   clearAll();
 }
 
 TSIntegerSet::TSIntegerSet(const TSIntegerSet & otherSet)
+   : mNumWords(0), mCapacity(InlineWords)
 {
    copy(otherSet);
 }
 
+TSIntegerSet::~TSIntegerSet()
+{
+   if (mCapacity > InlineWords)
+      dFree(mHeap);
+}
+
 void TSIntegerSet::read(Stream * s)
 {
    clearAll();
@@ -292,8 +385,9 @@ void TSIntegerSet::read(Stream * s)
 
    S32 sz;
    s->read(&sz);
-   AssertFatal(sz<=MAX_TS_SET_DWORDS,"TSIntegerSet::  set too large...increase max set size and re-compile");
 
+   grow(sz);
+   U32 *bits = words();
    for (S32 i=0; i<sz; i++) // now mirrors the write code...
       s->read(&(bits[i]));
 }
@@ -301,8 +395,9 @@ void TSIntegerSet::read(Stream * s)
 void TSIntegerSet::write(Stream * s) const
 {
    s->write((S32)0); // don't do this anymore, keep in to avoid versioning
+   const U32 *bits = words();
    S32 i,sz=0;
-   for (i=0; i<MAX_TS_SET_DWORDS; i++)
+   for (i=0; i<mNumWords; i++)
       if (bits[i]!=0)
          sz=i+1;
    s->write(sz);
@@ -36,22 +36,54 @@ BEGIN_NS(DTShape)
 
 //-----------------------------------------------------------------------------
 
-#if defined(LIBDTSHAPE_MAX_LIB)
-#define MAX_TS_SET_DWORDS 32
-#else
-#define MAX_TS_SET_DWORDS 64
-#endif
-
-#define MAX_TS_SET_SIZE   (32*MAX_TS_SET_DWORDS)
+/// Returned by TSIntegerSet::start() and TSIntegerSet::next() once there are
+/// no more set bits.  Sets are no longer limited to this many bits.
+#define MAX_TS_SET_SIZE   S32_MAX
 
 class Stream;
 
 /// The standard mathmatical set, where there are no duplicates.  However,
 /// this set uses bits instead of numbers.
+///
+/// The set grows as bits are set, so bits past the last word in use are
+/// always clear and operations only touch the words in use.  Small sets
+/// (up to InlineBits) are stored in the set itself, so a set sized to the
+/// nodes of a typical shape doesn't allocate.
+///
+/// @note The set doesn't point into itself, so it can be moved with a
+/// plain memcpy as Vector does when it grows.
 class TSIntegerSet
 {
-   /// The bits!
-   U32 bits[MAX_TS_SET_DWORDS];
+public:
+   enum
+   {
+      InlineWords = 8,
+      InlineBits = InlineWords * 32
+   };
+
+private:
+
+   /// The bits!  mInline while mCapacity <= InlineWords, otherwise mHeap.
+   union
+   {
+      U32 mInline[InlineWords];
+      U32 *mHeap;
+   };
+
+   /// Number of words in use
+   U32 mNumWords;
+
+   /// Number of words allocated
+   U32 mCapacity;
+
+   U32 *words() { return mCapacity > InlineWords ? mHeap : mInline; }
+   const U32 *words() const { return mCapacity > InlineWords ? mHeap : mInline; }
+
+   /// Grows the set to at least numWords words, clearing the new words
+   void grow(U32 numWords);
+
+   /// Number of words needed to hold upto bits, clamped to the words in use
+   U32 wordsUpTo(S32 upto) const;
 
 public:
 
@@ -62,14 +94,14 @@ public:
    /// Is this bit true?
    bool test(S32 index) const;
 
-   /// Sets all bits to false
+   /// Sets all bits below upto to false
    void clearAll(S32 upto = MAX_TS_SET_SIZE);
-   /// Sets all bits to true
-   void setAll(S32 upto = MAX_TS_SET_SIZE);
-   /// Tests all bits for true
+   /// Sets all bits below upto to true
+   void setAll(S32 upto);
+   /// Tests whether any bit below upto is true
    bool testAll(S32 upto = MAX_TS_SET_SIZE) const;
 
-   /// Counts set bits
+   /// Counts set bits below upto
    S32 count(S32 upto = MAX_TS_SET_SIZE) const;
 
    /// intersection (a & b)
@@ -89,8 +121,11 @@ public:
 
    void operator=(const TSIntegerSet& otherSet) { copy(otherSet); }
 
+   /// First set bit, or MAX_TS_SET_SIZE if none
    S32 start() const;
+   /// One past the last set bit, or 0 if none
    S32 end() const;
+   /// Advances i to the next set bit, or to MAX_TS_SET_SIZE if none
    void next(S32 & i) const;
 
    void read(Stream *);
@@ -98,27 +133,33 @@ public:
 
    TSIntegerSet();
    TSIntegerSet(const TSIntegerSet&);
+   ~TSIntegerSet();
 };
 
 inline void TSIntegerSet::clear(S32 index)
 {
-   AssertFatal(index>=0 && index<MAX_TS_SET_SIZE,"TS::IntegerSet::clear");
+   AssertFatal(index>=0,"TS::IntegerSet::clear");
 
-   bits[index>>5] &= ~(1 << (index & 31));
+   if ((U32)(index>>5) < mNumWords)
+      words()[index>>5] &= ~(1 << (index & 31));
 }
 
 inline void TSIntegerSet::set(S32 index)
 {
-   AssertFatal(index>=0 && index<MAX_TS_SET_SIZE,"TS::IntegerSet::set");
+   AssertFatal(index>=0,"TS::IntegerSet::set");
 
-   bits[index>>5] |= 1 << (index & 31);
+   if ((U32)(index>>5) >= mNumWords)
+      grow((index>>5) + 1);
+   words()[index>>5] |= 1 << (index & 31);
 }
 
 inline bool TSIntegerSet::test(S32 index) const
 {
-   AssertFatal(index>=0 && index<MAX_TS_SET_SIZE,"TS::IntegerSet::test");
+   AssertFatal(index>=0,"TS::IntegerSet::test");
 
-   return ((bits[index>>5] & (1 << (index & 31)))!=0);
+   if ((U32)(index>>5) >= mNumWords)
+      return false;
+   return ((words()[index>>5] & (1 << (index & 31)))!=0);
 }
 
 //-----------------------------------------------------------------------------
@@ -27,6 +27,10 @@
 #include "math/mRandom.h"
 #include "core/stream/fileStream.h"
 #include "ts/tsMaterialManager.h"
+#include "ts/tsMaterialList.h"
+#include "core/util/path.h"
+#include "platform/threads/threadPool.h"
+#include "platform/profiler.h"
 
 //-----------------------------------------------------------------------------
 
@@ -34,17 +38,99 @@ BEGIN_NS(DTShape)
 
 //-----------------------------------------------------------------------------
 
-#if 0
-GFXImplementVertexFormat( ImposterState )
+Vector<TSLastDetail*> TSLastDetail::smLastDetails;
+
+/// Returns less than zero if fileA is older than fileB or is missing, zero
+/// if they were modified at the same time and more than zero if it is newer.
+static S32 compareModifiedTimes( const String &fileA, const String &fileB )
 {
-   addElement( "POSITION", GFXDeclType_Float4 );
+   FileTime timeA, timeB;
+   if ( !Platform::getFileTimes( fileA, NULL, &timeA ) )
+      return -1;
+   if ( !Platform::getFileTimes( fileB, NULL, &timeB ) )
+      return 1;
 
-   addElement( "ImposterParams", GFXDeclType_Float2, 0 );
+   return Platform::compareFileTimes( timeA, timeB );
+}
 
-   addElement( "ImposterUpVec", GFXDeclType_Float3, 1 );
-   addElement( "ImposterRightVec", GFXDeclType_Float3, 2 );
-};
-#endif
+/// Writes a mip chain of RGBA images as an uncompressed A8R8G8B8 DDS.
+static bool writeDDS( const String &path, const U8 *bits, U32 width, U32 height, U32 numMips )
+{
+   FileStream fs;
+   if ( !fs.open( path, FileStream::Write ) )
+      return false;
+
+   fs.write( 4, "DDS " );
+
+   // DDS_HEADER
+   fs.write( (U32)124 );
+   fs.write( (U32)( 0x1 | 0x2 | 0x4 | 0x8 | 0x1000 | 0x20000 ) ); // caps, height, width, pitch, pixel format, mip count
+   fs.write( height );
+   fs.write( width );
+   fs.write( width * 4 );
+   fs.write( (U32)0 );
+   fs.write( numMips );
+   for ( U32 i = 0; i < 11; i++ )
+      fs.write( (U32)0 );
+
+   // DDS_PIXELFORMAT
+   fs.write( (U32)32 );
+   fs.write( (U32)( 0x40 | 0x1 ) ); // RGB with alpha
+   fs.write( (U32)0 );
+   fs.write( (U32)32 );
+   fs.write( (U32)0x00FF0000 );
+   fs.write( (U32)0x0000FF00 );
+   fs.write( (U32)0x000000FF );
+   fs.write( (U32)0xFF000000 );
+
+   fs.write( (U32)( 0x1000 | 0x8 | 0x400000 ) ); // texture, complex, mipmap
+   for ( U32 i = 0; i < 4; i++ )
+      fs.write( (U32)0 );
+
+   // The texels are stored as BGRA
+   Vector<U8> row;
+   for ( U32 mip = 0; mip < numMips; mip++ )
+   {
+      const U32 mipWidth = getMax( width >> mip, (U32)1 );
+      const U32 mipHeight = getMax( height >> mip, (U32)1 );
+      row.setSize( mipWidth * 4 );
+
+      for ( U32 y = 0; y < mipHeight; y++, bits += mipWidth * 4 )
+      {
+         for ( U32 x = 0; x < mipWidth * 4; x += 4 )
+         {
+            row[x+0] = bits[x+2];
+            row[x+1] = bits[x+1];
+            row[x+2] = bits[x+0];
+            row[x+3] = bits[x+3];
+         }
+
+         fs.write( row.size(), row.address() );
+      }
+   }
+
+   const bool success = fs.getStatus() == Stream::Ok;
+   fs.close();
+   return success;
+}
+
+/// Looks up the CPU side texture of a primitive's material, if there is one.
+static const TSRasterTexture* getPrimitiveTexture( TSMaterialList *materials, U32 matIndex )
+{
+   if ( !materials || ( matIndex & TSDrawPrimitive::NoMaterial ) )
+      return NULL;
+
+   matIndex &= TSDrawPrimitive::MaterialMask;
+   if ( matIndex >= materials->size() )
+      return NULL;
+
+   TSMaterialInstance *matInst = materials->getMaterialInst( matIndex );
+   TSMaterial *mat = matInst ? matInst->getMaterial() : NULL;
+   if ( !mat && MATMGR )
+      mat = MATMGR->getMaterialDefinitionByName( materials->getMaterialName( matIndex ) );
+
+   return mat ? mat->getRasterTexture() : NULL;
+}
 
 TSLastDetail::TSLastDetail(   TSShape *shape,
                               const String &cachePath,
@@ -69,10 +155,20 @@ TSLastDetail::TSLastDetail(   TSShape *shape,
 
    //mMaterial = NULL;
    mMatInstance = NULL;
+
+   // Matches TSImposterState
+   mImposterVertDecl.addElement( GFXSemantic::POSITION, GFXDeclType_Float4 );
+   mImposterVertDecl.addElement( GFXSemantic::TEXCOORD, GFXDeclType_Float, 0 );
+   mImposterVertDecl.addElement( GFXSemantic::TEXCOORD, GFXDeclType_Float3, 1 );
+   mImposterVertDecl.addElement( GFXSemantic::TEXCOORD, GFXDeclType_Float3, 2 );
+
+   smLastDetails.push_back( this );
 }
 
 TSLastDetail::~TSLastDetail()
 {
+   smLastDetails.remove( this );
+
    SAFE_DELETE( mMatInstance );
    //if ( mMaterial )
    //   mMaterial->deleteObject();
@@ -80,23 +176,14 @@ TSLastDetail::~TSLastDetail()
 
 void TSLastDetail::render( TSRenderState &rdata, F32 alpha )
 {
-#if 0
    // Early out if we have nothing to render.
-   if (  alpha < 0.01f || 
-         !mMatInstance ||
-         mMaterial->mImposterUVs.size() == 0 )
+   if ( alpha < 0.01f )
       return;
 
-   const MatrixF &mat = GFX->getWorldMatrix();
-
-   // Post a render instance for this imposter... the special
-   // imposter render manager will do the magic!
-   RenderPassManager *renderPass = rdata.getSceneState()->getRenderPass();
-
-   ImposterRenderInst *ri = renderPass->allocInst<ImposterRenderInst>();
-   ri->mat = rdata.getSceneState()->getOverrideMaterial( mMatInstance );
+   const MatrixF &mat = rdata.getInstanceTransform() ? *rdata.getInstanceTransform() : MatrixF::Identity;
 
-   ri->state.alpha = alpha;
+   TSImposterState state;
+   state.alpha = alpha;
 
    // Store the up and right vectors of the rotation
    // and we'll generate the up vector in the shader.
@@ -106,27 +193,20 @@ void TSLastDetail::render( TSRenderState &rdata, F32 alpha )
    //
    // NOTE: These vector include scale.
    //
-   mat.getColumn( 2, &ri->state.upVec );
-   mat.getColumn( 0, &ri->state.rightVec );
+   mat.getColumn( 2, &state.upVec );
+   mat.getColumn( 0, &state.rightVec );
 
    // We send the unscaled size and the vertex shader
    // will use the orientation vectors above to scale it.
-   ri->state.halfSize = mRadius;
+   state.halfSize = mRadius;
 
    // We use the center of the object bounds for
    // the center of the billboard quad.
-   mat.mulP( mCenter, &ri->state.center );
+   mat.mulP( mCenter, &state.center );
 
-   // We sort by the imposter type first so that RIT_Imposter and s
-   // RIT_ImposterBatches do not get mixed together.
-   //
-   // We then sort by material.
-   //
-   ri->defaultKey = 1;
-   ri->defaultKey2 = ri->mat->getStateHint();
-
-   renderPass->addInst( ri );
-#endif
+   // The render state gathers the imposters of each
+   // detail so they can be drawn in one go.
+   rdata.addImposter( this, state );
 }
 
 void TSLastDetail::update( bool forceUpdate )
@@ -146,51 +226,31 @@ void TSLastDetail::update( bool forceUpdate )
 
    // Make sure imposter textures have been flushed (and not just queued for deletion)
    TEXMGR->cleanupCache();
+#endif
 
    // Get the real path to the source shape for doing modified time
    // comparisons... this might be different if the DAEs have been 
    // deleted from the install.
-   String shapeFile( mCachePath );
-   if ( !Platform::isFile( shapeFile ) )
+   const String shapeFile = _getShapeFile();
+   if ( shapeFile.isEmpty() )
    {
-      DTShape::Path path(shapeFile);
-      path.setExtension("cached.dts");
-      shapeFile = path.getFullPath();
-      if ( !Platform::isFile( shapeFile ) )  
-      {
-         Log::errorf( "TSLastDetail::update - '%s' could not be found!", mCachePath.c_str() );
-         return;
-      }
+      Log::errorf( "TSLastDetail::update - '%s' could not be found!", mCachePath.c_str() );
+      return;
    }
 
    // Do we need to update the imposter?
    const String diffuseMapPath = _getDiffuseMapPath();
-   if (  forceUpdate || 
-         Platform::compareModifiedTimes( diffuseMapPath, shapeFile ) <= 0 )
+   if ( forceUpdate || _isCacheStale( shapeFile ) )
       _update();
 
    // If the time check fails now then the update must have not worked.
-   if ( Platform::compareModifiedTimes( diffuseMapPath, shapeFile ) < 0 )
+   if ( compareModifiedTimes( diffuseMapPath, shapeFile ) < 0 )
    {
       Log::errorf( "TSLastDetail::update - Failed to create imposters for '%s'!", mCachePath.c_str() );
       return;
    }
 
-   // Figure out what our vertex format will be.
-   //
-   // If we're on SM 3.0 we can do multiple vertex streams
-   // and the performance win is big as we send 3x less data
-   // on each imposter instance.
-   //
-   // The problem is SM 2.0 won't do this, so we need to
-   // support fallback to regular single stream imposters.
-   //
-   //mImposterVertDecl.copy( *getGFXVertexFormat<ImposterCorner>() );
-   //mImposterVertDecl.append( *getGFXVertexFormat<ImposterState>(), 1 );
-   //mImposterVertDecl.getDecl();   
-   mImposterVertDecl.clear();
-   mImposterVertDecl.copy( *getGFXVertexFormat<ImposterState>() );
-
+#if 0
    // Setup the material for this imposter.
    mMaterial = MATMGR->allocateAndRegister( String::EmptyString );
    mMaterial->mAutoGenerated = true;
@@ -247,6 +307,27 @@ void TSLastDetail::update( bool forceUpdate )
 #endif
 }
 
+String TSLastDetail::_getShapeFile() const
+{
+   String shapeFile( mCachePath );
+   if ( !Platform::isFile( shapeFile ) )
+   {
+      DTShape::Path path(shapeFile);
+      path.setExtension("cached.dts");
+      shapeFile = path.getFullPath();
+      if ( !Platform::isFile( shapeFile ) )  
+         return String::EmptyString;
+   }
+
+   return shapeFile;
+}
+
+bool TSLastDetail::_isCacheStale( const String &shapeFile ) const
+{
+   return   compareModifiedTimes( _getDiffuseMapPath(), shapeFile ) <= 0 ||
+            compareModifiedTimes( _getNormalMapPath(), shapeFile ) <= 0;
+}
+
 void TSLastDetail::_validateDim()
 {
    // Loop till they fit.
@@ -280,27 +361,166 @@ void TSLastDetail::_validateDim()
 
 void TSLastDetail::_update()
 {
-#if 0
-   // We're gonna render... make sure we can.
-   bool sceneBegun = GFX->canCurrentlyRender();
-   if ( !sceneBegun )
-      GFX->beginScene();
+   // Shapes set up their billboards as they are loaded, which may be
+   // on a pool thread, so this stays on the calling thread.
+   _prepareCapture();
+   _capture( NULL );
+}
 
-   _validateDim();
+void TSLastDetail::_prepareCapture()
+{
+   PROFILE_SCOPE( TSLastDetail_PrepareCapture );
 
-   Vector<GBitmap*> bitmaps;
-   Vector<GBitmap*> normalmaps;
+   mCaptureTriangles.clear();
+
+   const TSShape::Detail &detail = mShape->details[mDl];
+   const S32 ss = detail.subShapeNum;
+   const S32 od = detail.objectDetailNum;
+   if ( ss < 0 )
+   {
+      Log::errorf( "TSLastDetail::_prepareCapture - '%s' cannot capture a billboard detail!", mCachePath.c_str() );
+      return;
+   }
 
    // We need to create our own instance to render with.
-   TSShapeInstance *shape = new TSShapeInstance( mShape, true );
+   TSRenderState renderState;
+   TSShapeInstance *shape = new TSShapeInstance( mShape, &renderState, false );
 
    // Animate the shape once.
    shape->animate( mDl );
 
-   // So we don't have to change it everywhere.
-   const GFXFormat format = GFXFormatR8G8B8A8;  
+   Vector<Point3F> verts;
+   Vector<Point3F> normals;
+   Vector<Point2F> tverts;
 
-   S32 imposterCount = ( ((2*mNumPolarSteps) + 1 ) * mNumEquatorSteps ) + ( mIncludePoles ? 2 : 0 );
+   const S32 start = mShape->subShapeFirstObject[ss];
+   const S32 end = start + mShape->subShapeNumObjects[ss];
+   for ( S32 i = start; i < end; i++ )
+   {
+      TSShapeInstance::MeshObjectInstance &meshObj = shape->mMeshObjects[i];
+      TSMesh *mesh = meshObj.getMesh( od );
+      if ( !mesh || meshObj.forceHidden || meshObj.visible <= 0.01f || mesh->vertsPerFrame <= 0 )
+         continue;
+
+      // Find the vertices of the current frame, skinning them if needed.
+      const TSMesh::TSMeshVertexArray *vertexData = NULL;
+      S32 firstVert = 0;
+      if ( mesh->getMeshType() == TSMesh::SkinMeshType )
+      {
+         if ( !meshObj.updateCollisionSkin( static_cast<TSSkinMesh*>( mesh ) ) )
+            continue;
+         vertexData = &meshObj.mSkinnedVerts;
+      }
+      else
+      {
+         firstVert = mesh->vertsPerFrame * meshObj.frame;
+         if ( mesh->mVertexData.isReady() )
+            vertexData = &mesh->mVertexData;
+      }
+
+      const S32 numVerts = mesh->vertsPerFrame;
+      if ( vertexData ? firstVert + numVerts > vertexData->size() : firstVert + numVerts > mesh->verts.size() )
+         continue;
+
+      // Bring the vertices into shape space around the capture center.
+      const MatrixF &mat = meshObj.getTransform();
+      verts.setSize( numVerts );
+      normals.setSize( numVerts );
+      tverts.setSize( numVerts );
+
+      for ( S32 j = 0; j < numVerts; j++ )
+      {
+         if ( vertexData )
+         {
+            const TSMesh::__TSMeshVertexBase &vert = vertexData->getBase( firstVert + j );
+            verts[j] = vert.vert();
+            normals[j] = vert.normal();
+            tverts[j] = vert.tvert();
+         }
+         else
+         {
+            const S32 tvert = mesh->vertsPerFrame * meshObj.matFrame + j;
+            verts[j] = mesh->verts[ firstVert + j ];
+            normals[j] = firstVert + j < mesh->norms.size() ? mesh->norms[ firstVert + j ] : Point3F( 0, 0, 1 );
+            tverts[j] = tvert < mesh->tverts.size() ? mesh->tverts[ tvert ] : Point2F( 0, 0 );
+         }
+
+         mat.mulP( verts[j] );
+         verts[j] -= mCenter;
+         mat.mulV( normals[j] );
+         normals[j].normalizeSafe();
+      }
+
+      for ( S32 p = 0; p < mesh->primitives.size(); p++ )
+      {
+         const TSDrawPrimitive &draw = mesh->primitives[p];
+         const TSRasterTexture *texture = getPrimitiveTexture( mShape->materialList, draw.matIndex );
+         const bool indexed = draw.matIndex & TSDrawPrimitive::Indexed;
+         const U32 type = draw.matIndex & TSDrawPrimitive::TypeMask;
+
+         for ( S32 j = 2; j < draw.numElements; j++ )
+         {
+            // Corners of the j'th vertex's triangle, skipping
+            // to every third vertex for triangle lists.
+            S32 corners[3];
+            if ( type == TSDrawPrimitive::Triangles )
+            {
+               if ( j % 3 != 2 )
+                  continue;
+               corners[0] = j - 2;
+               corners[1] = j - 1;
+               corners[2] = j;
+            }
+            else if ( type == TSDrawPrimitive::Fan )
+            {
+               corners[0] = 0;
+               corners[1] = j - 1;
+               corners[2] = j;
+            }
+            else
+            {
+               // Strips: the rasterizer draws both sides
+               // so the alternating winding is ignored.
+               corners[0] = j - 2;
+               corners[1] = j - 1;
+               corners[2] = j;
+            }
+
+            CaptureTriangle tri;
+            bool valid = true;
+            for ( U32 k = 0; k < 3; k++ )
+            {
+               const S32 idx = indexed ? mesh->indices[ draw.start + corners[k] ] : draw.start + corners[k];
+               if ( idx < 0 || idx >= numVerts )
+               {
+                  valid = false;
+                  break;
+               }
+
+               tri.verts[k].pos = verts[idx];
+               tri.verts[k].normal = normals[idx];
+               tri.verts[k].uv = tverts[idx];
+            }
+
+            if ( !valid )
+               continue;
+
+            tri.texture = texture;
+            mCaptureTriangles.push_back( tri );
+         }
+      }
+   }
+
+   delete shape;
+}
+
+void TSLastDetail::_capture( ThreadPool *pool )
+{
+   PROFILE_SCOPE( TSLastDetail_Capture );
+
+   _validateDim();
+
+   const U32 imposterCount = ( ((2*mNumPolarSteps) + 1 ) * mNumEquatorSteps ) + ( mIncludePoles ? 2 : 0 );
 
    // Figure out the optimal texture size.
    Point2I texSize( smMaxTexSize, smMaxTexSize );
@@ -320,175 +540,131 @@ void TSLastDetail::_update()
       texSize = halfSize;
    }
 
-   GBitmap *imposter = NULL;
-   GBitmap *normalmap = NULL;
-   GBitmap destBmp( texSize.x, texSize.y, true, format );
-   GBitmap destNormal( texSize.x, texSize.y, true, format );
-
-   U32 mipLevels = destBmp.getNumMipLevels();
-
-   ImposterCapture *imposterCap = new ImposterCapture();
-
-   F32 equatorStepSize = M_2PI_F / (F32)mNumEquatorSteps;
-
-   static const MatrixF topXfm( EulerF( -M_PI_F / 2.0f, 0, 0 ) );
-   static const MatrixF bottomXfm( EulerF( M_PI_F / 2.0f, 0, 0 ) );
+   // We capture the images in a particular order which must
+   // match the order expected by the imposter renderer.
+   Vector<MatrixF> views;
 
-   MatrixF angMat;
+   const F32 equatorStepSize = M_2PI_F / (F32)mNumEquatorSteps;
 
    F32 polarStepSize = 0.0f;
+   F32 rotX = 0.0f;
    if ( mNumPolarSteps > 0 )
+   {
       polarStepSize = -( 0.5f * M_PI_F - mDegToRad( mPolarAngle ) ) / (F32)mNumPolarSteps;
+      rotX = -( mDegToRad( mPolarAngle ) - 0.5f * M_PI_F );
+   }
 
-   PROFILE_START(TSLastDetail_snapshots);
-
-   S32 currDim = mDim;
-   for ( S32 mip = 0; mip < mipLevels; mip++ )
+   for ( U32 j=0; j < (2 * mNumPolarSteps + 1); j++ )
    {
-      if ( currDim < 1 )
-         currDim = 1;
-      
-      dMemset( destBmp.getWritableBits(mip), 0, destBmp.getWidth(mip) * destBmp.getHeight(mip) * GFXFormat_getByteSize( format ) );
-      dMemset( destNormal.getWritableBits(mip), 0, destNormal.getWidth(mip) * destNormal.getHeight(mip) * GFXFormat_getByteSize( format ) );
-
-      bitmaps.clear();
-      normalmaps.clear();
+      F32 rotZ = -M_PI_F / 2.0f;
 
-      F32 rotX = 0.0f;
-      if ( mNumPolarSteps > 0 )
-         rotX = -( mDegToRad( mPolarAngle ) - 0.5f * M_PI_F );
+      for ( U32 k=0; k < mNumEquatorSteps; k++ )
+      {
+         views.increment();
+         views.last().mul( MatrixF( EulerF( rotX, 0, 0 ) ),
+                           MatrixF( EulerF( 0, 0, rotZ ) ) );
 
-      // We capture the images in a particular order which must
-      // match the order expected by the imposter renderer.
+         rotZ += equatorStepSize;
+      }
 
-      imposterCap->begin( shape, mDl, currDim, mRadius, mCenter );
+      rotX += polarStepSize;
+   }
 
-      for ( U32 j=0; j < (2 * mNumPolarSteps + 1); j++ )
-      {
-         F32 rotZ = -M_PI_F / 2.0f;
+   if ( mIncludePoles )
+   {
+      views.push_back( MatrixF( EulerF( -M_PI_F / 2.0f, 0, 0 ) ) );
+      views.push_back( MatrixF( EulerF( M_PI_F / 2.0f, 0, 0 ) ) );
+   }
 
-         for ( U32 k=0; k < mNumEquatorSteps; k++ )
-         {            
-            angMat.mul( MatrixF( EulerF( rotX, 0, 0 ) ),
-                        MatrixF( EulerF( 0, 0, rotZ ) ) );
+   AssertFatal( views.size() == imposterCount, "TSLastDetail::_capture - Wrong number of views!" );
 
-            imposterCap->capture( angMat, &imposter, &normalmap );
+   // Every mip of the atlas is captured again at its own size
+   // rather than filtered down from the top level.
+   U32 mipLevels = 1;
+   while ( ( texSize.x >> mipLevels ) > 0 || ( texSize.y >> mipLevels ) > 0 )
+      mipLevels++;
 
-            bitmaps.push_back( imposter );
-            normalmaps.push_back( normalmap );
+   U32 totalSize = 0;
+   for ( U32 mip = 0; mip < mipLevels; mip++ )
+      totalSize += getMax( texSize.x >> mip, 1 ) * getMax( texSize.y >> mip, 1 ) * 4;
 
-            rotZ += equatorStepSize;
-         }
+   Vector<U8> destBmp;
+   Vector<U8> destNormal;
+   destBmp.setSize( totalSize );
+   destNormal.setSize( totalSize );
+   dMemset( destBmp.address(), 0, totalSize );
+   dMemset( destNormal.address(), 0, totalSize );
 
-         rotX += polarStepSize;
+   TSRasterizer rasterizer;
+   TSRasterizer::Vertex verts[3];
+   const ColorI white( 255, 255, 255, 255 );
 
-         if ( mIncludePoles )
-         {
-            imposterCap->capture( topXfm, &imposter, &normalmap );
+   U32 mipOffset = 0;
+   S32 currDim = mDim;
+   for ( U32 mip = 0; mip < mipLevels; mip++ )
+   {
+      if ( currDim < 1 )
+         currDim = 1;
 
-            bitmaps.push_back(imposter);
-            normalmaps.push_back( normalmap );
+      const S32 mipWidth = getMax( texSize.x >> mip, 1 );
+      const S32 mipHeight = getMax( texSize.y >> mip, 1 );
 
-            imposterCap->capture( bottomXfm, &imposter, &normalmap );
+      // Ok... pack in images till we run out.
+      const S32 cellsX = mipWidth / currDim;
+      const S32 numCells = getMin( cellsX * ( mipHeight / currDim ), views.size() );
 
-            bitmaps.push_back( imposter );
-            normalmaps.push_back( normalmap );
-         }         
-      }
+      // Orthographic projection of the bounding sphere, looking down
+      // the y axis with z up the image.
+      const F32 halfDim = currDim * 0.5f;
+      const F32 scale = halfDim / mRadius;
 
-      imposterCap->end();
+      for ( S32 v = 0; v < numCells; v++ )
+      {
+         const MatrixF &view = views[v];
 
-      Point2I texSize( destBmp.getWidth(mip), destBmp.getHeight(mip) );
+         rasterizer.begin( currDim, currDim );
 
-      // Ok... pack in bitmaps till we run out.
-      for ( S32 y=0; y+currDim <= texSize.y; )
-      {
-         for ( S32 x=0; x+currDim <= texSize.x; )
+         for ( S32 t = 0; t < mCaptureTriangles.size(); t++ )
          {
-            // Copy the next bitmap to the dest texture.
-            GBitmap* bmp = bitmaps.first();
-            bitmaps.pop_front();
-            destBmp.copyRect( bmp, RectI( 0, 0, currDim, currDim ), Point2I( x, y ), 0, mip );
-            delete bmp;
-
-            // Copy the next normal to the dest texture.
-            GBitmap* normalmap = normalmaps.first();
-            normalmaps.pop_front();
-            destNormal.copyRect( normalmap, RectI( 0, 0, currDim, currDim ), Point2I( x, y ), 0, mip );
-            delete normalmap;
-
-            // Did we finish?
-            if ( bitmaps.empty() )
-               break;
-
-            x += currDim;
+            const CaptureTriangle &tri = mCaptureTriangles[t];
+            for ( U32 k = 0; k < 3; k++ )
+            {
+               Point3F pos;
+               view.mulV( tri.verts[k].pos, &pos );
+               verts[k].pos.set( halfDim + pos.x * scale, halfDim - pos.z * scale, pos.y );
+               view.mulV( tri.verts[k].normal, &verts[k].normal );
+               verts[k].uv = tri.verts[k].uv;
+            }
+
+            rasterizer.addTriangle( verts[0], verts[1], verts[2], tri.texture, white );
          }
 
-         // Did we finish?
-         if ( bitmaps.empty() )
-            break;
+         rasterizer.end( pool );
 
-         y += currDim;
+         // Copy the image to its place in the atlas.
+         const S32 x = ( v % cellsX ) * currDim;
+         const S32 y = ( v / cellsX ) * currDim;
+         const U32 rowSize = currDim * 4;
+         for ( S32 row = 0; row < currDim; row++ )
+         {
+            const U32 dest = mipOffset + ( ( y + row ) * mipWidth + x ) * 4;
+            dMemcpy( &destBmp[dest], rasterizer.getColorBits() + row * rowSize, rowSize );
+            dMemcpy( &destNormal[dest], rasterizer.getNormalBits() + row * rowSize, rowSize );
+         }
       }
 
       // Next mip...
+      mipOffset += mipWidth * mipHeight * 4;
       currDim /= 2;
    }
 
-   PROFILE_END(); // TSLastDetail_snapshots
-
-   delete imposterCap;
-   delete shape;   
-   
-   
-   // Should we dump the images?
-   if ( Log::getBoolVariable( "$TSLastDetail::dumpImposters", false ) )
-   {
-      String imposterPath = mCachePath + ".imposter.png";
-      String normalsPath = mCachePath + ".imposter_normals.png";
-
-      FileStream stream;
-      if ( stream.open( imposterPath, FileStream::Write  ) )
-         destBmp.writeBitmap( "png", stream );
-      stream.close();
-
-      if ( stream.open( normalsPath, FileStream::Write ) )
-         destNormal.writeBitmap( "png", stream );
-      stream.close();
-   }
-
-   // DEBUG: Some code to force usage of a test image.
-   //GBitmap* tempMap = GBitmap::load( "./forest/data/test1234.png" );
-   //tempMap->extrudeMipLevels();
-   //mTexture.set( tempMap, &GFXDefaultStaticDiffuseProfile, false );
-   //delete tempMap;
-
-   DDSFile *ddsDest = DDSFile::createDDSFileFromGBitmap( &destBmp );
-   DDSUtil::squishDDS( ddsDest, GFXFormatDXT3 );
-
-   DDSFile *ddsNormals = DDSFile::createDDSFileFromGBitmap( &destNormal );
-   DDSUtil::squishDDS( ddsNormals, GFXFormatDXT5 );
+   mCaptureTriangles.clear();
+   mCaptureTriangles.compact();
 
    // Finally save the imposters to disk.
-   FileStream fs;
-   if ( fs.open( _getDiffuseMapPath(), FileStream::Write ) )
-   {
-      ddsDest->write( fs );
-      fs.close();
-   }
-   if ( fs.open( _getNormalMapPath(), FileStream::Write ) )
-   {
-      ddsNormals->write( fs );
-      fs.close();
-   }
-
-   delete ddsDest;
-   delete ddsNormals;
-
-   // If we did a begin then end it now.
-   if ( !sceneBegun )
-      GFX->endScene();
-#endif
+   if ( !writeDDS( _getDiffuseMapPath(), destBmp.address(), texSize.x, texSize.y, mipLevels ) ||
+        !writeDDS( _getNormalMapPath(), destNormal.address(), texSize.x, texSize.y, mipLevels ) )
+      Log::errorf( "TSLastDetail::_capture - Failed to write imposters for '%s'!", mCachePath.c_str() );
 }
 
 void TSLastDetail::deleteImposterCacheTextures()
@@ -502,26 +678,39 @@ void TSLastDetail::deleteImposterCacheTextures()
       Platform::fileDelete( normalMap );
 }
 
-void TSLastDetail::updateImposterImages( bool forceUpdate )
+void TSLastDetail::_captureFn( void *data, U32 index, U32 workerIndex )
 {
-#if 0
-   // Can't do it without GFX!
-   if ( !GFXDevice::devicePresent() )
-      return;
-
-   //D3DPERF_SetMarker( D3DCOLOR_RGBA( 0, 255, 0, 255 ), L"TSLastDetail::makeImposter" );
+   (*static_cast< Vector<TSLastDetail*>* >( data ))[index]->_capture( NULL );
+}
 
-   bool sceneBegun = GFX->canCurrentlyRender();
-   if ( !sceneBegun )
-      GFX->beginScene();
+void TSLastDetail::updateImposterImages( bool forceUpdate )
+{
+   PROFILE_SCOPE( TSLastDetail_UpdateImposterImages );
 
+   // Gather the geometry of every stale detail up front, as skinning
+   // isn't safe to do from several threads...
+   Vector<TSLastDetail*> stale;
    Vector<TSLastDetail*>::iterator iter = smLastDetails.begin();
    for ( ; iter != smLastDetails.end(); iter++ )
-      (*iter)->update( forceUpdate );
+   {
+      const String shapeFile = (*iter)->_getShapeFile();
+      if ( shapeFile.isEmpty() || !( forceUpdate || (*iter)->_isCacheStale( shapeFile ) ) )
+         continue;
 
-   if ( !sceneBegun )
-      GFX->endScene();
-#endif
+      (*iter)->_prepareCapture();
+      stale.push_back( *iter );
+   }
+
+   // ...then render them a detail per thread.  With a single
+   // detail it is better to spread its tiles over the threads.
+   if ( stale.size() == 1 )
+      stale[0]->_capture( &ThreadPool::getGlobal() );
+   else if ( stale.size() > 1 )
+      ThreadPool::getGlobal().parallelFor( stale.size(), _captureFn, &stale, 1 );
+
+   // The images are fresh now, so this just finishes the setup.
+   for ( iter = smLastDetails.begin(); iter != smLastDetails.end(); iter++ )
+      (*iter)->update( false );
 }
 
 //-----------------------------------------------------------------------------
@@ -38,6 +38,9 @@
 #ifndef _TSRENDER_H_
 #include "ts/tsRender.h"
 #endif
+#ifndef _TSRASTERIZER_H_
+#include "ts/tsRasterizer.h"
+#endif
 
 //-----------------------------------------------------------------------------
 
@@ -50,29 +53,7 @@ class TSRenderState;
 class TSSceneRenderState;
 class Material;
 class TSMaterialInstance;
-
-#if 0
-
-/// The imposter state vertex format.
-GFXDeclareVertexFormat( ImposterState )
-{
-   /// .xyz = imposter center
-   /// .w = billboard corner... damn SM 2.0
-   Point3F center;
-   float corner;
-
-   /// .x = scaled half size
-   /// .y = alpha fade out
-   float halfSize;
-   float alpha;
-
-   /// The rotation encoded as the up
-   /// and right vectors... cross FTW.
-   Point3F upVec;
-   Point3F rightVec;
-};
-
-#endif
+class ThreadPool;
 
 
 /// This neat little class renders the object to a texture so that when the object
@@ -80,10 +61,17 @@ GFXDeclareVertexFormat( ImposterState )
 /// when the model is first loaded as to keep the realtime render as fast as possible.
 /// It also renders the model from a few different perspectives so that it would actually
 /// pass as a model instead of a silly old billboard.  In other words, this is an imposter.
+///
+/// The images are rendered with TSRasterizer so they can be baked without a
+/// GFX device, such as by a tool which calls updateImposterImages().
 class TSLastDetail
 {
 protected:
 
+   /// All the TSLastDetail objects, for updateImposterImages().  Details
+   /// should only be created and destroyed on one thread.
+   static Vector<TSLastDetail*> smLastDetails;
+
    /// The shape which we're impostering.
    TSShape *mShape;
 
@@ -123,8 +111,8 @@ protected:
    /// imposter texture.
    bool mIncludePoles;
 
-   /// The combined imposter state and corner data vertex
-   /// format used for rendering with multiple streams. 
+   /// The per instance vertex format of TSImposterState, for
+   /// drawing a TSImposterBatch with one instanced draw call.
    GFXVertexFormat mImposterVertDecl;
 
    /// The material for this imposter.
@@ -136,9 +124,40 @@ protected:
    /// The maximum texture size for a billboard texture.
    static const U32 smMaxTexSize = 2048;
 
+   /// A triangle of the captured detail level in shape space, relative
+   /// to mCenter.
+   struct CaptureTriangle
+   {
+      TSRasterizer::Vertex verts[3];
+      const TSRasterTexture *texture;
+   };
+
+   /// The triangles gathered by _prepareCapture().
+   Vector<CaptureTriangle> mCaptureTriangles;
+
    /// This update actually regenerates the imposter images.
    void _update();
 
+   /// Animates a private instance of the shape and gathers the triangles
+   /// of the detail level to capture.  Skinned meshes lazily set up data
+   /// shared with other instances, so this is not thread safe.
+   void _prepareCapture();
+
+   /// Renders the imposter images from the gathered triangles and saves
+   /// them to the cache.  If pool is not NULL the rasterizer is spread
+   /// over its threads.  Details can be captured from several threads at
+   /// once as long as they are given no pool.
+   void _capture( ThreadPool *pool );
+
+   static void _captureFn( void *data, U32 index, U32 workerIndex );
+
+   /// Returns the shape file to compare the cache time stamps with, or an
+   /// empty string if it could not be found.
+   String _getShapeFile() const;
+
+   /// Returns true if the cached images need to be rendered again.
+   bool _isCacheStale( const String &shapeFile ) const;
+
    ///
    void _validateDim();
 
@@ -161,7 +180,8 @@ public:
 
    ~TSLastDetail();
 
-   /// Calls update on all TSLastDetail objects in the system.
+   /// Calls update on all TSLastDetail objects in the system.  Details with
+   /// stale images are captured in parallel, one per thread.
    /// @see update()
    static void updateImposterImages( bool forceUpdate = false );
 
@@ -178,9 +198,27 @@ public:
 
 
    /// Internal function called from TSShapeInstance to 
-   /// submit an imposter render instance.
+   /// submit an imposter to the render state, which
+   /// batches it with the other instances of the shape.
    void render( TSRenderState &rdata, F32 alpha );
 
+   /// Returns the vertex format of TSImposterState:
+   /// POSITION holds the center and half size, TEXCOORD0
+   /// the alpha and TEXCOORD1/2 the up and right vectors.
+   const GFXVertexFormat* getImposterVertexFormat() const { return &mImposterVertDecl; }
+
+   /// @name Imposter Atlas
+   /// The layout of the images in the imposter textures.
+   /// @{
+   String getDiffuseMapPath() const { return _getDiffuseMapPath(); }
+   String getNormalMapPath() const { return _getNormalMapPath(); }
+   S32 getDim() const { return mDim; }
+   U32 getNumEquatorSteps() const { return mNumEquatorSteps; }
+   U32 getNumPolarSteps() const { return mNumPolarSteps; }
+   F32 getPolarAngle() const { return mPolarAngle; }
+   bool getIncludePoles() const { return mIncludePoles; }
+   /// @}
+
    /// Returns the material instance used to render this imposter.
    TSMaterialInstance* getMatInstance() const { return mMatInstance; }
 
@@ -35,6 +35,7 @@ BEGIN_NS(DTShape)
 class GFXVertexFormat;
 class ColladaAppMaterial;
 class TSMaterialInstance;
+struct TSRasterTexture;
 
 /// Represents a material in a DTS shape
 /// (The actual implementation logic is up to the client app, libDTS does no rendering
@@ -57,6 +58,11 @@ public:
    virtual bool isTranslucent() = 0;
    
    virtual const char* getName() = 0;
+
+   /// Returns the diffuse texture in system memory for software rendering,
+   /// such as when baking imposters.  By default there is none and the
+   /// material is drawn white.
+   virtual const TSRasterTexture *getRasterTexture() { return NULL; }
 };
 
 // Instance of TSMaterial. This is mainly for the app to track instances created from
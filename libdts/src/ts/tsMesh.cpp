@@ -35,11 +35,13 @@
 #include "math/mathUtils.h"
 #include "core/log.h"
 #include "collision/convex.h"
+#include "collision/collision.h"
 #include "collision/optimizedPolyList.h"
 #include "platform/profiler.h"
 #include "ts/tsMaterialManager.h"
 #include "core/util/triListOpt.h"
 #include "math/util/triRayCheck.h"
+#include "ts/tsMeshBVH.h"
 
 #if defined(LIBDTSHAPE_OS_XENON)
 #  include "platformXbox/platformXbox.h"
@@ -121,7 +123,11 @@ void TSMesh::innerRender( TSMaterialList *materials, TSRenderState &rdata, TSMes
       return;
 
    const TSSceneRenderState *state = rdata.getSceneState();
-   TSRenderInst *coreRI = rdata.allocRenderInst();
+   // Copied into the render instance of each primitive, so it
+   // doesn't need to come from the frame's allocator.
+   TSRenderInst core;
+   core.clear();
+   TSRenderInst *coreRI = &core;
    
    coreRI->type = 0;//RenderPassManager::RIT_Mesh;
    coreRI->renderData = rdata.getCurrentRenderData();
@@ -553,270 +559,227 @@ void TSMesh::support( S32 frame, const Point3F &v, F32 *currMaxDP, Point3F *curr
 
 bool TSMesh::castRay( S32 frame, const Point3F & start, const Point3F & end, RayInfo * rayInfo, TSMaterialList* materials )
 {
-#if 0
-   if ( planeNormals.empty() )
-      buildConvexHull(); // if haven't done it yet...
-
-   // Keep track of startTime and endTime.  They start out at just under 0 and just over 1, respectively.
-   // As we check against each plane, prune start and end times back to represent current intersection of
-   // line with all the planes (or rather with all the half-spaces defined by the planes).
-   // But, instead of explicitly keeping track of startTime and endTime, keep track as numerator and denominator
-   // so that we can avoid as many divisions as possible.
-
-   //   F32 startTime = -0.01f;
-   F32 startNum = -0.01f;
-   F32 startDen =  1.00f;
-   //   F32 endTime   = 1.01f;
-   F32 endNum = 1.01f;
-   F32 endDen = 1.00f;
-
-   S32 curPlane = 0;
-   U32 curMaterial = 0;
-   bool found = false;
-
-   // the following block of code is an optimization...
-   // it isn't necessary if the longer version of the main loop is used
-   bool tmpFound;
-   S32 tmpPlane;
-   F32 sgn = -1.0f;
-   F32 * pnum = &startNum;
-   F32 * pden = &startDen;
-   S32 * pplane = &curPlane;
-   bool * pfound = &found;
-
-   S32 startPlane = frame * planesPerFrame;
-   for ( S32  i = startPlane; i < startPlane + planesPerFrame; i++ )
-   {
-      // if start & end outside, no collision
-      // if start & end inside, continue
-      // if start outside, end inside, or visa versa, find intersection of line with plane
-      //    then update intersection of line with hull (using startTime and endTime)
-      F32 dot1 = mDot( planeNormals[i], start ) - planeConstants[i];
-      F32 dot2 = mDot( planeNormals[i], end) - planeConstants[i];
-      if ( dot1 * dot2 > 0.0f )
-      {
-         // same side of the plane...which side -- dot==0 considered inside
-         if ( dot1 > 0.0f )
-            return false; // start and end outside of this plane, no collision
-         
-         // start and end inside plane, continue
-         continue;
-      }
+   TSMeshBVH *bvh = getRayBVH( frame );
+   if ( !bvh )
+      return false;
 
-      //AssertFatal( dot1 / ( dot1 - dot2 ) >= 0.0f && dot1 / ( dot1 - dot2 ) <= 1.0f,"TSMesh::castRay (1)" );
-
-      // find intersection (time) with this plane...
-      // F32 time = dot1 / (dot1-dot2);
-      F32 num = mFabs( dot1 );
-      F32 den = mFabs( dot1 - dot2 );
-
-      // the following block of code is an optimized version...
-      // this can be commented out and the following block of code used instead
-      // if debugging a problem in this code, that should probably be done
-      // if you want to see how this works, look at the following block of code,
-      // not this one...
-      // Note that this does not get optimized appropriately...it is included this way
-      // as an idea for future optimization.
-      if ( sgn * dot1 >= 0 )
-      {
-         sgn *= -1.0f;
-         pnum = (F32*) ((dsize_t)pnum ^ (dsize_t)&endNum ^ (dsize_t)&startNum);
-         pden = (F32*) ((dsize_t)pden ^ (dsize_t)&endDen ^ (dsize_t)&startDen);
-         pplane = (S32*) ((dsize_t)pplane ^ (dsize_t)&tmpPlane ^ (dsize_t)&curPlane);
-         pfound = (bool*) ((dsize_t)pfound ^ (dsize_t)&tmpFound ^ (dsize_t)&found);
-      }
+   const U8 *frameVerts;
+   dsize_t stride;
+   getFrameVerts( frame, frameVerts, stride );
 
-      bool noCollision = num * endDen * sgn < endNum * den * sgn && num * startDen * sgn < startNum * den * sgn;
-      if (num * *pden * sgn < *pnum * den * sgn && !noCollision)
-      {
-         *pnum = num;
-         *pden = den;
-         *pplane = i;
-         *pfound = true;
-      }
-      else if ( noCollision )
-         return false;
+   return castRayBVH( bvh, bvh->getNodes(), frameVerts, stride, start, end, rayInfo, materials );
+}
 
-//      if (dot1<=0.0f)
-//      {
-//         // start is inside plane, end is outside...chop off end
-//         if (num*endDen<endNum*den) // if (time<endTime)
-//         {
-//            if (num*startDen<startNum*den) //if (time<startTime)
-//               // no intersection of line and hull
-//               return false;
-//            // endTime = time;
-//            endNum = num;
-//            endDen = den;
-//         }
-//         // else, no need to do anything, just continue (we've been more inside than this)
-//      }
-//      else // dot2<=0.0f
-//      {
-//         // end is inside poly, start is outside...chop off start
-//         AssertFatal(dot2<=0.0f,"TSMesh::castRay (2)");
-//         if (num*startDen>startNum*den) // if (time>startTime)
-//        {
-//            if (num*endDen>endNum*den) //if (time>endTime)
-//               // no intersection of line and hull
-//               return false;
-//            // startTime   = time;
-//            startNum = num;
-//            startDen = den;
-//            curPlane    = i;
-//            curMaterial = planeMaterials[i-startPlane];
-//            found = true;
-//         }
-//         // else, no need to do anything, just continue (we've been more inside than this)
-//      }
-   }
+bool TSMesh::castRayRendered( S32 frame, const Point3F & start, const Point3F & end, RayInfo * rayInfo, TSMaterialList* materials )
+{
+   return TSMesh::castRay( frame, start, end, rayInfo, materials );
+}
 
-   // setup rayInfo
-   if ( found && rayInfo )
-   {
-      curMaterial       = planeMaterials[ curPlane - startPlane ];
+bool TSMesh::getFrameVerts( S32 frame, const U8 *&outVerts, dsize_t &stride ) const
+{
+   if ( vertsPerFrame <= 0 || frame < 0 )
+      return false;
 
-      rayInfo->t        = (F32)startNum/(F32)startDen; // finally divide...
-      rayInfo->normal   = planeNormals[curPlane];
+   const S32 firstVert = vertsPerFrame * frame;
 
-      if (materials && materials->size() > 0)
-         rayInfo->material = materials->getMaterialInst( curMaterial );
-      else
-         rayInfo->material = NULL;
+   if ( mVertexData.isReady() )
+   {
+      if ( firstVert + vertsPerFrame > mVertexData.size() )
+         return false;
 
-      rayInfo->setContactPoint( start, end );
+      stride = mVertexData.vertSize();
+      outVerts = reinterpret_cast<const U8 *>( mVertexData.address() ) + firstVert * stride;
+   }
+   else
+   {
+      if ( firstVert + vertsPerFrame > verts.size() )
+         return false;
 
-      return true;
+      stride = sizeof( Point3F );
+      outVerts = reinterpret_cast<const U8 *>( verts.address() + firstVert );
    }
-   else if ( found )
-      return true;
-#endif
-   // only way to get here is if start is inside hull...
-   // we could return null and just plug in garbage for the material and normal...
-   return false;
+
+   return true;
 }
 
-bool TSMesh::castRayRendered( S32 frame, const Point3F & start, const Point3F & end, RayInfo * rayInfo, TSMaterialList* materials )
+TSMeshBVH* TSMesh::getRayBVH( S32 frame )
 {
-#if 0
-   if( vertsPerFrame <= 0 ) 
-      return false;
+   if ( frame < 0 )
+      return NULL;
 
-   if( mNumVerts == 0 )
-      return false;
+   if ( frame < mRayBVH.size() && mRayBVH[frame] )
+      return mRayBVH[frame];
 
-   S32 firstVert  = vertsPerFrame * frame;
+   const U8 *frameVerts;
+   dsize_t stride;
+   if ( !getFrameVerts( frame, frameVerts, stride ) )
+      return NULL;
 
-	bool found = false;
-	F32 best_t = F32_MAX;
-   U32 bestIdx0 = 0, bestIdx1 = 0, bestIdx2 = 0;
-   TSMaterialInstance* bestMaterial = NULL;
-	Point3F dir = end - start;
+   PROFILE_SCOPE( TSMesh_BuildRayBVH );
+
+   TSMeshBVH *bvh = new TSMeshBVH;
 
    for ( S32 i = 0; i < primitives.size(); i++ )
    {
-      TSDrawPrimitive & draw = primitives[i];
-      U32 drawStart = draw.start;
-
-      AssertFatal( draw.matIndex & TSDrawPrimitive::Indexed,"TSMesh::castRayRendered (1)" );
+      const TSDrawPrimitive &draw = primitives[i];
+      const U32 drawStart = draw.start;
 
-      U32 matIndex = draw.matIndex & TSDrawPrimitive::MaterialMask;
-      TSMaterialInstance* material = ( materials ? materials->getMaterialInst( matIndex ) : 0 );
+      AssertFatal( draw.matIndex & TSDrawPrimitive::Indexed,"TSMesh::getRayBVH (1)" );
 
-      U32 idx0, idx1, idx2;
+      const U32 matIndex = draw.matIndex & ( TSDrawPrimitive::MaterialMask | TSDrawPrimitive::NoMaterial );
 
       // gonna depend on what kind of primitive it is...
       if ( (draw.matIndex & TSDrawPrimitive::TypeMask) == TSDrawPrimitive::Triangles )
       {
-         for ( S32 j = 0; j < draw.numElements-2; j++)
-         {
-            idx0 = indices[drawStart + j + 0];
-            idx1 = indices[drawStart + j + 1];
-            idx2 = indices[drawStart + j + 2];
-
-			   F32 cur_t = 0;
-			   Point2F b;
-
-			   if(castRayTriangle(start, dir, mVertexData[firstVert + idx0].vert(),
-               mVertexData[firstVert + idx1].vert(), mVertexData[firstVert + idx2].vert(), cur_t, b))
-			   {
-				   if(cur_t < best_t)
-				   {
-					   best_t = cur_t;
-                  bestIdx0 = idx0;
-                  bestIdx1 = idx1;
-                  bestIdx2 = idx2;
-                  bestMaterial = material;
-					   found = true;
-				   }
-			   }
-         }
+         for ( S32 j = 0; j + 2 < draw.numElements; j += 3 )
+            bvh->addTriangle( indices[drawStart + j + 0], indices[drawStart + j + 1], indices[drawStart + j + 2], matIndex );
       }
       else
       {
-         AssertFatal( (draw.matIndex & TSDrawPrimitive::TypeMask) == TSDrawPrimitive::Strip,"TSMesh::castRayRendered (2)" );
+         AssertFatal( (draw.matIndex & TSDrawPrimitive::TypeMask) == TSDrawPrimitive::Strip,"TSMesh::getRayBVH (2)" );
 
-         idx0 = indices[drawStart + 0];
-         idx2 = indices[drawStart + 1];
-         U32 * nextIdx = &idx1;
+         // Winding alternates along the strip, but ray casts are two sided
          for ( S32 j = 2; j < draw.numElements; j++ )
          {
-            *nextIdx = idx2;
-            // nextIdx = (j%2)==0 ? &idx0 : &idx1;
-            nextIdx = (U32*) ( (dsize_t)nextIdx ^ (dsize_t)&idx0 ^ (dsize_t)&idx1);
-            idx2 = indices[drawStart + j];
+            const U32 idx0 = indices[drawStart + j - 2];
+            const U32 idx1 = indices[drawStart + j - 1];
+            const U32 idx2 = indices[drawStart + j];
             if ( idx0 == idx1 || idx0 == idx2 || idx1 == idx2 )
                continue;
 
-			   F32 cur_t = 0;
-			   Point2F b;
-
-			   if(castRayTriangle(start, dir, mVertexData[firstVert + idx0].vert(), 
-               mVertexData[firstVert + idx1].vert(), mVertexData[firstVert + idx2].vert(), cur_t, b))
-			   {
-				   if(cur_t < best_t)
-				   {
-					   best_t = cur_t;
-                  bestIdx0 = firstVert + idx0;
-                  bestIdx1 = firstVert + idx1;
-                  bestIdx2 = firstVert + idx2;
-                  bestMaterial = material;
-					   found = true;
-				   }
-			   }
+            if ( j & 1 )
+               bvh->addTriangle( idx1, idx0, idx2, matIndex );
+            else
+               bvh->addTriangle( idx0, idx1, idx2, matIndex );
          }
       }
    }
 
+   bvh->build( frameVerts, stride );
+
+   if ( frame >= mRayBVH.size() )
+   {
+      const S32 oldSize = mRayBVH.size();
+      mRayBVH.setSize( frame + 1 );
+      for ( S32 i = oldSize; i < mRayBVH.size(); i++ )
+         mRayBVH[i] = NULL;
+   }
+
+   mRayBVH[frame] = bvh;
+   return bvh;
+}
+
+void TSMesh::clearRayBVH()
+{
+   for ( S32 i = 0; i < mRayBVH.size(); i++ )
+      delete mRayBVH[i];
+   mRayBVH.clear();
+   mRayBVH.compact();
+}
+
+bool TSMesh::castRayBVH( const TSMeshBVH *bvh, const TSMeshBVH::Node *nodes, const U8 *frameVerts, dsize_t stride,
+                         const Point3F &start, const Point3F &end, RayInfo *rayInfo, TSMaterialList *materials )
+{
+   if ( bvh->isEmpty() )
+      return false;
+
+   TSMeshBVH::RayHit hit;
+   if ( !bvh->castRay( nodes, frameVerts, stride, start, end, hit, rayInfo == NULL ) )
+      return false;
+
    // setup rayInfo
-   if ( found && rayInfo )
+   if ( rayInfo )
    {
-      rayInfo->t = best_t;
+      const Point3F &v0 = *reinterpret_cast<const Point3F *>( frameVerts + hit.tri->idx[0] * stride );
+      const Point3F &v1 = *reinterpret_cast<const Point3F *>( frameVerts + hit.tri->idx[1] * stride );
+      const Point3F &v2 = *reinterpret_cast<const Point3F *>( frameVerts + hit.tri->idx[2] * stride );
+
+      rayInfo->t = hit.t;
 
       Point3F normal;
-      mCross(mVertexData[bestIdx2].vert()-mVertexData[bestIdx0].vert(),mVertexData[bestIdx1].vert()-mVertexData[bestIdx0].vert(),&normal);
+      mCross( v2 - v0, v1 - v0, &normal );
       if ( mDot( normal, normal ) < 0.001f )
       {
-         mCross( mVertexData[bestIdx0].vert() - mVertexData[bestIdx1].vert(), mVertexData[bestIdx2].vert() - mVertexData[bestIdx1].vert(), &normal );
+         mCross( v0 - v1, v2 - v1, &normal );
          if ( mDot( normal, normal ) < 0.001f )
-         {
-            mCross( mVertexData[bestIdx1].vert() - mVertexData[bestIdx2].vert(), mVertexData[bestIdx0].vert() - mVertexData[bestIdx2].vert(), &normal );
-         }
+            mCross( v1 - v2, v0 - v2, &normal );
       }
       normal.normalize();
       rayInfo->normal = normal;
 
-      rayInfo->material = bestMaterial;
+      if ( materials && !( hit.tri->matIndex & TSDrawPrimitive::NoMaterial ) )
+         rayInfo->material = materials->getMaterialInst( hit.tri->matIndex & TSDrawPrimitive::MaterialMask );
+      else
+         rayInfo->material = NULL;
 
       rayInfo->setContactPoint( start, end );
+   }
 
-      return true;
+   return true;
+}
+
+bool TSMesh::addPolys( const U8 *verts, dsize_t stride, AbstractPolyList *polyList, U32 &surfaceKey, TSMaterialList *materials )
+{
+   if ( vertsPerFrame <= 0 )
+      return false;
+
+   // add the verts...
+   const U32 base = polyList->addPoint( *reinterpret_cast<const Point3F *>( verts ) );
+   for ( S32 i = 1; i < vertsPerFrame; i++ )
+      polyList->addPoint( *reinterpret_cast<const Point3F *>( verts + i * stride ) );
+
+   // add the polys...
+   for ( S32 i = 0; i < primitives.size(); i++ )
+   {
+      const TSDrawPrimitive &draw = primitives[i];
+      const U32 start = draw.start;
+
+      AssertFatal( draw.matIndex & TSDrawPrimitive::Indexed,"TSMesh::addPolys (1)" );
+
+      TSMaterialInstance *material = NULL;
+      if ( materials && !( draw.matIndex & TSDrawPrimitive::NoMaterial ) )
+         material = materials->getMaterialInst( draw.matIndex & TSDrawPrimitive::MaterialMask );
+
+      // gonna depend on what kind of primitive it is...
+      if ( (draw.matIndex & TSDrawPrimitive::TypeMask) == TSDrawPrimitive::Triangles )
+      {
+         for ( S32 j = 0; j + 2 < draw.numElements; j += 3 )
+         {
+            const U32 idx0 = base + indices[start + j + 0];
+            const U32 idx1 = base + indices[start + j + 1];
+            const U32 idx2 = base + indices[start + j + 2];
+            polyList->begin( material, surfaceKey++ );
+            polyList->vertex( idx0 );
+            polyList->vertex( idx1 );
+            polyList->vertex( idx2 );
+            polyList->plane( idx0, idx1, idx2 );
+            polyList->end();
+         }
+      }
+      else
+      {
+         AssertFatal( (draw.matIndex & TSDrawPrimitive::TypeMask) == TSDrawPrimitive::Strip,"TSMesh::addPolys (2)" );
+
+         for ( S32 j = 2; j < draw.numElements; j++ )
+         {
+            // Keep the winding consistent along the strip
+            const U32 idx0 = base + indices[start + j - ( j & 1 ? 1 : 2 )];
+            const U32 idx1 = base + indices[start + j - ( j & 1 ? 2 : 1 )];
+            const U32 idx2 = base + indices[start + j];
+            if ( idx0 == idx1 || idx0 == idx2 || idx1 == idx2 )
+               continue;
+
+            polyList->begin( material, surfaceKey++ );
+            polyList->vertex( idx0 );
+            polyList->vertex( idx1 );
+            polyList->vertex( idx2 );
+            polyList->plane( idx0, idx1, idx2 );
+            polyList->end();
+         }
+      }
    }
-   else if ( found )
-      return true;
 
-#endif
-   return false;
+   return true;
 }
 
 bool TSMesh::addToHull( U32 idx0, U32 idx1, U32 idx2 )
@@ -1101,6 +1064,11 @@ TSMesh::TSMesh() : meshType( StandardMeshType )
 
    mNumVerts = 0;
    mRenderer = NULL;
+
+   mPackedVertexFormat = NULL;
+   mPackedVertSize = 0;
+   mPackedPosScale.set( 1.0f, 1.0f, 1.0f );
+   mPackedPosBias.set( 0.0f, 0.0f, 0.0f );
 }
 
 //-----------------------------------------------------
@@ -1111,6 +1079,8 @@ TSMesh::~TSMesh()
 {
    mNumVerts = 0;
    SAFE_DELETE(mRenderer);
+
+   clearRayBVH();
 }
 
 //-----------------------------------------------------
@@ -1152,27 +1122,81 @@ void TSSkinMesh::updateSkin( const Vector<MatrixF> &transforms, TSRenderState &r
       batchData.initialNorms.set( rdata.gNormalStore.address(), vertsPerFrame );
    }
 #endif
-   const MatrixF * matrices = NULL;
+
+   // If using hardware skinning, don't update (data is set in createBatchData)
+   if (TSShape::smUseHardwareSkinning)
+      return;
+
+   // set up bone transforms
+   PROFILE_START(TSSkinMesh_UpdateTransforms);
+   updateSkinBones( transforms, rdata.smSkinBoneTransforms );
+   PROFILE_END();
+
+   U8 *outPtr = reinterpret_cast<U8 *>(mVertexData.address());
    
-   if (!TSShape::smUseHardwareSkinning)
-   {
-      static Vector<MatrixF> sBoneTransforms;
-      sBoneTransforms.setSize( batchData.nodeIndex.size() );
-      
-      // set up bone transforms
-      PROFILE_START(TSSkinMesh_UpdateTransforms);
-      for( int i=0; i<batchData.nodeIndex.size(); i++ )
-      {
-         S32 node = batchData.nodeIndex[i];
-         sBoneTransforms[i].mul( transforms[node], batchData.initialTransforms[i] );
-      }
-      matrices = &sBoneTransforms[0];
-      PROFILE_END();
-   }
+   // Map to verts in renderer
+   U8 *altPtr = mRenderer->mapVerts(this, renderData);
+   if (altPtr) outPtr = altPtr;
+
+   skinVerts( rdata.smSkinBoneTransforms.address(), outPtr, mVertexData.vertSize() );
+
+   // Load verts
+   if (altPtr)
+      mRenderer->unmapVerts(this, renderData);
+}
+
+void TSSkinMesh::updateSkin( const TSMeshVertexArray &skinnedVerts, TSRenderState &rdata )
+{
+   PROFILE_SCOPE( TSSkinMesh_UpdateSkinFromInstance );
+
+   if (TSShape::smUseHardwareSkinning)
+      return;
+
+   AssertFatal( skinnedVerts.size() == mVertexData.size() && skinnedVerts.vertSize() == mVertexData.vertSize(),
+      "TSSkinMesh::updateSkin - skinned vertex data does not match this mesh!" );
+
+   TSMeshInstanceRenderData *renderData = rdata.getCurrentRenderData();
+
+   U8 *outPtr = reinterpret_cast<U8 *>(mVertexData.address());
+   U8 *altPtr = mRenderer->mapVerts(this, renderData);
+   if (altPtr) outPtr = altPtr;
+
+   dMemcpy( outPtr, skinnedVerts.address(), skinnedVerts.mem_size() );
+
+   if (altPtr)
+      mRenderer->unmapVerts(this, renderData);
+}
+
+void TSSkinMesh::initSkinnedVerts( TSMeshVertexArray &dest )
+{
+   AssertFatal( mVertexData.isReady(), "TSSkinMesh::initSkinnedVerts - call convertToAlignedMeshData() first!" );
+
+   if ( dest.isReady() && dest.size() == mVertexData.size() && dest.vertSize() == mVertexData.vertSize() )
+      return;
+
+   // Copy everything so attributes which are not skinned (uvs, colors
+   // and bone data) are already in place
+   void *aligned_mem = dMalloc_aligned( mVertexData.mem_size(), 16 );
+   dMemcpy( aligned_mem, mVertexData.address(), mVertexData.mem_size() );
+
+   dest.set( aligned_mem, mVertexData.vertSize(), mVertexData.size(), mVertexData.getColorOffset(), mVertexData.getBoneOffset() );
+   dest.setReady( true );
+}
+
+void TSSkinMesh::skinVerts( const MatrixF *boneTransforms, U8 *outPtr, dsize_t outStride )
+{
+   PROFILE_SCOPE( TSSkinMesh_SkinVerts );
+
+   AssertFatal(batchDataInitialized, "Batch data not initialized. Call createBatchData() before any skin update is called.");
 
    // Perform skinning
    const bool bBatchByVert = !batchData.vertexBatchOperations.empty();
-   if(bBatchByVert)
+   if(batchData.soaVerts.numVerts > 0)
+   {
+      // Each vertex is written once, so there is nothing to clear first
+      m_matF_x_SoAVertexStream(boneTransforms, batchData.soaVerts, outPtr, outStride);
+   }
+   else if(bBatchByVert)
    {
       const Point3F *inVerts = &batchData.initialVerts[0];
       const Point3F *inNorms = &batchData.initialNorms[0];
@@ -1183,10 +1207,6 @@ void TSSkinMesh::updateSkin( const Vector<MatrixF> &transforms, TSRenderState &r
 
       register Point3F skinnedVert;
       register Point3F skinnedNorm;
-      
-      // If using hardware skinning, don't update (data is set in createBatchData)
-      if (TSShape::smUseHardwareSkinning)
-         return;
 
       for( Vector<BatchData::BatchedVertex>::const_iterator itr = batchData.vertexBatchOperations.begin();
          itr != batchData.vertexBatchOperations.end(); itr++ )
@@ -1200,7 +1220,7 @@ void TSSkinMesh::updateSkin( const Vector<MatrixF> &transforms, TSRenderState &r
          {      
             const BatchData::TransformOp &transformOp = curVert.transform[tOp];
 
-            const MatrixF& deltaTransform = matrices[transformOp.transformIndex];
+            const MatrixF& deltaTransform = boneTransforms[transformOp.transformIndex];
 
             deltaTransform.mulP( inVerts[curVert.vertexIndex], &srcVtx );
             skinnedVert += ( srcVtx * transformOp.weight );
@@ -1210,20 +1230,13 @@ void TSSkinMesh::updateSkin( const Vector<MatrixF> &transforms, TSRenderState &r
          }
 
          // Assign results 
-         __TSMeshVertexBase &dest = mVertexData.getBase(curVert.vertexIndex);
+         __TSMeshVertexBase &dest = *reinterpret_cast<__TSMeshVertexBase *>(outPtr + curVert.vertexIndex * outStride);
          dest.vert(skinnedVert);
          dest.normal(skinnedNorm);
       }
    }
    else // Batch by transform
    {
-      U8 *outPtr = reinterpret_cast<U8 *>(mVertexData.address());
-      dsize_t outStride = mVertexData.vertSize();
-      
-      // Map to verts in renderer
-      U8 *altPtr = mRenderer->mapVerts(this, renderData);
-      if (altPtr) outPtr = altPtr;
-      
       // Set position/normal to zero so we can accumulate
       zero_vert_normal_bulk(mNumVerts, outPtr, outStride);
 
@@ -1233,17 +1246,13 @@ void TSSkinMesh::updateSkin( const Vector<MatrixF> &transforms, TSRenderState &r
       {
          const S32 boneXfmIdx = *itr;
          const BatchData::BatchedTransform &curTransform = *batchData.transformBatchOperations.retreive(boneXfmIdx);
-         const MatrixF &curBoneMat = matrices[boneXfmIdx];
+         const MatrixF &curBoneMat = boneTransforms[boneXfmIdx];
          const S32 numVerts = curTransform.numElements;
 
          // Bulk transform points/normals by this transform
          m_matF_x_BatchedVertWeightList(curBoneMat, numVerts, curTransform.alignedMem,
             outPtr, outStride);
       }
-      
-      // Load verts
-      if (altPtr)
-         mRenderer->unmapVerts(this, renderData);
    }
 }
 
@@ -1271,6 +1280,10 @@ void TSSkinMesh::createBatchData()
 
    bool issuedWeightWarning = false;
 
+   // GPU skinning and the SoA path both have a fixed number of influences per vertex
+   const bool limitToGPUBones = TSShape::smAllowHardwareSkinning || TSShape::smUseSoASkinning;
+   const S32 maxBones = limitToGPUBones ? TSSkinMesh::BatchData::maxBonePerVertGPU : TSSkinMesh::BatchData::maxBonePerVert;
+
    // Build the batch operations
    while( curVtx != endVtx )
    {
@@ -1295,14 +1308,13 @@ void TSSkinMesh::createBatchData()
          S32 opIdx = batchOperations.last().transformCount++;
 
          // Limit the number of weights per bone (keep the N largest influences)
-         if ( opIdx >= TSSkinMesh::BatchData::maxBonePerVert || (TSShape::smAllowHardwareSkinning && opIdx >= TSSkinMesh::BatchData::maxBonePerVertGPU)  )
+         if ( opIdx >= maxBones )
          {
             if ( !issuedWeightWarning )
             {
                issuedWeightWarning = true;
                Log::warnf( "At least one vertex has too many bone weights - limiting "
-                  "to the largest %d influences (see maxBonePerVert in tsMesh.h).",
-                          TSShape::smAllowHardwareSkinning ? TSSkinMesh::BatchData::maxBonePerVertGPU : TSSkinMesh::BatchData::maxBonePerVert );
+                  "to the largest %d influences (see maxBonePerVert in tsMesh.h).", maxBones );
             }
 
             // Too many weights => find and replace the smallest one
@@ -1318,7 +1330,7 @@ void TSSkinMesh::createBatchData()
             }
 
             opIdx = minIndex;
-            batchOperations.last().transformCount = TSSkinMesh::BatchData::maxBonePerVert;
+            batchOperations.last().transformCount = maxBones;
          }
 
          batchOperations.last().transform[opIdx].transformIndex = midx;
@@ -1356,6 +1368,9 @@ void TSSkinMesh::createBatchData()
       }
    }
 
+   if (TSShape::smUseSoASkinning)
+      createSoABatchData( batchOperations );
+
    if (TSShape::smAllowHardwareSkinning)
    {
       // Copy data to member, and be done
@@ -1418,7 +1433,7 @@ void TSSkinMesh::createBatchData()
          v.weight(weights);
       }
    }
-   else
+   else if (!TSShape::smUseSoASkinning)
    {
       // Convert to batch-by-transform, which is better for CPU skinning,
       // where-as GPU skinning would data for batch-by-vertex operation
@@ -1480,6 +1495,125 @@ void TSSkinMesh::createBatchData()
    }
 }
 
+void TSSkinMesh::createSoABatchData( const Vector<BatchData::BatchedVertex> &batchOperations )
+{
+   if ( batchOperations.empty() )
+      return;
+
+   BatchData::SoAVertexStream &stream = batchData.soaVerts;
+   stream.alloc( batchOperations.size() );
+
+   // Group vertices by influence count, most first, otherwise keeping their
+   // order. The kernels skip influences no vertex in a group uses, which
+   // then only happens at the boundaries between counts.
+   Vector<S32> order;
+   order.reserve( batchOperations.size() );
+   for ( S32 count = BatchData::maxBonePerVertGPU; count >= 0; count-- )
+   {
+      for ( S32 i = 0; i < batchOperations.size(); i++ )
+      {
+         if ( batchOperations[i].transformCount == count )
+            order.push_back( i );
+      }
+   }
+   AssertFatal( order.size() == batchOperations.size(), "TSSkinMesh::createSoABatchData - too many influences!" );
+
+   for ( S32 i = 0; i < order.size(); i++ )
+   {
+      const BatchData::BatchedVertex &batchOp = batchOperations[order[i]];
+      const Point3F &vert = batchData.initialVerts[batchOp.vertexIndex];
+      const Point3F &norm = batchData.initialNorms[batchOp.vertexIndex];
+
+      stream.vertX[i] = vert.x;
+      stream.vertY[i] = vert.y;
+      stream.vertZ[i] = vert.z;
+      stream.normX[i] = norm.x;
+      stream.normY[i] = norm.y;
+      stream.normZ[i] = norm.z;
+      stream.vertexIndex[i] = batchOp.vertexIndex;
+
+      for ( S32 j = 0; j < batchOp.transformCount; j++ )
+      {
+         stream.bone[j][i] = batchOp.transform[j].transformIndex;
+         stream.weight[j][i] = batchOp.transform[j].weight;
+      }
+
+      // Unused influences repeat the previous vertex's bone so the SIMD
+      // kernels see as many groups sharing a single bone as possible
+      for ( S32 j = batchOp.transformCount; j < BatchData::maxBonePerVertGPU && i > 0; j++ )
+         stream.bone[j][i] = stream.bone[j][i-1];
+
+      stream.numBones = getMax( stream.numBones, (U32)batchOp.transformCount );
+   }
+
+   // Same for the padding at the end of the last group
+   for ( dsize_t i = batchOperations.size(); i % BatchData::soaGroupSize; i++ )
+   {
+      for ( S32 j = 0; j < BatchData::maxBonePerVertGPU; j++ )
+         stream.bone[j][i] = stream.bone[j][i-1];
+   }
+}
+
+TSSkinMesh::BatchData::SoAVertexStream::SoAVertexStream() : mMem( NULL )
+{
+   free();
+}
+
+TSSkinMesh::BatchData::SoAVertexStream::~SoAVertexStream()
+{
+   free();
+}
+
+void TSSkinMesh::BatchData::SoAVertexStream::alloc( dsize_t count )
+{
+   free();
+
+   // Every array has the same padded length, and all elements are 4 bytes
+   const dsize_t paddedCount = ( count + soaGroupSize - 1 ) & ~( dsize_t )( soaGroupSize - 1 );
+   const dsize_t numArrays = 7 + maxBonePerVertGPU * 2;
+   const dsize_t arraySize = paddedCount * sizeof( F32 );
+
+   mMem = dMalloc_aligned( numArrays * arraySize, 32 );
+   AssertFatal( mMem, "Aligned malloc failed! Debug!" );
+   dMemset( mMem, 0, numArrays * arraySize );
+
+   U8 *mem = reinterpret_cast<U8 *>( mMem );
+   vertX = reinterpret_cast<F32 *>( mem ); mem += arraySize;
+   vertY = reinterpret_cast<F32 *>( mem ); mem += arraySize;
+   vertZ = reinterpret_cast<F32 *>( mem ); mem += arraySize;
+   normX = reinterpret_cast<F32 *>( mem ); mem += arraySize;
+   normY = reinterpret_cast<F32 *>( mem ); mem += arraySize;
+   normZ = reinterpret_cast<F32 *>( mem ); mem += arraySize;
+   vertexIndex = reinterpret_cast<S32 *>( mem ); mem += arraySize;
+
+   for ( S32 i = 0; i < maxBonePerVertGPU; i++ )
+   {
+      bone[i] = reinterpret_cast<S32 *>( mem ); mem += arraySize;
+      weight[i] = reinterpret_cast<F32 *>( mem ); mem += arraySize;
+   }
+
+   numVerts = count;
+   numBones = 0;
+}
+
+void TSSkinMesh::BatchData::SoAVertexStream::free()
+{
+   if ( mMem )
+      dFree_aligned( mMem );
+   mMem = NULL;
+
+   numVerts = 0;
+   numBones = 0;
+   vertX = vertY = vertZ = NULL;
+   normX = normY = normZ = NULL;
+   vertexIndex = NULL;
+   for ( S32 i = 0; i < maxBonePerVertGPU; i++ )
+   {
+      bone[i] = NULL;
+      weight[i] = NULL;
+   }
+}
+
 void TSSkinMesh::render( TSMeshRenderer &renderer )
 {
    innerRender( renderer );
@@ -1520,30 +1654,82 @@ void TSSkinMesh::render(   TSMaterialList *materials,
    innerRender( materials, rdata, renderer );
 }
 
-bool TSSkinMesh::buildPolyList( S32 frame, AbstractPolyList *polyList, U32 &surfaceKey, TSMaterialList *materials )
+void TSSkinMesh::render(   TSMaterialList *materials, 
+                           TSRenderState &rdata,
+                           const TSMeshVertexArray &skinnedVerts,
+                           TSMeshRenderer &renderer )
 {
-   // UpdateSkin() here may not be needed... 
-   // we don't capture skinned 
-   // verts in the polylist.
-   
-   // update verts and normals...
-   //if( !smGlowPass && !smRefractPass ) 
-   // updateSkin();
+   PROFILE_SCOPE(TSSkinMesh_renderSkinned);
+
+   if( mNumVerts == 0 )
+      return;
+
+   AssertFatal( mVertexData.isReady() && batchDataInitialized, "TSSkinMesh::render - mesh was not prepared by initSkinnedVerts()!" );
+
+   // Upload the vertices skinned for this instance
+   updateSkin( skinnedVerts, rdata );
+   _createVBIB(rdata.getCurrentRenderData());
 
    // render...
-   //Parent::buildPolyList( frame,polyList,surfaceKey, materials );
-   return false;
+   innerRender( materials, rdata, renderer );
+}
+
+bool TSSkinMesh::buildPolyList( S32 frame, AbstractPolyList *polyList, U32 &surfaceKey, TSMaterialList *materials )
+{
+   const U8 *bindVerts;
+   dsize_t stride;
+   if ( !getFrameVerts( frame, bindVerts, stride ) )
+      return false;
+
+   return addPolys( bindVerts, stride, polyList, surfaceKey, materials );
 }
 
 bool TSSkinMesh::castRay( S32 frame, const Point3F &start, const Point3F &end, RayInfo *rayInfo, TSMaterialList *materials )
 {
-   LIBDTSHAPE_UNUSED(frame);
-   LIBDTSHAPE_UNUSED(start);
-   LIBDTSHAPE_UNUSED(end);
-   LIBDTSHAPE_UNUSED(rayInfo);
-   LIBDTSHAPE_UNUSED(materials);
+   // Uses the bind pose, see castRaySkinned() for the animated mesh
+   return Parent::castRay( frame, start, end, rayInfo, materials );
+}
 
-   return false;
+bool TSSkinMesh::getFrameVerts( S32 frame, const U8 *&outVerts, dsize_t &stride ) const
+{
+   // Skins only have one frame, and mVertexData may hold skinned vertices
+   if ( frame != 0 || batchData.initialVerts.size() != vertsPerFrame )
+      return false;
+
+   stride = sizeof( Point3F );
+   outVerts = reinterpret_cast<const U8 *>( batchData.initialVerts.address() );
+   return true;
+}
+
+bool TSSkinMesh::refitRayBVH( const TSMeshVertexArray &skinnedVerts, Vector<TSMeshBVH::Node> &nodes )
+{
+   PROFILE_SCOPE( TSSkinMesh_RefitRayBVH );
+
+   TSMeshBVH *bvh = getRayBVH( 0 );
+   if ( !bvh || skinnedVerts.size() != vertsPerFrame )
+      return false;
+
+   bvh->refit( reinterpret_cast<const U8 *>( skinnedVerts.address() ), skinnedVerts.vertSize(), nodes );
+   return true;
+}
+
+bool TSSkinMesh::castRaySkinned( const TSMeshVertexArray &skinnedVerts, const Vector<TSMeshBVH::Node> &nodes,
+                                 const Point3F &start, const Point3F &end, RayInfo *rayInfo, TSMaterialList *materials )
+{
+   TSMeshBVH *bvh = getRayBVH( 0 );
+   if ( !bvh || nodes.size() != bvh->getNumNodes() )
+      return false;
+
+   return castRayBVH( bvh, nodes.address(), reinterpret_cast<const U8 *>( skinnedVerts.address() ), skinnedVerts.vertSize(),
+                      start, end, rayInfo, materials );
+}
+
+bool TSSkinMesh::buildPolyListSkinned( const TSMeshVertexArray &skinnedVerts, AbstractPolyList *polyList, U32 &surfaceKey, TSMaterialList *materials )
+{
+   if ( skinnedVerts.size() != vertsPerFrame )
+      return false;
+
+   return addPolys( reinterpret_cast<const U8 *>( skinnedVerts.address() ), skinnedVerts.vertSize(), polyList, surfaceKey, materials );
 }
 
 bool TSSkinMesh::buildConvexHull()
@@ -1847,6 +2033,115 @@ U8 TSMesh::encodeNormal( const Point3F &normal )
    return bestIndex;
 }
 
+U16 TSMesh::packHalf( F32 value )
+{
+   U32 bits;
+   dMemcpy( &bits, &value, sizeof(bits) );
+
+   const U32 sign = ( bits >> 16 ) & 0x8000;
+   const U32 mantissa = bits & 0x7FFFFF;
+   const S32 exponent = (S32)( ( bits >> 23 ) & 0xFF ) - 127 + 15;
+
+   // infinity and nan
+   if ( ( ( bits >> 23 ) & 0xFF ) == 0xFF )
+      return sign | 0x7C00 | ( mantissa ? 0x200 : 0 );
+
+   // too large, clamp to infinity
+   if ( exponent >= 31 )
+      return sign | 0x7C00;
+
+   // denormal or zero, rounded to nearest even
+   if ( exponent <= 0 )
+   {
+      if ( exponent < -10 )
+         return sign;
+
+      const U32 m = mantissa | 0x800000;
+      const U32 shift = 14 - exponent;
+      const U32 rem = m & ( ( 1 << shift ) - 1 );
+      const U32 mid = 1 << ( shift - 1 );
+      U32 half = m >> shift;
+      if ( rem > mid || ( rem == mid && ( half & 1 ) ) )
+         half++;
+      return sign | half;
+   }
+
+   // rounding may carry into the exponent, which is still correct
+   U32 half = ( exponent << 10 ) | ( mantissa >> 13 );
+   const U32 rem = mantissa & 0x1FFF;
+   if ( rem > 0x1000 || ( rem == 0x1000 && ( half & 1 ) ) )
+      half++;
+   return sign | half;
+}
+
+F32 TSMesh::unpackHalf( U16 value )
+{
+   const U32 sign = ( value & 0x8000 ) << 16;
+   S32 exponent = ( value >> 10 ) & 0x1F;
+   U32 mantissa = value & 0x3FF;
+   U32 bits;
+
+   if ( exponent == 0 )
+   {
+      if ( mantissa == 0 )
+         bits = sign;
+      else
+      {
+         // normalize the denormal
+         exponent = 1;
+         while ( !( mantissa & 0x400 ) )
+         {
+            mantissa <<= 1;
+            exponent--;
+         }
+         bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( ( mantissa & 0x3FF ) << 13 );
+      }
+   }
+   else if ( exponent == 31 )
+      bits = sign | 0x7F800000 | ( mantissa << 13 );
+   else
+      bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+
+   F32 result;
+   dMemcpy( &result, &bits, sizeof(result) );
+   return result;
+}
+
+// Octahedral normals project the unit sphere onto an octahedron, and unfold
+// the lower half over the corners of the upper half to fill a square.
+void TSMesh::encodeOctNormal( const Point3F &normal, S16 *out )
+{
+   const F32 l1 = mFabs( normal.x ) + mFabs( normal.y ) + mFabs( normal.z );
+   F32 x = l1 > 0.0f ? normal.x / l1 : 0.0f;
+   F32 y = l1 > 0.0f ? normal.y / l1 : 0.0f;
+
+   if ( normal.z < 0.0f )
+   {
+      const F32 ox = x;
+      x = ( 1.0f - mFabs( y ) ) * ( ox >= 0.0f ? 1.0f : -1.0f );
+      y = ( 1.0f - mFabs( ox ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+   }
+
+   out[0] = packSnorm16( x );
+   out[1] = packSnorm16( y );
+}
+
+Point3F TSMesh::decodeOctNormal( const S16 *in )
+{
+   Point3F n( unpackSnorm16( in[0] ), unpackSnorm16( in[1] ), 0.0f );
+   n.z = 1.0f - mFabs( n.x ) - mFabs( n.y );
+
+   if ( n.z < 0.0f )
+   {
+      const F32 ox = n.x;
+      n.x = ( 1.0f - mFabs( n.y ) ) * ( ox >= 0.0f ? 1.0f : -1.0f );
+      n.y = ( 1.0f - mFabs( ox ) ) * ( n.y >= 0.0f ? 1.0f : -1.0f );
+   }
+
+   n.normalizeSafe();
+   return n;
+}
+
 //-----------------------------------------------------
 // TSMesh assemble from/ dissemble to memory buffer
 //-----------------------------------------------------
@@ -1855,11 +2150,6 @@ U8 TSMesh::encodeNormal( const Point3F &normal )
 
 TSMesh* TSMesh::assembleMesh( TSIOState &ioState, U32 meshType, bool skip )
 {
-   static TSMesh tempStandardMesh;
-   static TSSkinMesh tempSkinMesh;
-   static TSDecalMesh tempDecalMesh;
-   static TSSortedMesh tempSortedMesh;
-
    bool justSize = skip || !tsalloc.allocShape32(0); // if this returns NULL, we're just sizing memory block
 
    // a little funny business because we pretend decals are derived from meshes
@@ -1873,29 +2163,37 @@ TSMesh* TSMesh::assembleMesh( TSIOState &ioState, U32 meshType, bool skip )
       {
          case StandardMeshType :
          {
-            ret = (S32*)&tempStandardMesh;
-            mesh = &tempStandardMesh;
+            if ( !ioState.smSizeStandardMesh )
+               ioState.smSizeStandardMesh = new TSMesh;
+            ret = (S32*)ioState.smSizeStandardMesh;
+            mesh = ioState.smSizeStandardMesh;
             tsalloc.allocShape32( sizeof(TSMesh) >> 2 );
             break;
          }
          case SkinMeshType     :
          {
-            ret = (S32*)&tempSkinMesh;
-            mesh = &tempSkinMesh;
+            if ( !ioState.smSizeSkinMesh )
+               ioState.smSizeSkinMesh = new TSSkinMesh;
+            ret = (S32*)ioState.smSizeSkinMesh;
+            mesh = ioState.smSizeSkinMesh;
             tsalloc.allocShape32( sizeof(TSSkinMesh) >> 2 );
             break;
          }
          case DecalMeshType    :
          {
-            ret = (S32*)&tempDecalMesh;
-            decal = &tempDecalMesh;
+            if ( !ioState.smSizeDecalMesh )
+               ioState.smSizeDecalMesh = new TSDecalMesh;
+            ret = (S32*)ioState.smSizeDecalMesh;
+            decal = ioState.smSizeDecalMesh;
             tsalloc.allocShape32( sizeof(TSDecalMesh) >> 2 );
             break;
          }
          case SortedMeshType   :
          {
-            ret = (S32*)&tempSortedMesh;
-            mesh = &tempSortedMesh;
+            if ( !ioState.smSizeSortedMesh )
+               ioState.smSizeSortedMesh = new TSSortedMesh;
+            ret = (S32*)ioState.smSizeSortedMesh;
+            mesh = ioState.smSizeSortedMesh;
             tsalloc.allocShape32( sizeof(TSSortedMesh) >> 2 );
             break;
          }
@@ -2549,7 +2847,7 @@ void TSMesh::assemble( TSIOState &ioState, bool skip )
    if ( tsalloc.allocShape32( 0 ) && ioState.smReadVersion < 19 )
       computeBounds(); // only do this if we copied the data...
 
-   if(getMeshType() != SkinMeshType)
+   if(getMeshType() != SkinMeshType && !(ioState.smSharedVertexData && getMeshType() == StandardMeshType))
       createTangents(verts, norms);
 }
 
@@ -2635,22 +2933,7 @@ void TSMesh::disassemble(TSIOState &ioState)
    }
 
    // optimize triangle draw order during disassemble
-   {
-      TempAlloc<TriListOpt::IndexType> tmpIdxs(indices.size());
-      for ( S32 i = 0; i < primitives.size(); i++ )
-      {
-         const TSDrawPrimitive& prim = primitives[i];
-
-         // only optimize triangle lists (strips and fans are assumed to be already optimized)
-         if ( (prim.matIndex & TSDrawPrimitive::TypeMask) == TSDrawPrimitive::Triangles )
-         {
-            TriListOpt::OptimizeTriangleOrdering(verts.size(), prim.numElements,
-               indices.address() + prim.start, tmpIdxs.ptr);
-            dCopyArray(indices.address() + prim.start, tmpIdxs.ptr,
-               prim.numElements);
-         }
-      }
-   }
+   optimizeTriangleOrder();
 
    if (ioState.smVersion > 25)
    {
@@ -2819,6 +3102,128 @@ TSSkinMesh::TSSkinMesh()
    batchDataInitialized = false;
 }
 
+//-----------------------------------------------------------------------------
+// vertex cache optimization
+//-----------------------------------------------------------------------------
+void TSMesh::optimizeTriangleOrder()
+{
+   PROFILE_SCOPE( TSMesh_OptimizeTriangleOrder );
+
+   clearRayBVH();
+
+   for ( S32 i = 0; i < primitives.size(); i++ )
+   {
+      const TSDrawPrimitive& prim = primitives[i];
+
+      // only optimize triangle lists (strips and fans are assumed to be already optimized)
+      if ( (prim.matIndex & TSDrawPrimitive::TypeMask) != TSDrawPrimitive::Triangles )
+         continue;
+
+      // indices may be optimized in place
+      U32 *primIndices = indices.address() + prim.start;
+      U32 numVerts = 0;
+      for ( S32 j = 0; j < prim.numElements; j++ )
+         numVerts = getMax( numVerts, primIndices[j] + 1 );
+
+      TriListOpt::OptimizeTriangleOrdering( numVerts, prim.numElements, primIndices, primIndices );
+   }
+}
+
+F32 TSMesh::getACMR( U32 cacheSize ) const
+{
+   F32 misses = 0.0f;
+   U32 numTris = 0;
+
+   for ( S32 i = 0; i < primitives.size(); i++ )
+   {
+      const TSDrawPrimitive& prim = primitives[i];
+      if ( (prim.matIndex & TSDrawPrimitive::TypeMask) != TSDrawPrimitive::Triangles )
+         continue;
+
+      const U32 *primIndices = indices.address() + prim.start;
+      U32 numVerts = 0;
+      for ( S32 j = 0; j < prim.numElements; j++ )
+         numVerts = getMax( numVerts, primIndices[j] + 1 );
+
+      const U32 primTris = prim.numElements / 3;
+      misses += TriListOpt::CalcACMR( numVerts, prim.numElements, primIndices, cacheSize ) * primTris;
+      numTris += primTris;
+   }
+
+   return numTris ? misses / numTris : 0.0f;
+}
+
+bool TSMesh::optimizeVertexOrder()
+{
+   return _optimizeVertexOrder( verts.size() );
+}
+
+bool TSSkinMesh::optimizeVertexOrder()
+{
+   // batch operations refer to vertices by index
+   if ( batchDataInitialized )
+      return false;
+
+   return _optimizeVertexOrder( batchData.initialVerts.size() );
+}
+
+bool TSMesh::_optimizeVertexOrder( U32 numVerts )
+{
+   // other meshes index our vertices through parentMesh, and the aligned
+   // data has already been built from them
+   if ( parentMesh >= 0 || numFrames > 1 || numMatFrames > 1 || numVerts == 0 || mVertexData.isReady() )
+      return false;
+
+   PROFILE_SCOPE( TSMesh_OptimizeVertexOrder );
+
+   TempAlloc<U32> remap( numVerts );
+   TriListOpt::OptimizeVertexFetch( numVerts, indices.size(), indices.address(), remap.ptr );
+   _remapVertices( remap.ptr, numVerts );
+
+   return true;
+}
+
+/// Moves element i of array to remap[i], if array has one element per vertex
+template< class T >
+static void _remapVertexArray( Vector<T> &array, const U32 *remap, U32 numVerts )
+{
+   if ( array.size() != numVerts )
+      return;
+
+   TempAlloc<T> source( numVerts );
+   dCopyArray( source.ptr, array.address(), numVerts );
+   for ( U32 i = 0; i < numVerts; i++ )
+      array[remap[i]] = source[i];
+}
+
+void TSMesh::_remapVertices( const U32 *remap, U32 numVerts )
+{
+   clearRayBVH();
+
+   _remapVertexArray( verts, remap, numVerts );
+   _remapVertexArray( norms, remap, numVerts );
+   _remapVertexArray( tverts, remap, numVerts );
+   _remapVertexArray( tverts2, remap, numVerts );
+   _remapVertexArray( colors, remap, numVerts );
+   _remapVertexArray( tangents, remap, numVerts );
+   _remapVertexArray( encodedNorms, remap, numVerts );
+}
+
+void TSSkinMesh::_remapVertices( const U32 *remap, U32 numVerts )
+{
+   Parent::_remapVertices( remap, numVerts );
+
+   _remapVertexArray( batchData.initialVerts, remap, numVerts );
+   _remapVertexArray( batchData.initialNorms, remap, numVerts );
+
+   // weights stay grouped by vertex, only the vertex they apply to moves
+   for ( S32 i = 0; i < vertexIndex.size(); i++ )
+   {
+      if ( vertexIndex[i] >= 0 )
+         vertexIndex[i] = remap[vertexIndex[i]];
+   }
+}
+
 //-----------------------------------------------------------------------------
 // find tangent vector
 //-----------------------------------------------------------------------------
@@ -3023,6 +3428,10 @@ void TSMesh::_convertToAlignedMeshData( TSMeshVertexArray &vertexData, const Vec
 
 
    AssertFatal(!vertexData.isReady(), "Mesh already converted to aligned data! Re-check code!");
+
+   // The hierarchies were built from the unaligned verts
+   if ( &vertexData == &mVertexData )
+      clearRayBVH();
    AssertFatal(_verts.size() == _norms.size() &&
                _verts.size() == tangents.size(), 
                "Vectors: verts, norms, tangents must all be the same size");
@@ -3086,6 +3495,78 @@ void TSMesh::_convertToAlignedMeshData( TSMeshVertexArray &vertexData, const Vec
    colors.free_memory();
 }
 
+void TSMesh::packVertexData( const GFXVertexFormat *format, U32 vertSize )
+{
+   clearPackedVertexData();
+
+   if ( !mVertexData.isReady() || mNumVerts == 0 )
+      return;
+
+   PROFILE_SCOPE( TSMesh_PackVertexData );
+
+   // Positions are stored relative to the box around every frame's vertices
+   Box3F box( mVertexData.getBase(0).vert(), mVertexData.getBase(0).vert() );
+   for ( U32 i = 1; i < mNumVerts; i++ )
+      box.extend( mVertexData.getBase(i).vert() );
+
+   box.getCenter( &mPackedPosBias );
+   mPackedPosScale = ( box.maxExtents - box.minExtents ) * 0.5f;
+   for ( U32 j = 0; j < 3; j++ )
+   {
+      if ( mPackedPosScale[j] <= 0.0f )
+         mPackedPosScale[j] = 1.0f;
+   }
+
+   const Point3F invScale( 1.0f / mPackedPosScale.x, 1.0f / mPackedPosScale.y, 1.0f / mPackedPosScale.z );
+   const bool hasColor = mVertexData.getColorOffset() != 0;
+   const bool packColor = vertSize >= sizeof(__TSMeshPackedVertex_UVColor);
+
+   mPackedVertexData.setSize( mNumVerts * vertSize );
+   dMemset( mPackedVertexData.address(), 0, mPackedVertexData.size() );
+
+   for ( U32 i = 0; i < mNumVerts; i++ )
+   {
+      const __TSMeshVertexBase &src = mVertexData.getBase(i);
+      __TSMeshPackedVertex &dst = *reinterpret_cast<__TSMeshPackedVertex *>( mPackedVertexData.address() + i * vertSize );
+
+      Point3F p = src.vert() - mPackedPosBias;
+      p.convolve( invScale );
+      dst._vert[0] = packSnorm16( p.x );
+      dst._vert[1] = packSnorm16( p.y );
+      dst._vert[2] = packSnorm16( p.z );
+      dst._vert[3] = 32767;
+
+      encodeOctNormal( src.normal(), dst._normal );
+      encodeOctNormal( src._tangent, dst._tangent );
+      dst._tangent[2] = packSnorm16( src._tangentW );
+
+      dst._tvert[0] = packHalf( src.tvert().x );
+      dst._tvert[1] = packHalf( src.tvert().y );
+
+      if ( packColor && hasColor )
+      {
+         const __TSMeshVertex_3xUVColor &srcColor = mVertexData.getColor(i);
+         __TSMeshPackedVertex_UVColor &dstColor = static_cast<__TSMeshPackedVertex_UVColor &>( dst );
+         dstColor._tvert2[0] = packHalf( srcColor._tvert2.x );
+         dstColor._tvert2[1] = packHalf( srcColor._tvert2.y );
+         dstColor._color = srcColor._color;
+      }
+   }
+
+   mPackedVertexFormat = format;
+   mPackedVertSize = vertSize;
+}
+
+void TSMesh::clearPackedVertexData()
+{
+   mPackedVertexFormat = NULL;
+   mPackedVertSize = 0;
+   mPackedPosScale.set( 1.0f, 1.0f, 1.0f );
+   mPackedPosBias.set( 0.0f, 0.0f, 0.0f );
+   mPackedVertexData.clear();
+   mPackedVertexData.compact();
+}
+
 //-----------------------------------------------------------------------------
 
 END_NS
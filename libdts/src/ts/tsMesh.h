@@ -45,6 +45,12 @@
 #ifndef _TSRENDER_H_
 #include "ts/tsRender.h"
 #endif
+#ifndef _TSMESHBVH_H_
+#include "ts/tsMeshBVH.h"
+#endif
+#ifndef _TRI_LIST_OPT_H_
+#include "core/util/triListOpt.h"
+#endif
 
 #include "core/util/safeDelete.h"
 
@@ -115,6 +121,10 @@ protected:
    void _convertToAlignedMeshData( TSMeshVertexArray &vertexData, const Vector<Point3F> &_verts, const Vector<Point3F> &_norms );
    void _createVBIB( TSMeshInstanceRenderData *meshRenderData = NULL );
 
+   /// Used by optimizeVertexOrder()
+   bool _optimizeVertexOrder( U32 numVerts );
+   virtual void _remapVertices( const U32 *remap, U32 numVerts );
+
   public:
 
    enum
@@ -200,6 +210,21 @@ protected:
       const Point4F &weight() const { return _weights; }
       void weight(const Point4F &w) { _weights = w; }
    };
+
+   /// Vertex of the packed vertex data, see packVertexData()
+   struct __TSMeshPackedVertex
+   {
+      S16 _vert[4];     ///< snorm16 within the packed bounds, w is 1
+      S16 _normal[2];   ///< octahedral
+      S16 _tangent[4];  ///< octahedral xy, z is the tangent w
+      U16 _tvert[2];    ///< half floats
+   };
+
+   struct __TSMeshPackedVertex_UVColor : public __TSMeshPackedVertex
+   {
+      U16 _tvert2[2];
+      TSVertexColor _color;
+   };
    
 #pragma pack()
    
@@ -267,6 +292,31 @@ protected:
    virtual void convertToAlignedMeshData();
    /// @}
 
+   /// @name Packed Vertex Data
+   /// A compact copy of mVertexData for renderers to upload instead, built for
+   /// standard meshes when TSShape::smPackVertices is set. mVertexData is kept
+   /// as it is for collision and the other CPU side users.
+   /// @{
+
+   const GFXVertexFormat *mPackedVertexFormat;  ///< NULL unless the mesh has packed data
+   U32 mPackedVertSize;
+   Point3F mPackedPosScale;   ///< position = packed position * mPackedPosScale + mPackedPosBias
+   Point3F mPackedPosBias;
+   Vector<U8> mPackedVertexData;
+
+   /// Packs mVertexData into a format made by TSShape::initVertexFeatures
+   void packVertexData( const GFXVertexFormat *format, U32 vertSize );
+   void clearPackedVertexData();
+   bool hasPackedVertexData() const { return mPackedVertexFormat != NULL; }
+
+   static U16 packHalf( F32 value );
+   static F32 unpackHalf( U16 value );
+   static S16 packSnorm16( F32 value ) { return (S16)mFloor( mClampF( value, -1.0f, 1.0f ) * 32767.0f + 0.5f ); }
+   static F32 unpackSnorm16( S16 value ) { return getMax( value / 32767.0f, -1.0f ); }
+   static void encodeOctNormal( const Point3F &normal, S16 *out );
+   static Point3F decodeOctNormal( const S16 *in );
+   /// @}
+
    /// @name Vertex data
    /// @{
 
@@ -310,6 +360,23 @@ protected:
    U32 mergeBufferStart;
    /// @}
 
+   /// @name Ray Cast Data
+   /// @{
+
+   /// Per frame triangle hierarchies used by castRay() and castRayRendered()
+   Vector<TSMeshBVH*> mRayBVH;
+
+   /// Gets the vertex positions for a frame, as used by TSMeshBVH
+   virtual bool getFrameVerts( S32 frame, const U8 *&outVerts, dsize_t &stride ) const;
+
+   /// Triangle accurate ray cast against bvh, using node bounds which match verts
+   bool castRayBVH( const TSMeshBVH *bvh, const TSMeshBVH::Node *nodes, const U8 *verts, dsize_t stride,
+                    const Point3F &start, const Point3F &end, RayInfo *rayInfo, TSMaterialList *materials );
+
+   /// Adds every triangle to polyList, using vertex positions from verts
+   bool addPolys( const U8 *verts, dsize_t stride, AbstractPolyList *polyList, U32 &surfaceKey, TSMaterialList *materials );
+   /// @}
+
    /// @name Render Methods
    /// @{
 
@@ -343,6 +410,15 @@ protected:
    virtual bool castRayRendered( S32 frame, const Point3F & start, const Point3F & end, RayInfo * rayInfo, TSMaterialList* materials );
    virtual bool buildConvexHull(); ///< returns false if not convex (still builds planes)
    bool addToHull( U32 idx0, U32 idx1, U32 idx2 );
+
+   /// Returns the ray cast hierarchy for a frame, building it on first use.
+   /// Building is not thread safe, so call this for each frame in use before
+   /// casting rays against the mesh from several threads.
+   TSMeshBVH* getRayBVH( S32 frame );
+
+   /// Frees the ray cast hierarchies, which must be done whenever the
+   /// vertices, indices or primitives change.
+   void clearRayBVH();
    /// @}
 
    /// @name Bounding Methods
@@ -378,6 +454,25 @@ protected:
    /// Creates mRenderer
    void initRender();
 
+   /// @name Vertex Cache Optimization
+   /// @{
+
+   /// Reorders the triangles of each triangle list primitive for the
+   /// post-transform vertex cache.
+   void optimizeTriangleOrder();
+
+   /// Reorders the vertices into the order the triangles first use them,
+   /// for locality of vertex fetches, and remaps every per-vertex array.
+   /// Only done before the aligned vertex data is built, for meshes with a
+   /// single frame which don't share their vertices with another mesh.
+   /// @return false if the mesh was left as it was
+   virtual bool optimizeVertexOrder();
+
+   /// Average number of post-transform cache misses per triangle (ACMR)
+   /// over the triangle list primitives.
+   F32 getACMR( U32 cacheSize = TriListOpt::DefaultSizeFIFOCache ) const;
+   /// @}
+
    /// convert primitives on load...
    void convertToTris(const TSDrawPrimitive *primitivesIn, const S32 *indicesIn,
                       S32 numPrimIn, S32 & numPrimOut, S32 & numIndicesOut,
@@ -487,6 +582,47 @@ public:
       Vector<S32> transformKeys;
       /// @}
 
+      /// @name Batch by Vertex, Structure of Arrays
+      /// Used for software skinning when TSShape::smUseSoASkinning is set.
+      /// Each vertex is computed once from up to maxBonePerVertGPU influences,
+      /// several vertices at a time. Unused influences have a weight of 0, and
+      /// every array is padded to a multiple of soaGroupSize with zero weight
+      /// entries so a whole group can always be loaded. Vertices are ordered
+      /// by influence count, and written back through vertexIndex.
+      /// @{
+      enum
+      {
+         soaGroupSize = 8, ///< Widest group of vertices processed at once
+      };
+
+      struct SoAVertexStream
+      {
+         dsize_t numVerts;    ///< Number of vertices in the stream (excluding padding)
+         U32 numBones;        ///< Largest number of influences on any vertex
+
+         F32 *vertX, *vertY, *vertZ;
+         F32 *normX, *normY, *normZ;
+         S32 *bone[maxBonePerVertGPU];    ///< Index into the bone transforms
+         F32 *weight[maxBonePerVertGPU];
+         S32 *vertexIndex;    ///< Output vertex
+
+         SoAVertexStream();
+         ~SoAVertexStream();
+
+         /// Allocates all arrays for count vertices, zero filled
+         void alloc( dsize_t count );
+         void free();
+
+      protected:
+         void *mMem;
+
+      private:
+         SoAVertexStream( const SoAVertexStream & );
+         SoAVertexStream &operator=( const SoAVertexStream & );
+      };
+      SoAVertexStream soaVerts;
+      /// @}
+
       // # = num bones
       Vector<S32> nodeIndex;
       Vector<MatrixF> initialTransforms;
@@ -499,6 +635,9 @@ public:
    /// This method will build the batch operations and prepare the BatchData
    /// for use.
    void createBatchData();
+
+   /// Builds batchData.soaVerts from per-vertex batch operations
+   void createSoABatchData( const Vector<BatchData::BatchedVertex> &batchOperations );
    virtual void convertToAlignedMeshData();
 
 public:
@@ -519,6 +658,24 @@ public:
    /// set verts and normals...
    void updateSkin( const Vector<MatrixF> &transforms, TSRenderState &rdata );
 
+   /// set verts and normals from data previously skinned by skinVerts()
+   void updateSkin( const TSMeshVertexArray &skinnedVerts, TSRenderState &rdata );
+
+   /// @name Thread safe skinning
+   /// These only read from the shared mesh data, so different instances
+   /// of a mesh may be skinned concurrently as long as each has its own
+   /// output.  The mesh must already have its aligned vertex data and
+   /// batch data built.
+   /// @{
+
+   /// Allocates dest as a copy of mVertexData for use as skinVerts() output.
+   void initSkinnedVerts( TSMeshVertexArray &dest );
+
+   /// Skins verts and normals into outPtr using the bone transforms
+   /// generated by updateSkinBones().
+   void skinVerts( const MatrixF *boneTransforms, U8 *outPtr, dsize_t outStride );
+   /// @}
+
    // render methods..
    void render( TSMeshRenderer &renderer );
    void render(   TSMaterialList *, 
@@ -527,18 +684,49 @@ public:
                   const Vector<MatrixF> &transforms, 
                   TSMeshRenderer &renderer );
 
-   // collision methods...
+   /// Renders using vertex data already skinned for this instance
+   void render(   TSMaterialList *, 
+                  TSRenderState &data,
+                  const TSMeshVertexArray &skinnedVerts,
+                  TSMeshRenderer &renderer );
+
+   // collision methods (against the bind pose)...
    bool buildPolyList( S32 frame, AbstractPolyList *polyList, U32 &surfaceKey, TSMaterialList *materials );
    bool castRay( S32 frame, const Point3F &start, const Point3F &end, RayInfo *rayInfo, TSMaterialList *materials );
    bool buildConvexHull(); // does nothing, skins don't use this
 
+   /// Returns the bind pose vertices, which the ray cast hierarchy is built from
+   bool getFrameVerts( S32 frame, const U8 *&outVerts, dsize_t &stride ) const;
+
+   /// @name Skinned Collision
+   /// Collision against an instance's output from skinVerts().  The ray
+   /// cast hierarchy is shared with the bind pose, with only the node
+   /// bounds refit for each instance.
+   /// @{
+
+   /// Refits the ray cast hierarchy to skinnedVerts, storing the bounds in nodes
+   bool refitRayBVH( const TSMeshVertexArray &skinnedVerts, Vector<TSMeshBVH::Node> &nodes );
+
+   /// Casts a ray against skinnedVerts, using nodes from refitRayBVH()
+   bool castRaySkinned( const TSMeshVertexArray &skinnedVerts, const Vector<TSMeshBVH::Node> &nodes,
+                        const Point3F &start, const Point3F &end, RayInfo *rayInfo, TSMaterialList *materials );
+
+   bool buildPolyListSkinned( const TSMeshVertexArray &skinnedVerts, AbstractPolyList *polyList, U32 &surfaceKey, TSMaterialList *materials );
+   /// @}
+
    void computeBounds( const MatrixF &transform, Box3F &bounds, S32 frame, Point3F *center, F32 *radius );
 
+   /// Also remaps vertexIndex, only before createBatchData() is called
+   bool optimizeVertexOrder();
+
    /// persist methods...
    void assemble( TSIOState &loadState, bool skip );
    void disassemble( TSIOState &loadState );
 
    TSSkinMesh();
+
+protected:
+   void _remapVertices( const U32 *remap, U32 numVerts );
 };
 
 //-----------------------------------------------------------------------------
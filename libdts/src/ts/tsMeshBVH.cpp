@@ -0,0 +1,373 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "ts/tsMeshBVH.h"
+#include "math/mMathFn.h"
+#include "math/util/triRayCheck.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+namespace
+{
+   enum
+   {
+      NumBins = 16,  ///< Number of buckets used to estimate split cost
+   };
+
+   inline const Point3F &_getVert( const U8 *verts, dsize_t stride, U32 idx )
+   {
+      return *reinterpret_cast<const Point3F *>( verts + idx * stride );
+   }
+
+   /// Half the surface area of box, which is proportional to the chance of
+   /// a random ray hitting it
+   inline F32 _getHalfArea( const Box3F &box )
+   {
+      const Point3F ext = box.maxExtents - box.minExtents;
+      return ext.x * ext.y + ext.y * ext.z + ext.z * ext.x;
+   }
+
+   /// Intersects the ray with a node's bounds, returning the entry time
+   inline bool _rayHitsNode( const TSMeshBVH::Node &node, const Point3F &start, const Point3F &invDir, F32 maxT, F32 &entryT )
+   {
+      F32 t0 = ( node.minExtents.x - start.x ) * invDir.x;
+      F32 t1 = ( node.maxExtents.x - start.x ) * invDir.x;
+      F32 tMin = getMin( t0, t1 );
+      F32 tMax = getMax( t0, t1 );
+
+      t0 = ( node.minExtents.y - start.y ) * invDir.y;
+      t1 = ( node.maxExtents.y - start.y ) * invDir.y;
+      tMin = getMax( tMin, getMin( t0, t1 ) );
+      tMax = getMin( tMax, getMax( t0, t1 ) );
+
+      t0 = ( node.minExtents.z - start.z ) * invDir.z;
+      t1 = ( node.maxExtents.z - start.z ) * invDir.z;
+      tMin = getMax( tMin, getMin( t0, t1 ) );
+      tMax = getMin( tMax, getMax( t0, t1 ) );
+
+      entryT = tMin;
+      return tMin <= tMax && tMax >= 0.0f && tMin <= maxT;
+   }
+}
+
+//-----------------------------------------------------------------------------
+
+TSMeshBVH::TSMeshBVH()
+{
+   VECTOR_SET_ASSOCIATION( mNodes );
+   VECTOR_SET_ASSOCIATION( mTriangles );
+}
+
+void TSMeshBVH::addTriangle( U32 idx0, U32 idx1, U32 idx2, U32 matIndex )
+{
+   mTriangles.increment();
+   Triangle &tri = mTriangles.last();
+   tri.idx[0] = idx0;
+   tri.idx[1] = idx1;
+   tri.idx[2] = idx2;
+   tri.matIndex = matIndex;
+}
+
+void TSMeshBVH::build( const U8 *verts, dsize_t stride )
+{
+   mNodes.clear();
+   if ( mTriangles.empty() )
+      return;
+
+   Vector<BuildItem> items;
+   items.setSize( mTriangles.size() );
+   for ( U32 i = 0; i < mTriangles.size(); i++ )
+   {
+      const Triangle &tri = mTriangles[i];
+      BuildItem &item = items[i];
+
+      const Point3F &v0 = _getVert( verts, stride, tri.idx[0] );
+      item.bounds.minExtents = v0;
+      item.bounds.maxExtents = v0;
+      item.bounds.intersect( _getVert( verts, stride, tri.idx[1] ) );
+      item.bounds.intersect( _getVert( verts, stride, tri.idx[2] ) );
+      item.centroid = item.bounds.getCenter();
+      item.triangle = i;
+   }
+
+   // A binary tree with n leaves has 2n - 1 nodes
+   mNodes.reserve( mTriangles.size() * 2 );
+   _buildNode( items, 0, items.size(), 0 );
+   mNodes.compact();
+
+   // Store the triangles in leaf order so each leaf is a single range
+   Vector<Triangle> sorted;
+   sorted.setSize( mTriangles.size() );
+   for ( U32 i = 0; i < items.size(); i++ )
+      sorted[i] = mTriangles[ items[i].triangle ];
+   mTriangles = sorted;
+}
+
+U32 TSMeshBVH::_buildNode( Vector<BuildItem> &items, U32 start, U32 end, U32 depth )
+{
+   const U32 nodeIndex = mNodes.size();
+   mNodes.increment();
+
+   Box3F bounds = Box3F::Invalid;
+   Box3F centroidBounds = Box3F::Invalid;
+   for ( U32 i = start; i < end; i++ )
+   {
+      bounds.intersect( items[i].bounds );
+      centroidBounds.intersect( items[i].centroid );
+   }
+
+   mNodes[nodeIndex].minExtents = bounds.minExtents;
+   mNodes[nodeIndex].maxExtents = bounds.maxExtents;
+
+   const U32 count = end - start;
+
+   // Split along the longest axis of the centroids
+   const Point3F extents = centroidBounds.getExtents();
+   U32 axis = 0;
+   if ( extents.y > extents[axis] )
+      axis = 1;
+   if ( extents.z > extents[axis] )
+      axis = 2;
+
+   if ( count <= MaxLeafTriangles || depth >= MaxDepth - 1 || extents[axis] <= 0.0f )
+   {
+      mNodes[nodeIndex].first = start;
+      mNodes[nodeIndex].count = count;
+      return nodeIndex;
+   }
+
+   // Bin the centroids and pick the split with the lowest surface area
+   // heuristic cost
+   U32 binCount[NumBins];
+   Box3F binBounds[NumBins];
+   for ( U32 b = 0; b < NumBins; b++ )
+   {
+      binCount[b] = 0;
+      binBounds[b] = Box3F::Invalid;
+   }
+
+   const F32 binScale = NumBins * 0.9999f / extents[axis];
+   const F32 axisMin = centroidBounds.minExtents[axis];
+   for ( U32 i = start; i < end; i++ )
+   {
+      const U32 b = (U32)( ( items[i].centroid[axis] - axisMin ) * binScale );
+      binCount[b]++;
+      binBounds[b].intersect( items[i].bounds );
+   }
+
+   // Cost of everything to the right of each split, swept from the right
+   F32 rightCost[NumBins];
+   Box3F sweepBounds = Box3F::Invalid;
+   U32 sweepCount = 0;
+   for ( U32 b = NumBins - 1; b > 0; b-- )
+   {
+      sweepBounds.intersect( binBounds[b] );
+      sweepCount += binCount[b];
+      rightCost[b] = sweepCount ? _getHalfArea( sweepBounds ) * sweepCount : 0.0f;
+   }
+
+   U32 bestSplit = 0;
+   F32 bestCost = F32_MAX;
+   sweepBounds = Box3F::Invalid;
+   sweepCount = 0;
+   for ( U32 b = 1; b < NumBins; b++ )
+   {
+      sweepBounds.intersect( binBounds[b - 1] );
+      sweepCount += binCount[b - 1];
+      const F32 cost = ( sweepCount ? _getHalfArea( sweepBounds ) * sweepCount : 0.0f ) + rightCost[b];
+      if ( cost < bestCost )
+      {
+         bestCost = cost;
+         bestSplit = b;
+      }
+   }
+
+   // Partition items into bins below and above the split
+   U32 mid = start;
+   for ( U32 i = start; i < end; i++ )
+   {
+      const U32 b = (U32)( ( items[i].centroid[axis] - axisMin ) * binScale );
+      if ( b < bestSplit )
+      {
+         const BuildItem tmp = items[i];
+         items[i] = items[mid];
+         items[mid] = tmp;
+         mid++;
+      }
+   }
+
+   // Shouldn't happen as the centroids span more than one bin, but make
+   // sure both sides get something
+   if ( mid == start || mid == end )
+      mid = start + count / 2;
+
+   // First child directly follows this node
+   _buildNode( items, start, mid, depth + 1 );
+   const U32 right = _buildNode( items, mid, end, depth + 1 );
+
+   mNodes[nodeIndex].first = right;
+   mNodes[nodeIndex].count = 0;
+   return nodeIndex;
+}
+
+void TSMeshBVH::refit( const U8 *verts, dsize_t stride, Vector<Node> &nodes ) const
+{
+   nodes.setSize( mNodes.size() );
+
+   // Children always come after their parent, so walking backwards
+   // updates both children before the node that contains them
+   for ( S32 i = mNodes.size() - 1; i >= 0; i-- )
+   {
+      const Node &src = mNodes[i];
+      Node &node = nodes[i];
+      node.first = src.first;
+      node.count = src.count;
+
+      if ( src.count > 0 )
+      {
+         const Triangle *tri = mTriangles.address() + src.first;
+         node.minExtents = node.maxExtents = _getVert( verts, stride, tri->idx[0] );
+         for ( U32 j = 0; j < src.count; j++, tri++ )
+         {
+            for ( U32 k = 0; k < 3; k++ )
+            {
+               const Point3F &v = _getVert( verts, stride, tri->idx[k] );
+               node.minExtents.setMin( v );
+               node.maxExtents.setMax( v );
+            }
+         }
+      }
+      else
+      {
+         const Node &left = nodes[i + 1];
+         const Node &right = nodes[src.first];
+         node.minExtents = left.minExtents;
+         node.minExtents.setMin( right.minExtents );
+         node.maxExtents = left.maxExtents;
+         node.maxExtents.setMax( right.maxExtents );
+      }
+   }
+}
+
+bool TSMeshBVH::castRay( const Node *nodes, const U8 *verts, dsize_t stride, const Point3F &start, const Point3F &end, RayHit &hit, bool anyHit ) const
+{
+   if ( mNodes.empty() )
+      return false;
+
+   const Point3F dir = end - start;
+
+   // Avoid infinities in the slab test, as 0 * inf would give NaN
+   Point3F invDir;
+   for ( U32 i = 0; i < 3; i++ )
+      invDir[i] = mFabs( dir[i] ) > 1e-20f ? 1.0f / dir[i] : ( dir[i] < 0.0f ? -1e20f : 1e20f );
+
+   bool found = false;
+   hit.t = 1.0f;
+   hit.tri = NULL;
+
+   U32 stack[MaxDepth];
+   U32 stackSize = 0;
+
+   F32 entryT;
+   if ( !_rayHitsNode( nodes[0], start, invDir, hit.t, entryT ) )
+      return false;
+
+   U32 nodeIndex = 0;
+   for (;;)
+   {
+      const Node &node = nodes[nodeIndex];
+      if ( node.count > 0 )
+      {
+         const Triangle *tri = mTriangles.address() + node.first;
+         for ( U32 i = 0; i < node.count; i++, tri++ )
+         {
+            F32 t;
+            Point2F bary;
+            if ( castRayTriangle( start, dir,
+                                  _getVert( verts, stride, tri->idx[0] ),
+                                  _getVert( verts, stride, tri->idx[1] ),
+                                  _getVert( verts, stride, tri->idx[2] ), t, bary ) && t <= hit.t )
+            {
+               hit.t = t;
+               hit.bary = bary;
+               hit.tri = tri;
+               found = true;
+
+               if ( anyHit )
+                  return true;
+            }
+         }
+      }
+      else
+      {
+         // Visit the nearer child first, so later nodes are more likely to
+         // be culled by the closest hit so far
+         const U32 left = nodeIndex + 1;
+         const U32 right = node.first;
+         F32 leftT, rightT;
+         const bool hitLeft = _rayHitsNode( nodes[left], start, invDir, hit.t, leftT );
+         const bool hitRight = _rayHitsNode( nodes[right], start, invDir, hit.t, rightT );
+
+         if ( hitLeft && hitRight )
+         {
+            AssertFatal( stackSize < MaxDepth, "TSMeshBVH::castRay - stack overflow" );
+            if ( leftT <= rightT )
+            {
+               stack[stackSize++] = right;
+               nodeIndex = left;
+            }
+            else
+            {
+               stack[stackSize++] = left;
+               nodeIndex = right;
+            }
+            continue;
+         }
+         else if ( hitLeft || hitRight )
+         {
+            nodeIndex = hitLeft ? left : right;
+            continue;
+         }
+      }
+
+      // Pop the next node which could still be closer than the current hit
+      for (;;)
+      {
+         if ( stackSize == 0 )
+            return found;
+
+         nodeIndex = stack[--stackSize];
+         if ( !found || _rayHitsNode( nodes[nodeIndex], start, invDir, hit.t, entryT ) )
+            break;
+      }
+   }
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
@@ -0,0 +1,142 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _TSMESHBVH_H_
+#define _TSMESHBVH_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+#ifndef _TVECTOR_H_
+#include "core/util/tVector.h"
+#endif
+#ifndef _MPOINT3_H_
+#include "math/mPoint3.h"
+#endif
+#ifndef _MPOINT2_H_
+#include "math/mPoint2.h"
+#endif
+#ifndef _MBOX_H_
+#include "math/mBox.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+/// Bounding volume hierarchy over the triangles of a mesh, used to speed
+/// up ray casts.
+///
+/// The hierarchy only stores vertex indices, so vertex positions are passed
+/// in to build() and castRay(). Positions are read as a Point3F at the
+/// start of each element of a strided array, which matches both a plain
+/// Vector<Point3F> and TSMesh::TSMeshVertexArray.
+class TSMeshBVH
+{
+public:
+   enum Constants
+   {
+      MaxLeafTriangles = 4,   ///< Leaves are split further when larger than this
+      MaxDepth = 64,          ///< Size of the traversal stack
+   };
+
+   struct Node
+   {
+      Point3F minExtents;
+      U32 first;              ///< First triangle for leaves, otherwise the second child (the first child directly follows its parent)
+      Point3F maxExtents;
+      U32 count;              ///< Number of triangles for leaves, 0 for interior nodes
+   };
+
+   struct Triangle
+   {
+      U32 idx[3];
+      U32 matIndex;           ///< TSDrawPrimitive material index
+   };
+
+   /// Closest hit found by castRay()
+   struct RayHit
+   {
+      F32 t;                  ///< Fraction along the ray
+      Point2F bary;           ///< Barycentric coordinates of the hit, relative to idx[1] and idx[2]
+      const Triangle *tri;
+   };
+
+protected:
+   Vector<Node> mNodes;
+   Vector<Triangle> mTriangles;
+
+   /// Build state
+   struct BuildItem
+   {
+      Box3F bounds;
+      Point3F centroid;
+      U32 triangle;
+   };
+
+   U32 _buildNode( Vector<BuildItem> &items, U32 start, U32 end, U32 depth );
+
+public:
+   TSMeshBVH();
+
+   /// Adds a triangle to be included in the next build()
+   void addTriangle( U32 idx0, U32 idx1, U32 idx2, U32 matIndex );
+
+   /// Builds the hierarchy over all added triangles
+   void build( const U8 *verts, dsize_t stride );
+
+   bool isEmpty() const { return mNodes.empty(); }
+   U32 getNumTriangles() const { return mTriangles.size(); }
+   U32 getNumNodes() const { return mNodes.size(); }
+   const Node *getNodes() const { return mNodes.address(); }
+
+   /// Recomputes the node bounds for moved vertex positions, such as a
+   /// skinned copy of the vertices the hierarchy was built with, keeping
+   /// the tree itself. The result goes in nodes so that many deformed
+   /// copies can share one hierarchy.
+   ///
+   /// Refitting is much cheaper than a rebuild, but the tree gets looser
+   /// the further the vertices move from where it was built.
+   void refit( const U8 *verts, dsize_t stride, Vector<Node> &nodes ) const;
+
+   /// Casts a ray from start to end against the triangles, using the same
+   /// vertex positions the hierarchy was built with.
+   ///
+   /// @param anyHit  Return on the first hit found, rather than the closest
+   /// @return true if there was a hit, in which case hit is filled in
+   bool castRay( const U8 *verts, dsize_t stride, const Point3F &start, const Point3F &end, RayHit &hit, bool anyHit = false ) const
+   {
+      return castRay( mNodes.address(), verts, stride, start, end, hit, anyHit );
+   }
+
+   /// Casts a ray using node bounds from refit() with the same verts
+   bool castRay( const Node *nodes, const U8 *verts, dsize_t stride, const Point3F &start, const Point3F &end, RayHit &hit, bool anyHit = false ) const;
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _TSMESHBVH_H_
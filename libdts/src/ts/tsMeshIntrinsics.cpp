@@ -22,8 +22,10 @@
 
 #include "platform/platform.h"
 #include "ts/tsMesh.h"
+#include "ts/tsTransform.h"
 #include "ts/tsMeshIntrinsics.h"
 #include "ts/arch/tsMeshIntrinsics.arch.h"
+#include "math/mPlane.h"
 #include "libdtshape.h"
 
 //-----------------------------------------------------------------------------
@@ -34,6 +36,10 @@ BEGIN_NS(DTShape)
 
 void (*zero_vert_normal_bulk)(const dsize_t count, U8 * __restrict const outPtr, const dsize_t outStride) = NULL;
 void (*m_matF_x_BatchedVertWeightList)(const MatrixF &mat, const dsize_t count, const TSSkinMesh::BatchData::BatchedVertWeight * __restrict batch, U8 * const __restrict outPtr, const dsize_t outStride) = NULL;
+void (*m_matF_x_SoAVertexStream)(const MatrixF *boneTransforms, const TSSkinMesh::BatchData::SoAVertexStream &stream, U8 * const __restrict outPtr, const dsize_t outStride) = NULL;
+void (*m_quat16_nlerp_bulk)(const dsize_t count, const Quat16 * const *key1, const Quat16 * const *key2, const F32 *keyPos, QuatF * const *out) = NULL;
+void (*m_quatF_point3F_set_matF_bulk)(const dsize_t count, const QuatF * __restrict rot, const Point3F * __restrict tran, MatrixF * __restrict out) = NULL;
+void (*m_sphere_pixel_size_bulk)(const dsize_t count, const Point3F * __restrict center, const F32 * __restrict lodRadius, const F32 * __restrict cullRadius, const Point3F &eye, const F32 pixelScale, const PlaneF *planes, const U32 numPlanes, F32 * __restrict outPixelSize) = NULL;
 
 //------------------------------------------------------------------------------
 // Default C++ Implementations (pretty slow)
@@ -81,6 +87,97 @@ void m_matF_x_BatchedVertWeightList_C(const MatrixF &mat,
    }
 }
 
+//------------------------------------------------------------------------------
+
+void m_matF_x_SoAVertexStream_C(const MatrixF *boneTransforms,
+                                const TSSkinMesh::BatchData::SoAVertexStream &stream,
+                                U8 * const __restrict outPtr,
+                                const dsize_t outStride)
+{
+   Point3F tempPt;
+   Point3F tempNrm;
+
+   for(dsize_t i = 0; i < stream.numVerts; i++)
+   {
+      const Point3F inVert(stream.vertX[i], stream.vertY[i], stream.vertZ[i]);
+      const Point3F inNorm(stream.normX[i], stream.normY[i], stream.normZ[i]);
+
+      Point3F skinnedVert(0.0f, 0.0f, 0.0f);
+      Point3F skinnedNorm(0.0f, 0.0f, 0.0f);
+
+      for(U32 b = 0; b < stream.numBones; b++)
+      {
+         const F32 w = stream.weight[b][i];
+         if(w == 0.0f)
+            continue;
+
+         const MatrixF &m = boneTransforms[stream.bone[b][i]];
+
+         m.mulP( inVert, &tempPt );
+         m.mulV( inNorm, &tempNrm );
+
+         skinnedVert += ( tempPt * w );
+         skinnedNorm += ( tempNrm * w );
+      }
+
+      TSMesh::__TSMeshVertexBase *outElem = reinterpret_cast<TSMesh::__TSMeshVertexBase *>(outPtr + stream.vertexIndex[i] * outStride);
+      outElem->_vert = skinnedVert;
+      outElem->_normal = skinnedNorm;
+   }
+}
+
+//------------------------------------------------------------------------------
+
+void m_quat16_nlerp_bulk_C(const dsize_t count,
+                           const Quat16 * const *key1,
+                           const Quat16 * const *key2,
+                           const F32 *keyPos,
+                           QuatF * const *out)
+{
+   QuatF q1, q2;
+
+   for(dsize_t i = 0; i < count; i++)
+   {
+      key1[i]->getQuatF(&q1);
+      key2[i]->getQuatF(&q2);
+      TSTransform::interpolate(q1, q2, keyPos[i], out[i]);
+   }
+}
+
+//------------------------------------------------------------------------------
+
+void m_quatF_point3F_set_matF_bulk_C(const dsize_t count,
+                                     const QuatF * __restrict rot,
+                                     const Point3F * __restrict tran,
+                                     MatrixF * __restrict out)
+{
+   for(dsize_t i = 0; i < count; i++)
+      TSTransform::setMatrix(rot[i], tran[i], &out[i]);
+}
+
+//------------------------------------------------------------------------------
+
+void m_sphere_pixel_size_bulk_C(const dsize_t count,
+                                const Point3F * __restrict center,
+                                const F32 * __restrict lodRadius,
+                                const F32 * __restrict cullRadius,
+                                const Point3F &eye,
+                                const F32 pixelScale,
+                                const PlaneF *planes,
+                                const U32 numPlanes,
+                                F32 * __restrict outPixelSize)
+{
+   for(dsize_t i = 0; i < count; i++)
+   {
+      bool culled = false;
+      for(U32 p = 0; p < numPlanes; p++)
+         culled |= planes[p].distToPlane(center[i]) < -cullRadius[i];
+
+      const F32 dist = getMax((center[i] - eye).len(), 0.01f);
+      outPixelSize[i] = culled ? -1.0f : (lodRadius[i] / dist) * pixelScale;
+   }
+}
+
 //-----------------------------------------------------------------------------
 
 END_NS
@@ -97,28 +194,55 @@ void DTShapeInit::initMeshIntrinsics()
       // Assign defaults (C++ versions)
       zero_vert_normal_bulk = zero_vert_normal_bulk_C;
       m_matF_x_BatchedVertWeightList = m_matF_x_BatchedVertWeightList_C;
+      m_matF_x_SoAVertexStream = m_matF_x_SoAVertexStream_C;
+      m_quat16_nlerp_bulk = m_quat16_nlerp_bulk_C;
+      m_quatF_point3F_set_matF_bulk = m_quatF_point3F_set_matF_bulk_C;
+      m_sphere_pixel_size_bulk = m_sphere_pixel_size_bulk_C;
 
    #if defined(LIBDTSHAPE_OS_XENON)
       zero_vert_normal_bulk = zero_vert_normal_bulk_X360;
       m_matF_x_BatchedVertWeightList = m_matF_x_BatchedVertWeightList_X360;
    #else
       // Find the best implementation for the current CPU
-      if(Platform::SystemInfo.processor.properties & CPU_PROP_SSE)
+      const U32 properties = Platform::SystemInfo.processor.properties;
+
+      if(properties & CPU_PROP_SSE)
       {
-   #if defined(LIBDTSHAPE_CPU_X86)
+   #if defined(LIBDTSHAPE_CPU_X86) || defined(LIBDTSHAPE_CPU_X86_64)
          
          zero_vert_normal_bulk = zero_vert_normal_bulk_SSE;
          m_matF_x_BatchedVertWeightList = m_matF_x_BatchedVertWeightList_SSE;
+         m_matF_x_SoAVertexStream = m_matF_x_SoAVertexStream_SSE;
+         m_sphere_pixel_size_bulk = m_sphere_pixel_size_bulk_SSE;
 
-         /* This code still has a bug left in it
-   #if (_MSC_VER >= 1500)
-         if(Platform::SystemInfo.processor.properties & CPU_PROP_SSE4_1)
+   #if defined(LIBDTSHAPE_MESHINTRINSICS_SSE4)
+         if(properties & CPU_PROP_SSE4_1)
+         {
             m_matF_x_BatchedVertWeightList = m_matF_x_BatchedVertWeightList_SSE4;
+            m_quat16_nlerp_bulk = m_quat16_nlerp_bulk_SSE4;
+            m_quatF_point3F_set_matF_bulk = m_quatF_point3F_set_matF_bulk_SSE4;
+         }
+   #endif
+
+   #if defined(LIBDTSHAPE_MESHINTRINSICS_AVX2)
+         if(properties & CPU_PROP_AVX)
+            zero_vert_normal_bulk = zero_vert_normal_bulk_AVX;
+
+         const U32 avx2Props = CPU_PROP_AVX2 | CPU_PROP_FMA;
+         if((properties & avx2Props) == avx2Props)
+         {
+            m_matF_x_BatchedVertWeightList = m_matF_x_BatchedVertWeightList_AVX2;
+            m_matF_x_SoAVertexStream = m_matF_x_SoAVertexStream_AVX2;
+
+   #if defined(LIBDTSHAPE_MESHINTRINSICS_AVX512)
+            if(properties & CPU_PROP_AVX512F)
+               m_matF_x_BatchedVertWeightList = m_matF_x_BatchedVertWeightList_AVX512;
+   #endif
+         }
    #endif
-            */
    #endif
       }
-      else if(Platform::SystemInfo.processor.properties & CPU_PROP_ALTIVEC)
+      else if(properties & CPU_PROP_ALTIVEC)
       {
    #if !defined(LIBDTSHAPE_OS_XENON) && defined(LIBDTSHAPE_CPU_PPC)
          zero_vert_normal_bulk = zero_vert_normal_bulk_gccvec;
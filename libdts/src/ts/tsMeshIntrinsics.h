@@ -29,6 +29,9 @@ BEGIN_NS(DTShape)
 
 //-----------------------------------------------------------------------------
 
+struct Quat16;
+class PlaneF;
+
 /// This is the batch-by-transform skin loop
 ///
 /// @param mat       Bone transform
@@ -43,6 +46,66 @@ extern void (*m_matF_x_BatchedVertWeightList)
                                     U8 * const __restrict outPtr,
                                     const dsize_t outStride);
 
+/// This is the batch-by-vertex skin loop for a structure of arrays stream.
+/// Each vertex in the stream is written exactly once.
+///
+/// @param boneTransforms  Bone transforms, indexed by the bone indices in the stream
+/// @param stream          Vertices, normals and influences to skin
+/// @param outPtr          Pointer to index 0 of a TSMesh aligned vertex buffer
+/// @param outStride       Size, in bytes, of one entry in the vertex buffer
+extern void (*m_matF_x_SoAVertexStream)
+                                   (const MatrixF *boneTransforms,
+                                    const TSSkinMesh::BatchData::SoAVertexStream &stream,
+                                    U8 * const __restrict outPtr,
+                                    const dsize_t outStride);
+
+/// Samples rotation tracks, decoding each pair of keys and interpolating
+/// between them exactly as TSTransform::interpolate() does.  The arrays
+/// form a structure of arrays with count entries each.
+///
+/// @param key1    First key of each track
+/// @param key2    Second key of each track
+/// @param keyPos  Position between the keys for each track
+/// @param out     Where to write each interpolated rotation
+extern void (*m_quat16_nlerp_bulk)
+                                   (const dsize_t count,
+                                    const Quat16 * const *key1,
+                                    const Quat16 * const *key2,
+                                    const F32 *keyPos,
+                                    QuatF * const *out);
+
+/// Builds node transforms from rotation and translation arrays, exactly as
+/// TSTransform::setMatrix() does.
+///
+/// @param count  Number of elements in each array
+extern void (*m_quatF_point3F_set_matF_bulk)
+                                   (const dsize_t count,
+                                    const QuatF * __restrict rot,
+                                    const Point3F * __restrict tran,
+                                    MatrixF * __restrict out);
+
+/// Works out the pixel size of bounding spheres for detail selection, as
+/// TSShapeInstance::setDetailFromDistance() does, and culls those entirely
+/// behind any of the planes.
+///
+/// @param center      Sphere centers
+/// @param lodRadius   Radius used for the pixel size of each sphere
+/// @param cullRadius  Radius used for culling each sphere
+/// @param eye         Camera position
+/// @param pixelScale  Pixel size of a radius of 1 at a distance of 1
+/// @param planes      Planes facing into the visible volume
+/// @param outPixelSize Pixel size of each sphere, or -1 if it was culled
+extern void (*m_sphere_pixel_size_bulk)
+                                   (const dsize_t count,
+                                    const Point3F * __restrict center,
+                                    const F32 * __restrict lodRadius,
+                                    const F32 * __restrict cullRadius,
+                                    const Point3F &eye,
+                                    const F32 pixelScale,
+                                    const PlaneF *planes,
+                                    const U32 numPlanes,
+                                    F32 * __restrict outPixelSize);
+
 /// Set the vertex position and normal to (0, 0, 0)
 ///
 /// @param count     Number of elements
@@ -0,0 +1,278 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "ts/tsRasterizer.h"
+
+#include "platform/threads/threadPool.h"
+#include "platform/profiler.h"
+#include "math/mMathFn.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+U8 TSRasterizer::smAlphaRef = 84;
+
+/// Bilinear sample with wrapping, result is RGBA in 0-255
+static void sampleTexture( const TSRasterTexture *tex, const Point2F &uv, F32 *out )
+{
+   const F32 u = uv.x * tex->width - 0.5f;
+   const F32 v = uv.y * tex->height - 0.5f;
+   const F32 fu = mFloor( u );
+   const F32 fv = mFloor( v );
+   const F32 su = u - fu;
+   const F32 sv = v - fv;
+
+   // Wrap, allowing for coordinates well outside 0-1
+   S32 x0 = (S32)fu % (S32)tex->width;
+   S32 y0 = (S32)fv % (S32)tex->height;
+   if ( x0 < 0 ) x0 += tex->width;
+   if ( y0 < 0 ) y0 += tex->height;
+   const S32 x1 = ( x0 + 1 ) % tex->width;
+   const S32 y1 = ( y0 + 1 ) % tex->height;
+
+   const U8 *t00 = tex->bits + ( y0 * tex->width + x0 ) * 4;
+   const U8 *t10 = tex->bits + ( y0 * tex->width + x1 ) * 4;
+   const U8 *t01 = tex->bits + ( y1 * tex->width + x0 ) * 4;
+   const U8 *t11 = tex->bits + ( y1 * tex->width + x1 ) * 4;
+
+   for ( U32 i = 0; i < 4; i++ )
+   {
+      const F32 top = t00[i] + ( t10[i] - t00[i] ) * su;
+      const F32 bottom = t01[i] + ( t11[i] - t01[i] ) * su;
+      out[i] = top + ( bottom - top ) * sv;
+   }
+}
+
+TSRasterizer::TSRasterizer()
+   : mWidth( 0 ),
+     mHeight( 0 ),
+     mTilesX( 0 ),
+     mTilesY( 0 )
+{
+}
+
+void TSRasterizer::begin( U32 width, U32 height )
+{
+   AssertFatal( width > 0 && height > 0, "TSRasterizer::begin - Bad target size!" );
+
+   mWidth = width;
+   mHeight = height;
+   mTilesX = ( width + TileSize - 1 ) / TileSize;
+   mTilesY = ( height + TileSize - 1 ) / TileSize;
+   AssertFatal( mTilesX <= 256 && mTilesY <= 256, "TSRasterizer::begin - Target is too big!" );
+
+   const U32 numPixels = width * height;
+   mColor.setSize( numPixels * 4 );
+   mNormal.setSize( numPixels * 4 );
+   mDepth.setSize( numPixels );
+
+   dMemset( mColor.address(), 0, mColor.size() );
+   dMemset( mNormal.address(), 0, mNormal.size() );
+   for ( U32 i = 0; i < numPixels; i++ )
+      mDepth[i] = F32_MAX;
+
+   mTriangles.clear();
+   mTriangleTiles.clear();
+}
+
+void TSRasterizer::addTriangle( const Vertex &v0, const Vertex &v1, const Vertex &v2, const TSRasterTexture *texture, const ColorI &color )
+{
+   // Reject triangles which are off screen or have no area
+   const F32 minX = getMin( getMin( v0.pos.x, v1.pos.x ), v2.pos.x );
+   const F32 maxX = getMax( getMax( v0.pos.x, v1.pos.x ), v2.pos.x );
+   const F32 minY = getMin( getMin( v0.pos.y, v1.pos.y ), v2.pos.y );
+   const F32 maxY = getMax( getMax( v0.pos.y, v1.pos.y ), v2.pos.y );
+   if ( maxX < 0.0f || maxY < 0.0f || minX >= (F32)mWidth || minY >= (F32)mHeight )
+      return;
+
+   const F32 area = ( v1.pos.x - v0.pos.x ) * ( v2.pos.y - v0.pos.y ) -
+                    ( v1.pos.y - v0.pos.y ) * ( v2.pos.x - v0.pos.x );
+   if ( mFabs( area ) < 1.0e-6f )
+      return;
+
+   // Clamped to the target while still floats, as converting a float out
+   // of range of U32 is undefined
+   const U32 tx0 = (U32)mClampF( minX, 0.0f, (F32)( mWidth - 1 ) ) / TileSize;
+   const U32 ty0 = (U32)mClampF( minY, 0.0f, (F32)( mHeight - 1 ) ) / TileSize;
+   const U32 tx1 = (U32)mClampF( maxX, 0.0f, (F32)( mWidth - 1 ) ) / TileSize;
+   const U32 ty1 = (U32)mClampF( maxY, 0.0f, (F32)( mHeight - 1 ) ) / TileSize;
+
+   mTriangles.increment();
+   Triangle &tri = mTriangles.last();
+   tri.verts[0] = v0;
+   tri.verts[1] = v1;
+   tri.verts[2] = v2;
+   tri.texture = ( texture && texture->bits && texture->width && texture->height ) ? texture : NULL;
+   tri.color = color;
+
+   mTriangleTiles.push_back( tx0 | ( ty0 << 8 ) | ( tx1 << 16 ) | ( ty1 << 24 ) );
+}
+
+void TSRasterizer::_binTriangles()
+{
+   const U32 numTiles = mTilesX * mTilesY;
+
+   // Count the triangles in each tile, then turn
+   // the counts into offsets and fill them in.
+   mBinStart.setSize( numTiles + 1 );
+   dMemset( mBinStart.address(), 0, mBinStart.size() * sizeof( U32 ) );
+
+   for ( U32 i = 0; i < mTriangleTiles.size(); i++ )
+   {
+      const U32 tiles = mTriangleTiles[i];
+      for ( U32 y = ( tiles >> 8 ) & 0xFF; y <= ( tiles >> 24 ); y++ )
+         for ( U32 x = tiles & 0xFF; x <= ( ( tiles >> 16 ) & 0xFF ); x++ )
+            mBinStart[ y * mTilesX + x + 1 ]++;
+   }
+
+   for ( U32 i = 0; i < numTiles; i++ )
+      mBinStart[i+1] += mBinStart[i];
+
+   mBinTriangles.setSize( mBinStart[numTiles] );
+
+   // Triangles are added in order so each
+   // tile draws them in submission order.
+   Vector<U32> next( mBinStart );
+   for ( U32 i = 0; i < mTriangleTiles.size(); i++ )
+   {
+      const U32 tiles = mTriangleTiles[i];
+      for ( U32 y = ( tiles >> 8 ) & 0xFF; y <= ( tiles >> 24 ); y++ )
+         for ( U32 x = tiles & 0xFF; x <= ( ( tiles >> 16 ) & 0xFF ); x++ )
+            mBinTriangles[ next[ y * mTilesX + x ]++ ] = i;
+   }
+}
+
+void TSRasterizer::_rasterizeTile( U32 tile )
+{
+   const S32 tileX0 = ( tile % mTilesX ) * TileSize;
+   const S32 tileY0 = ( tile / mTilesX ) * TileSize;
+   const S32 tileX1 = getMin( tileX0 + (S32)TileSize, (S32)mWidth ) - 1;
+   const S32 tileY1 = getMin( tileY0 + (S32)TileSize, (S32)mHeight ) - 1;
+
+   for ( U32 b = mBinStart[tile]; b < mBinStart[tile+1]; b++ )
+   {
+      const Triangle &tri = mTriangles[ mBinTriangles[b] ];
+      const Point3F &p0 = tri.verts[0].pos;
+      const Point3F &p1 = tri.verts[1].pos;
+      const Point3F &p2 = tri.verts[2].pos;
+
+      // Clip the triangle bounds to the tile
+      const S32 x0 = getMax( (S32)mFloor( getMin( getMin( p0.x, p1.x ), p2.x ) ), tileX0 );
+      const S32 y0 = getMax( (S32)mFloor( getMin( getMin( p0.y, p1.y ), p2.y ) ), tileY0 );
+      const S32 x1 = getMin( (S32)mFloor( getMax( getMax( p0.x, p1.x ), p2.x ) ), tileX1 );
+      const S32 y1 = getMin( (S32)mFloor( getMax( getMax( p0.y, p1.y ), p2.y ) ), tileY1 );
+      if ( x0 > x1 || y0 > y1 )
+         continue;
+
+      // Edge functions, scaled so that they give the
+      // barycentric weight of the opposite vertex.
+      const F32 area = ( p1.x - p0.x ) * ( p2.y - p0.y ) - ( p1.y - p0.y ) * ( p2.x - p0.x );
+      const F32 invArea = 1.0f / area;
+
+      const F32 a0 = ( p1.y - p2.y ) * invArea, b0 = ( p2.x - p1.x ) * invArea;
+      const F32 a1 = ( p2.y - p0.y ) * invArea, b1 = ( p0.x - p2.x ) * invArea;
+      const F32 a2 = ( p0.y - p1.y ) * invArea, b2 = ( p1.x - p0.x ) * invArea;
+
+      const F32 startX = x0 + 0.5f;
+      F32 rowY = y0 + 0.5f;
+
+      for ( S32 y = y0; y <= y1; y++, rowY += 1.0f )
+      {
+         F32 w0 = ( a0 * ( startX - p1.x ) + b0 * ( rowY - p1.y ) );
+         F32 w1 = ( a1 * ( startX - p2.x ) + b1 * ( rowY - p2.y ) );
+         F32 w2 = ( a2 * ( startX - p0.x ) + b2 * ( rowY - p0.y ) );
+
+         U32 pixel = y * mWidth + x0;
+         for ( S32 x = x0; x <= x1; x++, pixel++, w0 += a0, w1 += a1, w2 += a2 )
+         {
+            if ( w0 < 0.0f || w1 < 0.0f || w2 < 0.0f )
+               continue;
+
+            const F32 z = w0 * p0.z + w1 * p1.z + w2 * p2.z;
+            if ( z >= mDepth[pixel] )
+               continue;
+
+            F32 texel[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+            if ( tri.texture )
+            {
+               const Point2F uv = tri.verts[0].uv * w0 + tri.verts[1].uv * w1 + tri.verts[2].uv * w2;
+               sampleTexture( tri.texture, uv, texel );
+            }
+
+            const F32 alpha = texel[3] * tri.color.alpha * ( 1.0f / 255.0f );
+            if ( alpha < smAlphaRef )
+               continue;
+
+            mDepth[pixel] = z;
+
+            U8 *color = &mColor[ pixel * 4 ];
+            color[0] = (U8)( texel[0] * tri.color.red * ( 1.0f / 255.0f ) + 0.5f );
+            color[1] = (U8)( texel[1] * tri.color.green * ( 1.0f / 255.0f ) + 0.5f );
+            color[2] = (U8)( texel[2] * tri.color.blue * ( 1.0f / 255.0f ) + 0.5f );
+            color[3] = (U8)( alpha + 0.5f );
+
+            Point3F n = tri.verts[0].normal * w0 + tri.verts[1].normal * w1 + tri.verts[2].normal * w2;
+            n.normalizeSafe();
+
+            U8 *normal = &mNormal[ pixel * 4 ];
+            normal[0] = (U8)( mClampF( n.x * 127.5f + 127.5f, 0.0f, 255.0f ) + 0.5f );
+            normal[1] = (U8)( mClampF( n.y * 127.5f + 127.5f, 0.0f, 255.0f ) + 0.5f );
+            normal[2] = (U8)( mClampF( n.z * 127.5f + 127.5f, 0.0f, 255.0f ) + 0.5f );
+            normal[3] = 255;
+         }
+      }
+   }
+}
+
+void TSRasterizer::_rasterizeTileFn( void *data, U32 index, U32 workerIndex )
+{
+   static_cast<TSRasterizer*>( data )->_rasterizeTile( index );
+}
+
+void TSRasterizer::end( ThreadPool *pool )
+{
+   PROFILE_SCOPE( TSRasterizer_End );
+
+   _binTriangles();
+
+   // Tiles don't share any pixels so they can be drawn in any order
+   const U32 numTiles = mTilesX * mTilesY;
+   if ( pool && pool->getNumWorkers() > 1 && numTiles > 1 )
+      pool->parallelFor( numTiles, _rasterizeTileFn, this, 1 );
+   else
+   {
+      for ( U32 i = 0; i < numTiles; i++ )
+         _rasterizeTile( i );
+   }
+
+   mTriangles.clear();
+   mTriangleTiles.clear();
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
@@ -0,0 +1,156 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _TSRASTERIZER_H_
+#define _TSRASTERIZER_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+#ifndef _TVECTOR_H_
+#include "core/util/tVector.h"
+#endif
+#ifndef _MPOINT3_H_
+#include "math/mPoint3.h"
+#endif
+#ifndef _MPOINT2_H_
+#include "math/mPoint2.h"
+#endif
+#ifndef _COLOR_H_
+#include "core/color.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+class ThreadPool;
+
+/// An 8 bit RGBA image in system memory which TSRasterizer can sample.
+/// @see TSMaterial::getRasterTexture()
+struct TSRasterTexture
+{
+   U32 width;
+   U32 height;
+   const U8 *bits;            ///< width * height texels, the first row is v = 0
+
+   TSRasterTexture() : width(0), height(0), bits(NULL) {}
+};
+
+/// Software rasterizer used to render shapes where there is no GFX device,
+/// such as when baking imposter images.
+///
+/// Triangles are given in pixel coordinates with y going down the image and
+/// depth increasing away from the viewer.  They are binned into square tiles
+/// as they are added, and end() then fills the tiles independently so they
+/// can be spread over a ThreadPool.
+///
+/// Two RGBA8 targets are written: the color, which is the texture modulated
+/// by the triangle color, and the interpolated normal packed as n * 0.5 + 0.5
+/// with the coverage in alpha.  Pixels are cleared to 0 and texels with an
+/// alpha below smAlphaRef are discarded.  There is no culling, so both sides
+/// of every triangle are drawn.
+class TSRasterizer
+{
+public:
+   enum Constants
+   {
+      TileSize = 32,          ///< Width and height of a tile in pixels
+   };
+
+   struct Vertex
+   {
+      Point3F pos;            ///< x and y in pixels, z is depth
+      Point3F normal;
+      Point2F uv;
+   };
+
+   /// Texels with an alpha lower than this are not drawn.
+   static U8 smAlphaRef;
+
+protected:
+   struct Triangle
+   {
+      Vertex verts[3];
+      const TSRasterTexture *texture;
+      ColorI color;
+   };
+
+   U32 mWidth;
+   U32 mHeight;
+   U32 mTilesX;
+   U32 mTilesY;
+
+   Vector<Triangle> mTriangles;
+
+   /// Triangles overlapping each tile.  The triangle indices for tile i are
+   /// mBinTriangles[ mBinStart[i] ] up to mBinTriangles[ mBinStart[i+1] ],
+   /// built at the start of end().
+   Vector<U32> mBinStart;
+   Vector<U32> mBinTriangles;
+
+   /// First and last tile touched by each triangle, packed as
+   /// x0 | y0 << 8 | x1 << 16 | y1 << 24.
+   Vector<U32> mTriangleTiles;
+
+   Vector<U8> mColor;
+   Vector<U8> mNormal;
+   Vector<F32> mDepth;
+
+   void _binTriangles();
+   void _rasterizeTile( U32 tile );
+
+   static void _rasterizeTileFn( void *data, U32 index, U32 workerIndex );
+
+public:
+   TSRasterizer();
+
+   /// Clears the targets to the specified size and removes all triangles.
+   void begin( U32 width, U32 height );
+
+   /// Queues a triangle to be drawn by end().
+   /// @param texture  Texture to sample, or NULL to use color alone
+   void addTriangle( const Vertex &v0, const Vertex &v1, const Vertex &v2, const TSRasterTexture *texture, const ColorI &color );
+
+   /// Draws the queued triangles.  If pool is not NULL the tiles are
+   /// spread over its threads.
+   void end( ThreadPool *pool = NULL );
+
+   U32 getWidth() const { return mWidth; }
+   U32 getHeight() const { return mHeight; }
+   U32 getNumTriangles() const { return mTriangles.size(); }
+
+   /// Returns the color target as width * height RGBA texels.
+   const U8 *getColorBits() const { return mColor.address(); }
+
+   /// Returns the normal target as width * height RGBA texels.
+   const U8 *getNormalBits() const { return mNormal.address(); }
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _TSRASTERIZER_H_
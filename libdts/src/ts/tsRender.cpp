@@ -55,8 +55,13 @@ U32 GFXVertexElement::getSizeInBytes() const
          
       case GFXDeclType_UByte4:
       case GFXDeclType_Color:
+      case GFXDeclType_Half2:
+      case GFXDeclType_Short2N:
          return 4;
          
+      case GFXDeclType_Short4N:
+         return 8;
+         
       default:
          return 0;
    };
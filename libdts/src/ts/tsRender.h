@@ -102,6 +102,15 @@ enum GFXDeclType
    /// Four-component, packed, unsigned bytes ranged 0-255
    GFXDeclType_UByte4,
    
+   /// A two-component 16 bit float.
+   GFXDeclType_Half2,
+   
+   /// Two-component, packed, signed shorts mapped to -1 to 1 range.
+   GFXDeclType_Short2N,
+   
+   /// Four-component, packed, signed shorts mapped to -1 to 1 range.
+   GFXDeclType_Short4N,
+   
    /// The count of total GFXDeclTypes.
    GFXDeclType_COUNT,
 };
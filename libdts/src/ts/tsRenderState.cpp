@@ -26,6 +26,7 @@
 #include "ts/tsMesh.h"
 #include "ts/tsMaterial.h"
 #include "ts/tsShapeInstance.h"
+#include "core/util/radixSort.h"
 
 //-----------------------------------------------------------------------------
 
@@ -48,6 +49,7 @@ TSRenderState::TSRenderState()
       smNodeCurrentAlignedScales(__FILE__, __LINE__),
       smNodeCurrentArbitraryScales(__FILE__, __LINE__),
       smNodeLocalTransforms(__FILE__, __LINE__),
+      smSkinBoneTransforms(__FILE__, __LINE__),
       smRotationThreads(__FILE__, __LINE__),
       smTranslationThreads(__FILE__, __LINE__),
       smScaleThreads(__FILE__, __LINE__)
@@ -61,6 +63,12 @@ TSRenderState::TSRenderState()
    smLastPixelSize = 0.0f;
    
    mMeshObjectInstance = NULL;
+   mBatchRenderInsts = false;
+   mCurrentFrameChunker = 0;
+   mNumFrameRenderInsts = 0;
+   mInstanceTransform = NULL;
+   mLastImposterDetail = 0;
+   mImposterRenderer = NULL;
    
    smDetailCanShadow = true;
    
@@ -74,7 +82,13 @@ TSRenderState::TSRenderState( TSRenderState &state )
       mNoRenderNonTranslucent( state.mNoRenderNonTranslucent ),
       mMaterialHint( state.mMaterialHint ),
       mCuller( state.mCuller ),
-      mUseOriginSort( state.mUseOriginSort )//,
+      mUseOriginSort( state.mUseOriginSort ),
+      mBatchRenderInsts( state.mBatchRenderInsts ),
+      mInstanceTransform( state.mInstanceTransform ),
+      mCurrentFrameChunker( 0 ),
+      mNumFrameRenderInsts( 0 ),
+      mLastImposterDetail( 0 ),
+      mImposterRenderer( state.mImposterRenderer )//,
       //mMeshRenderInfos( state.mMeshRenderInfos )
 {
 }
@@ -83,7 +97,18 @@ void TSRenderState::reset()
 {
    mRenderInsts.clear();
    mTranslucentRenderInsts.clear();
-   mChunker.clear();
+   mRenderBatches.clear();
+   mBatchTransforms.clear();
+   
+   mImposterStates.clear();
+   mImposterDetailIndices.clear();
+   mImposterDetails.clear();
+   mImposterBatches.clear();
+   mLastImposterDetail = 0;
+   
+   mCurrentFrameChunker ^= 1;
+   mFrameChunkers[mCurrentFrameChunker].reset();
+   mNumFrameRenderInsts = 0;
    
    smNodeCurrentRotations.clear();
    smNodeCurrentTranslations.clear();
@@ -100,18 +125,40 @@ void TSRenderState::reset()
 }
 
 
+void TSRenderState::reserveRenderInsts( U32 numSolid, U32 numTranslucent )
+{
+   mRenderInsts.reserve( numSolid );
+   mTranslucentRenderInsts.reserve( numTranslucent );
+   
+   // Sort workspace
+   const U32 numSort = getMax( numSolid, numTranslucent );
+   mSortKeys.reserve( numSort );
+   mSortIndices.reserve( numSort );
+   mSortTmpKeys.reserve( numSort );
+   mSortTmpIndices.reserve( numSort );
+   mSortTmpInsts.reserve( numSort );
+   
+   if ( mBatchRenderInsts )
+   {
+      mRenderBatches.reserve( numSolid );
+      mBatchTransforms.reserve( numSolid );
+   }
+}
+
 /// Allocates a new TSRenderInst
 TSRenderInst *TSRenderState::allocRenderInst()
 {
-   TSRenderInst *inst = mChunker.alloc<TSRenderInst>();
+   // Keep each one on its own cache lines
+   TSRenderInst *inst = mFrameChunkers[mCurrentFrameChunker].alloc<TSRenderInst>( 64 );
    inst->clear();
+   mNumFrameRenderInsts++;
    return inst;
 }
 
 /// Allocates a new world matrix
 MatrixF *TSRenderState::allocMatrix(const MatrixF &transform)
 {
-   MatrixF *mat = mChunker.alloc<MatrixF>();
+   MatrixF *mat = mFrameChunkers[mCurrentFrameChunker].alloc<MatrixF>();
    *mat = transform;
    return mat;
 }
@@ -135,20 +182,189 @@ void TSRenderState::addRenderInst(TSRenderInst *inst)
       inst->defaultKey2 = inst->matInst->getStateHint();
 }
 
+void TSRenderState::addImposter(TSLastDetail *detail, const TSImposterState &state)
+{
+   if ( mLastImposterDetail >= mImposterDetails.size() || mImposterDetails[mLastImposterDetail] != detail )
+   {
+      // There are only as many details as kinds of shape
+      // on screen, so a linear search will do.
+      mLastImposterDetail = 0;
+      while ( mLastImposterDetail < mImposterDetails.size() && mImposterDetails[mLastImposterDetail] != detail )
+         mLastImposterDetail++;
+      
+      if ( mLastImposterDetail == mImposterDetails.size() )
+         mImposterDetails.push_back( detail );
+   }
+   
+   mImposterStates.push_back( state );
+   mImposterDetailIndices.push_back( mLastImposterDetail );
+}
+
 static S32 RenderStateSortFunc(const void *p1, const void *p2)
 {
-   const TSRenderInst* ri1 = (const TSRenderInst*)p1;
-   const TSRenderInst* ri2 = (const TSRenderInst*)p2;
+   const TSRenderInst* ri1 = *(const TSRenderInst**)p1;
+   const TSRenderInst* ri2 = *(const TSRenderInst**)p2;
    
    S32 test1 = ri2->defaultKey - ri1->defaultKey;
    
    return ( test1 == 0 ) ? S32(ri1->defaultKey2) - S32(ri2->defaultKey2) : test1;
 }
 
+/// Spreads a pointer or id across the top 'bits' bits of a U32
+static inline U64 hashSortKey(size_t value, U32 bits)
+{
+   return ( U32(value) * 2654435769U ) >> ( 32 - bits );
+}
+
+/// Sort key for a positive distance, in the same order as the distance
+static inline U32 distSortKey(F32 dist)
+{
+   U32 bits;
+   dMemcpy(&bits, &dist, sizeof(bits));
+   return bits;
+}
+
+/// Sort key which groups solid primitives by the state needed to draw them:
+/// material (20 bits), vertex format (8), mesh (16), primitive (8) and
+/// then a coarse front to back depth (12).
+static U64 makeBatchSortKey(const TSRenderInst *inst)
+{
+   const TSMesh *mesh = inst->mesh;
+   const GFXVertexFormat *fmt = mesh->hasPackedVertexData() ? mesh->mPackedVertexFormat : mesh->mVertexFormat;
+   
+   U64 key = hashSortKey( inst->matInst ? inst->matInst->getStateHint() : 0, 20 ) << 44;
+   key |= hashSortKey( (size_t)fmt, 8 ) << 36;
+   key |= hashSortKey( (size_t)mesh, 16 ) << 20;
+   key |= U64( inst->primBuffIndex & 0xFF ) << 12;
+   
+   // Exponent and top mantissa bits
+   key |= ( distSortKey( inst->sortDistSq ) >> 19 ) & 0xFFF;
+   return key;
+}
+
+/// True if b can be drawn in the same batch as a
+static bool canBatchRenderInsts(const TSRenderInst *a, const TSRenderInst *b)
+{
+   // Skinned meshes have their own vertices and bones
+   return   a->mesh == b->mesh &&
+            a->matInst == b->matInst &&
+            a->primBuffIndex == b->primBuffIndex &&
+            a->mNumNodeTransforms == 0 && b->mNumNodeTransforms == 0 &&
+            a->visibility == b->visibility &&
+            a->worldToCamera == b->worldToCamera &&
+            a->projection == b->projection;
+}
+
 void TSRenderState::sortRenderInsts()
 {
-   dQsort(mRenderInsts.address(), mRenderInsts.size(), sizeof(TSRenderState*), RenderStateSortFunc);
-   dQsort(mTranslucentRenderInsts.address(), mTranslucentRenderInsts.size(), sizeof(TSRenderState*), RenderStateSortFunc);
+   mRenderBatches.clear();
+   mBatchTransforms.clear();
+   
+   _buildImposterBatches();
+   
+   if ( !mBatchRenderInsts )
+   {
+      dQsort(mRenderInsts.address(), mRenderInsts.size(), sizeof(TSRenderInst*), RenderStateSortFunc);
+      dQsort(mTranslucentRenderInsts.address(), mTranslucentRenderInsts.size(), sizeof(TSRenderInst*), RenderStateSortFunc);
+      return;
+   }
+   
+   mSortKeys.setSize( mRenderInsts.size() );
+   for ( U32 i = 0; i < mRenderInsts.size(); i++ )
+      mSortKeys[i] = makeBatchSortKey( mRenderInsts[i] );
+   _sortByKeys( mRenderInsts );
+   
+   // Back to front
+   mSortKeys.setSize( mTranslucentRenderInsts.size() );
+   for ( U32 i = 0; i < mTranslucentRenderInsts.size(); i++ )
+      mSortKeys[i] = ~distSortKey( mTranslucentRenderInsts[i]->sortDistSq );
+   _sortByKeys( mTranslucentRenderInsts );
+   
+   _buildRenderBatches();
+}
+
+void TSRenderState::_sortByKeys( Vector<TSRenderInst*> &insts )
+{
+   const U32 count = insts.size();
+   
+   mSortIndices.setSize( count );
+   for ( U32 i = 0; i < count; i++ )
+      mSortIndices[i] = i;
+   
+   mSortTmpKeys.setSize( count );
+   mSortTmpIndices.setSize( count );
+   dRadixSort64( mSortKeys.address(), mSortIndices.address(), count, mSortTmpKeys.address(), mSortTmpIndices.address() );
+   
+   mSortTmpInsts.setSize( count );
+   for ( U32 i = 0; i < count; i++ )
+      mSortTmpInsts[i] = insts[mSortIndices[i]];
+   dCopyArray( insts.address(), mSortTmpInsts.address(), count );
+}
+
+void TSRenderState::_buildRenderBatches()
+{
+   // Sized up front so the batches can point into it
+   mBatchTransforms.setSize( mRenderInsts.size() );
+   
+   for ( U32 start = 0; start < mRenderInsts.size(); )
+   {
+      const TSRenderInst *first = mRenderInsts[start];
+      
+      U32 end = start + 1;
+      while ( end < mRenderInsts.size() && canBatchRenderInsts( first, mRenderInsts[end] ) )
+         end++;
+      
+      for ( U32 i = start; i < end; i++ )
+         mBatchTransforms[i] = *mRenderInsts[i]->objectToWorld;
+      
+      mRenderBatches.increment();
+      TSRenderBatch &batch = mRenderBatches.last();
+      batch.insts = mRenderInsts.address() + start;
+      batch.transforms = mBatchTransforms.address() + start;
+      batch.count = end - start;
+      
+      start = end;
+   }
+}
+
+void TSRenderState::_buildImposterBatches()
+{
+   mImposterBatches.setSize( mImposterDetails.size() );
+   for ( U32 i = 0; i < mImposterBatches.size(); i++ )
+   {
+      mImposterBatches[i].detail = mImposterDetails[i];
+      mImposterBatches[i].count = 0;
+   }
+   
+   // A single kind of shape can use the states as they are
+   if ( mImposterBatches.size() == 1 )
+   {
+      mImposterBatches[0].states = mImposterStates.address();
+      mImposterBatches[0].count = mImposterStates.size();
+      return;
+   }
+   
+   // Otherwise count the imposters of each detail, then
+   // copy them into place after the ones before.
+   for ( U32 i = 0; i < mImposterDetailIndices.size(); i++ )
+      mImposterBatches[ mImposterDetailIndices[i] ].count++;
+   
+   mSortedImposterStates.setSize( mImposterStates.size() );
+   
+   U32 offset = 0;
+   for ( U32 i = 0; i < mImposterBatches.size(); i++ )
+   {
+      mImposterBatches[i].states = mSortedImposterStates.address() + offset;
+      offset += mImposterBatches[i].count;
+      mImposterBatches[i].count = 0;
+   }
+   
+   for ( U32 i = 0; i < mImposterStates.size(); i++ )
+   {
+      TSImposterBatch &batch = mImposterBatches[ mImposterDetailIndices[i] ];
+      const U32 dest = ( batch.states - mSortedImposterStates.address() ) + batch.count++;
+      mSortedImposterStates[dest] = mImposterStates[i];
+   }
 }
 
 void TSRenderInst::clear()
@@ -161,6 +377,24 @@ void TSRenderInst::render(TSRenderState *renderState)
    mesh->mRenderer->doRenderInst(mesh, this, renderState);
 }
 
+void TSRenderBatch::render(TSRenderState *renderState)
+{
+   TSMesh *mesh = insts[0]->mesh;
+   mesh->mRenderer->doRenderBatch(mesh, this, renderState);
+}
+
+void TSImposterBatch::render(TSRenderState *renderState)
+{
+   if ( renderState->getImposterRenderer() )
+      renderState->getImposterRenderer()->doRenderImposters(this, renderState);
+}
+
+void TSMeshRenderer::doRenderBatch(TSMesh *mesh, TSRenderBatch *batch, TSRenderState *renderState)
+{
+   for ( U32 i = 0; i < batch->count; i++ )
+      doRenderInst(mesh, batch->insts[i], renderState);
+}
+
 //-----------------------------------------------------------------------------
 
 END_NS
@@ -61,6 +61,7 @@ class TSMeshRenderer;
 class TSMesh;
 class TSMeshInstanceRenderData;
 class TSThread;
+class TSLastDetail;
 
 typedef U32 TSRenderInstTypeHash;
 
@@ -128,6 +129,82 @@ typedef struct TSRenderInst
    void render(TSRenderState *state);
 } TSRenderInst;
 
+//**************************************************************************
+// Render Batch
+//**************************************************************************
+
+/// A run of render instances which draw the same primitive of the same
+/// mesh with the same material, built by TSRenderState::sortRenderInsts()
+/// when batching is enabled. Only meshes with the same vertices for every
+/// shape instance are merged, so skinned meshes get a batch each.
+struct TSRenderBatch
+{
+   /// Render instances in the batch. The first holds the state shared 
+   /// by the whole batch (mesh, material, render data).
+   TSRenderInst **insts;
+   
+   /// The objectToWorld transform of each render instance, one after 
+   /// another.
+   const MatrixF *transforms;
+   
+   /// Number of render instances in the batch
+   U32 count;
+   
+   void render(TSRenderState *state);
+};
+
+//**************************************************************************
+// Imposters
+//**************************************************************************
+
+/// Per instance data for drawing an imposter, laid out to match
+/// TSLastDetail::getImposterVertexFormat().
+struct TSImposterState
+{
+   /// World space center of the billboard
+   Point3F center;
+   
+   /// Unscaled half size, the up and right vectors carry the scale
+   F32 halfSize;
+   
+   /// Fade out
+   F32 alpha;
+   
+   /// The rotation of the shape encoded as its up and right vectors
+   Point3F upVec;
+   Point3F rightVec;
+};
+
+/// Every imposter of one TSLastDetail added since the last reset(), built
+/// by TSRenderState::sortRenderInsts() so that all the far away instances
+/// of a shape can be drawn with one instanced draw call.
+struct TSImposterBatch
+{
+   /// The imposter images and atlas layout to draw with
+   TSLastDetail *detail;
+   
+   /// The state of each imposter, one after another so they can be 
+   /// copied straight into an instance buffer.
+   const TSImposterState *states;
+   
+   /// Number of imposters in the batch
+   U32 count;
+   
+   void render(TSRenderState *state);
+};
+
+/// Generic interface which draws TSImposterBatches, set on the
+/// TSRenderState by the app.
+class TSImposterRenderer
+{
+public:
+   virtual ~TSImposterRenderer() {;}
+   
+   /// Draws every imposter in the batch, normally with a single
+   /// instanced draw call.
+   virtual void doRenderImposters(TSImposterBatch *batch, TSRenderState *renderState) = 0;
+};
+
 // Generic interface which provides scene info to the rendering code
 class TSSceneRenderState
 {
@@ -233,6 +310,17 @@ public:
    Vector<TSScale> smNodeCurrentArbitraryScales;
    Vector<MatrixF> smNodeLocalTransforms;
    TSIntegerSet    smNodeLocalTransformDirty;
+
+   /// Rotation tracks gathered for m_quat16_nlerp_bulk
+   Vector<const Quat16*> smSampleKeys1;
+   Vector<const Quat16*> smSampleKeys2;
+   Vector<F32>           smSampleKeyPos;
+   Vector<QuatF*>        smSampleRotations;
+   /// @}
+   
+   /// @name Workspace for Skinning
+   /// @{
+   Vector<MatrixF> smSkinBoneTransforms;
    /// @}
    
    /// @name Threads
@@ -263,11 +351,66 @@ public:
    
    /// Mesh object instance being rendered
    void *mMeshObjectInstance;
+   
+   /// Sort solid primitives by state and merge them into
+   /// mRenderBatches, see sortRenderInsts().
+   bool mBatchRenderInsts;
+   
+   /// Optional shape to world transform, applied to the objectToWorld
+   /// of each render instance. Set this for each shape instance when
+   /// several placed instances are rendered into one TSRenderState.
+   const MatrixF *mInstanceTransform;
 	
 protected:
    
-   /// Allocator for TSRenderInst and MatrixF
-   MultiTypedChunker mChunker;
+   /// Allocators for TSRenderInst and MatrixF. reset() switches between
+   /// them, so the previous frame's allocations stay valid for a frame.
+   FrameChunker mFrameChunkers[2];
+   U32 mCurrentFrameChunker;
+   
+   /// Render instances allocated since the last reset()
+   U32 mNumFrameRenderInsts;
+   
+   /// @name Workspace for Sorting
+   /// @{
+   Vector<U64>           mSortKeys;
+   Vector<U32>           mSortIndices;
+   Vector<U64>           mSortTmpKeys;
+   Vector<U32>           mSortTmpIndices;
+   Vector<TSRenderInst*> mSortTmpInsts;
+   /// @}
+   
+   /// Storage for TSRenderBatch::transforms
+   Vector<MatrixF> mBatchTransforms;
+   
+   /// @name Imposters
+   /// @{
+   
+   /// Imposters in the order they were added, with the index in
+   /// mImposterDetails of the TSLastDetail each one belongs to
+   Vector<TSImposterState> mImposterStates;
+   Vector<U32>             mImposterDetailIndices;
+   Vector<TSLastDetail*>   mImposterDetails;
+   
+   /// Storage for TSImposterBatch::states when there is more than
+   /// one batch
+   Vector<TSImposterState> mSortedImposterStates;
+   
+   /// Index of the last detail added to, as the instances of a shape
+   /// are usually drawn one after another.
+   U32 mLastImposterDetail;
+   
+   TSImposterRenderer *mImposterRenderer;
+   /// @}
+   
+   /// Sorts render instances by mSortKeys
+   void _sortByKeys( Vector<TSRenderInst*> &insts );
+   
+   /// Merges runs of sorted mRenderInsts into mRenderBatches
+   void _buildRenderBatches();
+   
+   /// Groups mImposterStates by detail into mImposterBatches
+   void _buildImposterBatches();
    
 public:
    /// @name Output TSRenderInsts
@@ -277,6 +420,13 @@ public:
    
    /// Primitives which must be drawn on top of solid geometry
    Vector<TSRenderInst*> mTranslucentRenderInsts;
+   
+   /// mRenderInsts merged by mesh primitive and material, only
+   /// filled in when mBatchRenderInsts is set
+   Vector<TSRenderBatch> mRenderBatches;
+   
+   /// Imposters added with addImposter(), one batch per TSLastDetail
+   Vector<TSImposterBatch> mImposterBatches;
    /// @}
 
 public:
@@ -284,7 +434,15 @@ public:
    TSRenderState();
    TSRenderState( TSRenderState &state );
    
+   /// Starts a new frame, clearing the render instances and the node
+   /// workspace. Memory is kept for the next frame, so a frame no bigger
+   /// than the ones before it makes no heap allocations. TSRenderInsts and
+   /// matrices from the previous frame stay valid until the next reset().
    void reset();
+   
+   /// Makes room for this many solid and translucent render instances
+   /// per frame up front.
+   void reserveRenderInsts( U32 numSolid, U32 numTranslucent );
 
    /// @name Get/Set methods.
    /// @{
@@ -325,7 +483,19 @@ public:
    void setMeshObjectInstance( void* shape ) { mMeshObjectInstance = shape; }
    void* getMeshObjectInstance() const { return mMeshObjectInstance; }
    
-   /// Allocates a new TSRenderInst
+   ///@see mBatchRenderInsts
+   void setBatchRenderInsts( bool batch ) { mBatchRenderInsts = batch; }
+   bool isBatchRenderInsts() const { return mBatchRenderInsts; }
+   
+   ///@see mInstanceTransform
+   void setInstanceTransform( const MatrixF *transform ) { mInstanceTransform = transform; }
+   const MatrixF* getInstanceTransform() const { return mInstanceTransform; }
+   
+   ///@see mImposterRenderer
+   void setImposterRenderer( TSImposterRenderer *renderer ) { mImposterRenderer = renderer; }
+   TSImposterRenderer* getImposterRenderer() const { return mImposterRenderer; }
+   
+   /// Allocates a new TSRenderInst, aligned to a cache line
    TSRenderInst *allocRenderInst();
    
    /// Allocates a new world matrix
@@ -334,7 +504,27 @@ public:
    /// Adds a new TSRenderInst to the rendering pool
    void addRenderInst(TSRenderInst *inst);
    
-   /// Sorts TSRenderInsts
+   /// Queues an imposter of the specified detail, to be drawn in 
+   /// its TSImposterBatch.
+   void addImposter(TSLastDetail *detail, const TSImposterState &state);
+   
+   /// @name Frame Statistics
+   /// Since the last reset()
+   /// @{
+   U32 getFrameRenderInsts() const { return mNumFrameRenderInsts; }
+   U32 getFrameBytes() const { return mFrameChunkers[mCurrentFrameChunker].getBytesUsed(); }
+   U32 getFrameHeapAllocs() const { return mFrameChunkers[mCurrentFrameChunker].getNumHeapAllocs(); }
+   /// @}
+   
+   /// Sorts TSRenderInsts. 
+   ///
+   /// Solid primitives are normally sorted front to back. If 
+   /// mBatchRenderInsts is set they are sorted by material, vertex format,
+   /// mesh, primitive and then roughly front to back, and runs which can be
+   /// drawn together are gathered in mRenderBatches. Translucent primitives
+   /// are always sorted back to front.
+   ///
+   /// Imposters are always gathered into mImposterBatches.
    void sortRenderInsts();
 
    /// @}
@@ -378,6 +568,11 @@ public:
    /// Renders whatever needs to be drawn, usually called AFTER the main
    virtual void doRenderInst(TSMesh *mesh, TSRenderInst *inst, TSRenderState *renderState) = 0;
    
+   /// Renders every render instance in a batch. Override this to draw
+   /// them with one instanced draw call, the default calls doRenderInst
+   /// for each.
+   virtual void doRenderBatch(TSMesh *mesh, TSRenderBatch *batch, TSRenderState *renderState);
+   
    /// Returns true if buffers need updating
    virtual bool isDirty(TSMesh *mesh, TSMeshInstanceRenderData *renderData) = 0;
    
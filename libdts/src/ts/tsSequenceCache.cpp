@@ -0,0 +1,457 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "ts/tsSequenceCache.h"
+
+#include "core/stream/fileStream.h"
+#include "core/util/endian.h"
+#include "core/log.h"
+#include "platform/threads/mutex.h"
+#include "platform/profiler.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+bool TSShape::smStreamSequences = false;
+
+static U32 sBudget = 16 << 20;
+static U32 sResidentSize = 0;
+static U32 sNumResident = 0;
+static U32 sNumLoads = 0;
+static U32 sCurrentFrame = 0;
+
+/// Most and least recently used resident sequences
+static TSShape::StreamedSequence *sHead = NULL;
+static TSShape::StreamedSequence *sTail = NULL;
+
+/// Protects everything above, and the paging state of every sequence
+static Mutex sCacheMutex;
+
+//-----------------------------------------------------------------------------
+
+void TSSequenceCache::setBudget( U32 bytes )
+{
+   MutexHandle handle( sCacheMutex );
+   sBudget = bytes;
+   _evict();
+}
+
+U32 TSSequenceCache::getBudget()
+{
+   return sBudget;
+}
+
+void TSSequenceCache::advanceFrame()
+{
+   MutexHandle handle( sCacheMutex );
+   sCurrentFrame++;
+}
+
+U32 TSSequenceCache::getCurrentFrame()
+{
+   return sCurrentFrame;
+}
+
+U32 TSSequenceCache::getResidentSize()
+{
+   return sResidentSize;
+}
+
+U32 TSSequenceCache::getNumResident()
+{
+   return sNumResident;
+}
+
+U32 TSSequenceCache::getNumLoads()
+{
+   return sNumLoads;
+}
+
+bool TSSequenceCache::touch( TSShape::StreamedSequence *entry )
+{
+   MutexHandle handle( sCacheMutex );
+
+   if ( !entry->resident )
+   {
+      PROFILE_SCOPE( TSSequenceCache_load );
+
+      if ( !entry->load() )
+         return false;
+
+      sResidentSize += entry->residentSize;
+      sNumResident++;
+      sNumLoads++;
+   }
+   else
+      _unlink( entry );
+
+   entry->lastUsedFrame = sCurrentFrame;
+   _link( entry );
+
+   _evict();
+   return true;
+}
+
+void TSSequenceCache::remove( TSShape::StreamedSequence *entry )
+{
+   MutexHandle handle( sCacheMutex );
+
+   if ( !entry->resident )
+      return;
+
+   _unlink( entry );
+   sResidentSize -= entry->residentSize;
+   sNumResident--;
+   entry->unload();
+}
+
+void TSSequenceCache::_link( TSShape::StreamedSequence *entry )
+{
+   entry->prev = NULL;
+   entry->next = sHead;
+   if ( sHead )
+      sHead->prev = entry;
+   else
+      sTail = entry;
+   sHead = entry;
+}
+
+void TSSequenceCache::_unlink( TSShape::StreamedSequence *entry )
+{
+   if ( entry->prev )
+      entry->prev->next = entry->next;
+   else
+      sHead = entry->next;
+
+   if ( entry->next )
+      entry->next->prev = entry->prev;
+   else
+      sTail = entry->prev;
+
+   entry->prev = entry->next = NULL;
+}
+
+void TSSequenceCache::_evict()
+{
+   if ( !sBudget )
+      return;
+
+   // Anything used this frame may still be being sampled
+   while ( sResidentSize > sBudget && sTail && sTail->lastUsedFrame != sCurrentFrame )
+   {
+      TSShape::StreamedSequence *entry = sTail;
+      _unlink( entry );
+      sResidentSize -= entry->residentSize;
+      sNumResident--;
+      entry->unload();
+   }
+}
+
+//-----------------------------------------------------------------------------
+// Streamed sequence keyframes
+//-----------------------------------------------------------------------------
+
+TSShape::StreamedSequence::StreamedSequence()
+{
+   shape = NULL;
+   sequenceIndex = -1;
+
+   rotationOffset = 0;
+   translationOffset = 0;
+   scaleOffset = 0;
+   scaleRotationOffset = 0;
+   groundTranslationOffset = 0;
+   groundRotationOffset = 0;
+
+   resident = false;
+   residentSize = 0;
+   lastUsedFrame = 0;
+   prev = next = NULL;
+}
+
+/// Reads count little endian words from the file
+template<class T> static bool readKeyWords(FileStream &stream, U32 offset, T *dest, U32 count)
+{
+   if (!count)
+      return true;
+   if (!stream.setPosition(offset) || !stream.read(count * sizeof(T), dest))
+      return false;
+
+   if (0x12345678 != convertLEndianToHost(0x12345678))
+   {
+      for (U32 i=0; i<count; i++)
+         dest[i] = convertLEndianToHost(dest[i]);
+   }
+   return true;
+}
+
+/// Reads the keyframes of a set of tracks, which may be in any order in the
+/// file, into consecutive tracks of keys.
+template<class T, class W> static bool readTracks(FileStream &stream, U32 offset, const Vector<S32> &tracks,
+                                                  S32 numKeyframes, Vector<T> &keys)
+{
+   const U32 wordsPerKey = sizeof(T) / sizeof(W);
+   keys.setSize(tracks.size() * numKeyframes);
+   for (S32 i=0; i<tracks.size(); i++)
+   {
+      U32 trackOffset = offset + tracks[i] * numKeyframes * sizeof(T);
+      if (!readKeyWords(stream, trackOffset, (W*)&keys[i * numKeyframes], numKeyframes * wordsPerKey))
+         return false;
+   }
+   return true;
+}
+
+bool TSShape::StreamedSequence::load()
+{
+   const Sequence & seq = shape->sequences[sequenceIndex];
+
+   FileStream stream;
+   if (!stream.open(path, FileStream::Read))
+   {
+      Log::errorf("TSShape::StreamedSequence::load - Could not open '%s'", path.c_str());
+      return false;
+   }
+
+   bool ok = readTracks<Quat16, S16>(stream, rotationOffset, rotationTracks, seq.numKeyframes, rotations) &&
+             readTracks<Point3F, S32>(stream, translationOffset, translationTracks, seq.numKeyframes, translations);
+
+   if (ok && scaleTracks.size())
+   {
+      if (seq.animatesArbitraryScale())
+         ok = readTracks<Quat16, S16>(stream, scaleRotationOffset, scaleTracks, seq.numKeyframes, arbitraryScaleRots) &&
+              readTracks<Point3F, S32>(stream, scaleOffset, scaleTracks, seq.numKeyframes, arbitraryScaleFactors);
+      else if (seq.animatesAlignedScale())
+         ok = readTracks<Point3F, S32>(stream, scaleOffset, scaleTracks, seq.numKeyframes, alignedScales);
+      else
+         ok = readTracks<F32, S32>(stream, scaleOffset, scaleTracks, seq.numKeyframes, uniformScales);
+   }
+
+   if (ok && seq.numGroundFrames)
+   {
+      groundTranslations.setSize(seq.numGroundFrames);
+      groundRotations.setSize(seq.numGroundFrames);
+      ok = readKeyWords(stream, groundTranslationOffset, (S32*)groundTranslations.address(), seq.numGroundFrames * 3) &&
+           readKeyWords(stream, groundRotationOffset, (S16*)groundRotations.address(), seq.numGroundFrames * 4);
+   }
+
+   if (!ok)
+   {
+      Log::errorf("TSShape::StreamedSequence::load - Could not read sequence '%s' from '%s'",
+         shape->getSequenceName(sequenceIndex).c_str(), path.c_str());
+      unload();
+      return false;
+   }
+
+   residentSize = rotations.memSize() + translations.memSize() + uniformScales.memSize() +
+                  alignedScales.memSize() + arbitraryScaleRots.memSize() + arbitraryScaleFactors.memSize() +
+                  groundRotations.memSize() + groundTranslations.memSize();
+   resident = true;
+   return true;
+}
+
+void TSShape::StreamedSequence::unload()
+{
+   rotations.clear();
+   translations.clear();
+   uniformScales.clear();
+   alignedScales.clear();
+   arbitraryScaleRots.clear();
+   arbitraryScaleFactors.clear();
+   groundRotations.clear();
+   groundTranslations.clear();
+   rotations.compact();
+   translations.compact();
+   uniformScales.compact();
+   alignedScales.compact();
+   arbitraryScaleRots.compact();
+   arbitraryScaleFactors.compact();
+   groundRotations.compact();
+   groundTranslations.compact();
+
+   resident = false;
+   residentSize = 0;
+}
+
+//-----------------------------------------------------------------------------
+// TSShape sequence streaming
+//-----------------------------------------------------------------------------
+
+bool TSShape::touchSequence(S32 seqIndex) const
+{
+   const Sequence & seq = sequences[seqIndex];
+   if (!seq.isStreamed())
+      return true;
+   return TSSequenceCache::touch(streamedSequences[seq.streamIndex]);
+}
+
+void TSShape::loadAllSequenceKeys()
+{
+   unstreamSequences();
+   decompressSequences();
+}
+
+/// Identity track map for sequences read from dts files
+static void setTrackCount(Vector<S32> &tracks, S32 count)
+{
+   tracks.setSize(count);
+   for (S32 i=0; i<count; i++)
+      tracks[i] = i;
+}
+
+void TSShape::streamSequencesFromFile(TSIOState &ioState, U32 bufferOffset, const S8 *buffer)
+{
+   #define KEYS_OFFSET(ptr) (bufferOffset + (U32)((const S8*)(ptr) - buffer))
+
+   const U32 rotationOffset = KEYS_OFFSET(ioState.smNodeRotationKeys);
+   const U32 translationOffset = KEYS_OFFSET(ioState.smNodeTranslationKeys);
+   const U32 uniformScaleOffset = KEYS_OFFSET(ioState.smUniformScaleKeys);
+   const U32 alignedScaleOffset = KEYS_OFFSET(ioState.smAlignedScaleKeys);
+   const U32 arbitraryScaleFactorOffset = KEYS_OFFSET(ioState.smArbitraryScaleFactorKeys);
+   const U32 arbitraryScaleRotOffset = KEYS_OFFSET(ioState.smArbitraryScaleRotKeys);
+   const U32 groundTranslationOffset = KEYS_OFFSET(ioState.smGroundTranslationKeys);
+   const U32 groundRotationOffset = KEYS_OFFSET(ioState.smGroundRotationKeys);
+
+   #undef KEYS_OFFSET
+
+   const String path = mPath.getFullPath();
+   Vector<S32> streamed;
+
+   // Locate the keys of each sequence in the file first, as erasing them
+   // from the shape moves the keys of the others
+   for (S32 i=0; i<sequences.size(); i++)
+   {
+      Sequence & seq = sequences[i];
+      if (seq.isCompressed() || seq.isStreamed())
+         continue;
+
+      StreamedSequence *entry = new StreamedSequence;
+      entry->shape = this;
+      entry->sequenceIndex = i;
+      entry->path = path;
+
+      entry->rotationOffset = rotationOffset + seq.baseRotation * sizeof(Quat16);
+      entry->translationOffset = translationOffset + seq.baseTranslation * sizeof(Point3F);
+      if (seq.animatesArbitraryScale())
+      {
+         entry->scaleOffset = arbitraryScaleFactorOffset + seq.baseScale * sizeof(Point3F);
+         entry->scaleRotationOffset = arbitraryScaleRotOffset + seq.baseScale * sizeof(Quat16);
+      }
+      else if (seq.animatesAlignedScale())
+         entry->scaleOffset = alignedScaleOffset + seq.baseScale * sizeof(Point3F);
+      else
+         entry->scaleOffset = uniformScaleOffset + seq.baseScale * sizeof(F32);
+      entry->groundTranslationOffset = groundTranslationOffset + seq.firstGroundFrame * sizeof(Point3F);
+      entry->groundRotationOffset = groundRotationOffset + seq.firstGroundFrame * sizeof(Quat16);
+
+      setTrackCount(entry->rotationTracks, seq.rotationMatters.count());
+      setTrackCount(entry->translationTracks, seq.translationMatters.count());
+      setTrackCount(entry->scaleTracks, seq.scaleMatters.count());
+
+      streamedSequences.push_back(entry);
+      streamed.push_back(i);
+   }
+
+   for (S32 i=0; i<streamed.size(); i++)
+   {
+      eraseSequenceKeys(streamed[i], true, true);
+      sequences[streamed[i]].streamIndex = i;
+   }
+}
+
+void TSShape::unstreamSequences()
+{
+   if (!streamedSequences.size())
+      return;
+
+   for (S32 i=0; i<sequences.size(); i++)
+   {
+      Sequence & seq = sequences[i];
+      if (!seq.isStreamed())
+         continue;
+
+      StreamedSequence *entry = streamedSequences[seq.streamIndex];
+      if (!TSSequenceCache::touch(entry))
+      {
+         // The keys are lost, hold the animated nodes at their defaults
+         for (S32 node=seq.rotationMatters.start(); node<seq.rotationMatters.end(); seq.rotationMatters.next(node))
+         {
+            for (S32 f=0; f<seq.numKeyframes; f++)
+               entry->rotations.push_back(defaultRotations[node]);
+         }
+         for (S32 node=seq.translationMatters.start(); node<seq.translationMatters.end(); seq.translationMatters.next(node))
+         {
+            for (S32 f=0; f<seq.numKeyframes; f++)
+               entry->translations.push_back(defaultTranslations[node]);
+         }
+         entry->scaleTracks.clear();
+         seq.scaleMatters.clearAll();
+         seq.flags &= ~AnyScale;
+         seq.numGroundFrames = 0;
+      }
+
+      seq.baseRotation = nodeRotations.size();
+      nodeRotations.merge(entry->rotations);
+      seq.baseTranslation = nodeTranslations.size();
+      nodeTranslations.merge(entry->translations);
+
+      if (entry->scaleTracks.size())
+      {
+         if (seq.animatesArbitraryScale())
+         {
+            seq.baseScale = nodeArbitraryScaleFactors.size();
+            nodeArbitraryScaleRots.merge(entry->arbitraryScaleRots);
+            nodeArbitraryScaleFactors.merge(entry->arbitraryScaleFactors);
+         }
+         else if (seq.animatesAlignedScale())
+         {
+            seq.baseScale = nodeAlignedScales.size();
+            nodeAlignedScales.merge(entry->alignedScales);
+         }
+         else
+         {
+            seq.baseScale = nodeUniformScales.size();
+            nodeUniformScales.merge(entry->uniformScales);
+         }
+      }
+      else
+         seq.baseScale = 0;
+
+      seq.firstGroundFrame = groundTranslations.size();
+      groundTranslations.merge(entry->groundTranslations);
+      groundRotations.merge(entry->groundRotations);
+
+      seq.streamIndex = -1;
+   }
+
+   for (S32 i=0; i<streamedSequences.size(); i++)
+   {
+      TSSequenceCache::remove(streamedSequences[i]);
+      delete streamedSequences[i];
+   }
+   streamedSequences.clear();
+}
+
+END_NS
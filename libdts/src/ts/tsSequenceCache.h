@@ -0,0 +1,101 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _TSSEQUENCECACHE_H_
+#define _TSSEQUENCECACHE_H_
+
+#ifndef _TSSHAPE_H_
+#include "ts/tsShape.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+/// Keeps track of the keyframes of streamed sequences (see
+/// TSShape::smStreamSequences) which are in memory, and evicts the least
+/// recently used ones when they take up more than the budget.
+///
+/// Keyframes are only evicted once they have not been used for a whole
+/// frame, so pointers to them stay valid until the next advanceFrame(). The
+/// caller must therefore call advanceFrame() at a point where no thread is
+/// animating, e.g. once per frame before the animation update. The budget
+/// may be exceeded by the sequences used in the current frame.
+///
+/// @code
+/// TSShape::smStreamSequences = true;
+/// TSSequenceCache::setBudget( 8 << 20 );
+///
+/// // each frame
+/// TSSequenceCache::advanceFrame();
+/// for ( U32 i = 0; i < instances.size(); i++ )
+///    instances[i]->animate();
+/// @endcode
+class TSSequenceCache
+{
+public:
+
+   /// Sets the number of bytes of keyframes to keep in memory, 0 for no limit.
+   /// Defaults to 16MB.
+   static void setBudget( U32 bytes );
+   static U32 getBudget();
+
+   /// Starts a new frame. Sequences used in earlier frames may be evicted
+   /// from here on, when a new one is loaded and the budget is exceeded.
+   static void advanceFrame();
+   static U32 getCurrentFrame();
+
+   /// Makes sure the keyframes of a sequence are in memory, and marks them
+   /// as used in the current frame. Returns false if they could not be read.
+   static bool touch( TSShape::StreamedSequence *entry );
+
+   /// Unloads a sequence and stops tracking it.
+   static void remove( TSShape::StreamedSequence *entry );
+
+   /// @name Statistics
+   /// @{
+
+   /// Bytes of keyframes currently in memory
+   static U32 getResidentSize();
+
+   /// Number of sequences currently in memory
+   static U32 getNumResident();
+
+   /// Number of times keyframes have been read from a file
+   static U32 getNumLoads();
+   /// @}
+
+protected:
+
+   static void _link( TSShape::StreamedSequence *entry );
+   static void _unlink( TSShape::StreamedSequence *entry );
+   static void _evict();
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _TSSEQUENCECACHE_H_
@@ -25,15 +25,23 @@
 #include "ts/tsShape.h"
 
 #include "ts/tsLastDetail.h"
+#include "ts/tsDecal.h"
+#include "ts/tsSortedMesh.h"
 #include "ts/tsMaterialList.h"
 #include "core/log.h"
 #include "ts/tsShapeInstance.h"
 #include "collision/convex.h"
 #include "ts/tsMaterial.h"
 #include "ts/tsMaterialManager.h"
+#include "ts/tsSequenceCache.h"
 #include "math/mathIO.h"
 #include "core/util/endian.h"
 #include "core/stream/fileStream.h"
+#include "core/stream/memStream.h"
+#include "platform/fileio.h"
+#include "platform/threads/mutex.h"
+#include "platform/threads/threadPool.h"
+#include "platform/profiler.h"
 
 //-----------------------------------------------------------------------------
 
@@ -55,10 +63,16 @@ const F32 TSShape::smAlphaOutDefault = -1.0f;
 
 bool TSShape::smAllowHardwareSkinning = true;
 bool TSShape::smUseHardwareSkinning = true;
+bool TSShape::smUseSoASkinning = false;
+bool TSShape::smUseSkinnedCollision = true;
+bool TSShape::smUseSoASampling = true;
+bool TSShape::smUseMappedLoading = true;
+bool TSShape::smPackVertices = false;
+bool TSShape::smOptimizeMeshes = false;
 
 TSIOState::TSIOState()
 {
-   smVersion = 26;
+   smVersion = 27;
    smReadVersion = -1;
    
    smNumSkipLoadDetails = 0;
@@ -69,6 +83,29 @@ TSIOState::TSIOState()
    smUseOneStrip  = true; // join triangle strips into one long strip on load
    smMinStripSize = 1;     // smallest number of _faces_ allowed per strip (all else put in tri list)
    smUseEncodedNormals = false;
+   smSharedVertexData = false;
+
+   smSizeStandardMesh = NULL;
+   smSizeSkinMesh = NULL;
+   smSizeDecalMesh = NULL;
+   smSizeSortedMesh = NULL;
+
+   smNodeTranslationKeys = NULL;
+   smNodeRotationKeys = NULL;
+   smUniformScaleKeys = NULL;
+   smAlignedScaleKeys = NULL;
+   smArbitraryScaleFactorKeys = NULL;
+   smArbitraryScaleRotKeys = NULL;
+   smGroundTranslationKeys = NULL;
+   smGroundRotationKeys = NULL;
+}
+
+TSIOState::~TSIOState()
+{
+   delete smSizeStandardMesh;
+   delete smSizeSkinMesh;
+   delete smSizeDecalMesh;
+   delete smSizeSortedMesh;
 }
 
 TSShape::TSShape()
@@ -78,6 +115,8 @@ TSShape::TSShape()
    mSequencesConstructed = false;
    mShapeData = NULL;
    mShapeDataSize = 0;
+   mBlobMapping = NULL;
+   mPackedVertSize = 0;
    
    mNumSkipLoadDetails = 0;
 
@@ -95,6 +134,10 @@ TSShape::TSShape()
    VECTOR_SET_ASSOCIATION(nodeArbitraryScaleFactors);
    VECTOR_SET_ASSOCIATION(groundRotations);
    VECTOR_SET_ASSOCIATION(groundTranslations);
+   VECTOR_SET_ASSOCIATION(compressedTracks);
+   VECTOR_SET_ASSOCIATION(compressedKeyFrames);
+   VECTOR_SET_ASSOCIATION(compressedKeyData);
+   VECTOR_SET_ASSOCIATION(streamedSequences);
    VECTOR_SET_ASSOCIATION(triggers);
    VECTOR_SET_ASSOCIATION(billboardDetails);
    VECTOR_SET_ASSOCIATION(detailCollisionAccelerators);
@@ -131,6 +174,12 @@ TSShape::~TSShape()
       if (!meshes[i])
          continue;
 
+      // Vertex data in a blob mapping isn't ours to free
+      if (mBlobMapping && meshes[i]->mVertexData.address() &&
+          (U8*)meshes[i]->mVertexData.address() >= (U8*)mBlobMapping->getData() &&
+          (U8*)meshes[i]->mVertexData.address() < (U8*)mBlobMapping->getData() + mBlobMapping->getSize())
+         meshes[i]->mVertexData.set(NULL, 0, 0, 0, 0, false);
+
       // Handle meshes that were either assembled with the shape or added later
       if (((S8*)meshes[i] >= mShapeData) && ((S8*)meshes[i] < (mShapeData + mShapeDataSize)))
          destructInPlace(meshes[i]);
@@ -162,8 +211,16 @@ TSShape::~TSShape()
    for (dca = 0; dca < detailCollisionAccelerators.size(); dca++)
       detailCollisionAccelerators[dca] = NULL;
 
+   for (i=0; i<streamedSequences.size(); i++)
+   {
+      TSSequenceCache::remove(streamedSequences[i]);
+      delete streamedSequences[i];
+   }
+
    if( mShapeData )
       delete[] mShapeData;
+
+   delete mBlobMapping;
 }
 
 const String& TSShape::getName( S32 nameIndex ) const
@@ -201,17 +258,217 @@ const String& TSShape::getSequenceName( S32 seqIndex ) const
    return names[nameIdx];
 }
 
-S32 TSShape::findName(const String &name) const
+//-------------------------------------------------
+// Name lookup
+//-------------------------------------------------
+
+/// Case-insensitive FNV-1a hash, consistent with String::equal( NoCase )
+static U32 hashNameNoCase(const String &name)
 {
+   const char *str = name.c_str();
+   U32 len = name.length();
+
+   U32 hash = 2166136261U;
+   for (U32 i=0; i<len; i++)
+      hash = (hash ^ (U8)dTolower(str[i])) * 16777619U;
+   return hash;
+}
+
+static inline const String &getSlotName(const String &name) { return name; }
+static inline const String &getSlotName(const String *name) { return *name; }
+
+/// Returns the index in names of the name hashed into slots, or -1
+template<class T> static S32 findNameSlot(const Vector<S32> &slots, const Vector<T> &names, const String &name)
+{
+   if (slots.empty())
+      return -1;
+
+   U32 mask = slots.size() - 1;
+   for (U32 slot = hashNameNoCase(name) & mask; slots[slot] >= 0; slot = (slot + 1) & mask)
+   {
+      if (getSlotName(names[slots[slot]]).equal( name, String::NoCase ))
+         return slots[slot];
+   }
+   return -1;
+}
+
+/// Adds names[index] to slots, assuming it is not already there.  Grows the
+/// table to keep it at most half full.
+template<class T> static void insertNameSlot(Vector<S32> &slots, const Vector<T> &names, S32 index)
+{
+   if ((U32)(index + 1) * 2 > (U32)slots.size())
+   {
+      // Rehash everything before index into a bigger table
+      U32 size = getMax(slots.size() * 2, 16);
+      while (size < (U32)(index + 1) * 2)
+         size *= 2;
+
+      Vector<S32> old(slots);
+      slots.setSize(size);
+      dMemset(slots.address(), 0xFF, size * sizeof(S32));
+      for (U32 i=0; i<old.size(); i++)
+      {
+         if (old[i] >= 0)
+            insertNameSlot(slots, names, old[i]);
+      }
+   }
+
+   U32 mask = slots.size() - 1;
+   U32 slot = hashNameNoCase(getSlotName(names[index])) & mask;
+   while (slots[slot] >= 0)
+      slot = (slot + 1) & mask;
+   slots[slot] = index;
+}
+
+void TSShape::_buildNameSlots()
+{
+   PROFILE_SCOPE(TSShape_buildNameSlots);
+
+   mNameSlots.clear();
    for (S32 i=0; i<names.size(); i++)
    {
-      if (names[i].equal( name, String::NoCase ))
-         return i;
+      // Duplicate names resolve to the first one, as a linear search would
+      if (findNameSlot(mNameSlots, names, names[i]) < 0)
+         insertNameSlot(mNameSlots, names, i);
+   }
+}
+
+static S32 QSORT_CALLBACK compareNameIdRefs(const void *a, const void *b)
+{
+   const TSShape::NameIdRef *refA = (const TSShape::NameIdRef*)a;
+   const TSShape::NameIdRef *refB = (const TSShape::NameIdRef*)b;
+   if (refA->id != refB->id)
+      return refA->id < refB->id ? -1 : 1;
+   return refA->nameIndex - refB->nameIndex;
+}
+
+template<class T> static void fillNameRefs(Vector<TSShape::NameRefs> &refs, const Vector<T> &group, S32 TSShape::NameRefs::*member)
+{
+   for (S32 i=group.size()-1; i>=0; i--)
+   {
+      S32 nameIndex = group[i].nameIndex;
+      if (nameIndex >= -1 && nameIndex + 1 < refs.size())
+         refs[nameIndex + 1].*member = i;
+   }
+}
+
+void TSShape::_buildNameRefs()
+{
+   PROFILE_SCOPE(TSShape_buildNameRefs);
+
+   // Filled in reverse, so each name ends up with its first user
+   mNameRefs.setSize(names.size() + 1);
+   dMemset(mNameRefs.address(), 0xFF, mNameRefs.size() * sizeof(NameRefs));
+   fillNameRefs(mNameRefs, nodes, &NameRefs::node);
+   fillNameRefs(mNameRefs, objects, &NameRefs::object);
+   fillNameRefs(mNameRefs, details, &NameRefs::detail);
+   fillNameRefs(mNameRefs, sequences, &NameRefs::sequence);
+
+   mNameIdRefs.setSize(names.size());
+   for (S32 i=0; i<names.size(); i++)
+   {
+      mNameIdRefs[i].id = internName(names[i]).id;
+      mNameIdRefs[i].nameIndex = i;
    }
-  
+   dQsort(mNameIdRefs.address(), mNameIdRefs.size(), sizeof(NameIdRef), compareNameIdRefs);
+}
+
+void TSShape::invalidateNameLookup()
+{
+   _buildNameSlots();
+   _buildNameRefs();
+}
+
+void TSShape::_addNameSlot(S32 nameIndex)
+{
+   // Only kept incrementally while the lookup matches the names
+   if (mNameRefs.size() != names.size())
+   {
+      invalidateNameLookup();
+      return;
+   }
+
+   insertNameSlot(mNameSlots, names, nameIndex);
+
+   // The new name has no users yet, but can now be found by id
+   NameRefs refs;
+   dMemset(&refs, 0xFF, sizeof(refs));
+   mNameRefs.push_back(refs);
+
+   NameIdRef idRef;
+   idRef.id = internName(names[nameIndex]).id;
+   idRef.nameIndex = nameIndex;
+   S32 pos = mNameIdRefs.size();
+   while (pos > 0 && compareNameIdRefs(&mNameIdRefs[pos-1], &idRef) > 0)
+      pos--;
+   mNameIdRefs.insert(pos, idRef);
+}
+
+const TSShape::NameRefs *TSShape::_findNameRefs(S32 nameIndex) const
+{
+   if (nameIndex < -1 || nameIndex + 1 >= mNameRefs.size())
+      return NULL;
+   return &mNameRefs[nameIndex + 1];
+}
+
+S32 TSShape::findName(const String &name) const
+{
+   return findNameSlot(mNameSlots, names, name);
+}
+
+S32 TSShape::findName(TSNameId id) const
+{
+   // First entry with this id
+   S32 lo = 0, hi = mNameIdRefs.size();
+   while (lo < hi)
+   {
+      S32 mid = (lo + hi) / 2;
+      if (mNameIdRefs[mid].id < id.id)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   if (lo < mNameIdRefs.size() && mNameIdRefs[lo].id == id.id)
+      return mNameIdRefs[lo].nameIndex;
    return -1;
 }
 
+/// Names interned by TSShape::internName, hashed the same way as shape names.
+/// Allocated individually so they stay put as the table grows.
+static Vector<String*> sInternedNames;
+static Vector<S32> sInternedNameSlots;
+static Mutex sInternedNameMutex;
+
+TSNameId TSShape::internName(const String &name)
+{
+   if (name.isEmpty())
+      return TSNameId();
+
+   MutexHandle handle(sInternedNameMutex);
+
+   S32 index = findNameSlot(sInternedNameSlots, sInternedNames, name);
+   if (index < 0)
+   {
+      // Copy the characters, so the table does not share a reference count
+      // with strings used on other threads
+      index = sInternedNames.size();
+      sInternedNames.push_back(new String(name.c_str()));
+      insertNameSlot(sInternedNameSlots, sInternedNames, index);
+   }
+
+   return TSNameId(index + 1);
+}
+
+const char *TSShape::getInternedName(TSNameId id)
+{
+   MutexHandle handle(sInternedNameMutex);
+
+   if (!id.isValid() || id.id > (U32)sInternedNames.size())
+      return "";
+   return sInternedNames[id.id - 1]->c_str();
+}
+
 const String& TSShape::getTargetName( S32 mapToNameIndex ) const
 {
 	S32 targetCount = materialList->getMaterialNameList().size();
@@ -233,26 +490,20 @@ S32 TSShape::getTargetCount() const
 
 S32 TSShape::findNode(S32 nameIndex) const
 {
-   for (S32 i=0; i<nodes.size(); i++)
-      if (nodes[i].nameIndex==nameIndex)
-         return i;
-   return -1;
+   const NameRefs *refs = _findNameRefs(nameIndex);
+   return refs ? refs->node : -1;
 }
 
 S32 TSShape::findObject(S32 nameIndex) const
 {
-   for (S32 i=0; i<objects.size(); i++)
-      if (objects[i].nameIndex==nameIndex)
-         return i;
-   return -1;
+   const NameRefs *refs = _findNameRefs(nameIndex);
+   return refs ? refs->object : -1;
 }
 
 S32 TSShape::findDetail(S32 nameIndex) const
 {
-   for (S32 i=0; i<details.size(); i++)
-      if (details[i].nameIndex==nameIndex)
-         return i;
-   return -1;
+   const NameRefs *refs = _findNameRefs(nameIndex);
+   return refs ? refs->detail : -1;
 }
 
 S32 TSShape::findDetailBySize(S32 size) const
@@ -265,10 +516,8 @@ S32 TSShape::findDetailBySize(S32 size) const
 
 S32 TSShape::findSequence(S32 nameIndex) const
 {
-   for (S32 i=0; i<sequences.size(); i++)
-      if (sequences[i].nameIndex==nameIndex)
-         return i;
-   return -1;
+   const NameRefs *refs = _findNameRefs(nameIndex);
+   return refs ? refs->sequence : -1;
 }
 
 bool TSShape::findMeshIndex(const String& meshName, S32& objIndex, S32& meshIndex)
@@ -400,10 +649,18 @@ void TSShape::getObjectDetails(S32 objIndex, Vector<S32>& objDetails)
 }
 
 void TSShape::init()
+{
+   initShapeData();
+   initMaterialList();
+}
+
+void TSShape::initShapeData()
 {
    S32 numSubShapes = subShapeFirstNode.size();
    AssertFatal(numSubShapes==subShapeFirstObject.size(),"TSShape::init");
 
+   invalidateNameLookup();
+
    S32 i,j;
 
    // set up parent/child relationships on nodes and objects
@@ -444,9 +701,47 @@ void TSShape::init()
       }
    }
 
+   // order each subshape's nodes parents first, keeping node order where
+   // it already is
+   mNodeOrder.setSize(nodes.size());
+   for (i=0; i<nodes.size(); i++)
+      mNodeOrder[i] = i;
+
+   Vector<bool> nodeOrdered;
+   nodeOrdered.setSize(nodes.size());
+   for (i=0; i<nodes.size(); i++)
+      nodeOrdered[i] = false;
+
+   Vector<S32> nodeChain;
+   for (i=0; i<subShapeFirstNode.size(); i++)
+   {
+      const S32 a = subShapeFirstNode[i];
+      const S32 b = a + subShapeNumNodes[i];
+      S32 next = a;
+      for (S32 j=a; j<b; j++)
+      {
+         // add the node after any of its ancestors not added yet
+         nodeChain.clear();
+         for (S32 n=j; n>=a && n<b && !nodeOrdered[n] && nodeChain.size()<b-a; n=nodes[n].parentIndex)
+            nodeChain.push_back(n);
+         while (nodeChain.size())
+         {
+            const S32 n = nodeChain.last();
+            nodeChain.pop_back();
+            if (!nodeOrdered[n])
+            {
+               nodeOrdered[n] = true;
+               mNodeOrder[next++] = n;
+            }
+         }
+      }
+   }
+
    mFlags = 0;
    for (i=0; i<sequences.size(); i++)
    {
+      sequences[i].initTracks();
+
       if (!sequences[i].animatesScale())
          continue;
 
@@ -558,7 +853,75 @@ void TSShape::init()
    }
 
    initVertexFeatures();
-   initMaterialList();
+}
+
+struct TSMeshOptimizeItem
+{
+   TSMesh *mesh;
+   bool reorderVerts;
+};
+
+static void _optimizeMeshItem( void *data, U32 index, U32 workerIndex )
+{
+   TSMeshOptimizeItem &item = reinterpret_cast<TSMeshOptimizeItem*>( data )[index];
+
+   item.mesh->optimizeTriangleOrder();
+   if ( item.reorderVerts )
+      item.mesh->optimizeVertexOrder();
+}
+
+void TSShape::optimizeMeshes( ThreadPool *pool )
+{
+   PROFILE_SCOPE( TSShape_OptimizeMeshes );
+
+   // Vertices shared between meshes through parentMesh have to stay put
+   Vector<bool> sharedVerts;
+   sharedVerts.setSize( meshes.size() );
+   dMemset( sharedVerts.address(), 0, sharedVerts.size() * sizeof(bool) );
+   for ( S32 i = 0; i < meshes.size(); i++ )
+   {
+      const TSMesh *mesh = meshes[i];
+      if ( mesh && mesh->parentMesh >= 0 )
+      {
+         sharedVerts[i] = true;
+         if ( mesh->parentMesh < meshes.size() )
+            sharedVerts[mesh->parentMesh] = true;
+      }
+   }
+
+   Vector<TSMeshOptimizeItem> items;
+   for ( S32 i = 0; i < meshes.size(); i++ )
+   {
+      TSMesh *mesh = meshes[i];
+      if (  !mesh || mesh->mVertexData.isReady() ||
+            (  mesh->getMeshType() != TSMesh::StandardMeshType &&
+               mesh->getMeshType() != TSMesh::SkinMeshType ) )
+         continue;
+
+      TSMeshOptimizeItem item;
+      item.mesh = mesh;
+      item.reorderVerts = !sharedVerts[i];
+      items.push_back( item );
+   }
+
+   if ( items.empty() )
+      return;
+
+   if ( !pool )
+      pool = &ThreadPool::getGlobal();
+
+   pool->parallelFor( items.size(), _optimizeMeshItem, items.address(), 1 );
+}
+
+void TSShape::Sequence::initTracks()
+{
+   rotationNodes.clear();
+   translationNodes.clear();
+
+   for (S32 i=rotationMatters.start(); i<MAX_TS_SET_SIZE; rotationMatters.next(i))
+      rotationNodes.push_back(i);
+   for (S32 i=translationMatters.start(); i<MAX_TS_SET_SIZE; translationMatters.next(i))
+      translationNodes.push_back(i);
 }
 
 void TSShape::initVertexFeatures()
@@ -590,6 +953,9 @@ void TSShape::initVertexFeatures()
       }
    }
    
+   if ( smOptimizeMeshes )
+      optimizeMeshes();
+
    mVertSize = sizeof(TSMesh::__TSMeshVertexBase);
    mVertexFormat.clear();
    
@@ -626,6 +992,30 @@ void TSShape::initVertexFeatures()
    }
    
    mVertSize = mVertexFormat.getSizeInBytes();
+
+   // A blob written with another vertex format can't be used in place
+   if ( mBlobMapping )
+      _detachBlobVertexData();
+
+   // Positions relative to each mesh's bounds, octahedral normals and
+   // tangents, and half float texture coordinates
+   mPackedVertexFormat.clear();
+   mPackedVertSize = 0;
+   if ( smPackVertices && !(hasSkin && smAllowHardwareSkinning) )
+   {
+      mPackedVertexFormat.addElement( GFXSemantic::POSITION, GFXDeclType_Short4N );
+      mPackedVertexFormat.addElement( GFXSemantic::NORMAL, GFXDeclType_Short2N );
+      mPackedVertexFormat.addElement( GFXSemantic::TANGENT, GFXDeclType_Short4N );
+      mPackedVertexFormat.addElement( GFXSemantic::TEXCOORD, GFXDeclType_Half2, 0 );
+
+      if ( hasTexcoord2 || hasColors )
+      {
+         mPackedVertexFormat.addElement( GFXSemantic::TEXCOORD, GFXDeclType_Half2, 1 );
+         mPackedVertexFormat.addElement( GFXSemantic::COLOR, GFXDeclType_Color );
+      }
+
+      mPackedVertSize = mPackedVertexFormat.getSizeInBytes();
+   }
    
    // Go fix up meshes to include defaults for optional features
    // and initialize them if they're not a skin mesh.
@@ -645,6 +1035,11 @@ void TSShape::initVertexFeatures()
       // Create and fill aligned data structure
       mesh->convertToAlignedMeshData();
 
+      if ( mPackedVertSize && mesh->getMeshType() == TSMesh::StandardMeshType )
+         mesh->packVertexData( &mPackedVertexFormat, mPackedVertSize );
+      else
+         mesh->clearPackedVertexData();
+
       // Init the vertex buffer.
       //if ( mesh->getMeshType() == TSMesh::StandardMeshType )
       //   mesh->createVBIB();
@@ -809,8 +1204,9 @@ void TSShape::computeBounds(S32 dl, Box3F & bounds) const
    S32 start = subShapeFirstNode[ss];
    S32 end   = subShapeNumNodes[ss] + start;
    gTempNodeTransforms.setSize(end-start);
-   for (i=start; i<end; i++)
+   for (S32 k=start; k<end; k++)
    {
+      i = mNodeOrder[k];
       MatrixF mat;
       QuatF q;
       TSTransform::setMatrix(defaultRotations[i].getQuatF(&q),defaultTranslations[i],&mat);
@@ -1005,9 +1401,11 @@ void TSShape::assembleShape(TSIOState &ioState)
    defaultTranslations.set(ptr32,numNodes);
 
    // get any node sequence data stored in shape
+   ioState.smNodeTranslationKeys = tsalloc.getPointer32(0);
    nodeTranslations.setSize(numNodeTrans);
    for (i=0;i<numNodeTrans;i++)
       tsalloc.get32((S32*)&nodeTranslations[i],3);
+   ioState.smNodeRotationKeys = tsalloc.getPointer16(0);
    nodeRotations.setSize(numNodeRots);
    for (i=0;i<numNodeRots;i++)
       tsalloc.get16((S16*)&nodeRotations[i],4);
@@ -1018,15 +1416,19 @@ void TSShape::assembleShape(TSIOState &ioState)
    if (ioState.smReadVersion>21)
    {
       // more node sequence data...scale
+      ioState.smUniformScaleKeys = tsalloc.getPointer32(0);
       nodeUniformScales.setSize(numNodeUniformScales);
       for (i=0;i<numNodeUniformScales;i++)
          tsalloc.get32((S32*)&nodeUniformScales[i],1);
+      ioState.smAlignedScaleKeys = tsalloc.getPointer32(0);
       nodeAlignedScales.setSize(numNodeAlignedScales);
       for (i=0;i<numNodeAlignedScales;i++)
          tsalloc.get32((S32*)&nodeAlignedScales[i],3);
+      ioState.smArbitraryScaleFactorKeys = tsalloc.getPointer32(0);
       nodeArbitraryScaleFactors.setSize(numNodeArbitraryScales);
       for (i=0;i<numNodeArbitraryScales;i++)
          tsalloc.get32((S32*)&nodeArbitraryScaleFactors[i],3);
+      ioState.smArbitraryScaleRotKeys = tsalloc.getPointer16(0);
       nodeArbitraryScaleRots.setSize(numNodeArbitraryScales);
       for (i=0;i<numNodeArbitraryScales;i++)
          tsalloc.get16((S16*)&nodeArbitraryScaleRots[i],4);
@@ -1061,9 +1463,11 @@ void TSShape::assembleShape(TSIOState &ioState)
    // earlier shapes is handled just above, so...
    if (mReadVersion>23)
    {
+      ioState.smGroundTranslationKeys = tsalloc.getPointer32(0);
       groundTranslations.setSize(numGroundFrames);
       for (i=0;i<numGroundFrames;i++)
          tsalloc.get32((S32*)&groundTranslations[i],3);
+      ioState.smGroundRotationKeys = tsalloc.getPointer16(0);
       groundRotations.setSize(numGroundFrames);
       for (i=0;i<numGroundFrames;i++)
          tsalloc.get16((S16*)&groundRotations[i],4);
@@ -1269,6 +1673,7 @@ void TSShape::assembleShape(TSIOState &ioState)
       nameBufferSize += j + 1;
       name += j + 1;
    }
+   invalidateNameLookup();
 
    tsalloc.getPointer8(nameBufferSize);
    tsalloc.align32();
@@ -1527,6 +1932,18 @@ void TSShape::write(Stream * s, TSIOState *options)
       ioState = *options;
    }
 
+   // streamed keyframes have to be in memory to be written
+   unstreamSequences();
+
+   // compressed tracks can only be stored in version 27 and later, so
+   // older versions are written from temporarily decompressed keys
+   TempDecompression decompressed(ioState.smVersion < 27 ? this : NULL);
+
+   // version 27 only adds the compressed tracks, so write 26 when there
+   // are none to keep the file readable by older loaders
+   if (ioState.smVersion > 26 && !hasCompressedSequences())
+      ioState.smVersion = 26;
+
    // write version
    s->write(ioState.smVersion | (mExporterVersion<<16));
 
@@ -1575,6 +1992,9 @@ void TSShape::write(Stream * s, TSIOState *options)
    // write material list - write will properly endian-flip.
    materialList->write(*s);
 
+   if (ioState.smVersion > 26)
+      writeCompressedTracks(s);
+
    delete [] buffer32;
    delete [] buffer16;
    delete [] buffer8;
@@ -1610,6 +2030,8 @@ bool TSShape::read(Stream * s, TSIOState *options)
    S16 * memBuffer16;
    S8 * memBuffer8;
    S32 count32, count16, count8;
+   U32 memBufferPos = 0;
+   bool ownsMemBuffer = true;
    if (mReadVersion<19)
    {
       Log::errorf("... Shape with old version.");
@@ -1631,8 +2053,32 @@ bool TSShape::read(Stream * s, TSIOState *options)
          return false;
       }
 
-      S32 * tmp = new S32[sizeMemBuffer];
-      s->read(sizeof(S32)*sizeMemBuffer,(U8*)tmp);
+      memBufferPos = s->getPosition();
+
+      // When reading from memory on a little-endian host the buffer can be
+      // assembled from where it lies, rather than from a copy
+      MemStream *memStream = dynamic_cast<MemStream*>(s);
+      U8 *inPlace = NULL;
+      if (memStream && 0x12345678 == convertLEndianToHost(0x12345678))
+      {
+         U32 pos = memStream->getPosition();
+         inPlace = (U8*)memStream->getBuffer() + pos;
+         if (((size_t)inPlace & 3) != 0 || sizeMemBuffer > (memStream->getStreamSize() - pos) / sizeof(S32))
+            inPlace = NULL;
+      }
+
+      S32 * tmp;
+      if (inPlace)
+      {
+         memStream->setPosition(memStream->getPosition() + sizeof(S32)*sizeMemBuffer);
+         tmp = (S32*)inPlace;
+         ownsMemBuffer = false;
+      }
+      else
+      {
+         tmp = new S32[sizeMemBuffer];
+         s->read(sizeof(S32)*sizeMemBuffer,(U8*)tmp);
+      }
       memBuffer32 = tmp;
       memBuffer16 = (S16*)(tmp+startU16);
       memBuffer8  = (S8*)(tmp+startU8);
@@ -1658,6 +2104,14 @@ bool TSShape::read(Stream * s, TSIOState *options)
       delete materialList; // just in case...
       materialList = new TSMaterialList;
       materialList->read(*s, &ioState);
+
+      if (mReadVersion > 26 && !readCompressedTracks(s))
+      {
+         Log::errorf(LogEntry::General, "Error: bad compressed tracks in shape file.");
+         if (ownsMemBuffer)
+            delete [] memBuffer32;
+         return false;
+      }
    }
 
 	// since we read in the buffers, we need to endian-flip their entire contents...
@@ -1672,7 +2126,12 @@ bool TSShape::read(Stream * s, TSIOState *options)
    assembleShape(ioState); // copy to buffer
    AssertFatal(tsalloc.getSize()==mShapeDataSize,"TSShape::read: shape data buffer size mis-calculated");
 
-   delete [] memBuffer32;
+   // leave the keyframes in the file (older files keep ground frames elsewhere)
+   if (smStreamSequences && mReadVersion > 23 && !mPath.isEmpty())
+      streamSequencesFromFile(ioState, memBufferPos, (const S8*)memBuffer32);
+
+   if (ownsMemBuffer)
+      delete [] memBuffer32;
 
    if (ioState.smInitOnRead)
       init();
@@ -1971,6 +2430,9 @@ void TSShape::createEmptyShape()
    nodeArbitraryScaleFactors.set(NULL, 0);
    groundRotations.set(NULL, 0);
    groundTranslations.set(NULL, 0);
+   compressedTracks.set(NULL, 0);
+   compressedKeyFrames.set(NULL, 0);
+   compressedKeyData.set(NULL, 0);
    triggers.set(NULL, 0);
    billboardDetails.set(NULL, 0);
 
@@ -1978,6 +2440,7 @@ void TSShape::createEmptyShape()
    names[0] = "Detail2";
    names[1] = "Mesh2";
    names[2] = "Mesh";
+   invalidateNameLookup();
 
    radius = 0.866025f;
    tubeRadius = 0.707107f;
@@ -2016,7 +2479,39 @@ void TSShape::fixEndian(S32 * buff32, S16 * buff16, S8 *, S32 count32, S32 count
    }
 }
 
-TSShape *TSShape::createFromPath(const DTShape::Path &path)
+/// Creates a shape and reads a dts file into it, returning NULL if the file
+/// could not be opened. Maps the file where possible so the shape can be
+/// assembled straight from its pages.
+static TSShape *readShapeFile(const String &fullPath, TSIOState *options, bool &readSuccess)
+{
+   TSShape *shape = NULL;
+
+   FileMapping *mapping = TSShape::smUseMappedLoading ? FileMapping::mapFile( fullPath ) : NULL;
+   if ( mapping )
+   {
+      MemStream stream( mapping->getSize(), mapping->getData(), true, false );
+      shape = new TSShape;
+      shape->mPath = fullPath;
+      readSuccess = shape->read(&stream, options);
+      delete mapping;
+      return shape;
+   }
+
+   FileStream stream;
+   stream.open( fullPath, FileStream::Read );
+   if ( stream.getStatus() != Stream::Ok )
+   {
+      Log::errorf( "Resource<TSShape>::create - Could not open '%s'", fullPath.c_str() );
+      return NULL;
+   }
+
+   shape = new TSShape;
+   shape->mPath = fullPath;
+   readSuccess = shape->read(&stream, options);
+   return shape;
+}
+
+TSShape *TSShape::createFromPath(const DTShape::Path &path, TSIOState *options)
 {
 #if 0
    // Execute the shape script if it exists
@@ -2050,17 +2545,9 @@ TSShape *TSShape::createFromPath(const DTShape::Path &path)
 
    if ( extension.equal( "dts", String::NoCase ) )
    {
-      FileStream stream;
-      stream.open( path.getFullPath(), FileStream::Read );
-      if ( stream.getStatus() != Stream::Ok )
-      {
-         Log::errorf( "Resource<TSShape>::create - Could not open '%s'", path.getFullPath().c_str() );
+      ret = readShapeFile( path.getFullPath(), options, readSuccess );
+      if ( !ret )
          return NULL;
-      }
-
-      ret = new TSShape;
-      ret->mPath = path.getFullPath();
-      readSuccess = ret->read(&stream);
    }
    else if ( extension.equal( "dae", String::NoCase ) || extension.equal( "kmz", String::NoCase ) )
    {
@@ -2073,16 +2560,9 @@ TSShape *TSShape::createFromPath(const DTShape::Path &path)
       DTShape::Path cachedPath = path;
       cachedPath.setExtension("cached.dts");
        
-      FileStream stream;
-      stream.open( cachedPath.getFullPath(), FileStream::Read );
-      if ( stream.getStatus() != Stream::Ok )
-      {
-         Log::errorf( "Resource<TSShape>::create - Could not open '%s'", cachedPath.getFullPath().c_str() );
+      ret = readShapeFile( cachedPath.getFullPath(), options, readSuccess );
+      if ( !ret )
          return NULL;
-      }
-      ret = new TSShape;
-      ret->mPath = cachedPath.getFullPath();
-      readSuccess = ret->read(&stream);
 #endif
    }
    else
@@ -54,7 +54,11 @@ BEGIN_NS(DTShape)
 
 class TSMaterialList;
 class TSLastDetail;
+class FileMapping;
 class PhysicsCollision;
+class TSDecalMesh;
+class TSSortedMesh;
+class ThreadPool;
 
 //
 struct CollisionShapeInfo
@@ -106,12 +110,38 @@ public:
    bool smUseOneStrip; // join triangle strips into one long strip on load
    S32  smMinStripSize;     // smallest number of _faces_ allowed per strip (all else put in tri list)
    bool smUseEncodedNormals;
+
+   /// Standard meshes will be given their aligned vertex data from a shape
+   /// blob after the read, so don't compute their tangents
+   bool smSharedVertexData;
+
+   // meshes assembled into while sizing the shape buffer, created on demand
+   TSMesh       *smSizeStandardMesh;
+   TSSkinMesh   *smSizeSkinMesh;
+   TSDecalMesh  *smSizeDecalMesh;
+   TSSortedMesh *smSizeSortedMesh;
+   /// @}
+
+   /// @name Keyframe array locations
+   /// Where assembleShape found the sequence keyframe arrays in the shape
+   /// buffer, so they can be streamed from the file later. Used (and valid)
+   /// during read only.
+   /// @{
+   const S32 *smNodeTranslationKeys;
+   const S16 *smNodeRotationKeys;
+   const S32 *smUniformScaleKeys;
+   const S32 *smAlignedScaleKeys;
+   const S32 *smArbitraryScaleFactorKeys;
+   const S16 *smArbitraryScaleRotKeys;
+   const S32 *smGroundTranslationKeys;
+   const S16 *smGroundRotationKeys;
    /// @}
    
    /// TS Allocator
    TSShapeAlloc tsalloc;
    
    TSIOState();
+   ~TSIOState();
    
    TSIOState& operator= (TSIOState &rhs)
    {
@@ -124,9 +154,29 @@ public:
       smUseOneStrip = rhs.smUseOneStrip;
       smMinStripSize = rhs.smMinStripSize;
       smUseEncodedNormals = rhs.smUseEncodedNormals;
+      smSharedVertexData = rhs.smSharedVertexData;
       return *this;
    }
-   
+
+private:
+   TSIOState(const TSIOState&); ///< Not copyable, owns the sizing meshes
+};
+
+/// Handle to a name interned with TSShape::internName().
+///
+/// Interned names are shared by all shapes and never removed, so a name can
+/// be resolved once and the handle used to find nodes, sequences etc. in
+/// any shape without comparing strings.
+struct TSNameId
+{
+   U32 id;  ///< 0 for an invalid handle
+
+   TSNameId() : id(0) {}
+   explicit TSNameId(U32 i) : id(i) {}
+
+   bool isValid() const { return id != 0; }
+   bool operator==(const TSNameId &other) const { return id == other.id; }
+   bool operator!=(const TSNameId &other) const { return id != other.id; }
 };
 
 /// TSShape stores generic data for a 3space model.
@@ -236,6 +286,35 @@ class TSShape : public StrongRefBase
       TSIntegerSet matFrameMatters;     ///< Set of objects
       /// @}
 
+      /// @name Dense Tracks
+      /// The nodes in rotationMatters and translationMatters as plain lists,
+      /// so entry j is the node animated by track j. Built by initTracks().
+      /// @{
+
+      Vector<S32> rotationNodes;
+      Vector<S32> translationNodes;
+
+      void initTracks();
+      /// @}
+
+      /// @name Compressed Tracks
+      /// Set by TSShape::compressSequence(). When the sequence is compressed its
+      /// rotation and translation keys live in TSShape::compressedTracks (one
+      /// track per entry in rotationNodes, followed by one per entry in
+      /// translationNodes) instead of nodeRotations and nodeTranslations.
+      /// @{
+
+      S32 firstCompressedTrack;
+
+      bool isCompressed() const { return firstCompressedTrack >= 0; }
+      /// @}
+
+      /// Index into TSShape::streamedSequences when the keyframes of this
+      /// sequence are paged in from its file on demand, otherwise -1.
+      S32 streamIndex;
+
+      bool isStreamed() const { return streamIndex >= 0; }
+
       S32 priority;
       U32 flags;
       U32 dirtyFlags; ///< determined at load time
@@ -276,6 +355,102 @@ class TSShape : public StrongRefBase
       void read(Stream *, TSIOState &loadState, bool readNameIndex = true);
       void write(Stream *, TSIOState &loadState, bool writeNameIndex = true) const;
       /// @}
+
+      Sequence() : firstCompressedTrack(-1), streamIndex(-1) { }
+   };
+
+   /// A node rotation or translation track of a compressed sequence. Only some
+   /// of the sequence keyframes are stored (those listed in compressedKeyFrames),
+   /// the rest are linearly interpolated from their neighbours. Each stored key
+   /// is three U16s in compressedKeyData: rotations use smallest-three packing,
+   /// translations are quantized to 16 bits per axis between origin and
+   /// origin + scale * 65535.
+   struct CompressedTrack
+   {
+      S32 firstKey;     ///< index of the first key in compressedKeyFrames
+      S32 numKeys;
+      Point3F origin;   ///< translation tracks only
+      Point3F scale;    ///< translation tracks only
+   };
+
+   /// Decompresses a shape's sequences for as long as it is in scope, then
+   /// drops the decompressed keys and puts the compressed tracks back, so
+   /// keyframes can be written or copied without losing the compression.
+   class TempDecompression
+   {
+      TSShape *mShape;
+      S32 mNumRotations;
+      S32 mNumTranslations;
+      Vector<S32> mFirstTracks;
+      Vector<S32> mBaseRotations;
+      Vector<S32> mBaseTranslations;
+      Vector<CompressedTrack> mTracks;
+      Vector<U16> mKeyFrames;
+      Vector<U16> mKeyData;
+
+      TempDecompression(const TempDecompression&);
+      TempDecompression& operator=(const TempDecompression&);
+
+   public:
+      /// Does nothing if shape is NULL or has no compressed sequences
+      TempDecompression(TSShape *shape);
+      ~TempDecompression();
+   };
+
+   /// The keyframes of a streamed sequence. Only the sequence header stays in
+   /// memory; the keyframes are read from the dts or dsq file when the
+   /// sequence is touched, and may be evicted again by TSSequenceCache.
+   ///
+   /// Each track list gives, for every track of the sequence, the track in
+   /// the file to read it from (dsq files can animate nodes in another order).
+   struct StreamedSequence
+   {
+      TSShape *shape;
+      S32 sequenceIndex;
+      String path;
+
+      /// @name File layout
+      /// Offsets of the first keyframe of track 0 of each array
+      /// @{
+      U32 rotationOffset;
+      U32 translationOffset;
+      U32 scaleOffset;           ///< uniform, aligned or arbitrary scale factors
+      U32 scaleRotationOffset;   ///< arbitrary scale rotations
+      U32 groundTranslationOffset;
+      U32 groundRotationOffset;
+      Vector<S32> rotationTracks;
+      Vector<S32> translationTracks;
+      Vector<S32> scaleTracks;
+      /// @}
+
+      /// @name Paging
+      /// Maintained by TSSequenceCache
+      /// @{
+      bool resident;
+      U32 residentSize;
+      U32 lastUsedFrame;
+      StreamedSequence *prev;
+      StreamedSequence *next;
+      /// @}
+
+      /// @name Keyframes
+      /// Valid while resident, laid out as the shape arrays would be with
+      /// the sequence's base offsets at 0.
+      /// @{
+      Vector<Quat16> rotations;
+      Vector<Point3F> translations;
+      Vector<F32> uniformScales;
+      Vector<Point3F> alignedScales;
+      Vector<Quat16> arbitraryScaleRots;
+      Vector<Point3F> arbitraryScaleFactors;
+      Vector<Quat16> groundRotations;
+      Vector<Point3F> groundTranslations;
+      /// @}
+
+      StreamedSequence();
+
+      bool load();
+      void unload();
    };
 
    /// Describes state of an individual object.  Includes everything in an object that can be
@@ -404,6 +579,10 @@ class TSShape : public StrongRefBase
    Vector<Point3F>                  nodeArbitraryScaleFactors;
    Vector<Quat16>                   groundRotations;
    Vector<Point3F>                  groundTranslations;
+   Vector<CompressedTrack>          compressedTracks;
+   Vector<U16>                      compressedKeyFrames;
+   Vector<U16>                      compressedKeyData;
+   Vector<StreamedSequence*>        streamedSequences;
    Vector<Trigger>                  triggers;
    Vector<TSLastDetail*>            billboardDetails;
    Vector<ConvexHullAccelerator*>   detailCollisionAccelerators;
@@ -460,6 +639,15 @@ class TSShape : public StrongRefBase
    /// level and intra-detail level for each pixel size.
    Vector<LodPair> mDetailLevelLookup;
 
+   /// Returns the intra-detail level of a visible detail level at
+   /// the given pixel size, as stored in mDetailLevelLookup.
+   F32 getIntraDetail( S32 dl, F32 pixelSize ) const
+   {
+      F32 curSize = details[dl].size;
+      F32 nextSize = dl == 0 ? 2.0f * curSize : details[dl - 1].size;
+      return mClampF( nextSize - curSize > 0.01f ? (pixelSize - curSize) / (nextSize - curSize) : 1.0f, 0, 1 );
+   }
+
    /// The GFX vertex format for all detail meshes in the shape.
    /// @see initVertexFeatures()
    GFXVertexFormat mVertexFormat;
@@ -468,10 +656,24 @@ class TSShape : public StrongRefBase
    /// @see initVertexFeatures()
    U32 mVertSize;
 
+   /// The GFX vertex format and size of the packed vertex data of standard
+   /// meshes, when smPackVertices is set.
+   /// @see initVertexFeatures()
+   GFXVertexFormat mPackedVertexFormat;
+   U32 mPackedVertSize;
+
    bool mSequencesConstructed;
 
+   /// Node indices with each subshape's range ordered so parents come
+   /// before their children, built by init(). Node transforms are
+   /// multiplied down the hierarchy in this order.
+   Vector<S32> mNodeOrder;
+
    S8* mShapeData;
    U32 mShapeDataSize;
+
+   /// Shared mapping of the blob this shape was loaded from, if any
+   FileMapping *mBlobMapping;
    
    /// don't load this many of the highest detail levels (although we always
    /// load one renderable detail if there is one)
@@ -479,6 +681,40 @@ class TSShape : public StrongRefBase
    
    DTShape::Path mPath;
 
+   /// @name Name Lookup
+   /// Hashed indices used by the find methods.  Built by init() and rebuilt
+   /// straight away by the shape editing methods, so the const find methods
+   /// only ever read them and may be called from several threads at once.
+   /// Code which changes names or nameIndex members directly must call
+   /// invalidateNameLookup().
+   /// @{
+
+   /// First node, object, detail and sequence using a name
+   struct NameRefs
+   {
+      S32 node;
+      S32 object;
+      S32 detail;
+      S32 sequence;
+   };
+
+   /// Interned name and the index in names it maps to
+   struct NameIdRef
+   {
+      U32 id;
+      S32 nameIndex;
+   };
+
+   Vector<S32> mNameSlots;           ///< Open addressed hash of names, -1 if empty
+   Vector<NameRefs> mNameRefs;       ///< Indexed by nameIndex+1, so unnamed (-1) entries are included
+   Vector<NameIdRef> mNameIdRefs;    ///< Sorted by id
+
+   void _buildNameSlots();
+   void _addNameSlot(S32 nameIndex);
+   void _buildNameRefs();
+   const NameRefs *_findNameRefs(S32 nameIndex) const;
+   /// @}
+
    // shape class has few methods --
    // just constructor/destructor, io, and lookup methods
 
@@ -486,11 +722,12 @@ class TSShape : public StrongRefBase
    TSShape();
    ~TSShape();
    void init();
+   void initShapeData();       ///< everything init() does except initMaterialList()
    void initMaterialList();    ///< you can swap in a new material list, but call this if you do
    bool preloadMaterialList(const DTShape::Path &path); ///< called to preload and validate the materials in the mat list
    
    // Generic helpers to load a shape or cae from a pth
-   static TSShape *createFromPath(const DTShape::Path &path);
+   static TSShape *createFromPath(const DTShape::Path &path, TSIOState *options = NULL);
    
    DTShape::Path getPath() { return mPath; }
 
@@ -499,6 +736,12 @@ class TSShape : public StrongRefBase
    /// Called from init() to calcuate the GFX vertex features for
    /// all detail meshes in the shape.
    void initVertexFeatures();
+
+   /// Reorders the triangles and vertices of meshes for the vertex cache,
+   /// spread over the pool (ThreadPool::getGlobal() if NULL). Only meshes
+   /// whose aligned vertex data hasn't been built yet are optimized.
+   /// @see TSMesh::optimizeTriangleOrder, TSMesh::optimizeVertexOrder
+   void optimizeMeshes( ThreadPool *pool = NULL );
    
    /// Initializes mesh renderers
    void initRender();
@@ -512,13 +755,77 @@ class TSShape : public StrongRefBase
    /// @{
 
    QuatF & getRotation(const Sequence & seq, S32 keyframeNum, S32 rotNum, QuatF *) const;
-   const Point3F & getTranslation(const Sequence & seq, S32 keyframeNum, S32 tranNum) const;
+   Point3F getTranslation(const Sequence & seq, S32 keyframeNum, S32 tranNum) const;
    F32 getUniformScale(const Sequence & seq, S32 keyframeNum, S32 scaleNum) const;
    const Point3F & getAlignedScale(const Sequence & seq, S32 keyframeNum, S32 scaleNum) const;
    TSScale & getArbitraryScale(const Sequence & seq, S32 keyframeNum, S32 scaleNum, TSScale *) const;
    const ObjectState & getObjectState(const Sequence & seq, S32 keyframeNum, S32 objectNum) const;
    /// @}
 
+   /// @name Keyframe Arrays
+   /// The first keyframe of a sequence in each keyframe array. This is in the
+   /// shape arrays, unless the sequence is streamed, in which case it must
+   /// have been touched this frame (see touchSequence).
+   /// @{
+
+   const Quat16 * getRotationKeys(const Sequence & seq) const;
+   const Point3F * getTranslationKeys(const Sequence & seq) const;
+   const F32 * getUniformScaleKeys(const Sequence & seq) const;
+   const Point3F * getAlignedScaleKeys(const Sequence & seq) const;
+   const Quat16 * getArbitraryScaleRotKeys(const Sequence & seq) const;
+   const Point3F * getArbitraryScaleFactorKeys(const Sequence & seq) const;
+   const Quat16 * getGroundRotationKeys(const Sequence & seq) const;
+   const Point3F * getGroundTranslationKeys(const Sequence & seq) const;
+   /// @}
+
+   /// @name Sequence Streaming
+   /// When smStreamSequences is set, dts files read through createFromPath
+   /// and dsq files imported with a path keep only their sequence headers in
+   /// memory. Keyframes are paged in by touchSequence and paged out by
+   /// TSSequenceCache when its memory budget is exceeded.
+   /// @{
+
+   /// Make sure the keyframes of a sequence are in memory, loading them if
+   /// needed. Called by threads when they start playing a sequence and before
+   /// every sample. Returns false if the keyframes could not be read.
+   bool touchSequence(S32 seqIndex) const;
+
+   /// Bring the keyframes of every sequence back into the shape arrays, so
+   /// they can be edited or saved. Decompresses compressed sequences and
+   /// stops streaming streamed ones.
+   void loadAllSequenceKeys();
+   /// @}
+
+   /// @name Track Compression
+   /// Sequences can have their node rotation and translation keys compressed
+   /// once they are final. Keys are dropped wherever interpolating their
+   /// neighbours stays within the given tolerance (radians for rotations, shape
+   /// units for translations), and the remaining keys are quantized. Shape
+   /// edits which change keyframes decompress all sequences first.
+   /// @{
+
+   bool compressSequence(S32 seqIndex, F32 rotTolerance = 0.0005f, F32 posTolerance = 0.0005f);
+   void compressSequences(F32 rotTolerance = 0.0005f, F32 posTolerance = 0.0005f);
+   void decompressSequences();
+   bool hasCompressedSequences() const;
+
+   QuatF & getCompressedRotation(const CompressedTrack & track, S32 keyframeNum, QuatF *) const;
+   Point3F getCompressedTranslation(const CompressedTrack & track, S32 keyframeNum) const;
+
+   /// Returns false, with no sequences compressed, if the tracks are
+   /// truncated or out of range
+   bool readCompressedTracks(Stream *);
+   bool _failCompressedTracks();
+   void writeCompressedTracks(Stream *) const;
+   /// @}
+
+   /// Remove the keyframes of a sequence from the shape arrays, fixing up the
+   /// base offsets of the other sequences.
+   void eraseSequenceKeys(S32 seqIndex, bool nodeTransforms, bool scalesAndGround);
+
+   void streamSequencesFromFile(TSIOState &ioState, U32 bufferOffset, const S8 *buffer);
+   void unstreamSequences();
+
    /// build LOS collision detail
    void computeAccelerator(S32 dl);
    bool buildConvexHull(S32 dl) const;
@@ -601,6 +908,25 @@ class TSShape : public StrongRefBase
    S32 findSequence(S32 nameIndex) const;
    S32 findSequence(const String &name) const { return findSequence(findName(name)); }
 
+   /// Returns the name index for an interned name, or -1 if this shape
+   /// does not use it.
+   S32 findName(TSNameId id) const;
+   S32 findNode(TSNameId id) const { return findNode(findName(id)); }
+   S32 findObject(TSNameId id) const { return findObject(findName(id)); }
+   S32 findDetail(TSNameId id) const { return findDetail(findName(id)); }
+   S32 findSequence(TSNameId id) const { return findSequence(findName(id)); }
+
+   /// Interns a name, returning a handle which can be passed to the find
+   /// methods of any shape.  Names are compared without case.  Thread safe.
+   static TSNameId internName(const String &name);
+
+   /// Returns the string for an interned name.
+   static const char *getInternedName(TSNameId id);
+
+   /// Rebuilds the name lookup after names or nameIndex members have been
+   /// changed directly.
+   void invalidateNameLookup();
+
    S32 getSubShapeForNode(S32 nodeIndex);
    S32 getSubShapeForObject(S32 objIndex);
    void getSubShapeDetails(S32 subShapeIndex, Vector<S32>& validDetails);
@@ -647,6 +973,28 @@ class TSShape : public StrongRefBase
    /// Initializes our TSShape to be ready to receive put mesh data
    void createEmptyShape();
 
+   /// @name Shape Blobs
+   /// A shape blob holds a dts stream followed by the aligned vertex data of
+   /// every standard mesh, at offsets from the start of the blob. Loading a
+   /// blob maps it read-only and shared, so the vertex data of every process
+   /// using the shape lives in the same pages. Blob shapes must not be edited.
+   /// Blobs are little-endian, and can only be written and loaded on
+   /// little-endian hosts.
+   /// @{
+
+   bool writeBlob(Stream *s, TSIOState *options = NULL);
+   static TSShape *createFromBlob(const String &path, TSIOState *options = NULL);
+   bool isBlobShape() const { return mBlobMapping != NULL; }
+
+   /// Bytes of the mesh vertex data which live in the blob mapping
+   U32 getBlobVertexSize() const;
+
+   /// Copies the vertex data of meshes which use the blob mapping, but not
+   /// the vertex size of this shape, back into the mesh vectors so
+   /// initVertexFeatures() can build it locally.
+   void _detachBlobVertexData();
+   /// @}
+
    void exportSequences(Stream *, TSIOState *options = NULL);
    void exportSequence(Stream * s, const TSShape::Sequence& seq, TSIOState *options = NULL);
    bool importSequences(Stream *, const String& sequencePath, TSIOState *options = NULL);
@@ -710,6 +1058,10 @@ class TSShape : public StrongRefBase
    bool setMeshSize(const String& meshName, S32 size);
    bool removeMesh(const String& meshName);
 
+   /// Frees the ray cast hierarchies of every mesh, after meshes
+   /// have been added or removed.
+   void clearRayBVHs();
+
    S32 setDetailSize(S32 oldSize, S32 newSize);
    bool removeDetail(S32 size);
 
@@ -728,6 +1080,41 @@ class TSShape : public StrongRefBase
    
    static bool smAllowHardwareSkinning;
    static bool smUseHardwareSkinning;
+
+   /// Software skin meshes per vertex from a structure of arrays layout,
+   /// rather than batching by bone transform. Limits each vertex to
+   /// TSSkinMesh::BatchData::maxBonePerVertGPU influences. Only affects
+   /// meshes whose batch data has not been created yet.
+   static bool smUseSoASkinning;
+
+   /// Sample node rotations for all threads in one batch using
+   /// m_quat16_nlerp_bulk, and build node transforms in bulk, rather than
+   /// node by node. Gives the same results either way.
+   static bool smUseSoASampling;
+
+   /// Shape instance ray casts and poly lists use each instance's skinned
+   /// vertices, rather than the bind pose of skinned meshes. Instances are
+   /// skinned and refit on demand when first queried after animating.
+   static bool smUseSkinnedCollision;
+
+   /// Load dts files by mapping them into memory and assembling the shape
+   /// directly from the mapping, rather than reading them through a
+   /// FileStream into a temporary buffer.
+   static bool smUseMappedLoading;
+
+   /// Leave sequence keyframes in their dts or dsq file when loading, and
+   /// page them in when sequences are played.
+   static bool smStreamSequences;
+
+   /// Give standard meshes packed vertex data for renderers to upload, about
+   /// half the size of the aligned vertex data. Shapes using the hardware
+   /// skinning vertex format are left unpacked.
+   /// @see TSMesh::packVertexData
+   static bool smPackVertices;
+
+   /// Call optimizeMeshes() from initVertexFeatures(). Shapes written out
+   /// afterwards, such as cached dts files, keep the optimized order.
+   static bool smOptimizeMeshes;
 };
 
 typedef StrongRefPtr<TSShape> TSShapeRef;
@@ -738,30 +1125,90 @@ typedef StrongRefPtr<TSShape> TSShapeRef;
 #define TSSequence TSShape::Sequence
 #define TSDetail TSShape::Detail
 
+inline const Quat16 * TSShape::getRotationKeys(const Sequence & seq) const
+{
+   if (seq.isStreamed())
+      return streamedSequences[seq.streamIndex]->rotations.address();
+   return nodeRotations.address() + seq.baseRotation;
+}
+
+inline const Point3F * TSShape::getTranslationKeys(const Sequence & seq) const
+{
+   if (seq.isStreamed())
+      return streamedSequences[seq.streamIndex]->translations.address();
+   return nodeTranslations.address() + seq.baseTranslation;
+}
+
+inline const F32 * TSShape::getUniformScaleKeys(const Sequence & seq) const
+{
+   if (seq.isStreamed())
+      return streamedSequences[seq.streamIndex]->uniformScales.address();
+   return nodeUniformScales.address() + seq.baseScale;
+}
+
+inline const Point3F * TSShape::getAlignedScaleKeys(const Sequence & seq) const
+{
+   if (seq.isStreamed())
+      return streamedSequences[seq.streamIndex]->alignedScales.address();
+   return nodeAlignedScales.address() + seq.baseScale;
+}
+
+inline const Quat16 * TSShape::getArbitraryScaleRotKeys(const Sequence & seq) const
+{
+   if (seq.isStreamed())
+      return streamedSequences[seq.streamIndex]->arbitraryScaleRots.address();
+   return nodeArbitraryScaleRots.address() + seq.baseScale;
+}
+
+inline const Point3F * TSShape::getArbitraryScaleFactorKeys(const Sequence & seq) const
+{
+   if (seq.isStreamed())
+      return streamedSequences[seq.streamIndex]->arbitraryScaleFactors.address();
+   return nodeArbitraryScaleFactors.address() + seq.baseScale;
+}
+
+inline const Quat16 * TSShape::getGroundRotationKeys(const Sequence & seq) const
+{
+   if (seq.isStreamed())
+      return streamedSequences[seq.streamIndex]->groundRotations.address();
+   return groundRotations.address() + seq.firstGroundFrame;
+}
+
+inline const Point3F * TSShape::getGroundTranslationKeys(const Sequence & seq) const
+{
+   if (seq.isStreamed())
+      return streamedSequences[seq.streamIndex]->groundTranslations.address();
+   return groundTranslations.address() + seq.firstGroundFrame;
+}
+
 inline QuatF & TSShape::getRotation(const Sequence & seq, S32 keyframeNum, S32 rotNum, QuatF * quat) const
 {
-   return nodeRotations[seq.baseRotation + rotNum*seq.numKeyframes + keyframeNum].getQuatF(quat);
+   if (seq.isCompressed())
+      return getCompressedRotation(compressedTracks[seq.firstCompressedTrack + rotNum], keyframeNum, quat);
+   return getRotationKeys(seq)[rotNum*seq.numKeyframes + keyframeNum].getQuatF(quat);
 }
 
-inline const Point3F & TSShape::getTranslation(const Sequence & seq, S32 keyframeNum, S32 tranNum) const
+inline Point3F TSShape::getTranslation(const Sequence & seq, S32 keyframeNum, S32 tranNum) const
 {
-   return nodeTranslations[seq.baseTranslation + tranNum*seq.numKeyframes + keyframeNum];
+   if (seq.isCompressed())
+      return getCompressedTranslation(compressedTracks[seq.firstCompressedTrack + seq.rotationNodes.size() + tranNum], keyframeNum);
+   return getTranslationKeys(seq)[tranNum*seq.numKeyframes + keyframeNum];
 }
 
 inline F32 TSShape::getUniformScale(const Sequence & seq, S32 keyframeNum, S32 scaleNum) const
 {
-   return nodeUniformScales[seq.baseScale + scaleNum*seq.numKeyframes + keyframeNum];
+   return getUniformScaleKeys(seq)[scaleNum*seq.numKeyframes + keyframeNum];
 }
 
 inline const Point3F & TSShape::getAlignedScale(const Sequence & seq, S32 keyframeNum, S32 scaleNum) const
 {
-   return nodeAlignedScales[seq.baseScale + scaleNum*seq.numKeyframes + keyframeNum];
+   return getAlignedScaleKeys(seq)[scaleNum*seq.numKeyframes + keyframeNum];
 }
 
 inline TSScale & TSShape::getArbitraryScale(const Sequence & seq, S32 keyframeNum, S32 scaleNum, TSScale * scale) const
 {
-   nodeArbitraryScaleRots[seq.baseScale + scaleNum*seq.numKeyframes + keyframeNum].getQuatF(&scale->mRotate);
-   scale->mScale = nodeArbitraryScaleFactors[seq.baseScale + scaleNum*seq.numKeyframes + keyframeNum];
+   getArbitraryScaleRotKeys(seq)[scaleNum*seq.numKeyframes + keyframeNum].getQuatF(&scale->mRotate);
+   scale->mScale = getArbitraryScaleFactorKeys(seq)[scaleNum*seq.numKeyframes + keyframeNum];
    return *scale;
 }
 
@@ -0,0 +1,344 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+#include "ts/tsShape.h"
+
+#include "core/stream/memStream.h"
+#include "core/util/endian.h"
+#include "core/log.h"
+#include "platform/fileio.h"
+#include "platform/profiler.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+// Blob layout, all offsets from the start of the blob:
+//
+//    BlobHeader
+//    dts stream                          (at shapeOffset, 16 byte aligned)
+//    aligned vertex data of each mesh    (at BlobMesh::vertexOffset, 16 byte aligned)
+//    BlobMesh table, one per shape mesh  (at meshOffset)
+
+static const U32 BlobMagic = 0x42535444; // 'DTSB'
+static const U32 BlobVersion = 1;
+static const U32 BlobAlign = 16;
+
+enum BlobFlags
+{
+   BlobHardwareSkinFormat = BIT(0),  ///< written with TSShape::smAllowHardwareSkinning set
+};
+
+enum BlobMeshFlags
+{
+   BlobMeshHasColor = BIT(0),
+   BlobMeshHasTVert2 = BIT(1),
+};
+
+struct BlobHeader
+{
+   U32 magic;
+   U32 version;
+   U32 shapeOffset;
+   U32 shapeSize;
+   U32 meshOffset;
+   U32 numMeshes;
+   U32 vertSize;
+   U32 flags;
+};
+
+struct BlobMesh
+{
+   U32 vertexOffset; ///< 0 if the mesh has no vertex data in the blob
+   U32 numVerts;
+   U32 colorOffset;
+   U32 boneOffset;
+   U32 flags;
+};
+
+static bool isLittleEndianHost()
+{
+   return 0x12345678 == convertLEndianToHost(0x12345678);
+}
+
+static void writeBlobHeader(Stream *s, const BlobHeader &hdr)
+{
+   s->write(hdr.magic);
+   s->write(hdr.version);
+   s->write(hdr.shapeOffset);
+   s->write(hdr.shapeSize);
+   s->write(hdr.meshOffset);
+   s->write(hdr.numMeshes);
+   s->write(hdr.vertSize);
+   s->write(hdr.flags);
+}
+
+static void padBlob(Stream *s, U32 start)
+{
+   static const U8 zeros[BlobAlign] = { 0 };
+   U32 pos = s->getPosition() - start;
+   if (pos % BlobAlign)
+      s->write(BlobAlign - (pos % BlobAlign), zeros);
+}
+
+static bool isStandardMesh(const TSMesh *mesh)
+{
+   return mesh && mesh->getMeshType() == TSMesh::StandardMeshType;
+}
+
+//-----------------------------------------------------------------------------
+
+bool TSShape::writeBlob(Stream *s, TSIOState *options)
+{
+   if (!isLittleEndianHost())
+   {
+      Log::errorf("TSShape::writeBlob - shape blobs can only be written on little-endian hosts");
+      return false;
+   }
+
+   PROFILE_SCOPE(TSShape_writeBlob);
+
+   const U32 start = s->getPosition();
+
+   BlobHeader hdr;
+   dMemset(&hdr, 0, sizeof(hdr));
+   hdr.magic = BlobMagic;
+   hdr.version = BlobVersion;
+   hdr.flags = smAllowHardwareSkinning ? BlobHardwareSkinFormat : 0;
+   writeBlobHeader(s, hdr);
+   padBlob(s, start);
+
+   hdr.shapeOffset = s->getPosition() - start;
+   write(s, options);
+   hdr.shapeSize = s->getPosition() - start - hdr.shapeOffset;
+
+   // The vertex data is only laid out once the shape has been initialized
+   Vector<BlobMesh> blobMeshes;
+   blobMeshes.setSize(meshes.size());
+   dMemset(blobMeshes.address(), 0, blobMeshes.memSize());
+   hdr.vertSize = mVertSize;
+
+   for (S32 i = 0; i < meshes.size(); i++)
+   {
+      TSMesh *mesh = meshes[i];
+      if (!isStandardMesh(mesh) || !mesh->mVertexData.isReady() || !mesh->mVertexData.size())
+         continue;
+
+      padBlob(s, start);
+
+      BlobMesh &bm = blobMeshes[i];
+      bm.vertexOffset = s->getPosition() - start;
+      bm.numVerts = mesh->mVertexData.size();
+      bm.colorOffset = mesh->mVertexData.getColorOffset();
+      bm.boneOffset = mesh->mVertexData.getBoneOffset();
+      bm.flags = (mesh->mHasColor ? BlobMeshHasColor : 0) | (mesh->mHasTVert2 ? BlobMeshHasTVert2 : 0);
+
+      s->write(mesh->mVertexData.mem_size(), mesh->mVertexData.address());
+   }
+
+   hdr.meshOffset = s->getPosition() - start;
+   hdr.numMeshes = blobMeshes.size();
+   for (S32 i = 0; i < blobMeshes.size(); i++)
+   {
+      s->write(blobMeshes[i].vertexOffset);
+      s->write(blobMeshes[i].numVerts);
+      s->write(blobMeshes[i].colorOffset);
+      s->write(blobMeshes[i].boneOffset);
+      s->write(blobMeshes[i].flags);
+   }
+
+   // Seeking can leave the stream at EOS, so check for errors first
+   const U32 end = s->getPosition();
+   bool ok = s->getStatus() == Stream::Ok;
+   ok = ok && s->setPosition(start);
+   writeBlobHeader(s, hdr);
+   ok = ok && s->getStatus() != Stream::IOError;
+   return s->setPosition(end) && ok;
+}
+
+TSShape *TSShape::createFromBlob(const String &path, TSIOState *options)
+{
+   if (!isLittleEndianHost())
+   {
+      Log::errorf("TSShape::createFromBlob - shape blobs can only be loaded on little-endian hosts");
+      return NULL;
+   }
+
+   PROFILE_SCOPE(TSShape_createFromBlob);
+
+   FileMapping *mapping = FileMapping::mapFile(path, true);
+   if (!mapping)
+   {
+      Log::errorf("TSShape::createFromBlob - Could not map '%s'", path.c_str());
+      return NULL;
+   }
+
+   const U8 *data = (const U8*)mapping->getData();
+   const U32 size = mapping->getSize();
+
+   // The host is little-endian, so the header can be used where it lies
+   const BlobHeader *hdr = (const BlobHeader*)data;
+   if (size < sizeof(BlobHeader) || hdr->magic != BlobMagic || hdr->version != BlobVersion ||
+       (hdr->shapeOffset & 3) || hdr->shapeOffset > size || hdr->shapeSize > size - hdr->shapeOffset ||
+       hdr->meshOffset > size || hdr->numMeshes > (size - hdr->meshOffset) / sizeof(BlobMesh))
+   {
+      Log::errorf("TSShape::createFromBlob - '%s' is not a valid shape blob", path.c_str());
+      delete mapping;
+      return NULL;
+   }
+   const BlobMesh *blobMeshes = (const BlobMesh*)(data + hdr->meshOffset);
+
+   // Vertex data in another layout has to be built by this process
+   bool attach = hdr->vertSize && ((hdr->flags & BlobHardwareSkinFormat) != 0) == smAllowHardwareSkinning;
+
+   TSIOState ioState;
+   if (options)
+      ioState = *options;
+   ioState.smInitOnRead = false;
+   ioState.smSharedVertexData = attach;
+
+   TSShape *shape = new TSShape;
+   shape->mBlobMapping = mapping;
+
+   // The dts stream is assembled in place, so nothing is written to the mapping
+   MemStream stream(hdr->shapeSize, (void*)(data + hdr->shapeOffset), true, false);
+   if (!shape->read(&stream, &ioState))
+   {
+      Log::errorf("TSShape::createFromBlob - Could not read the shape in '%s'", path.c_str());
+      delete shape;
+      return NULL;
+   }
+
+   if (hdr->numMeshes != shape->meshes.size())
+      attach = false;
+
+   for (S32 i = 0; i < shape->meshes.size(); i++)
+   {
+      TSMesh *mesh = shape->meshes[i];
+      if (!isStandardMesh(mesh))
+         continue;
+
+      const BlobMesh *bm = attach ? &blobMeshes[i] : NULL;
+      if (bm && bm->vertexOffset && !(bm->vertexOffset % BlobAlign) && bm->vertexOffset < size &&
+          bm->numVerts == mesh->verts.size() && bm->numVerts <= (size - bm->vertexOffset) / hdr->vertSize)
+      {
+         mesh->mVertexData.set((void*)(data + bm->vertexOffset), hdr->vertSize, bm->numVerts, bm->colorOffset, bm->boneOffset, false);
+         mesh->mVertexData.setReady(true);
+         mesh->mNumVerts = bm->numVerts;
+         mesh->mHasColor = (bm->flags & BlobMeshHasColor) != 0;
+         mesh->mHasTVert2 = (bm->flags & BlobMeshHasTVert2) != 0;
+
+         // Same as convertToAlignedMeshData, the vectors aren't needed now
+         mesh->verts.free_memory();
+         mesh->norms.free_memory();
+         mesh->tangents.free_memory();
+         mesh->tverts.free_memory();
+         mesh->tverts2.free_memory();
+         mesh->colors.free_memory();
+      }
+      else if (ioState.smSharedVertexData)
+      {
+         // Tangents were left for the blob, so build them for this mesh after all
+         mesh->createTangents(mesh->verts, mesh->norms);
+      }
+   }
+
+   shape->mPath = path;
+
+   if (!options || options->smInitOnRead)
+      shape->init();
+
+   return shape;
+}
+
+U32 TSShape::getBlobVertexSize() const
+{
+   if (!mBlobMapping)
+      return 0;
+
+   const U8 *start = (const U8*)mBlobMapping->getData();
+   const U8 *end = start + mBlobMapping->getSize();
+
+   U32 size = 0;
+   for (S32 i = 0; i < meshes.size(); i++)
+   {
+      const U8 *base = meshes[i] ? (const U8*)meshes[i]->mVertexData.address() : NULL;
+      if (base >= start && base < end)
+         size += meshes[i]->mVertexData.mem_size();
+   }
+   return size;
+}
+
+void TSShape::_detachBlobVertexData()
+{
+   const U8 *start = (const U8*)mBlobMapping->getData();
+   const U8 *end = start + mBlobMapping->getSize();
+
+   for (S32 i = 0; i < meshes.size(); i++)
+   {
+      TSMesh *mesh = meshes[i];
+      const U8 *base = mesh ? (const U8*)mesh->mVertexData.address() : NULL;
+      if (base < start || base >= end || mesh->mVertexData.vertSize() == mVertSize)
+         continue;
+
+      Log::warnf("TSShape::_detachBlobVertexData - '%s' mesh %d was written with a %d byte vertex, not %d",
+         mPath.getFullPath().c_str(), i, (S32)mesh->mVertexData.vertSize(), mVertSize);
+
+      // Same as TSMesh::assemble does before writing, tangents included
+      const U32 numVerts = mesh->mVertexData.size();
+      mesh->verts.setSize(numVerts);
+      mesh->tverts.setSize(numVerts);
+      mesh->norms.setSize(numVerts);
+      mesh->tangents.setSize(numVerts);
+      mesh->colors.setSize(mesh->mHasColor ? numVerts : 0);
+      mesh->tverts2.setSize(mesh->mHasTVert2 ? numVerts : 0);
+
+      for (U32 j = 0; j < numVerts; j++)
+      {
+         const TSMesh::__TSMeshVertexBase &v = mesh->mVertexData.getBase(j);
+         mesh->verts[j] = v.vert();
+         mesh->tverts[j] = v.tvert();
+         mesh->norms[j] = v.normal();
+         mesh->tangents[j] = v.tangent();
+
+         if (mesh->mHasColor || mesh->mHasTVert2)
+         {
+            const TSMesh::__TSMeshVertex_3xUVColor &vc = mesh->mVertexData.getColor(j);
+            if (mesh->mHasColor)
+               vc.color().getColor(&mesh->colors[j]);
+            if (mesh->mHasTVert2)
+               mesh->tverts2[j] = vc.tvert2();
+         }
+      }
+
+      mesh->mVertexData.set(NULL, 0, 0, 0, 0, false);
+      mesh->mVertexData.setReady(false);
+   }
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
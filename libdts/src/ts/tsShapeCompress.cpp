@@ -0,0 +1,598 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "platform/platform.h"
+
+#include "ts/tsShape.h"
+#include "ts/tsTransform.h"
+#include "core/stream/stream.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+// Key packing
+//-----------------------------------------------------------------------------
+
+// The three smallest components of a unit quaternion lie in this range
+static const F32 sSmallestThreeRange = 0.707106781f;
+
+/// Pack a rotation into 48 bits: the index of the largest component in
+/// 2 bits, then the other three components at 15 bits each. The largest
+/// component is made positive (q and -q are the same rotation) so it can be
+/// rebuilt from the other three.
+static void packRotation(const QuatF & rot, U16 * out)
+{
+   QuatF q(rot);
+   q.normalize();
+   F32 c[4] = { q.x, q.y, q.z, q.w };
+
+   U32 largest = 0;
+   for (U32 i=1; i<4; i++)
+      if (mFabs(c[i]) > mFabs(c[largest]))
+         largest = i;
+   F32 sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+   U64 bits = largest;
+   for (U32 i=0; i<4; i++)
+   {
+      if (i == largest)
+         continue;
+      F32 v = (c[i] * sign + sSmallestThreeRange) * (0.5f / sSmallestThreeRange);
+      bits = (bits << 15) | (U32)mClampF(v * 32767.0f + 0.5f, 0.0f, 32767.0f);
+   }
+
+   out[0] = (U16)(bits >> 32);
+   out[1] = (U16)(bits >> 16);
+   out[2] = (U16)bits;
+}
+
+static QuatF & unpackRotation(const U16 * in, QuatF * q)
+{
+   U64 bits = ((U64)in[0] << 32) | ((U64)in[1] << 16) | in[2];
+   U32 largest = (U32)(bits >> 45) & 3;
+
+   F32 c[4];
+   F32 sum = 0.0f;
+   for (S32 i=3; i>=0; i--)
+   {
+      if (i == largest)
+         continue;
+      F32 v = (F32)(bits & 0x7fff) * (2.0f * sSmallestThreeRange / 32767.0f) - sSmallestThreeRange;
+      bits >>= 15;
+      c[i] = v;
+      sum += v * v;
+   }
+   c[largest] = mSqrt(getMax(0.0f, 1.0f - sum));
+
+   q->set(c[0], c[1], c[2], c[3]);
+   return *q;
+}
+
+static void packTranslation(const Point3F & p, const Point3F & origin, const Point3F & invScale, U16 * out)
+{
+   out[0] = (U16)mClampF((p.x - origin.x) * invScale.x + 0.5f, 0.0f, 65535.0f);
+   out[1] = (U16)mClampF((p.y - origin.y) * invScale.y + 0.5f, 0.0f, 65535.0f);
+   out[2] = (U16)mClampF((p.z - origin.z) * invScale.z + 0.5f, 0.0f, 65535.0f);
+}
+
+static inline Point3F unpackTranslation(const U16 * in, const Point3F & origin, const Point3F & scale)
+{
+   return Point3F(origin.x + in[0] * scale.x,
+                  origin.y + in[1] * scale.y,
+                  origin.z + in[2] * scale.z);
+}
+
+/// Find the last stored key at or before the given keyframe
+static inline S32 findCompressedKey(const U16 * frames, S32 numKeys, S32 keyframeNum)
+{
+   S32 lo = 0;
+   S32 hi = numKeys - 1;
+   while (lo < hi)
+   {
+      S32 mid = (lo + hi + 1) >> 1;
+      if (frames[mid] <= keyframeNum)
+         lo = mid;
+      else
+         hi = mid - 1;
+   }
+   return lo;
+}
+
+//-----------------------------------------------------------------------------
+// Key reduction
+//-----------------------------------------------------------------------------
+
+/// Tests whether interpolating between two (quantized) keys reproduces the
+/// original rotations of every frame between them
+struct RotationKeyFit
+{
+   const QuatF * source;
+   const QuatF * decoded;
+   F32 maxChordSq;
+
+   // Compares the distance between the unit quaternions rather than their
+   // dot product, which has no precision left for small angles
+   bool within(QuatF q, S32 frame) const
+   {
+      // TSTransform::interpolate only roughly normalizes
+      q.normalize();
+      const QuatF & s = source[frame];
+      if (q.dot(s) < 0.0f)
+         q.neg();
+      F32 dx = q.x - s.x, dy = q.y - s.y, dz = q.z - s.z, dw = q.w - s.w;
+      return dx*dx + dy*dy + dz*dz + dw*dw <= maxChordSq;
+   }
+
+   bool fits(S32 a, S32 b) const
+   {
+      for (S32 f=a+1; f<b; f++)
+      {
+         QuatF q;
+         TSTransform::interpolate(decoded[a], decoded[b], F32(f-a) / F32(b-a), &q);
+         if (!within(q, f))
+            return false;
+      }
+      return true;
+   }
+
+   bool constant(S32 numFrames) const
+   {
+      for (S32 f=1; f<numFrames; f++)
+         if (!within(decoded[0], f))
+            return false;
+      return true;
+   }
+};
+
+struct TranslationKeyFit
+{
+   const Point3F * source;
+   const Point3F * decoded;
+   F32 tolerance;
+
+   bool within(const Point3F & p, S32 frame) const
+   {
+      return (p - source[frame]).lenSquared() <= tolerance * tolerance;
+   }
+
+   bool fits(S32 a, S32 b) const
+   {
+      for (S32 f=a+1; f<b; f++)
+      {
+         Point3F p;
+         TSTransform::interpolate(decoded[a], decoded[b], F32(f-a) / F32(b-a), &p);
+         if (!within(p, f))
+            return false;
+      }
+      return true;
+   }
+
+   bool constant(S32 numFrames) const
+   {
+      for (S32 f=1; f<numFrames; f++)
+         if (!within(decoded[0], f))
+            return false;
+      return true;
+   }
+};
+
+/// Choose which keyframes of a track to store. Walks forward from each kept
+/// key, extending the span until some frame inside it can no longer be
+/// interpolated within tolerance, then keeps the last key that worked.
+template <class T> static void reduceKeys(const T & fit, S32 numFrames, Vector<S32> & keys)
+{
+   keys.clear();
+   keys.push_back(0);
+   if (numFrames < 2 || fit.constant(numFrames))
+      return;
+
+   S32 a = 0;
+   for (S32 b=2; b<numFrames; b++)
+   {
+      if (!fit.fits(a, b))
+      {
+         a = b - 1;
+         keys.push_back(a);
+      }
+   }
+   keys.push_back(numFrames - 1);
+}
+
+//-----------------------------------------------------------------------------
+// TSShape track compression
+//-----------------------------------------------------------------------------
+
+QuatF & TSShape::getCompressedRotation(const CompressedTrack & track, S32 keyframeNum, QuatF * quat) const
+{
+   const U16 * frames = compressedKeyFrames.address() + track.firstKey;
+   const U16 * data = compressedKeyData.address() + track.firstKey * 3;
+
+   S32 key = findCompressedKey(frames, track.numKeys, keyframeNum);
+   if (frames[key] == keyframeNum || key == track.numKeys - 1)
+      return unpackRotation(data + key * 3, quat);
+
+   QuatF q1, q2;
+   unpackRotation(data + key * 3, &q1);
+   unpackRotation(data + key * 3 + 3, &q2);
+   F32 t = F32(keyframeNum - frames[key]) / F32(frames[key+1] - frames[key]);
+   return TSTransform::interpolate(q1, q2, t, quat);
+}
+
+Point3F TSShape::getCompressedTranslation(const CompressedTrack & track, S32 keyframeNum) const
+{
+   const U16 * frames = compressedKeyFrames.address() + track.firstKey;
+   const U16 * data = compressedKeyData.address() + track.firstKey * 3;
+
+   S32 key = findCompressedKey(frames, track.numKeys, keyframeNum);
+   if (frames[key] == keyframeNum || key == track.numKeys - 1)
+      return unpackTranslation(data + key * 3, track.origin, track.scale);
+
+   Point3F p;
+   F32 t = F32(keyframeNum - frames[key]) / F32(frames[key+1] - frames[key]);
+   TSTransform::interpolate(unpackTranslation(data + key * 3, track.origin, track.scale),
+                            unpackTranslation(data + key * 3 + 3, track.origin, track.scale), t, &p);
+   return p;
+}
+
+bool TSShape::compressSequence(S32 seqIndex, F32 rotTolerance, F32 posTolerance)
+{
+   Sequence & seq = sequences[seqIndex];
+   if (seq.isCompressed() || seq.isStreamed() || seq.numKeyframes < 1 || seq.numKeyframes > U16_MAX)
+      return false;
+
+   seq.initTracks();
+
+   const S32 numFrames = seq.numKeyframes;
+
+   Vector<U16> packed(numFrames * 3);
+   packed.setSize(numFrames * 3);
+   Vector<S32> keys;
+
+   seq.firstCompressedTrack = compressedTracks.size();
+
+   // Rotation tracks
+   {
+      Vector<QuatF> source(numFrames), decoded(numFrames);
+      source.setSize(numFrames);
+      decoded.setSize(numFrames);
+
+      RotationKeyFit fit;
+      fit.source = source.address();
+      fit.decoded = decoded.address();
+      // an angle of a between two rotations is a chord of 2sin(a/4) between
+      // their quaternions
+      F32 maxChord = 2.0f * mSin(rotTolerance * 0.25f);
+      fit.maxChordSq = maxChord * maxChord;
+
+      for (S32 j=0; j<seq.rotationNodes.size(); j++)
+      {
+         for (S32 f=0; f<numFrames; f++)
+         {
+            nodeRotations[seq.baseRotation + j*numFrames + f].getQuatF(&source[f]).normalize();
+            packRotation(source[f], &packed[f*3]);
+            unpackRotation(&packed[f*3], &decoded[f]);
+         }
+         reduceKeys(fit, numFrames, keys);
+
+         compressedTracks.increment();
+         CompressedTrack & track = compressedTracks.last();
+         track.firstKey = compressedKeyFrames.size();
+         track.numKeys = keys.size();
+         track.origin.zero();
+         track.scale.zero();
+         for (S32 k=0; k<keys.size(); k++)
+         {
+            compressedKeyFrames.push_back(keys[k]);
+            compressedKeyData.push_back(packed[keys[k]*3]);
+            compressedKeyData.push_back(packed[keys[k]*3+1]);
+            compressedKeyData.push_back(packed[keys[k]*3+2]);
+         }
+      }
+   }
+
+   // Translation tracks, quantized over the range each one covers
+   {
+      Vector<Point3F> decoded(numFrames);
+      decoded.setSize(numFrames);
+
+      TranslationKeyFit fit;
+      fit.decoded = decoded.address();
+      fit.tolerance = posTolerance;
+
+      for (S32 j=0; j<seq.translationNodes.size(); j++)
+      {
+         const Point3F * source = nodeTranslations.address() + seq.baseTranslation + j*numFrames;
+         fit.source = source;
+
+         Box3F range(source[0], source[0]);
+         for (S32 f=1; f<numFrames; f++)
+            range.extend(source[f]);
+
+         Point3F scale = range.getExtents() / 65535.0f;
+         Point3F invScale(scale.x > 0.0f ? 1.0f / scale.x : 0.0f,
+                          scale.y > 0.0f ? 1.0f / scale.y : 0.0f,
+                          scale.z > 0.0f ? 1.0f / scale.z : 0.0f);
+
+         for (S32 f=0; f<numFrames; f++)
+         {
+            packTranslation(source[f], range.minExtents, invScale, &packed[f*3]);
+            decoded[f] = unpackTranslation(&packed[f*3], range.minExtents, scale);
+         }
+         reduceKeys(fit, numFrames, keys);
+
+         compressedTracks.increment();
+         CompressedTrack & track = compressedTracks.last();
+         track.firstKey = compressedKeyFrames.size();
+         track.numKeys = keys.size();
+         track.origin = range.minExtents;
+         track.scale = scale;
+         for (S32 k=0; k<keys.size(); k++)
+         {
+            compressedKeyFrames.push_back(keys[k]);
+            compressedKeyData.push_back(packed[keys[k]*3]);
+            compressedKeyData.push_back(packed[keys[k]*3+1]);
+            compressedKeyData.push_back(packed[keys[k]*3+2]);
+         }
+      }
+   }
+
+   // Drop the uncompressed keys
+   eraseSequenceKeys(seqIndex, true, false);
+
+   return true;
+}
+
+void TSShape::compressSequences(F32 rotTolerance, F32 posTolerance)
+{
+   for (S32 i=0; i<sequences.size(); i++)
+      compressSequence(i, rotTolerance, posTolerance);
+}
+
+void TSShape::decompressSequences()
+{
+   if (!hasCompressedSequences())
+      return;
+
+   for (S32 i=0; i<sequences.size(); i++)
+   {
+      Sequence & seq = sequences[i];
+      if (!seq.isCompressed())
+         continue;
+
+      const S32 numFrames = seq.numKeyframes;
+      const S32 numRotTracks = seq.rotationMatters.count();
+      const S32 numTransTracks = seq.translationMatters.count();
+      const CompressedTrack * tracks = compressedTracks.address() + seq.firstCompressedTrack;
+
+      S32 baseRotation = nodeRotations.size();
+      nodeRotations.increment(numRotTracks * numFrames);
+      for (S32 j=0; j<numRotTracks; j++)
+      {
+         for (S32 f=0; f<numFrames; f++)
+         {
+            QuatF q;
+            nodeRotations[baseRotation + j*numFrames + f].set(getCompressedRotation(tracks[j], f, &q));
+         }
+      }
+
+      S32 baseTranslation = nodeTranslations.size();
+      nodeTranslations.increment(numTransTracks * numFrames);
+      for (S32 j=0; j<numTransTracks; j++)
+      {
+         for (S32 f=0; f<numFrames; f++)
+            nodeTranslations[baseTranslation + j*numFrames + f] = getCompressedTranslation(tracks[numRotTracks + j], f);
+      }
+
+      seq.baseRotation = baseRotation;
+      seq.baseTranslation = baseTranslation;
+      seq.firstCompressedTrack = -1;
+   }
+
+   compressedTracks.clear();
+   compressedKeyFrames.clear();
+   compressedKeyData.clear();
+}
+
+TSShape::TempDecompression::TempDecompression(TSShape *shape)
+{
+   mShape = NULL;
+   if (!shape || !shape->hasCompressedSequences())
+      return;
+
+   mShape = shape;
+   mNumRotations = shape->nodeRotations.size();
+   mNumTranslations = shape->nodeTranslations.size();
+   mFirstTracks.setSize(shape->sequences.size());
+   mBaseRotations.setSize(shape->sequences.size());
+   mBaseTranslations.setSize(shape->sequences.size());
+   for (S32 i=0; i<shape->sequences.size(); i++)
+   {
+      mFirstTracks[i] = shape->sequences[i].firstCompressedTrack;
+      mBaseRotations[i] = shape->sequences[i].baseRotation;
+      mBaseTranslations[i] = shape->sequences[i].baseTranslation;
+   }
+   mTracks = shape->compressedTracks;
+   mKeyFrames = shape->compressedKeyFrames;
+   mKeyData = shape->compressedKeyData;
+
+   shape->decompressSequences();
+}
+
+TSShape::TempDecompression::~TempDecompression()
+{
+   if (!mShape)
+      return;
+
+   AssertFatal(mShape->sequences.size() == mFirstTracks.size(),
+      "TSShape::TempDecompression - sequences changed while decompressed");
+
+   // the decompressed keys were appended, so drop them from the end
+   mShape->nodeRotations.setSize(mNumRotations);
+   mShape->nodeTranslations.setSize(mNumTranslations);
+   for (S32 i=0; i<mShape->sequences.size(); i++)
+   {
+      mShape->sequences[i].firstCompressedTrack = mFirstTracks[i];
+      mShape->sequences[i].baseRotation = mBaseRotations[i];
+      mShape->sequences[i].baseTranslation = mBaseTranslations[i];
+   }
+   mShape->compressedTracks = mTracks;
+   mShape->compressedKeyFrames = mKeyFrames;
+   mShape->compressedKeyData = mKeyData;
+}
+
+bool TSShape::hasCompressedSequences() const
+{
+   for (S32 i=0; i<sequences.size(); i++)
+      if (sequences[i].isCompressed())
+         return true;
+   return false;
+}
+
+//-----------------------------------------------------------------------------
+// read/write compressed tracks (version 27+, after the material list)
+//-----------------------------------------------------------------------------
+
+void TSShape::writeCompressedTracks(Stream * s) const
+{
+   for (S32 i=0; i<sequences.size(); i++)
+      s->write(sequences[i].firstCompressedTrack);
+
+   s->write(compressedTracks.size());
+   for (S32 i=0; i<compressedTracks.size(); i++)
+   {
+      const CompressedTrack & track = compressedTracks[i];
+      s->write(track.firstKey);
+      s->write(track.numKeys);
+      s->write(track.origin.x);
+      s->write(track.origin.y);
+      s->write(track.origin.z);
+      s->write(track.scale.x);
+      s->write(track.scale.y);
+      s->write(track.scale.z);
+   }
+
+   s->write(compressedKeyFrames.size());
+   for (S32 i=0; i<compressedKeyFrames.size(); i++)
+      s->write(compressedKeyFrames[i]);
+   for (S32 i=0; i<compressedKeyData.size(); i++)
+      s->write(compressedKeyData[i]);
+}
+
+bool TSShape::readCompressedTracks(Stream * s)
+{
+   // the file can't need more tracks or keys than the sequences have
+   S64 maxTracks = 0;
+   S64 maxKeys = 0;
+   for (S32 i=0; i<sequences.size(); i++)
+   {
+      s->read(&sequences[i].firstCompressedTrack);
+
+      const S32 numSeqTracks = sequences[i].rotationMatters.count() + sequences[i].translationMatters.count();
+      maxTracks += numSeqTracks;
+      maxKeys += (S64)numSeqTracks * getMax(sequences[i].numKeyframes, 0);
+   }
+
+   S32 numTracks;
+   s->read(&numTracks);
+   if (s->getStatus() != Stream::Ok || numTracks < 0 || numTracks > maxTracks)
+      return _failCompressedTracks();
+
+   compressedTracks.setSize(numTracks);
+   for (S32 i=0; i<numTracks; i++)
+   {
+      CompressedTrack & track = compressedTracks[i];
+      s->read(&track.firstKey);
+      s->read(&track.numKeys);
+      s->read(&track.origin.x);
+      s->read(&track.origin.y);
+      s->read(&track.origin.z);
+      s->read(&track.scale.x);
+      s->read(&track.scale.y);
+      s->read(&track.scale.z);
+   }
+
+   S32 numKeys;
+   s->read(&numKeys);
+   if (s->getStatus() != Stream::Ok || numKeys < 0 || numKeys > maxKeys)
+      return _failCompressedTracks();
+
+   compressedKeyFrames.setSize(numKeys);
+   compressedKeyData.setSize(numKeys * 3);
+   for (S32 i=0; i<numKeys; i++)
+      s->read(&compressedKeyFrames[i]);
+   for (S32 i=0; i<numKeys*3; i++)
+      s->read(&compressedKeyData[i]);
+   if (s->getStatus() != Stream::Ok)
+      return _failCompressedTracks();
+
+   // every track must lie within the key arrays, with its keys in order and
+   // inside its sequence
+   for (S32 i=0; i<compressedTracks.size(); i++)
+   {
+      const CompressedTrack & track = compressedTracks[i];
+      if (track.firstKey < 0 || track.numKeys < 1 || track.numKeys > numKeys - track.firstKey)
+         return _failCompressedTracks();
+   }
+   for (S32 i=0; i<sequences.size(); i++)
+   {
+      const Sequence & seq = sequences[i];
+      if (seq.firstCompressedTrack < 0)
+      {
+         sequences[i].firstCompressedTrack = -1;
+         continue;
+      }
+
+      const S32 numSeqTracks = seq.rotationMatters.count() + seq.translationMatters.count();
+      if (numSeqTracks > numTracks - seq.firstCompressedTrack)
+         return _failCompressedTracks();
+
+      for (S32 j=0; j<numSeqTracks; j++)
+      {
+         const CompressedTrack & track = compressedTracks[seq.firstCompressedTrack + j];
+         const U16 * frames = compressedKeyFrames.address() + track.firstKey;
+         if (frames[track.numKeys - 1] >= seq.numKeyframes)
+            return _failCompressedTracks();
+         for (S32 k=1; k<track.numKeys; k++)
+         {
+            if (frames[k] <= frames[k-1])
+               return _failCompressedTracks();
+         }
+      }
+   }
+
+   return true;
+}
+
+bool TSShape::_failCompressedTracks()
+{
+   for (S32 i=0; i<sequences.size(); i++)
+      sequences[i].firstCompressedTrack = -1;
+   compressedTracks.clear();
+   compressedKeyFrames.clear();
+   compressedKeyData.clear();
+   return false;
+}
+
+END_NS
@@ -27,6 +27,7 @@
 #include "ts/tsShapeInstance.h"
 #include "ts/tsLastDetail.h"
 #include "ts/tsMaterialList.h"
+#include "ts/tsSequenceCache.h"
 #include "core/stream/fileStream.h"
 
 //-----------------------------------------------------------------------------
@@ -47,6 +48,7 @@ S32 TSShape::addName(const String& name)
       return index;
 
    names.push_back(name);
+   _addNameSlot(names.size()-1);
    return names.size()-1;
 }
 
@@ -99,11 +101,7 @@ void TSShape::updateSmallestVisibleDL()
       // Calculate the intra detail level.
       F32 intraDL = 0;
       if ( dl > -1 )
-      {
-         F32 curSize = details[dl].size;
-         F32 nextSize = dl == 0 ? 2.0f * curSize : details[dl - 1].size;
-         intraDL = mClampF( nextSize - curSize > 0.01f ? (pixelSize - curSize) / (nextSize - curSize) : 1.0f, 0, 1 );
-      }
+         intraDL = getIntraDetail( dl, pixelSize );
 
       mDetailLevelLookup[l].set( dl, intraDL );
    }
@@ -150,6 +148,7 @@ S32 TSShape::addDetail(const String& dname, S32 size, S32 subShapeNum)
    detail.averageError = -1;
    detail.maxError = -1;
    detail.polyCount = 0;
+   invalidateNameLookup();
 
    // Resize alpha vectors
    alphaIn.increment();
@@ -291,6 +290,7 @@ bool TSShape::removeImposter()
 
    // Remove the detail level
    details.erase( detIndex );
+   invalidateNameLookup();
 
    if ( detIndex < billboardDetails.size() )
    {
@@ -357,6 +357,7 @@ bool TSShape::removeName(const String& name)
    adjustForNameRemoval(objects, nameIndex);
    adjustForNameRemoval(sequences, nameIndex);
    adjustForNameRemoval(details, nameIndex);
+   invalidateNameLookup();
 
    return true;
 }
@@ -386,6 +387,7 @@ template<class T> bool doRename(TSShape* shape, Vector<T>& group, const String&
 
    // Do the rename (the old name will be removed if it is no longer in use)
    group[index].nameIndex = shape->addName(newName);
+   shape->invalidateNameLookup();
    shape->removeName(oldName);
    return true;
 }
@@ -414,13 +416,6 @@ bool TSShape::renameSequence(const String& oldName, const String& newName)
 
 bool TSShape::addNode(const String& name, const String& parentName, const Point3F& pos, const QuatF& rot)
 {
-   // Check that adding this node would not exceed the maximum count
-   if (nodes.size() >= MAX_TS_SET_SIZE)
-   {
-      Log::errorf("TSShape::addNode: Cannot add node, shape already has maximum (%d) nodes", MAX_TS_SET_SIZE);
-      return false;
-   }
-
    // Check that there is not already a node with this name
    if (findNode(name) >= 0)
    {
@@ -467,6 +462,7 @@ bool TSShape::addNode(const String& name, const String& parentName, const Point3
    node.firstObject = -1;
    node.nextSibling = -1;
    nodes.insert(nodeIndex, node);
+   invalidateNameLookup();
 
    // Insert node default translation and rotation
    Quat16 rot16;
@@ -543,6 +539,9 @@ bool TSShape::removeNode(const String& name)
 
    S32 nodeParentIndex = nodes[nodeIndex].parentIndex;
 
+   // Node tracks are about to be removed from the sequences
+   loadAllSequenceKeys();
+
    // Warn if there are objects attached to this node
    Vector<S32> nodeObjects;
    getNodeObjects(nodeIndex, nodeObjects);
@@ -583,6 +582,7 @@ bool TSShape::removeNode(const String& name)
 
    // Remove the node
    nodes.erase(nodeIndex);
+   invalidateNameLookup();
    defaultTranslations.erase(nodeIndex);
    defaultRotations.erase(nodeIndex);
 
@@ -675,6 +675,7 @@ S32 TSShape::addObject(const String& objName, S32 subShapeIndex)
    obj.firstDecal = 0;
    obj.nextSibling = 0;
    objects.insert(objIndex, obj);
+   invalidateNameLookup();
 
    // Add default object state
    TSShape::ObjectState state;
@@ -769,6 +770,7 @@ void TSShape::removeMeshFromObject(S32 objIndex, S32 meshIndex)
       }
 
       details.erase(validDetails[meshIndex]);
+      invalidateNameLookup();
    }
 
    // Remove trailing NULL meshes from the object
@@ -835,6 +837,7 @@ bool TSShape::removeObject(const String& name)
 
    // Remove the object from the shape
    objects.erase(objIndex);
+   invalidateNameLookup();
    S32 subShapeIndex = getSubShapeForObject(objIndex);
    subShapeNumObjects[subShapeIndex]--;
    for (S32 i = subShapeIndex + 1; i < subShapeFirstObject.size(); i++)
@@ -863,6 +866,8 @@ bool TSShape::removeObject(const String& name)
    // Update smallest visible detail
    updateSmallestVisibleDL();
 
+   clearRayBVHs();
+
    // Re-initialise the shape
    init();
 
@@ -953,6 +958,12 @@ TSMesh* TSShape::copyMesh( const TSMesh* srcMesh ) const
       mesh->convertToAlignedMeshData();
    }
 
+   // Pack from the aligned data just set up, as the load path does
+   if ( mPackedVertSize && mesh->getMeshType() == TSMesh::StandardMeshType )
+      mesh->packVertexData( &mPackedVertexFormat, mPackedVertSize );
+   else
+      mesh->clearPackedVertexData();
+
    mesh->computeBounds();
 
    if ( mesh->getMeshType() != TSMesh::SkinMeshType )
@@ -1051,6 +1062,8 @@ bool TSShape::addMesh(TSMesh* mesh, const String& meshName)
       }
    }
 
+   clearRayBVHs();
+
    // Re-initialise the shape
    init();
 
@@ -1153,6 +1166,8 @@ bool TSShape::setMeshSize(const String& meshName, S32 size)
    // Update smallest visible detail
    updateSmallestVisibleDL();
 
+   clearRayBVHs();
+
    // Re-initialise the shape
    init();
 
@@ -1181,12 +1196,23 @@ bool TSShape::removeMesh(const String& meshName)
    // Update smallest visible detail
    updateSmallestVisibleDL();
 
+   clearRayBVHs();
+
    // Re-initialise the shape
    init();
 
    return true;
 }
 
+void TSShape::clearRayBVHs()
+{
+   for (S32 i = 0; i < meshes.size(); i++)
+   {
+      if (meshes[i])
+         meshes[i]->clearRayBVH();
+   }
+}
+
 //-----------------------------------------------------------------------------
 
 // Helper function for dealing with some of the Vectors used in a TSShape. 'meshes'
@@ -1245,6 +1271,7 @@ S32 TSShape::setDetailSize(S32 oldSize, S32 newSize)
 
    // Add the detail at its new position
    details.insert( newIndex, tmpDetail );
+   invalidateNameLookup();
 
    // Rename the detail so its trailing size value is correct
    {
@@ -1344,6 +1371,8 @@ bool TSShape::removeDetail( S32 size )
    // Update smallest visible detail
    updateSmallestVisibleDL();
 
+   clearRayBVHs();
+
    // Re-initialise the shape
    init();
 
@@ -1390,6 +1419,7 @@ bool TSShape::addSequence(const DTShape::Path& path, const String& fromSeq,
             // Use a dummy intermediate name since we might be renaming from an
             // existing name (and we want to rename the right sequence!)
             sequences.last().nameIndex = addName("__dummy__");
+            invalidateNameLookup();
             renameSequence("__dummy__", name);
          }
       }
@@ -1405,6 +1435,7 @@ bool TSShape::addSequence(const DTShape::Path& path, const String& fromSeq,
             Log::errorf("TSShape::addSequence: Failed to add sequence '%s' "
                "(name already exists)", getName(nameIndex).c_str());
             sequences[i].nameIndex = addName("__dummy__");
+            invalidateNameLookup();
             removeSequence("__dummy__");
             if (i == sequences.size())
                lastSequenceRejected = true;
@@ -1462,6 +1493,14 @@ bool TSShape::addSequence(const DTShape::Path& path, const String& fromSeq,
       oldName = path.getFullPath();
    }
 
+   // Keyframes are copied directly from the source sequence. Another shape
+   // is only decompressed while its keys are copied, but this shape gains
+   // keys here so stays decompressed, like any other keyframe edit.
+   srcShape->unstreamSequences();
+   if (srcShape == this)
+      loadAllSequenceKeys();
+   TempDecompression decompressed(srcShape != this ? srcShape : NULL);
+
    // Find the sequence
    S32 seqIndex = srcShape->findSequence(oldName);
    if (seqIndex < 0)
@@ -1506,6 +1545,7 @@ bool TSShape::addSequence(const DTShape::Path& path, const String& fromSeq,
    seq = *srcSeq;
 
    seq.nameIndex = addName(name);
+   invalidateNameLookup();
    seq.numKeyframes = endFrame - startFrame + 1;
    if (seq.duration > 0)
       seq.duration *= ((F32)seq.numKeyframes / srcSeq->numKeyframes);
@@ -1756,6 +1796,8 @@ bool TSShape::addSequence(const DTShape::Path& path, const String& fromSeq,
    mFlags &= ~(AnyScale);
    mFlags |= getMax(curVal, seq.flags & AnyScale);    // take the larger value (can only convert upwards)
 
+   seq.initTracks();
+
    // Set sequence flags
    seq.dirtyFlags = 0;
    if (seq.rotationMatters.testAll() || seq.translationMatters.testAll() || seq.scaleMatters.testAll())
@@ -1778,6 +1820,71 @@ bool TSShape::addSequence(const DTShape::Path& path, const String& fromSeq,
    return true;
 }
 
+void TSShape::eraseSequenceKeys(S32 seqIndex, bool nodeTransforms, bool scalesAndGround)
+{
+   Sequence & seq = sequences[seqIndex];
+
+   const S32 numRots = nodeTransforms ? seq.rotationMatters.count() * seq.numKeyframes : 0;
+   const S32 numTrans = nodeTransforms ? seq.translationMatters.count() * seq.numKeyframes : 0;
+   const S32 numScales = scalesAndGround ? seq.scaleMatters.count() * seq.numKeyframes : 0;
+   const S32 numGround = scalesAndGround ? seq.numGroundFrames : 0;
+   const U32 scaleType = seq.flags & AnyScale;
+
+   // Fixup the other sequences whose keys are in the shape arrays. Compressed
+   // sequences only have scale and ground keys there.
+   for (S32 i = 0; i < sequences.size(); i++)
+   {
+      Sequence & other = sequences[i];
+      if (i == seqIndex || other.isStreamed())
+         continue;
+
+      if (!other.isCompressed())
+      {
+         if (numRots && other.baseRotation >= seq.baseRotation + numRots)
+            other.baseRotation -= numRots;
+         if (numTrans && other.baseTranslation >= seq.baseTranslation + numTrans)
+            other.baseTranslation -= numTrans;
+      }
+      if (numScales && (other.flags & AnyScale) == scaleType && other.baseScale >= seq.baseScale + numScales)
+         other.baseScale -= numScales;
+      if (numGround && other.firstGroundFrame >= seq.firstGroundFrame + numGround)
+         other.firstGroundFrame -= numGround;
+   }
+
+   if (numRots)
+      nodeRotations.erase(seq.baseRotation, numRots);
+   if (numTrans)
+      nodeTranslations.erase(seq.baseTranslation, numTrans);
+   if (numScales)
+   {
+      if (seq.animatesArbitraryScale())
+      {
+         nodeArbitraryScaleRots.erase(seq.baseScale, numScales);
+         nodeArbitraryScaleFactors.erase(seq.baseScale, numScales);
+      }
+      else if (seq.animatesAlignedScale())
+         nodeAlignedScales.erase(seq.baseScale, numScales);
+      else
+         nodeUniformScales.erase(seq.baseScale, numScales);
+   }
+   if (numGround)
+   {
+      groundTranslations.erase(seq.firstGroundFrame, numGround);
+      groundRotations.erase(seq.firstGroundFrame, numGround);
+   }
+
+   if (nodeTransforms)
+   {
+      seq.baseRotation = 0;
+      seq.baseTranslation = 0;
+   }
+   if (scalesAndGround)
+   {
+      seq.baseScale = 0;
+      seq.firstGroundFrame = 0;
+   }
+}
+
 bool TSShape::removeSequence(const String& name)
 {
    // Find the sequence to be removed
@@ -1788,6 +1895,7 @@ bool TSShape::removeSequence(const String& name)
       return false;
    }
 
+   loadAllSequenceKeys();
    TSShape::Sequence& seq = sequences[seqIndex];
 
    // Remove the node transforms for this sequence
@@ -1829,6 +1937,7 @@ bool TSShape::removeSequence(const String& name)
 
    // Remove the sequence itself
    sequences.erase(seqIndex);
+   invalidateNameLookup();
 
    // Remove the sequence name if it is no longer in use
    removeName(name);
@@ -1969,22 +2078,19 @@ bool TSShape::removeTrigger(const String& seqName, S32 keyframe, S32 state)
 
 void TSShape::getNodeKeyframe(S32 nodeIndex, const TSShape::Sequence& seq, S32 keyframe, MatrixF* mat) const
 {
+   if (seq.isStreamed())
+      TSSequenceCache::touch(streamedSequences[seq.streamIndex]);
+
    // Get the node rotation and translation
    QuatF rot;
    if (seq.rotationMatters.test(nodeIndex))
-   {
-      S32 index = seq.rotationMatters.count(nodeIndex) * seq.numKeyframes + keyframe;
-      nodeRotations[seq.baseRotation + index].getQuatF(&rot);
-   }   
+      getRotation(seq, keyframe, seq.rotationMatters.count(nodeIndex), &rot);
    else
       defaultRotations[nodeIndex].getQuatF(&rot);
 
    Point3F trans;
    if (seq.translationMatters.test(nodeIndex))
-   {
-      S32 index = seq.translationMatters.count(nodeIndex) * seq.numKeyframes + keyframe;
-      trans = nodeTranslations[seq.baseTranslation + index];
-   }
+      trans = getTranslation(seq, keyframe, seq.translationMatters.count(nodeIndex));
    else
       trans = defaultTranslations[nodeIndex];
 
@@ -2023,6 +2129,9 @@ bool TSShape::setSequenceBlend(const String& seqName, bool blend, const String&
       return false;
    }
 
+   // Keyframes are modified in place below
+   loadAllSequenceKeys();
+
    // Set the new flag
    if (blend)
       seq.flags |= TSShape::Blend;
@@ -2088,6 +2197,9 @@ bool TSShape::setSequenceGroundSpeed(const String& seqName, const Point3F& trans
       Log::errorf("setSequenceGroundSpeed: Could not find sequence named '%s'", seqName.c_str());
       return false;
    }
+
+   // Ground frames are modified in place below
+   loadAllSequenceKeys();
    TSShape::Sequence& seq = sequences[seqIndex];
 
    // Determine how many ground-frames to generate (FPS=10, at least 1 frame)
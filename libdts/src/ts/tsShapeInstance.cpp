@@ -28,9 +28,12 @@
 #include "ts/tsMaterialList.h"
 #include "ts/tsDecal.h"
 #include "platform/profiler.h"
+#include "platform/threads/threadPool.h"
 #include "ts/tsMaterialManager.h"
 #include "ts/tsMaterial.h"
 #include "math/util/frustum.h"
+#include "math/mPlane.h"
+#include "ts/tsMeshIntrinsics.h"
 
 //-----------------------------------------------------------------------------
 
@@ -557,12 +560,35 @@ S32 TSShapeInstance::setDetailFromDistance( const TSSceneRenderState *state, F32
    // For debugging/metrics.
    mCurrentRenderState->smLastPixelSize = pixelSize;
 
+   return _setDetailFromPixelSize( pixelSize, 0.0f );
+}
+
+S32 TSShapeInstance::_setDetailFromPixelSize( F32 pixelSize, F32 hysteresis )
+{
+   const S32 prevDetailLevel = mCurrentDetailLevel;
+
    // Clamp it to an acceptable range for the lookup table.
    U32 index = (U32)mClampF( pixelSize, 0, mShape->mDetailLevelLookup.size() - 1 );
 
    // Check the lookup table for the detail and intra detail levels.
    mShape->mDetailLevelLookup[ index ].get( mCurrentDetailLevel, mCurrentIntraDetailLevel );
 
+   // Keep the previous detail level until the pixel size is well past
+   // the range it is selected for.
+   if (  hysteresis > 0.0f && 
+         mCurrentDetailLevel != prevDetailLevel && 
+         prevDetailLevel >= 0 && 
+         prevDetailLevel <= mShape->mSmallestVisibleDL )
+   {
+      const F32 minSize = mShape->details[prevDetailLevel].size * ( 1.0f - hysteresis );
+      const F32 maxSize = prevDetailLevel == 0 ? F32_MAX : mShape->details[prevDetailLevel - 1].size * ( 1.0f + hysteresis );
+      if ( pixelSize > minSize && pixelSize <= maxSize )
+      {
+         mCurrentDetailLevel = prevDetailLevel;
+         mCurrentIntraDetailLevel = mShape->getIntraDetail( prevDetailLevel, pixelSize );
+      }
+   }
+
    // Restrict the chosen detail level by cutoff value.
    if ( mCurrentRenderState->smNumSkipRenderDetails > 0 && mCurrentDetailLevel >= 0 )
    {
@@ -577,6 +603,92 @@ S32 TSShapeInstance::setDetailFromDistance( const TSSceneRenderState *state, F32
    return mCurrentDetailLevel;
 }
 
+U32 TSShapeInstance::setDetailsFromPosAndScale(  const TSSceneRenderState *state,
+                                                TSShapeInstance * const *instances,
+                                                const Point3F *positions,
+                                                const Point3F *scales,
+                                                U32 count,
+                                                const PlaneF *cullPlanes,
+                                                U32 numCullPlanes,
+                                                F32 hysteresis,
+                                                Vector<U32> *outVisible )
+{
+   PROFILE_SCOPE( TSShapeInstance_setDetailsFromPosAndScale );
+
+   if ( outVisible )
+      outVisible->clear();
+
+   // See setDetailFromDistance().
+   const Point3F eye = state->getDiffuseCameraPosition();
+   const F32 pixelScale = state->getWorldToScreenScale().y * ( state->getViewport().extent.y / 300.0f );
+
+   // Instances are done a block at a time so the working arrays stay in
+   // the cache between the passes.
+   const U32 BlockSize = 256;
+   F32 lodRadius[BlockSize];
+   F32 cullRadius[BlockSize];
+   F32 pixelSize[BlockSize];
+
+   U32 numVisible = 0;
+   for ( U32 start = 0; start < count; start += BlockSize )
+   {
+      const U32 blockCount = getMin( count - start, BlockSize );
+
+      for ( U32 i = 0; i < blockCount; i++ )
+      {
+         const TSShape *shape = instances[start + i]->mShape;
+         const Point3F &scale = scales[start + i];
+         const F32 maxScale = getMax( getMax( scale.x, scale.y ), scale.z );
+
+         // The bounds may be anywhere around the shape's origin
+         lodRadius[i] = shape->radius * maxScale;
+         cullRadius[i] = ( shape->center.len() + shape->radius ) * maxScale;
+      }
+
+      m_sphere_pixel_size_bulk( blockCount, positions + start, lodRadius, cullRadius, eye, pixelScale,
+                                cullPlanes, cullPlanes ? numCullPlanes : 0, pixelSize );
+
+      for ( U32 i = 0; i < blockCount; i++ )
+      {
+         TSShapeInstance *inst = instances[start + i];
+         const TSShape *shape = inst->mShape;
+
+         if ( pixelSize[i] < 0.0f )
+         {
+            inst->mCurrentDetailLevel = -1;
+            inst->mCurrentIntraDetailLevel = 0.0f;
+            continue;
+         }
+
+         if ( shape->mUseDetailFromScreenError )
+         {
+            // Legacy shapes go the long way round
+            const Point3F &scale = scales[start + i];
+            const F32 dist = getMax( ( positions[start + i] - eye ).len(), 0.01f );
+            inst->setDetailFromDistance( state, dist / getMax( getMax( scale.x, scale.y ), scale.z ) );
+         }
+         else
+         {
+            F32 size = pixelSize[i] * inst->mCurrentRenderState->smDetailAdjust;
+            if (  size > inst->mCurrentRenderState->smSmallestVisiblePixelSize &&
+                  size <= shape->mSmallestVisibleSize )
+               size = shape->mSmallestVisibleSize + 0.01f;
+
+            inst->_setDetailFromPixelSize( size, hysteresis );
+         }
+
+         if ( inst->mCurrentDetailLevel >= 0 )
+         {
+            numVisible++;
+            if ( outVisible )
+               outVisible->push_back( start + i );
+         }
+      }
+   }
+
+   return numVisible;
+}
+
 S32 TSShapeInstance::setDetailFromScreenError( F32 errorTolerance )
 {
    PROFILE_SCOPE( TSShapeInstance_setDetailFromScreenError );
@@ -672,7 +784,10 @@ void TSShapeInstance::MeshObjectInstance::render(  S32 objectDetail,
 
    //const MatrixF *worldMatrix = rdata.getSceneState()->getWorldMatrix();
    //rdata.mWorldMatrix = *worldMatrix;
-   rdata.mWorldMatrix = transform;//.mul(transform);
+   if ( rdata.getInstanceTransform() )
+      rdata.mWorldMatrix.mul( *rdata.getInstanceTransform(), transform );
+   else
+      rdata.mWorldMatrix = transform;//.mul(transform);
 
    mesh->setFade( visible * alpha );
    
@@ -687,7 +802,17 @@ void TSShapeInstance::MeshObjectInstance::render(  S32 objectDetail,
    // Store skin mesh transforms in mActiveTransforms
    if (isSkinDirty && mesh->getMeshType() == TSMesh::SkinMeshType)
    {
-      static_cast<TSSkinMesh*>(mesh)->updateSkinBones(*mTransforms, mActiveTransforms);
+      TSSkinMesh *skinMesh = static_cast<TSSkinMesh*>(mesh);
+
+      // Already skinned by TSShapeInstance::updateSkins()?
+      if (mSkinnedMesh == skinMesh)
+      {
+         skinMesh->render( materials, rdata, mSkinnedVerts, *mesh->mRenderer );
+         mLastTime = currTime;
+         return;
+      }
+
+      skinMesh->updateSkinBones(*mTransforms, mActiveTransforms);
    }
 
    mesh->render(  materials, 
@@ -700,9 +825,138 @@ void TSShapeInstance::MeshObjectInstance::render(  S32 objectDetail,
    mLastTime = currTime;
 }
 
+//-------------------------------------------------------------------------------------
+// Parallel skinning
+//-------------------------------------------------------------------------------------
+
+struct TSSkinWorkItem
+{
+   TSShapeInstance::MeshObjectInstance *meshObj;
+   TSSkinMesh *mesh;
+};
+
+static void _updateSkinWorkItem( void *data, U32 index, U32 workerIndex )
+{
+   TSSkinWorkItem &item = reinterpret_cast<TSSkinWorkItem*>( data )[index];
+   TSShapeInstance::MeshObjectInstance *meshObj = item.meshObj;
+
+   // Both outputs are owned by the mesh object instance, and were sized
+   // up front so nothing here allocates
+   item.mesh->updateSkinBones( *meshObj->mTransforms, meshObj->mActiveTransforms );
+
+   if ( !TSShape::smUseHardwareSkinning )
+      item.mesh->skinVerts( meshObj->mActiveTransforms.address(), 
+                            reinterpret_cast<U8*>( meshObj->mSkinnedVerts.address() ),
+                            meshObj->mSkinnedVerts.vertSize() );
+}
+
+void TSShapeInstance::updateSkins( const Vector<SkinUpdate> &updates, ThreadPool *pool )
+{
+   PROFILE_SCOPE( TSShapeInstance_updateSkins );
+
+   Vector<TSSkinWorkItem> items;
+
+   // Forget previous results first, so a mesh object listed more than
+   // once is only claimed by the first entry
+   for ( U32 i = 0; i < updates.size(); i++ )
+   {
+      TSShapeInstance *inst = updates[i].instance;
+      for ( U32 j = 0; j < inst->mMeshObjects.size(); j++ )
+      {
+         inst->mMeshObjects[j].mSkinnedMesh = NULL;
+         inst->mMeshObjects[j].clearCollisionSkin();
+      }
+   }
+
+   // Gather the meshes to skin.  Any lazy setup of the shared mesh data
+   // has to happen here, before the work is handed out.
+   for ( U32 i = 0; i < updates.size(); i++ )
+   {
+      TSShapeInstance *inst = updates[i].instance;
+      const S32 dl = updates[i].detailLevel;
+      if ( dl < 0 || dl >= inst->mShape->details.size() )
+         continue;
+
+      const TSDetail &detail = inst->mShape->details[dl];
+      const S32 ss = detail.subShapeNum;
+      const S32 od = detail.objectDetailNum;
+      if ( ss < 0 )
+         continue;
+
+      const S32 start = inst->mShape->subShapeFirstObject[ss];
+      const S32 end = start + inst->mShape->subShapeNumObjects[ss];
+      for ( S32 j = start; j < end; j++ )
+      {
+         MeshObjectInstance &meshObj = inst->mMeshObjects[j];
+         if ( meshObj.forceHidden || meshObj.visible <= 0.01f || meshObj.mSkinnedMesh )
+            continue;
+
+         TSMesh *mesh = meshObj.getMesh( od );
+         if ( !mesh || mesh->getMeshType() != TSMesh::SkinMeshType || mesh->mNumVerts == 0 )
+            continue;
+
+         TSSkinMesh *skinMesh = static_cast<TSSkinMesh*>( mesh );
+         skinMesh->convertToAlignedMeshData();
+         skinMesh->createBatchData();
+
+         meshObj.mActiveTransforms.setSize( skinMesh->batchData.nodeIndex.size() );
+         if ( !TSShape::smUseHardwareSkinning )
+         {
+            skinMesh->initSkinnedVerts( meshObj.mSkinnedVerts );
+            meshObj.mCollisionMesh = skinMesh;
+         }
+
+         meshObj.mSkinnedMesh = skinMesh;
+
+         items.increment();
+         items.last().meshObj = &meshObj;
+         items.last().mesh = skinMesh;
+      }
+   }
+
+   if ( !pool )
+      pool = &ThreadPool::getGlobal();
+
+   pool->parallelFor( items.size(), _updateSkinWorkItem, items.address() );
+}
+
+bool TSShapeInstance::MeshObjectInstance::updateCollisionSkin( TSSkinMesh *mesh )
+{
+   if ( mCollisionMesh == mesh )
+      return true;
+
+   if ( mesh->mNumVerts == 0 )
+      return false;
+
+   PROFILE_SCOPE( TSShapeInstance_updateCollisionSkin );
+
+   mesh->convertToAlignedMeshData();
+   mesh->createBatchData();
+
+   // The outputs are about to be reused, so anything skinned for rendering
+   // another detail level has to be redone when it is drawn
+   if ( mSkinnedMesh != mesh )
+      mSkinnedMesh = NULL;
+   mSkinnedRayMesh = NULL;
+
+   mesh->initSkinnedVerts( mSkinnedVerts );
+   mesh->updateSkinBones( *mTransforms, mActiveTransforms );
+   mesh->skinVerts( mActiveTransforms.address(),
+                    reinterpret_cast<U8*>( mSkinnedVerts.address() ),
+                    mSkinnedVerts.vertSize() );
+
+   // Rendering can pick up the same result
+   if ( !TSShape::smUseHardwareSkinning )
+      mSkinnedMesh = mesh;
+
+   mCollisionMesh = mesh;
+   return true;
+}
+
 TSShapeInstance::MeshObjectInstance::MeshObjectInstance() 
    : meshList(0), object(0), frame(0), matFrame(0),
-     visible(1.0f), forceHidden(false), mLastTime( 0 )
+     visible(1.0f), forceHidden(false), mLastTime( 0 ), mSkinnedMesh( NULL ),
+     mCollisionMesh( NULL ), mSkinnedRayMesh( NULL )
 {
 }
 
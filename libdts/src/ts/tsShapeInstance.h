@@ -48,10 +48,13 @@ BEGIN_NS(DTShape)
 
 class RenderItem;
 class TSThread;
+struct TSKeyframePair;
 class ConvexFeature;
 class TSSceneRenderState;
 class TSMeshInstanceRenderData;
 class TSShapeInstance;
+class ThreadPool;
+class PlaneF;
 
 
 //-------------------------------------------------------------------------------------
@@ -104,6 +107,7 @@ class TSShapeInstance
    friend class TSThread;
    friend class TSLastDetail;
    friend class TSPartInstance;
+   friend class TSAnimationBatch;
 
    /// Base class for all renderable objects, including mesh objects and decal objects.
    ///
@@ -166,6 +170,43 @@ class TSShapeInstance
       /// For GPU Skinning
       Vector<MatrixF> mActiveTransforms;
 
+      /// @name Software Skinning Output
+      /// Filled in by TSShapeInstance::updateSkins() so that instances
+      /// sharing a shape can be skinned concurrently.
+      /// @{
+      TSMesh::TSMeshVertexArray mSkinnedVerts;
+
+      /// The mesh mSkinnedVerts currently holds skinned data for, or
+      /// NULL if the skin must be updated when rendering.
+      TSSkinMesh *mSkinnedMesh;
+      /// @}
+
+      /// @name Skinned Collision
+      /// Used when TSShape::smUseSkinnedCollision is set, and only brought
+      /// up to date when a collision query reaches this object.
+      /// @{
+
+      /// The mesh mSkinnedVerts holds current positions for, or NULL.
+      /// Unlike mSkinnedMesh this is never set by hardware skinning.
+      TSSkinMesh *mCollisionMesh;
+
+      /// Bounds of the mesh's ray cast hierarchy refit to mSkinnedVerts
+      Vector<TSMeshBVH::Node> mSkinnedRayNodes;
+
+      /// The mesh mSkinnedRayNodes were refit for, or NULL
+      TSSkinMesh *mSkinnedRayMesh;
+
+      /// Skins mesh into mSkinnedVerts if they are out of date.  Not thread
+      /// safe for the same instance, and the shared mesh data is set up
+      /// lazily on first use.
+      bool updateCollisionSkin( TSSkinMesh *mesh );
+
+      /// Marks skinned collision data as out of date
+      void clearCollisionSkin() { mCollisionMesh = NULL; mSkinnedRayMesh = NULL; }
+
+      bool castRaySkinned( TSSkinMesh *mesh, const Point3F &start, const Point3F &end, RayInfo *info, TSMaterialList *materials );
+      /// @}
+
       MeshObjectInstance();
       virtual ~MeshObjectInstance() {}
 
@@ -184,6 +225,13 @@ class TSShapeInstance
       bool castRayRendered( S32 objectDetail, const Point3F &start, const Point3F &end, RayInfo *info, TSMaterialList *materials );
 
      /// @}
+
+   private:
+
+      /// mSkinnedVerts owns its buffer, so copies would free it twice.
+      /// Vector moves elements without copying them when it grows.
+      MeshObjectInstance( const MeshObjectInstance& );
+      MeshObjectInstance& operator=( const MeshObjectInstance& );
    };
 
    protected:
@@ -192,6 +240,7 @@ class TSShapeInstance
    {
       TSCallback * callback;
       S32 nodeIndex;
+      MatrixF baseTransform;  ///< Local transform passed to the callback by the last animateNodes()
    };
 
 //-------------------------------------------------------------------------------------
@@ -278,6 +327,13 @@ protected:
    TSIntegerSet mHandsOffNodes;        ///< Nodes that aren't animated through threads automatically
    TSIntegerSet mCallbackNodes;
 
+   /// Nodes passed to setNodeDirty() since they were last animated
+   TSIntegerSet mDirtyNodes;
+
+   /// Local node transforms from the last animateNodes(), only kept for
+   /// instances with hands-off or callback nodes
+   Vector<MatrixF> mNodeLocalTransforms;
+
    // node callbacks
    Vector<TSCallbackRecord> mNodeCallbacks;
 
@@ -449,15 +505,49 @@ protected:
    virtual void render( TSRenderState &rdata );
    virtual void render( TSRenderState &rdata, S32 dl, F32 intraDL = 0.0f );
 
+   /// @name Parallel Skinning
+   /// @{
+
+   struct SkinUpdate
+   {
+      TSShapeInstance *instance;
+      S32 detailLevel;
+
+      SkinUpdate() : instance( NULL ), detailLevel( -1 ) {}
+      SkinUpdate( TSShapeInstance *inst, S32 dl ) : instance( inst ), detailLevel( dl ) {}
+   };
+
+   /// Updates the skinned meshes of each instance at the given detail
+   /// level, spreading the work over the pool (or the global pool if NULL).
+   /// Instances must already be animated.  The results are picked up by
+   /// the next render of that detail level, until the nodes are animated
+   /// again.  An instance should only be listed once per call.
+   static void updateSkins( const Vector<SkinUpdate> &updates, ThreadPool *pool = NULL );
+   /// @}
+
    void animate() { animate( mCurrentDetailLevel ); }
    void animate(S32 dl);
    void animateNodes(S32 ss);
+   void animateDirtyNodes(S32 ss);
    void animateVisibility(S32 ss);
    void animateFrame(S32 ss);
    void animateMatFrame(S32 ss);
    void animateSubtrees(bool forceFull = true);
    void animateNodeSubtrees(bool forceFull = true);
 
+   /// Marks a hands-off or callback node as changed, so the next animate()
+   /// updates it and the nodes below it. Call this after writing the
+   /// mNodeTransforms of a hands-off node, or when a callback would set a
+   /// different transform. When no thread has moved, only those subtrees
+   /// are updated.
+   void setNodeDirty(S32 nodeIndex);
+
+   /// Returns false if animate() has nothing to do at the detail level,
+   /// i.e. no thread has moved to different keyframes and nothing has been
+   /// marked dirty. The node transforms, and anything built from them
+   /// such as skinned meshes, are then the same as last time.
+   bool isAnimationDirty(S32 dl) const;
+
    /// Sets the 'forceHidden' state on the named mesh.
    /// @see MeshObjectInstance::forceHidden
    void setMeshForceHidden( const char *meshName, bool hidden );
@@ -514,6 +604,48 @@ protected:
    /// Sets the current detail level using the legacy screen error metric.
    S32 setDetailFromScreenError( F32 errorTOL );
 
+protected:
+   /// Selects the current detail level for a pixel size, see setDetailFromDistance()
+   S32 _setDetailFromPixelSize( F32 pixelSize, F32 hysteresis );
+
+public:
+
+   /// @name Batched Detail Selection
+   /// @{
+
+   /// Selects the detail level of many instances in one go, as calling
+   /// setDetailFromPosAndScale() on each would. Pixel sizes are worked out
+   /// several instances at a time, and instances whose bounds are entirely
+   /// behind one of the cull planes get detail level -1. The smLast* metrics
+   /// of the render states are only updated for shapes using the screen
+   /// error metric, which go through setDetailFromDistance().
+   ///
+   /// @param instances   Instances to select detail levels for
+   /// @param positions   World space position of each instance
+   /// @param scales      Scale of each instance
+   /// @param count       Number of instances
+   /// @param cullPlanes  Planes facing into the visible volume, such as those
+   ///                    returned by Frustum::getPlanes(), or NULL
+   /// @param numCullPlanes Number of cull planes
+   /// @param hysteresis  How far, as a fraction of a detail's size, the pixel
+   ///                    size must pass the point where the detail level
+   ///                    changes before an instance leaves its current detail
+   ///                    level. Stops instances near a switch from popping
+   ///                    back and forth. 0 for none.
+   /// @param outVisible  If set, receives the indices of the instances left
+   ///                    with a visible detail level
+   /// @return The number of instances left with a visible detail level
+   static U32 setDetailsFromPosAndScale(  const TSSceneRenderState *state,
+                                          TSShapeInstance * const *instances,
+                                          const Point3F *positions,
+                                          const Point3F *scales,
+                                          U32 count,
+                                          const PlaneF *cullPlanes = NULL,
+                                          U32 numCullPlanes = 0,
+                                          F32 hysteresis = 0.0f,
+                                          Vector<U32> *outVisible = NULL );
+   /// @}
+
    enum
    {
       TransformDirty =  BIT(0),
@@ -521,7 +653,8 @@ protected:
       FrameDirty =      BIT(2),
       MatFrameDirty =   BIT(3),
       ThreadDirty =     BIT(4),
-      AllDirtyMask = TransformDirty | VisDirty | FrameDirty | MatFrameDirty | ThreadDirty
+      NodeDirty =       BIT(5),  ///< Only mDirtyNodes need updating
+      AllDirtyMask = TransformDirty | VisDirty | FrameDirty | MatFrameDirty | ThreadDirty | NodeDirty
    };
    U32 * mDirtyFlags;
    void setDirty(U32 dirty);
@@ -538,6 +671,14 @@ protected:
    bool castRay(const Point3F & start, const Point3F & end, RayInfo *,S32 dl);
    bool castRayRendered(const Point3F & start, const Point3F & end, RayInfo *,S32 dl);
    bool quickLOS(const Point3F & start, const Point3F & end, S32 dl) { return castRay(start,end,NULL,dl); }
+
+   /// Casts numRays rays against detail level dl, as castRay() would, but
+   /// only inverts each node transform once for all of the rays.
+   ///
+   /// @param rayInfos  numRays results to fill in, or NULL to only test for hits
+   /// @param hits      numRays flags, set to whether each ray hit
+   /// @return the number of rays which hit
+   U32 castRays(const Point3F *starts, const Point3F *ends, U32 numRays, RayInfo *rayInfos, bool *hits, S32 dl);
    Point3F support(const Point3F & v, S32 dl);
    void computeBounds(S32 dl, Box3F & bounds); ///< uses current transforms to compute bounding box around a detail level
                                                ///< see like named method on shape if you want to use default transforms
@@ -651,6 +792,7 @@ protected:
 class TSThread
 {
    friend class TSShapeInstance;
+   friend class TSAnimationBatch;
 
    S32 priority;
 
@@ -667,6 +809,10 @@ class TSThread
 
    bool blendDisabled;                ///< Blend with other sequences?
 
+   /// Keys decoded by TSAnimationBatch for keyNum1 and keyNum2, or NULL
+   /// to sample the sequence directly
+   const TSKeyframePair * keyframePair;
+
    /// if in transition...
    struct TransitionData
    {
@@ -711,7 +857,7 @@ class TSThread
    /// @}
 
    TSThread(TSShapeInstance*);
-   TSThread() {}
+   TSThread() : keyframePair(NULL) {}
 
    void setSequence(S32 seq, F32 pos);
    void transitionToSequence(S32 seq, F32 pos, F32 duration, bool continuePlay);
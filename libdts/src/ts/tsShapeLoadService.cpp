@@ -0,0 +1,247 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "ts/tsShapeLoadService.h"
+
+#include "platform/threads/thread.h"
+#include "platform/profiler.h"
+#include "core/log.h"
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+Mutex TSShapeLoadService::smColladaMutex;
+
+TSShapeLoadService::Request::Request( const String &path )
+   :  mPath( path ),
+      mStatus( Queued ),
+      mLoadedShape( NULL ),
+      mRequestTime( Platform::getRealMilliseconds() ),
+      mQueueTime( 0 ),
+      mLoadTime( 0 ),
+      mFinalizeTime( 0 )
+{
+}
+
+TSShapeLoadService::Request::~Request()
+{
+   // Loaded but never finalized
+   delete mLoadedShape;
+}
+
+//-----------------------------------------------------------------------------
+
+class TSShapeLoadService::LoaderThread : public Thread
+{
+protected:
+   TSShapeLoadService *mService;
+
+public:
+   LoaderThread( TSShapeLoadService *service ) : mService( service ) {}
+
+   virtual void run( void *data )
+   {
+      while ( Request *req = mService->_getWork() )
+         mService->_loadRequest( req );
+   }
+};
+
+TSShapeLoadService::TSShapeLoadService( S32 numThreads )
+   :  mNextToLoad( 0 ),
+      mNumDone( 0 ),
+      mFinalizeRender( true ),
+      mShutdown( false )
+{
+   if ( numThreads < 0 )
+      numThreads = (S32)Thread::getNumHardwareThreads() - 1;
+
+   // Loading always happens off the calling thread
+   numThreads = getMax( numThreads, 1 );
+
+   for ( S32 i = 0; i < numThreads; i++ )
+   {
+      Thread *thread = new LoaderThread( this );
+      mThreads.push_back( thread );
+      thread->start();
+   }
+}
+
+TSShapeLoadService::~TSShapeLoadService()
+{
+   {
+      MutexHandle handle( mMutex );
+      mShutdown = true;
+   }
+   mWorkSemaphore.release( mThreads.size() );
+
+   for ( U32 i = 0; i < mThreads.size(); i++ )
+   {
+      mThreads[i]->join();
+      delete mThreads[i];
+   }
+   mThreads.clear();
+
+   for ( U32 i = 0; i < mRequests.size(); i++ )
+      delete mRequests[i];
+}
+
+TSShapeLoadService::Request *TSShapeLoadService::_getWork()
+{
+   mWorkSemaphore.acquire();
+
+   MutexHandle handle( mMutex );
+   if ( mShutdown )
+      return NULL;
+
+   AssertFatal( mNextToLoad < mRequests.size(), "TSShapeLoadService::_getWork - woken without a request" );
+   Request *req = mRequests[mNextToLoad++];
+   req->mStatus = Loading;
+   req->mQueueTime = Platform::getRealMilliseconds() - req->mRequestTime;
+   return req;
+}
+
+void TSShapeLoadService::_loadRequest( Request *req )
+{
+   U32 start = Platform::getRealMilliseconds();
+
+   // Copying the String would share its reference count with the calling
+   // thread, so build the path from the characters
+   DTShape::Path path( req->mPath.c_str() );
+   const String extension = path.getExtension();
+   bool isCollada = extension.equal( "dae", String::NoCase ) || extension.equal( "kmz", String::NoCase );
+
+   TSIOState ioState;
+   ioState.smInitOnRead = false;
+
+   TSShape *shape;
+   if ( isCollada )
+   {
+      MutexHandle handle( smColladaMutex );
+      shape = TSShape::createFromPath( path, &ioState );
+   }
+   else
+      shape = TSShape::createFromPath( path, &ioState );
+
+   // Everything but the material list can be set up here
+   if ( shape )
+      shape->initShapeData();
+
+   MutexHandle handle( mMutex );
+   req->mLoadedShape = shape;
+   req->mLoadTime = Platform::getRealMilliseconds() - start;
+   req->mStatus = Loaded;
+   mLoaded.push_back( req );
+   mLoadedSemaphore.release();
+}
+
+TSShapeLoadService::Request *TSShapeLoadService::load( const DTShape::Path &path )
+{
+   String fullPath = path.getFullPath();
+
+   Map<String, Request*>::Iterator itr = mRequestMap.find( fullPath );
+   if ( itr != mRequestMap.end() )
+      return itr->value;
+
+   Request *req = new Request( fullPath );
+   mRequestMap.insert( fullPath, req );
+
+   {
+      MutexHandle handle( mMutex );
+      mRequests.push_back( req );
+   }
+   mWorkSemaphore.release();
+
+   return req;
+}
+
+U32 TSShapeLoadService::finalize( U32 maxCount )
+{
+   PROFILE_SCOPE( TSShapeLoadService_Finalize );
+
+   Vector<Request*> loaded;
+   {
+      MutexHandle handle( mMutex );
+      U32 count = getMin( maxCount, (U32)mLoaded.size() );
+      if ( count == 0 )
+         return 0;
+
+      loaded.set( mLoaded.address(), count );
+      mLoaded.erase( 0, count );
+   }
+
+   for ( U32 i = 0; i < loaded.size(); i++ )
+   {
+      Request *req = loaded[i];
+      U32 start = Platform::getRealMilliseconds();
+
+      TSShape *shape = req->mLoadedShape;
+      req->mLoadedShape = NULL;
+
+      if ( shape )
+      {
+         shape->initMaterialList();
+         if ( mFinalizeRender )
+            shape->initRender();
+
+         req->mShape = shape;
+         req->mStatus = Ready;
+      }
+      else
+      {
+         Log::errorf( "TSShapeLoadService - Could not load '%s'", req->mPath.c_str() );
+         req->mStatus = Failed;
+      }
+
+      req->mFinalizeTime = Platform::getRealMilliseconds() - start;
+      mNumDone++;
+   }
+
+   return loaded.size();
+}
+
+void TSShapeLoadService::wait( Request *req )
+{
+   finalize();
+   while ( !req->isDone() )
+   {
+      mLoadedSemaphore.acquire();
+      finalize();
+   }
+}
+
+void TSShapeLoadService::waitAll()
+{
+   finalize();
+   while ( mNumDone < mRequests.size() )
+   {
+      mLoadedSemaphore.acquire();
+      finalize();
+   }
+}
+
+//-----------------------------------------------------------------------------
+
+END_NS
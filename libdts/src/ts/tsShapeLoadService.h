@@ -0,0 +1,216 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2012 GarageGames, LLC
+// Portions Copyright (C) 2013 James S Urquhart
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _TSSHAPELOADSERVICE_H_
+#define _TSSHAPELOADSERVICE_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+#ifndef _TVECTOR_H_
+#include "core/util/tVector.h"
+#endif
+#ifndef _TDICTIONARY_H_
+#include "core/util/tDictionary.h"
+#endif
+#ifndef _TSSHAPE_H_
+#include "ts/tsShape.h"
+#endif
+#ifndef _PLATFORM_THREADS_MUTEX_H_
+#include "platform/threads/mutex.h"
+#endif
+#ifndef _PLATFORM_THREADS_SEMAPHORE_H_
+#include "platform/threads/semaphore.h"
+#endif
+
+//-----------------------------------------------------------------------------
+
+BEGIN_NS(DTShape)
+
+//-----------------------------------------------------------------------------
+
+class Thread;
+
+/// Loads shapes on a set of background threads.
+///
+/// Files are read and assembled by the loader threads.  The parts of
+/// loading which are not thread safe (initMaterialList() and, optionally,
+/// initRender()) are left for finalize(), which the caller runs on the
+/// thread of its choice, e.g. once per frame on the render thread.
+///
+/// Requesting a path which has already been requested returns the same
+/// Request.  The service and its requests must only be used from the
+/// thread which calls finalize().
+///
+/// @code
+/// TSShapeLoadService loader;
+/// for ( U32 i = 0; i < files.size(); i++ )
+///    requests.push_back( loader.load( files[i] ) );
+///
+/// // each frame
+/// loader.finalize();
+/// if ( requests[0]->isDone() ) ...
+/// @endcode
+///
+/// @note COLLADA files are loaded one at a time, as the COLLADA loader
+/// is not thread safe, and are fully initialized on the loader thread.
+class TSShapeLoadService
+{
+public:
+
+   enum Status
+   {
+      Queued,     ///< Waiting for a loader thread
+      Loading,    ///< Being read and assembled
+      Loaded,     ///< Assembled, waiting for finalize()
+      Ready,      ///< Finalized, the shape can be used
+      Failed      ///< Could not be loaded
+   };
+
+   /// A requested shape.  Owned by the service.
+   class Request
+   {
+      friend class TSShapeLoadService;
+
+   protected:
+      String mPath;
+      Status mStatus;
+      TSShape *mLoadedShape;  ///< Set by the loader thread
+      TSShapeRef mShape;      ///< Set by finalize()
+
+      /// @name Timing
+      /// All in milliseconds.
+      /// @{
+      U32 mRequestTime;
+      U32 mQueueTime;      ///< Waiting for a loader thread
+      U32 mLoadTime;       ///< Reading and assembling the shape
+      U32 mFinalizeTime;   ///< Spent in finalize()
+      /// @}
+
+      Request( const String &path );
+      ~Request();
+
+   public:
+      const String &getPath() const { return mPath; }
+      Status getStatus() const { return mStatus; }
+
+      /// Returns true once the shape is ready or failed to load.
+      bool isDone() const { return mStatus >= Ready; }
+
+      /// Returns the shape once it is ready, NULL otherwise.
+      TSShape *getShape() const { return mShape; }
+
+      U32 getQueueTime() const { return mQueueTime; }
+      U32 getLoadTime() const { return mLoadTime; }
+      U32 getFinalizeTime() const { return mFinalizeTime; }
+   };
+
+protected:
+
+   class LoaderThread;
+   friend class LoaderThread;
+
+   Vector<Thread*> mThreads;
+
+   /// All requests, in the order they were made.
+   Vector<Request*> mRequests;
+
+   /// Requests by full path.
+   Map<String, Request*> mRequestMap;
+
+   /// Protects the request states and the lists below.
+   Mutex mMutex;
+
+   /// Index in mRequests of the next request to load.
+   U32 mNextToLoad;
+
+   /// Requests which have been loaded but not finalized.
+   Vector<Request*> mLoaded;
+
+   U32 mNumDone;
+
+   /// Released once for each new request.
+   Semaphore mWorkSemaphore;
+
+   /// Released by the loader threads as each request is loaded.
+   Semaphore mLoadedSemaphore;
+
+   bool mFinalizeRender;
+   bool mShutdown;
+
+   /// Serializes COLLADA loads.
+   static Mutex smColladaMutex;
+
+   /// Takes the next request to load, returning NULL on shutdown.
+   Request *_getWork();
+
+   /// Loads a request on a loader thread.
+   void _loadRequest( Request *req );
+
+public:
+
+   /// Creates a service with the specified number of loader threads.  If
+   /// numThreads is -1 one thread is created per logical processor, minus
+   /// one for the calling thread, with a minimum of one.
+   TSShapeLoadService( S32 numThreads = -1 );
+
+   /// Waits for the loader threads to finish their current requests, and
+   /// drops the rest.  Ready shapes stay alive while referenced elsewhere.
+   ~TSShapeLoadService();
+
+   /// Requests a shape, returning the existing request if the path has
+   /// already been requested.
+   Request *load( const DTShape::Path &path );
+
+   /// Runs the finalization of up to maxCount loaded shapes on the
+   /// calling thread.  Returns the number of requests finalized.
+   U32 finalize( U32 maxCount = U32_MAX );
+
+   /// Blocks until req has loaded, finalizing anything loaded meanwhile.
+   void wait( Request *req );
+
+   /// Blocks until every request has loaded, and finalizes them.
+   void waitAll();
+
+   /// Call initRender() on each shape in finalize().  Defaults to true.
+   void setFinalizeRender( bool finalizeRender ) { mFinalizeRender = finalizeRender; }
+
+   /// @name Progress
+   /// @{
+   U32 getNumRequests() const { return mRequests.size(); }
+
+   /// Returns the number of requests which are ready or failed.
+   U32 getNumDone() const { return mNumDone; }
+
+   /// Returns the fraction of requests which are ready or failed.
+   F32 getProgress() const { return mRequests.empty() ? 1.0f : (F32)mNumDone / (F32)mRequests.size(); }
+
+   const Vector<Request*> &getRequests() const { return mRequests; }
+   /// @}
+};
+
+//-----------------------------------------------------------------------------
+
+END_NS
+
+#endif // _TSSHAPELOADSERVICE_H_
@@ -202,6 +202,14 @@ void TSShape::exportSequences(Stream * s, TSIOState *options)
       saveState = *options;
    }
 
+   // dsq files always store uncompressed, resident keyframes, so have
+   // nothing which needs a version after 26. The shape keeps its
+   // compressed tracks once the export is done.
+   unstreamSequences();
+   TempDecompression decompressed(this);
+   if (saveState.smVersion > 26)
+      saveState.smVersion = 26;
+
    
    // write version
    s->write(saveState.smVersion);
@@ -314,6 +322,14 @@ void TSShape::exportSequence(Stream * s, const TSShape::Sequence& seq, TSIOState
       saveState = *options;
    }
 
+   // dsq files always store uncompressed, resident keyframes, so have
+   // nothing which needs a version after 26. The shape keeps its
+   // compressed tracks once the export is done.
+   unstreamSequences();
+   TempDecompression decompressed(this);
+   if (saveState.smVersion > 26)
+      saveState.smVersion = 26;
+
    // write version
    s->write(saveState.smVersion);
 
@@ -490,6 +506,7 @@ bool TSShape::importSequences(Stream * s, const String& sequencePath, TSIOState
          if (names.size() != startSize)
          {
             names.decrement();
+            invalidateNameLookup();
 
             if (names.size() != startSize)
                Log::errorf(LogEntry::General, "TSShape::importSequence: failed to remove unused node correctly for dsq %s.", names[nameIndex].c_str(), sequencePath.c_str());
@@ -519,7 +536,36 @@ bool TSShape::importSequences(Stream * s, const String& sequencePath, TSIOState
    Vector<Quat16>    seqArbitraryScaleRots;
    Vector<Point3F>   seqArbitraryScaleFactors;
 
-   if (readVersion>21)
+   // When streaming, the keyframes are left in the file and only the
+   // positions of the arrays are noted
+   const bool streaming = smStreamSequences && readVersion>21 && sequencePath.isNotEmpty();
+   U32 rotationPos = 0, translationPos = 0, uniformScalePos = 0, alignedScalePos = 0;
+   U32 arbitraryScaleRotPos = 0, arbitraryScaleFactorPos = 0, groundTranslationPos = 0, groundRotationPos = 0;
+
+   if (streaming)
+   {
+      s->read(&sz);
+      rotationPos = s->getPosition();
+      s->setPosition(rotationPos + sz * sizeof(Quat16));
+      s->read(&sz);
+      translationPos = s->getPosition();
+      s->setPosition(translationPos + sz * sizeof(Point3F));
+      s->read(&sz);
+      uniformScalePos = s->getPosition();
+      s->setPosition(uniformScalePos + sz * sizeof(F32));
+      s->read(&sz);
+      alignedScalePos = s->getPosition();
+      s->setPosition(alignedScalePos + sz * sizeof(Point3F));
+      s->read(&sz);
+      arbitraryScaleRotPos = s->getPosition();
+      arbitraryScaleFactorPos = arbitraryScaleRotPos + sz * sizeof(Quat16);
+      s->setPosition(arbitraryScaleFactorPos + sz * sizeof(Point3F));
+      s->read(&sz);
+      groundTranslationPos = s->getPosition();
+      groundRotationPos = groundTranslationPos + sz * sizeof(Point3F);
+      s->setPosition(groundRotationPos + sz * sizeof(Quat16));
+   }
+   else if (readVersion>21)
    {
       s->read(&sz);
       seqRotations.setSize(sz);
@@ -620,6 +666,80 @@ bool TSShape::importSequences(Stream * s, const String& sequencePath, TSIOState
 
       // read the rest of the sequence
       seq.read(s,loadState,false);
+
+      if (streaming)
+      {
+         // locate the keys of the sequence in the file, and map the tracks
+         // of the nodes we have to them
+         StreamedSequence *entry = new StreamedSequence;
+         entry->shape = this;
+         entry->sequenceIndex = sequences.size() - 1;
+         entry->path = sequencePath;
+         entry->rotationOffset = rotationPos + seq.baseRotation * sizeof(Quat16);
+         entry->translationOffset = translationPos + seq.baseTranslation * sizeof(Point3F);
+         if (seq.animatesArbitraryScale())
+         {
+            entry->scaleOffset = arbitraryScaleFactorPos + seq.baseScale * sizeof(Point3F);
+            entry->scaleRotationOffset = arbitraryScaleRotPos + seq.baseScale * sizeof(Quat16);
+         }
+         else if (seq.animatesAlignedScale())
+            entry->scaleOffset = alignedScalePos + seq.baseScale * sizeof(Point3F);
+         else
+            entry->scaleOffset = uniformScalePos + seq.baseScale * sizeof(F32);
+         entry->groundTranslationOffset = groundTranslationPos + seq.firstGroundFrame * sizeof(Point3F);
+         entry->groundRotationOffset = groundRotationPos + seq.firstGroundFrame * sizeof(Quat16);
+
+         TSIntegerSet newTransMembership;
+         TSIntegerSet newRotMembership;
+         TSIntegerSet newScaleMembership;
+         for (S32 j = 0; j < nodeMap.size(); j++)
+         {
+            if (nodeMap[j] < 0)
+               continue;
+
+            if (seq.translationMatters.test(j))
+               newTransMembership.set(nodeMap[j]);
+            if (seq.rotationMatters.test(j))
+               newRotMembership.set(nodeMap[j]);
+            if (seq.scaleMatters.test(j))
+               newScaleMembership.set(nodeMap[j]);
+         }
+
+         entry->translationTracks.setSize(newTransMembership.count());
+         entry->rotationTracks.setSize(newRotMembership.count());
+         entry->scaleTracks.setSize(newScaleMembership.count());
+         for (S32 j = 0; j < nodeMap.size(); j++)
+         {
+            if (nodeMap[j] < 0)
+               continue;
+
+            if (newTransMembership.test(nodeMap[j]))
+               entry->translationTracks[newTransMembership.count(nodeMap[j])] = seq.translationMatters.count(j);
+            if (newRotMembership.test(nodeMap[j]))
+               entry->rotationTracks[newRotMembership.count(nodeMap[j])] = seq.rotationMatters.count(j);
+            if (newScaleMembership.test(nodeMap[j]))
+               entry->scaleTracks[newScaleMembership.count(nodeMap[j])] = seq.scaleMatters.count(j);
+         }
+
+         seq.translationMatters = newTransMembership;
+         seq.rotationMatters = newRotMembership;
+         seq.scaleMatters = newScaleMembership;
+         seq.baseRotation = 0;
+         seq.baseTranslation = 0;
+         seq.baseScale = 0;
+         seq.firstGroundFrame = 0;
+         seq.firstTrigger += triggers.size();
+
+         seq.streamIndex = streamedSequences.size();
+         streamedSequences.push_back(entry);
+         continue;
+      }
+
+      // keys of the sequence in the temporary arrays
+      const S32 srcBaseRotation = readVersion>21 ? seq.baseRotation : 0;
+      const S32 srcBaseTranslation = readVersion>21 ? seq.baseTranslation : 0;
+      const S32 srcBaseScale = readVersion>21 ? seq.baseScale : 0;
+
       seq.baseRotation = nodeRotations.size();
       seq.baseTranslation = nodeTranslations.size();
 
@@ -673,19 +793,19 @@ bool TSShape::importSequences(Stream * s, const String& sequencePath, TSIOState
 
          if (newTransMembership.test(nodeMap[j]))
          {
-            S32 src = seq.numKeyframes * seq.translationMatters.count(j);
+            S32 src = srcBaseTranslation + seq.numKeyframes * seq.translationMatters.count(j);
             S32 dest = seq.baseTranslation + seq.numKeyframes * newTransMembership.count(nodeMap[j]);
             dCopyArray(&nodeTranslations[dest], &seqTranslations[src], seq.numKeyframes);
          }
          if (newRotMembership.test(nodeMap[j]))
          {
-            S32 src = seq.numKeyframes * seq.rotationMatters.count(j);
+            S32 src = srcBaseRotation + seq.numKeyframes * seq.rotationMatters.count(j);
             S32 dest = seq.baseRotation + seq.numKeyframes * newRotMembership.count(nodeMap[j]);
             dCopyArray(&nodeRotations[dest], &seqRotations[src], seq.numKeyframes);
          }
          if (newScaleMembership.test(nodeMap[j]))
          {
-            S32 src = seq.numKeyframes * seq.scaleMatters.count(j);
+            S32 src = srcBaseScale + seq.numKeyframes * seq.scaleMatters.count(j);
             S32 dest = seq.baseScale + seq.numKeyframes * newScaleMembership.count(nodeMap[j]);
             if (seq.flags & TSShape::ArbitraryScale)
             {
@@ -728,6 +848,9 @@ bool TSShape::importSequences(Stream * s, const String& sequencePath, TSIOState
       }
    }
 
+   // make the new sequences visible to findSequence
+   invalidateNameLookup();
+
    // add the new triggers
    S32 oldSz = triggers.size();
    s->read(&sz);
@@ -894,11 +1017,7 @@ S32 TSShape::readName(Stream * s, bool addName)
       }
 
       if (nameIndex<0 && addName)
-      {
-         nameIndex = names.size();
-         names.increment();
-         names.last() = buffer;
-      }
+         nameIndex = TSShape::addName(buffer);
    }
 
    return nameIndex;
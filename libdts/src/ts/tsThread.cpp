@@ -22,6 +22,7 @@
 
 #include "platform/platform.h"
 #include "ts/tsShapeInstance.h"
+#include "core/log.h"
 
 //-----------------------------------------------------------------------------
 
@@ -134,6 +135,18 @@ void TSThread::getGround(F32 t, MatrixF * pMat)
    // needs to be strictly less than 'sequence->numGroundFrames'
    F32 kf = 0.999999f * t * (F32) getSequence()->numGroundFrames;
 
+   const TSShape * shape = mShapeInstance->mShape;
+   if (!shape->touchSequence(sequence))
+   {
+      // no ground keyframes to sample, so don't move
+      Log::errorf("TSThread::getGround - Could not load keyframes for sequence '%s'",
+         shape->getSequenceName(sequence).c_str());
+      pMat->identity();
+      return;
+   }
+   const Point3F * groundTranslations = shape->getGroundTranslationKeys(*getSequence());
+   const Quat16 * groundRotations = shape->getGroundRotationKeys(*getSequence());
+
    // get frame number and interp param (kpos)
    S32 frame = (S32)kf;
    F32 kpos = kf - (F32)frame;
@@ -144,8 +157,8 @@ void TSThread::getGround(F32 t, MatrixF * pMat)
    // assumed to be ident. and not found in the list.
    if (frame)
    {
-      p1 = &mShapeInstance->mShape->groundTranslations[getSequence()->firstGroundFrame + frame - 1];
-      q1 = &mShapeInstance->mShape->groundRotations[getSequence()->firstGroundFrame + frame - 1].getQuatF(&rot1);
+      p1 = &groundTranslations[frame - 1];
+      q1 = &groundRotations[frame - 1].getQuatF(&rot1);
    }
    else
    {
@@ -154,8 +167,8 @@ void TSThread::getGround(F32 t, MatrixF * pMat)
    }
 
    // similar to above, ground keyframe number 'frame+1' is actually offset by 'frame'
-   p2 = &mShapeInstance->mShape->groundTranslations[getSequence()->firstGroundFrame + frame];
-   q2 = &mShapeInstance->mShape->groundRotations[getSequence()->firstGroundFrame + frame].getQuatF(&rot2);
+   p2 = &groundTranslations[frame];
+   q2 = &groundRotations[frame].getQuatF(&rot2);
 
    QuatF q;
    Point3F p;
@@ -186,6 +199,11 @@ void TSThread::setSequence(S32 seq, F32 toPos)
 
    // select keyframes
    selectKeyframes(pos,getSequence(),&keyNum1,&keyNum2,&keyPos);
+
+   // page in streamed keyframes now, rather than on the next animate
+   if (!shape->touchSequence(sequence))
+      Log::errorf("TSThread::setSequence - Could not load keyframes for sequence '%s'",
+         shape->getSequenceName(sequence).c_str());
 }
 
 void TSThread::transitionToSequence(S32 seq, F32 toPos, F32 duration, bool continuePlay)
@@ -221,8 +239,12 @@ void TSThread::transitionToSequence(S32 seq, F32 toPos, F32 duration, bool conti
    // in transition...
    transitionData.inTransition = true;
 
-   // set target sequence data
+   // set target sequence data, paging in streamed keyframes ahead of the
+   // transition reaching them
    sequence = seq;
+   if (!mShapeInstance->mShape->touchSequence(sequence))
+      Log::errorf("TSThread::transitionToSequence - Could not load keyframes for sequence '%s'",
+         mShapeInstance->mShape->getSequenceName(sequence).c_str());
    priority = getSequence()->priority;
    pos = toPos;
    makePath = getSequence()->makePath();
@@ -355,14 +377,19 @@ void TSThread::setTimeScale(F32 ts)
 
 void TSThread::advancePos(F32 delta)
 {
-   if (mFabs(delta)>0.00001f)
+   const bool moved = mFabs(delta)>0.00001f;
+   U32 dirtyFlags = 0;
+   if (moved)
    {
       // make dirty what this thread changes
-      U32 dirtyFlags = getSequence()->dirtyFlags | (transitionData.inTransition ? TSShapeInstance::TransformDirty : 0);
-      for (S32 i=0; i<mShapeInstance->getShape()->subShapeFirstNode.size(); i++)
-         mShapeInstance->mDirtyFlags[i] |= dirtyFlags;
+      dirtyFlags = getSequence()->dirtyFlags | (transitionData.inTransition ? TSShapeInstance::TransformDirty : 0);
    }
 
+   const S32 oldKeyNum1 = keyNum1;
+   const S32 oldKeyNum2 = keyNum2;
+   const F32 oldKeyPos = keyPos;
+   const bool wasInTransition = transitionData.inTransition;
+
    if (transitionData.inTransition)
    {
       transitionData.pos += transitionData.direction * delta;
@@ -423,6 +450,20 @@ void TSThread::advancePos(F32 delta)
 
    // select keyframes
    selectKeyframes(pos,getSequence(),&keyNum1,&keyNum2,&keyPos);
+
+   if (moved)
+   {
+      // nodes only need animating if the pose changed, which it doesn't
+      // while a sequence is held on its last frame.  Callback and hands off
+      // nodes can change every frame whatever the sequence does, so shapes
+      // with either are always animated.
+      if (!wasInTransition && keyNum1 == oldKeyNum1 && keyNum2 == oldKeyNum2 && keyPos == oldKeyPos &&
+          !mShapeInstance->mCallbackNodes.testAll() && !mShapeInstance->mHandsOffNodes.testAll())
+         dirtyFlags &= ~TSShapeInstance::TransformDirty;
+
+      for (S32 i=0; i<mShapeInstance->getShape()->subShapeFirstNode.size(); i++)
+         mShapeInstance->mDirtyFlags[i] |= dirtyFlags;
+   }
 }
 
 void TSThread::advanceTime(F32 delta)
@@ -471,6 +512,7 @@ TSThread::TSThread(TSShapeInstance * _shapeInst)
    mShapeInstance = _shapeInst;
    transitionData.inTransition = false;
    blendDisabled = false;
+   keyframePair = NULL;
    setSequence(0,0.0f);
 }
 